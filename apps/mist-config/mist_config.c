@@ -35,10 +35,15 @@
 #include "user_tcp.h"
 #include "user_support.h"
 #include "port_printf.h"
+#include "user_stack.h"
+#include "user_timer.h"
+#include "user_metrics.h"
+#include "user_trace.h"
+#include "spiffs_integration.h"
 
 
 static mist_app_t* mist_app;
-static os_timer_t reboot_timer;
+static struct user_timer reboot_timer;
 
 static void reboot_timer_cb(void) {
     user_reboot();
@@ -56,9 +61,40 @@ static void reboot_timer_cb(void) {
 
 #define MIST_UPTIME_EP "uptime"
 
+/** Endpoint name for the runtime metrics. Invoking it returns all metrics
+ * in one document, the individual metrics are its children and are read
+ * as ints */
+#define MIST_METRICS_EP "metrics"
+
+/** Endpoint name for the trace ring. Invoking it returns the events in the
+ * ring as a binary blob, see user_trace.h */
+#define MIST_TRACE_EP "trace"
+
+/** Endpoint name for the file system statistics. Invoking it returns the
+ * statistics of my_spiffs_get_stats() and the erase age of every block,
+ * see spiffs_integration.h */
+#define MIST_FS_STATS_EP "fsStats"
+
+/** At most this many erase ages are returned by fsStats */
+#define MIST_FS_STATS_MAX_BLOCKS 256
+
+/** Endpoint name for the file listing. Invoking it with { cursor: n }
+ * returns the name, size, object id and page count of the files from
+ * cursor n on, at most MIST_FS_LIST_MAX_FILES of them, and the cursor to
+ * invoke it with for the rest, see my_fs_list(). The listing starts with
+ * cursor 0 and is complete when no cursor is returned. */
+#define MIST_FS_LIST_EP "fsList"
+
+/** Files returned per invoke of fsList */
+#define MIST_FS_LIST_MAX_FILES 10
+/** A file of the listing in BSON, its name at most SPIFFS_OBJ_NAME_LEN
+ * (32) bytes */
+#define MIST_FS_LIST_FILE_MAX_LEN 96
+
 #define MIST_APP_NAME "MistConfig"
 
 static enum mist_error wifi_read(mist_ep* ep, wish_protocol_peer_t* peer, int request_id) {
+    USER_STACK_ENTER(USER_STACK_PROBE_MIST_READ);
     size_t result_max_len = 256;
     uint8_t result[result_max_len];
 
@@ -94,10 +130,260 @@ static enum mist_error wifi_read(mist_ep* ep, wish_protocol_peer_t* peer, int re
     mist_read_response(ep->model->mist_app, full_epid, request_id, &bs);
     
     WISHDEBUG(LOG_CRITICAL, "returning from wifi_read");
+    USER_STACK_EXIT(USER_STACK_PROBE_MIST_READ);
     return MIST_NO_ERROR;
     
 }
 
+static mist_ep metric_eps[USER_METRIC_MAX];
+
+static enum mist_error metrics_read(mist_ep* ep, wish_protocol_peer_t* peer, int request_id) {
+    USER_STACK_ENTER(USER_STACK_PROBE_MIST_READ);
+    uint8_t result[64];
+
+    char full_epid[MIST_EPID_LEN];
+    mist_ep_full_epid(ep, full_epid);
+
+    bson bs;
+    bson_init_buffer(&bs, result, sizeof(result));
+
+    user_metrics_sample();
+    enum user_metric metric = ep - metric_eps;
+    bson_append_int(&bs, "data", user_metric_get(metric));
+    bson_finish(&bs);
+
+    enum mist_error ret = MIST_NO_ERROR;
+    if (bs.err) {
+        WISHDEBUG(LOG_CRITICAL, "There was an BSON error");
+        ret = MIST_ERROR;
+    }
+    else {
+        mist_read_response(ep->model->mist_app, full_epid, request_id, &bs);
+    }
+
+    USER_STACK_EXIT(USER_STACK_PROBE_MIST_READ);
+    return ret;
+}
+
+static enum mist_error metrics_invoke(mist_ep* ep, wish_protocol_peer_t* peer, int request_id, bson* args) {
+    USER_STACK_ENTER(USER_STACK_PROBE_MIST_INVOKE);
+    size_t result_max_len = 512;
+    uint8_t *result = wish_platform_malloc(result_max_len);
+    if (result == NULL) {
+        WISHDEBUG(LOG_CRITICAL, "OOM in metrics_invoke");
+        USER_STACK_EXIT(USER_STACK_PROBE_MIST_INVOKE);
+        return MIST_ERROR;
+    }
+
+    bson bs;
+    bson_init_buffer(&bs, result, result_max_len);
+
+    user_metrics_sample();
+    bson_append_start_object(&bs, "data");
+    user_metrics_append_bson(&bs);
+    bson_append_finish_object(&bs);
+    bson_finish(&bs);
+
+    enum mist_error ret = MIST_NO_ERROR;
+    if (bs.err) {
+        WISHDEBUG(LOG_CRITICAL, "There was an BSON error");
+        ret = MIST_ERROR;
+    }
+    else {
+        mist_invoke_response(mist_app, ep->id, request_id, &bs);
+    }
+
+    wish_platform_free(result);
+    USER_STACK_EXIT(USER_STACK_PROBE_MIST_INVOKE);
+    return ret;
+}
+
+static enum mist_error trace_invoke(mist_ep* ep, wish_protocol_peer_t* peer, int request_id, bson* args) {
+    USER_STACK_ENTER(USER_STACK_PROBE_MIST_INVOKE);
+    size_t trace_max_len = USER_TRACE_RING_LEN * sizeof(struct user_trace_entry);
+    size_t result_max_len = trace_max_len + 64;
+    uint8_t *trace = wish_platform_malloc(trace_max_len);
+    uint8_t *result = wish_platform_malloc(result_max_len);
+    if (trace == NULL || result == NULL) {
+        WISHDEBUG(LOG_CRITICAL, "OOM in trace_invoke");
+        if (trace != NULL) {
+            wish_platform_free(trace);
+        }
+        if (result != NULL) {
+            wish_platform_free(result);
+        }
+        USER_STACK_EXIT(USER_STACK_PROBE_MIST_INVOKE);
+        return MIST_ERROR;
+    }
+
+    uint32_t lost = 0;
+    size_t trace_len = user_trace_snapshot(trace, trace_max_len, &lost);
+
+    bson bs;
+    bson_init_buffer(&bs, result, result_max_len);
+    bson_append_start_object(&bs, "data");
+    bson_append_int(&bs, "lost", lost);
+    bson_append_binary(&bs, "events", (char *) trace, trace_len);
+    bson_append_finish_object(&bs);
+    bson_finish(&bs);
+
+    enum mist_error ret = MIST_NO_ERROR;
+    if (bs.err) {
+        WISHDEBUG(LOG_CRITICAL, "There was an BSON error");
+        ret = MIST_ERROR;
+    }
+    else {
+        mist_invoke_response(mist_app, ep->id, request_id, &bs);
+    }
+
+    wish_platform_free(trace);
+    wish_platform_free(result);
+    USER_STACK_EXIT(USER_STACK_PROBE_MIST_INVOKE);
+    return ret;
+}
+
+static enum mist_error fs_stats_invoke(mist_ep* ep, wish_protocol_peer_t* peer, int request_id, bson* args) {
+    USER_STACK_ENTER(USER_STACK_PROBE_MIST_INVOKE);
+    size_t ages_max_len = MIST_FS_STATS_MAX_BLOCKS * sizeof(uint16_t);
+    size_t result_max_len = ages_max_len + 480;
+    uint16_t *ages = wish_platform_malloc(ages_max_len);
+    uint8_t *result = wish_platform_malloc(result_max_len);
+    if (ages == NULL || result == NULL) {
+        WISHDEBUG(LOG_CRITICAL, "OOM in fs_stats_invoke");
+        if (ages != NULL) {
+            wish_platform_free(ages);
+        }
+        if (result != NULL) {
+            wish_platform_free(result);
+        }
+        USER_STACK_EXIT(USER_STACK_PROBE_MIST_INVOKE);
+        return MIST_ERROR;
+    }
+
+    struct my_spiffs_stats st;
+    int32_t blocks = my_spiffs_get_erase_ages(ages, MIST_FS_STATS_MAX_BLOCKS);
+    if (blocks < 0 || my_spiffs_get_stats(&st) != 0) {
+        WISHDEBUG(LOG_CRITICAL, "Could not get file system stats");
+        wish_platform_free(ages);
+        wish_platform_free(result);
+        USER_STACK_EXIT(USER_STACK_PROBE_MIST_INVOKE);
+        return MIST_ERROR;
+    }
+
+    bson bs;
+    bson_init_buffer(&bs, result, result_max_len);
+    bson_append_start_object(&bs, "data");
+    bson_append_int(&bs, "blocks", st.blocks);
+    bson_append_int(&bs, "pagesTotal", st.pages_total);
+    bson_append_int(&bs, "pagesAllocated", st.pages_allocated);
+    bson_append_int(&bs, "pagesDeleted", st.pages_deleted);
+    bson_append_int(&bs, "pagesFree", st.pages_free);
+    bson_append_int(&bs, "gcRuns", st.gc_runs);
+    bson_append_int(&bs, "gcPagesMoved", st.gc_pages_moved);
+    bson_append_int(&bs, "cacheHits", st.cache_hits);
+    bson_append_int(&bs, "cacheMisses", st.cache_misses);
+    bson_append_int(&bs, "cacheLuHits", st.cache_lu_hits);
+    bson_append_int(&bs, "cacheLuMisses", st.cache_lu_misses);
+    bson_append_int(&bs, "cacheIxHits", st.cache_ix_hits);
+    bson_append_int(&bs, "cacheIxMisses", st.cache_ix_misses);
+    bson_append_int(&bs, "cacheDataHits", st.cache_data_hits);
+    bson_append_int(&bs, "cacheDataMisses", st.cache_data_misses);
+    bson_append_int(&bs, "checkProgress", st.check_progress);
+    bson_append_int(&bs, "eraseCount", st.erase_count);
+    bson_append_int(&bs, "eraseAgeMin", st.erase_age_min);
+    bson_append_int(&bs, "eraseAgeMax", st.erase_age_max);
+    /* Little endian uint16 per block, 0xffff for a block never erased */
+    bson_append_binary(&bs, "eraseAges", (char *) ages, blocks * sizeof(uint16_t));
+    bson_append_finish_object(&bs);
+    bson_finish(&bs);
+
+    enum mist_error ret = MIST_NO_ERROR;
+    if (bs.err) {
+        WISHDEBUG(LOG_CRITICAL, "There was an BSON error");
+        ret = MIST_ERROR;
+    }
+    else {
+        mist_invoke_response(mist_app, ep->id, request_id, &bs);
+    }
+
+    wish_platform_free(ages);
+    wish_platform_free(result);
+    USER_STACK_EXIT(USER_STACK_PROBE_MIST_INVOKE);
+    return ret;
+}
+
+struct fs_list_state {
+    bson *bs;
+    int count;
+};
+
+static int32_t fs_list_file(const struct my_fs_file *f, void *arg) {
+    struct fs_list_state *st = arg;
+    if (st->count == MIST_FS_LIST_MAX_FILES) {
+        return 1;
+    }
+    char index[4];
+    os_sprintf(index, "%d", st->count++);
+    bson_append_start_object(st->bs, index);
+    bson_append_string(st->bs, "name", f->name);
+    bson_append_int(st->bs, "size", f->size);
+    bson_append_int(st->bs, "id", f->id);
+    bson_append_int(st->bs, "pages", f->pages);
+    bson_append_finish_object(st->bs);
+    return 0;
+}
+
+static enum mist_error fs_list_invoke(mist_ep* ep, wish_protocol_peer_t* peer, int request_id, bson* args) {
+    USER_STACK_ENTER(USER_STACK_PROBE_MIST_INVOKE);
+    size_t result_max_len = MIST_FS_LIST_MAX_FILES * MIST_FS_LIST_FILE_MAX_LEN + 64;
+    uint8_t *result = wish_platform_malloc(result_max_len);
+    if (result == NULL) {
+        WISHDEBUG(LOG_CRITICAL, "OOM in fs_list_invoke");
+        USER_STACK_EXIT(USER_STACK_PROBE_MIST_INVOKE);
+        return MIST_ERROR;
+    }
+
+    uint32_t cursor = 0;
+    bson_iterator it;
+    bson_find(&it, args, "args");
+    bson_iterator sit;
+    bson_iterator_subiterator(&it, &sit);
+    bson_find_fieldpath_value("cursor", &sit);
+    if (bson_iterator_type(&sit) == BSON_INT) {
+        cursor = bson_iterator_int(&sit);
+    }
+
+    bson bs;
+    bson_init_buffer(&bs, result, result_max_len);
+    bson_append_start_object(&bs, "data");
+    bson_append_start_object(&bs, "files");
+    struct fs_list_state st = { .bs = &bs, .count = 0 };
+    int32_t listed = my_fs_list(&cursor, fs_list_file, &st);
+    bson_append_finish_object(&bs);
+    if (cursor != MY_FS_LIST_END) {
+        bson_append_int(&bs, "cursor", cursor);
+    }
+    bson_append_finish_object(&bs);
+    bson_finish(&bs);
+
+    enum mist_error ret = MIST_NO_ERROR;
+    if (listed < 0) {
+        WISHDEBUG(LOG_CRITICAL, "Could not list files: %d", listed);
+        ret = MIST_ERROR;
+    }
+    else if (bs.err) {
+        WISHDEBUG(LOG_CRITICAL, "There was an BSON error");
+        ret = MIST_ERROR;
+    }
+    else {
+        mist_invoke_response(mist_app, ep->id, request_id, &bs);
+    }
+
+    wish_platform_free(result);
+    USER_STACK_EXIT(USER_STACK_PROBE_MIST_INVOKE);
+    return ret;
+}
+
 /* See here what the Invoke should return
  * https://gist.github.com/akaustel/1f7efeb791d156ea98099fe7b6e63ae7
  *
@@ -111,7 +397,7 @@ static enum mist_error wifi_read(mist_ep* ep, wish_protocol_peer_t* peer, int re
  * In Mist UI, remember to check "JSON" checkbox! 
  *
  */
-static enum mist_error wifi_invoke(mist_ep* ep, wish_protocol_peer_t* peer, int request_id, bson* args) {
+static enum mist_error do_wifi_invoke(mist_ep* ep, wish_protocol_peer_t* peer, int request_id, bson* args) {
     /* The stuff that comes in to this function in args.base has following structure: 
      
         epid: 'mistWifiCommissioning'           <---- added by handle_control_model on local side
@@ -230,9 +516,9 @@ static enum mist_error wifi_invoke(mist_ep* ep, wish_protocol_peer_t* peer, int
         /* Schedule a reboot via timer. This is because we would like to
          * give the TCP stack possibility to send the "ack" message of
          * this invoke function */
-        os_timer_disarm(&reboot_timer);
-        os_timer_setfn(&reboot_timer, (os_timer_func_t *) reboot_timer_cb, NULL);
-        os_timer_arm(&reboot_timer, 1000, 0);
+        user_timer_disarm(&reboot_timer);
+        user_timer_setfn(&reboot_timer, (user_timer_func_t *) reboot_timer_cb, NULL);
+        user_timer_arm(&reboot_timer, 1000, false);
     }
 
     wish_platform_free(result);
@@ -241,6 +527,15 @@ static enum mist_error wifi_invoke(mist_ep* ep, wish_protocol_peer_t* peer, int
     return MIST_NO_ERROR;
 }
 
+/* Invoke handler for the wifi endpoints. do_wifi_invoke() has many exit
+ * paths, so the stack probe is placed in this wrapper. */
+static enum mist_error wifi_invoke(mist_ep* ep, wish_protocol_peer_t* peer, int request_id, bson* args) {
+    USER_STACK_ENTER(USER_STACK_PROBE_MIST_INVOKE);
+    enum mist_error ret = do_wifi_invoke(ep, peer, request_id, args);
+    USER_STACK_EXIT(USER_STACK_PROBE_MIST_INVOKE);
+    return ret;
+}
+
 static mist_ep type_ep = {.id = MIST_TYPE_EP, .label = MIST_TYPE_EP, .type = MIST_TYPE_STRING, .read = wifi_read};
 static mist_ep version_ep = {.id = MIST_VERSION_EP, .label = MIST_VERSION_EP, .type = MIST_TYPE_STRING, .read = wifi_read};
 static mist_ep list_available_ep = { .id = MIST_WIFI_LIST_AVAILABLE_EP, .label = MIST_WIFI_LIST_AVAILABLE_EP, .type = MIST_TYPE_INVOKE, .read = NULL, .write = NULL, .invoke = wifi_invoke};
@@ -250,6 +545,10 @@ static mist_ep mist_super_ep = {.id = "mist", .label = "", .type = MIST_TYPE_STR
 static mist_ep mist_name_ep = {.id = "name", .label = "Name", .type = MIST_TYPE_STRING, .read = wifi_read };
 static mist_ep port_version_ep = {.id = "portVersion", .label = "Port layer version", .type = MIST_TYPE_STRING, .read = wifi_read };
 static mist_ep uptime_ep = {.id = "uptime", .label = "Uptime" , .type = MIST_TYPE_INT, .read = wifi_read };
+static mist_ep trace_ep = {.id = MIST_TRACE_EP, .label = "Trace", .type = MIST_TYPE_INVOKE, .read = NULL, .write = NULL, .invoke = trace_invoke };
+static mist_ep metrics_ep = {.id = MIST_METRICS_EP, .label = "Metrics", .type = MIST_TYPE_INVOKE, .read = NULL, .write = NULL, .invoke = metrics_invoke };
+static mist_ep fs_stats_ep = {.id = MIST_FS_STATS_EP, .label = "File system statistics", .type = MIST_TYPE_INVOKE, .read = NULL, .write = NULL, .invoke = fs_stats_invoke };
+static mist_ep fs_list_ep = {.id = MIST_FS_LIST_EP, .label = "File listing", .type = MIST_TYPE_INVOKE, .read = NULL, .write = NULL, .invoke = fs_list_invoke };
 
 static wish_app_t *app;
 
@@ -416,6 +715,18 @@ void mist_config_init(void) {
     mist_ep_add(&(mist_app->model), NULL, &commissioning_ep);
     mist_ep_add(&(mist_app->model), NULL, &port_version_ep);
     mist_ep_add(&(mist_app->model), NULL, &uptime_ep);
+    mist_ep_add(&(mist_app->model), NULL, &trace_ep);
+    mist_ep_add(&(mist_app->model), NULL, &fs_stats_ep);
+    mist_ep_add(&(mist_app->model), NULL, &fs_list_ep);
+    mist_ep_add(&(mist_app->model), NULL, &metrics_ep);
+    int i = 0;
+    for (i = 0; i < USER_METRIC_MAX; i++) {
+        metric_eps[i].id = (char *) user_metric_get_name(i);
+        metric_eps[i].label = metric_eps[i].id;
+        metric_eps[i].type = MIST_TYPE_INT;
+        metric_eps[i].read = metrics_read;
+        mist_ep_add(&(mist_app->model), metrics_ep.id, &metric_eps[i]);
+    }
         
     app->ready = init_app;
      
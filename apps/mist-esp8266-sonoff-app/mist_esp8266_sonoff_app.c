@@ -21,6 +21,9 @@
 #include "user_support.h"
 #include "user_wifi.h"
 #include "port_printf.h"
+#include "user_stack.h"
+#include "user_timer.h"
+#include "user_settings.h"
 
 static char mist_app_name[30] = { 0 }; /* Need to have enough storage for: Sonoff S20 (ab:cd) but actually the name cannot be that long! */
 #define RELAY_DEFAULT_STATE true
@@ -48,11 +51,15 @@ static mist_ep mist_name_ep = {.id = "name", .label = "Name", .type = MIST_TYPE_
 
 mist_app_t *mist_app;
 
-#define CONFIG_FILENAME "sonoff.bin"
-#define CONFIG_DATA_LEN 1   /* uint8_t */
+/* Settings of earlier firmware, one byte with relay_state in bit 0 and
+ * toggle_relay in bit 1. Moved to the settings log on first boot. */
+#define LEGACY_CONFIG_FILENAME "sonoff.bin"
+#define LEGACY_CONFIG_DATA_LEN 1   /* uint8_t */
 
-static void load_settings(void) {
-    wish_file_t fd = wish_fs_open(CONFIG_FILENAME);
+static void write_settings(void);
+
+static void load_legacy_settings(void) {
+    wish_file_t fd = wish_fs_open(LEGACY_CONFIG_FILENAME);
     if (fd <= 0) {
         PORT_PRINTF("Error opening file!\n");
         return;
@@ -60,35 +67,37 @@ static void load_settings(void) {
     wish_fs_lseek(fd, 0, WISH_FS_SEEK_SET);
     
     uint8_t config_data = 0;
-    int read_ret = wish_fs_read(fd, (void*) &config_data, CONFIG_DATA_LEN);   
-    if (read_ret == 0) {
-        PORT_PRINTF("Empty file, apparently\n");
-        
-        relay_state = RELAY_DEFAULT_STATE;
-        toggle_relay = TOGGLE_RELAY_DEFAULT_STATE;
-    }
-    else {
+    int read_ret = wish_fs_read(fd, (void*) &config_data, LEGACY_CONFIG_DATA_LEN);   
+    wish_fs_close(fd);
+    if (read_ret == LEGACY_CONFIG_DATA_LEN) {
         relay_state = config_data & 1 ? true : false;
         toggle_relay = config_data & 2 ? true : false;
+        PORT_PRINTF("Load %x from legacy file\n", config_data);
     }
-    PORT_PRINTF("Load %x from file\n", config_data);
-    wish_fs_close(fd);
+    write_settings();
+    wish_fs_remove(LEGACY_CONFIG_FILENAME);
 }
 
-static void write_settings() {
-    wish_file_t fd = wish_fs_open(CONFIG_FILENAME);
-    if (fd <= 0) {
-        PORT_PRINTF("Error opening file!\n");
+static void load_settings(void) {
+    uint8_t value = 0;
+    if (user_settings_get(USER_SETTINGS_RELAY, &value, sizeof(value)) != sizeof(value)) {
+        load_legacy_settings();
         return;
     }
-    wish_fs_lseek(fd, 0, WISH_FS_SEEK_SET);
-    
-    uint8_t config_data = 0;
-    config_data = relay_state ? 1 : 0;
-    config_data |= ((toggle_relay) ? 1 : 0) << 1;
-    wish_fs_write(fd, (void*) &config_data, CONFIG_DATA_LEN);
-    PORT_PRINTF("Wrote %x to file\n", config_data);
-    wish_fs_close(fd);
+    relay_state = value ? true : false;
+    if (user_settings_get(USER_SETTINGS_TOGGLE_RELAY, &value, sizeof(value)) == sizeof(value)) {
+        toggle_relay = value ? true : false;
+    }
+    PORT_PRINTF("Load relay %d toggle_relay %d\n", relay_state, toggle_relay);
+}
+
+/* Only settings which changed are written to flash */
+static void write_settings(void) {
+    uint8_t value = relay_state ? 1 : 0;
+    user_settings_set(USER_SETTINGS_RELAY, &value, sizeof(value));
+    value = toggle_relay ? 1 : 0;
+    user_settings_set(USER_SETTINGS_TOGGLE_RELAY, &value, sizeof(value));
+    PORT_PRINTF("Wrote relay %d toggle_relay %d\n", relay_state, toggle_relay);
 }
 
 static void actuate_relay(bool new_state) {
@@ -119,7 +128,7 @@ static volatile int btn_event_time = 0;
 volatile bool btn_handled = false;
 static volatile int curr_time = 0;
 
-LOCAL os_timer_t button_timer;
+LOCAL struct user_timer button_timer;
 const int button_timer_interval = 10; /* Milliseconds */
 
 static int fine_grained_cnt = 0;
@@ -181,7 +190,7 @@ void button_timer_cb(void) {
             gpio_output_set(BIT13, 0, BIT13, 0);
         }
         if (cnt > 1) {
-            system_restart();
+            user_reboot();
         }
     }
 }
@@ -212,7 +221,7 @@ void __attribute__((section(".text"))) gpio_isr(void *arg) {
     ETS_GPIO_INTR_ENABLE();
 }
 
-os_timer_t led_blink_timer;
+struct user_timer led_blink_timer;
 const int led_blink_timer_interval = 100; /* milliseconds */
 
 void led_blink_timer_cb(void) {
@@ -220,18 +229,18 @@ void led_blink_timer_cb(void) {
         case  USER_WIFI_MODE_STATION:
             if (wifi_station_get_connect_status() == STATION_GOT_IP) {
                 /* Stop this timer */
-                os_timer_disarm(&led_blink_timer);
+                user_timer_disarm(&led_blink_timer);
                 toggle_led(true);
                 return;
             }
             else {
                 /* Blink very rapidly */
-                os_timer_arm(&led_blink_timer, led_blink_timer_interval, false);
+                user_timer_arm(&led_blink_timer, led_blink_timer_interval, false);
             }
             break;
         case USER_WIFI_MODE_SETUP:
             /* Blink slowly */
-            os_timer_arm(&led_blink_timer, 8*led_blink_timer_interval, true);
+            user_timer_arm(&led_blink_timer, 8*led_blink_timer_interval, true);
             break;
     }
     static bool led_state;
@@ -241,6 +250,7 @@ void led_blink_timer_cb(void) {
 
 /* Reader function for endpoint "mist" and "mist.name" */
 static enum mist_error mist_read(struct mist_endpoint* ep, wish_protocol_peer_t* peer, int request_id) {
+    USER_STACK_ENTER(USER_STACK_PROBE_MIST_READ);
     PORT_PRINTF("mist_read: %s\n", ep->id);
     
     /* In this case we reply synchronously. Start building the response. */
@@ -264,12 +274,14 @@ static enum mist_error mist_read(struct mist_endpoint* ep, wish_protocol_peer_t*
     mist_read_response(ep->model->mist_app, full_epid, request_id, &bs);
     PORT_PRINTF("Ret: mist_read\n");
   
+    USER_STACK_EXIT(USER_STACK_PROBE_MIST_READ);
     return MIST_NO_ERROR;
     
 }
 
 
 static enum mist_error hw_read(mist_ep* ep, wish_protocol_peer_t* peer, int request_id) {
+    USER_STACK_ENTER(USER_STACK_PROBE_MIST_READ);
     PORT_PRINTF("hw read: %s, type %d", ep->id, ep->type);
     
     size_t result_max_len = 100;
@@ -299,16 +311,19 @@ static enum mist_error hw_read(mist_ep* ep, wish_protocol_peer_t* peer, int requ
     bson_finish(&bs);
     mist_read_response(ep->model->mist_app, full_epid, request_id, &bs);
     
+    USER_STACK_EXIT(USER_STACK_PROBE_MIST_READ);
     return MIST_NO_ERROR;
 }
 
 static enum mist_error hw_write(mist_ep* ep,  wish_protocol_peer_t* peer, int request_id, bson* args) {
+    USER_STACK_ENTER(USER_STACK_PROBE_MIST_WRITE);
     PORT_PRINTF("hw write: %s, type %d\n", ep->id, ep->type);
     
     bson_iterator new_value_it;
     if ( BSON_EOO == bson_find(&new_value_it, args, "args") ) { 
         mist_write_error(ep->model->mist_app, ep->id, request_id, 7, "Bad BSON structure, no element 'data'");
         PORT_PRINTF("hw write reg: no element data\n");
+        USER_STACK_EXIT(USER_STACK_PROBE_MIST_WRITE);
         return MIST_ERROR; 
     }
     
@@ -332,6 +347,7 @@ static enum mist_error hw_write(mist_ep* ep,  wish_protocol_peer_t* peer, int re
     mist_write_response(ep->model->mist_app, ep->id, request_id);
     mist_value_changed(ep->model->mist_app, ep->id);
 
+    USER_STACK_EXIT(USER_STACK_PROBE_MIST_WRITE);
     return MIST_NO_ERROR;
 }
 
@@ -394,13 +410,13 @@ void mist_esp8266_sonoff_app_init(void) {
     mist_app->app = app;
     wish_app_login(app);
     
-    os_timer_disarm(&button_timer);
-    os_timer_setfn(&button_timer, (os_timer_func_t *) button_timer_cb, NULL);
-    os_timer_arm(&button_timer, button_timer_interval, true);
+    user_timer_disarm(&button_timer);
+    user_timer_setfn(&button_timer, (user_timer_func_t *) button_timer_cb, NULL);
+    user_timer_arm(&button_timer, button_timer_interval, true);
     
-    os_timer_disarm(&led_blink_timer);
-    os_timer_setfn(&led_blink_timer, (os_timer_func_t *) led_blink_timer_cb, NULL);
-    os_timer_arm(&led_blink_timer, led_blink_timer_interval, true);
+    user_timer_disarm(&led_blink_timer);
+    user_timer_setfn(&led_blink_timer, (user_timer_func_t *) led_blink_timer_cb, NULL);
+    user_timer_arm(&led_blink_timer, led_blink_timer_interval, true);
 
     /* Read in initial value for relay */
     load_settings();
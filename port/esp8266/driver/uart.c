@@ -36,6 +36,37 @@ extern UartDevice    UartDev;
 LOCAL struct UartBuffer* pTxBuffer = NULL;
 LOCAL struct UartBuffer* pRxBuffer = NULL;
 
+#if UART_TX_RING_EN
+/* Software TX ring for UART0. Bytes are added by uart0_tx_ring_put() and
+ * moved to the hardware fifo by the tx fifo empty interrupt, so the caller
+ * never waits for the line. The indexes are free running, the ring holds
+ * (tx_ring_in - tx_ring_out) bytes. */
+#define UART_TX_RING_MASK (UART_TX_RING_SIZE - 1)
+LOCAL uint8 tx_ring[UART_TX_RING_SIZE];
+LOCAL volatile uint16 tx_ring_in = 0;
+LOCAL volatile uint16 tx_ring_out = 0;
+LOCAL uint32 tx_ring_dropped_bytes = 0;
+
+LOCAL void uart0_tx_ring_fill(void);
+#endif
+
+#if UART_RX_RING_EN
+/* Software RX ring for UART0, filled by the rx interrupt and read from the
+ * task given to uart0_rx_ring_enable(). When the ring is full the rx
+ * interrupt is disabled, so the bytes stay in the hardware fifo (and RTS
+ * stops the sender if UART_HW_RTS is set) until the task has read. */
+#define UART_RX_RING_MASK (UART_RX_RING_SIZE - 1)
+LOCAL uint8 rx_ring[UART_RX_RING_SIZE];
+LOCAL volatile uint16 rx_ring_in = 0;
+LOCAL volatile uint16 rx_ring_out = 0;
+LOCAL bool rx_ring_enabled = false;
+LOCAL uint8 rx_ring_task_prio;
+/* Set when the task has been posted but has not yet called uart0_rx_ring_ack() */
+LOCAL volatile bool rx_ring_posted = false;
+/* Number of hardware fifo overflows, the bytes were lost */
+LOCAL uint32 rx_fifo_overflows = 0;
+#endif
+
 /*uart demo with a system task, to output what uart receives*/
 /*this is a example to process uart data from task,please change the priority to fit your application task if exists*/
 /*it might conflict with your task, if so,please arrange the priority of different task,  or combine it to a different event in the same task. */
@@ -49,6 +80,9 @@ os_event_t    uart_recvTaskQueue[uart_recvTaskQueueLen];
 
 
 LOCAL void uart0_rx_intr_handler(void *para);
+#if UART_RX_RING_EN
+LOCAL void uart0_rx_ring_fill(void);
+#endif
 
 /******************************************************************************
  * FunctionName : uart_config
@@ -185,14 +219,117 @@ uart0_write_char_no_wait(char c)
  *                uint16 len - buffer len
  * Returns      :
 *******************************************************************************/
+#if UART_TX_RING_EN
+/******************************************************************************
+ * FunctionName : uart0_tx_ring_put
+ * Description  : add bytes to the uart0 tx ring and start the transmission,
+ *                never waits. If the ring is full, UART_TX_OVERFLOW_POLICY
+ *                decides which bytes are dropped.
+ *                Called from os_printf, so it must be in RAM.
+ * Parameters   : const uint8 *buf - bytes to send
+ *                uint16 len - number of bytes
+ * Returns      : NONE
+*******************************************************************************/
+LOCAL void __attribute__((section(".text")))
+uart0_tx_ring_put(const uint8 *buf, uint16 len)
+{
+    uint16 i;
+    /* os_printf may also be called from interrupt handlers */
+    ETS_INTR_LOCK();
+    for (i = 0; i < len; i++) {
+        if ((uint16) (tx_ring_in - tx_ring_out) >= UART_TX_RING_SIZE) {
+        #if UART_TX_OVERFLOW_POLICY == UART_TX_DROP_OLDEST
+            tx_ring_out++;
+            tx_ring_dropped_bytes++;
+        #else
+            tx_ring_dropped_bytes += len - i;
+            break;
+        #endif
+        }
+        tx_ring[tx_ring_in & UART_TX_RING_MASK] = buf[i];
+        tx_ring_in++;
+    }
+    uart0_tx_ring_fill();
+    ETS_INTR_UNLOCK();
+}
+
+/******************************************************************************
+ * FunctionName : uart0_tx_ring_fill
+ * Description  : move bytes from the tx ring to the uart0 tx fifo, and enable
+ *                the tx fifo empty interrupt as long as the ring has data.
+ *                Called from the interrupt handler, must be in RAM.
+ * Parameters   : NONE
+ * Returns      : NONE
+*******************************************************************************/
+LOCAL void __attribute__((section(".text")))
+uart0_tx_ring_fill(void)
+{
+    uint8 fifo_cnt = (READ_PERI_REG(UART_STATUS(UART0)) >> UART_TXFIFO_CNT_S) & UART_TXFIFO_CNT;
+    uint8 fifo_remain = UART_FIFO_LEN - fifo_cnt;
+
+    while (fifo_remain > 0 && tx_ring_out != tx_ring_in) {
+        WRITE_PERI_REG(UART_FIFO(UART0), tx_ring[tx_ring_out & UART_TX_RING_MASK]);
+        tx_ring_out++;
+        fifo_remain--;
+    }
+
+    WRITE_PERI_REG(UART_INT_CLR(UART0), UART_TXFIFO_EMPTY_INT_CLR);
+    if (tx_ring_out != tx_ring_in) {
+        SET_PERI_REG_MASK(UART_INT_ENA(UART0), UART_TXFIFO_EMPTY_INT_ENA);
+    } else {
+        CLEAR_PERI_REG_MASK(UART_INT_ENA(UART0), UART_TXFIFO_EMPTY_INT_ENA);
+    }
+}
+
+//os_printf output to the tx ring, in RAM as uart0_tx_ring_put
+LOCAL void __attribute__((section(".text")))
+uart0_write_char_ring(char c)
+{
+    if (c == '\n') {
+        uart0_tx_ring_put((const uint8 *) "\r\n", 2);
+    } else if (c == '\r') {
+    } else {
+        uart0_tx_ring_put((const uint8 *) &c, 1);
+    }
+}
+
+/******************************************************************************
+ * FunctionName : uart0_tx_ring_pending
+ * Description  : number of bytes in the tx ring not yet moved to the fifo
+ * Parameters   : NONE
+ * Returns      : uint16 - number of bytes
+*******************************************************************************/
+uint16 ICACHE_FLASH_ATTR
+uart0_tx_ring_pending(void)
+{
+    return tx_ring_in - tx_ring_out;
+}
+
+/******************************************************************************
+ * FunctionName : uart0_tx_ring_dropped
+ * Description  : number of bytes dropped because the tx ring was full
+ * Parameters   : NONE
+ * Returns      : uint32 - number of bytes since boot
+*******************************************************************************/
+uint32 ICACHE_FLASH_ATTR
+uart0_tx_ring_dropped(void)
+{
+    return tx_ring_dropped_bytes;
+}
+#endif
+
 void ICACHE_FLASH_ATTR
 uart0_tx_buffer(uint8 *buf, uint16 len)
 {
+#if UART_TX_RING_EN
+    uart0_tx_ring_put(buf, len);
+#else
     uint16 i;
     for (i = 0; i < len; i++)
     {
         uart_tx_one_char(UART0, buf[i]);
     }
+#endif
 }
 
 /******************************************************************************
@@ -205,11 +342,125 @@ uart0_tx_buffer(uint8 *buf, uint16 len)
 void ICACHE_FLASH_ATTR
 uart0_sendStr(const char *str)
 {
+#if UART_TX_RING_EN
+    uart0_tx_ring_put((const uint8 *) str, os_strlen(str));
+#else
     while(*str){
         uart_tx_one_char(UART0, *str++);
     }
+#endif
 }
 void at_port_print(const char *str) __attribute__((alias("uart0_sendStr")));
+
+#if UART_RX_RING_EN
+/******************************************************************************
+ * FunctionName : uart0_rx_ring_fill
+ * Description  : move the bytes in the uart0 rx fifo to the rx ring, and post
+ *                the rx task. Called from the interrupt handler, must be in RAM.
+ * Parameters   : NONE
+ * Returns      : NONE
+*******************************************************************************/
+LOCAL void __attribute__((section(".text")))
+uart0_rx_ring_fill(void)
+{
+    uint8 fifo_len = (READ_PERI_REG(UART_STATUS(UART0)) >> UART_RXFIFO_CNT_S) & UART_RXFIFO_CNT;
+
+    while (fifo_len > 0 && (uint16) (rx_ring_in - rx_ring_out) < UART_RX_RING_SIZE) {
+        rx_ring[rx_ring_in & UART_RX_RING_MASK] = READ_PERI_REG(UART_FIFO(UART0)) & 0xFF;
+        rx_ring_in++;
+        fifo_len--;
+    }
+    if (fifo_len > 0) {
+        /* Ring full, leave the rest in the fifo until the task has read */
+        uart_rx_intr_disable(UART0);
+    }
+
+    if (!rx_ring_posted) {
+        rx_ring_posted = true;
+        system_os_post(rx_ring_task_prio, 0, 0);
+    }
+}
+
+/******************************************************************************
+ * FunctionName : uart0_rx_ring_enable
+ * Description  : start receiving uart0 to the rx ring. The task 'task_prio'
+ *                is posted whenever there is new data in the ring.
+ * Parameters   : uint8 task_prio - priority of the task which reads the ring
+ *                uint8 full_thresh - rx interrupt when the fifo has this many bytes
+ *                uint8 tout_thresh - rx interrupt when the line has been idle
+ *                                    for this many byte times
+ * Returns      : NONE
+*******************************************************************************/
+void ICACHE_FLASH_ATTR
+uart0_rx_ring_enable(uint8 task_prio, uint8 full_thresh, uint8 tout_thresh)
+{
+    uart_rx_intr_disable(UART0);
+    rx_ring_task_prio = task_prio;
+    rx_ring_in = 0;
+    rx_ring_out = 0;
+    rx_ring_posted = false;
+    rx_ring_enabled = true;
+
+    SET_PERI_REG_BITS(UART_CONF1(UART0), UART_RXFIFO_FULL_THRHD, full_thresh, UART_RXFIFO_FULL_THRHD_S);
+    SET_PERI_REG_BITS(UART_CONF1(UART0), UART_RX_TOUT_THRHD, tout_thresh, UART_RX_TOUT_THRHD_S);
+    SET_PERI_REG_MASK(UART_CONF1(UART0), UART_RX_TOUT_EN);
+    WRITE_PERI_REG(UART_INT_CLR(UART0), UART_RXFIFO_FULL_INT_CLR | UART_RXFIFO_TOUT_INT_CLR);
+    uart_rx_intr_enable(UART0);
+}
+
+/******************************************************************************
+ * FunctionName : uart0_rx_ring_ack
+ * Description  : called by the rx task before it reads the ring, so that new
+ *                data after this point posts the task again
+ * Parameters   : NONE
+ * Returns      : NONE
+*******************************************************************************/
+void ICACHE_FLASH_ATTR
+uart0_rx_ring_ack(void)
+{
+    rx_ring_posted = false;
+}
+
+/******************************************************************************
+ * FunctionName : uart0_rx_ring_read
+ * Description  : read bytes from the rx ring
+ * Parameters   : uint8 *buf - destination
+ *                uint16 len - size of buf
+ * Returns      : uint16 - number of bytes read
+*******************************************************************************/
+uint16 ICACHE_FLASH_ATTR
+uart0_rx_ring_read(uint8 *buf, uint16 len)
+{
+    uint16 avail = rx_ring_in - rx_ring_out;
+    uint16 n = len < avail ? len : avail;
+    uint16 first = UART_RX_RING_SIZE - (rx_ring_out & UART_RX_RING_MASK);
+    if (first > n) {
+        first = n;
+    }
+    os_memcpy(buf, &rx_ring[rx_ring_out & UART_RX_RING_MASK], first);
+    os_memcpy(buf + first, rx_ring, n - first);
+    rx_ring_out += n;
+
+    if (n > 0) {
+        /* The interrupt may have been disabled because the ring was full */
+        uart_rx_intr_enable(UART0);
+    }
+    return n;
+}
+
+/******************************************************************************
+ * FunctionName : uart0_rx_ring_overflows
+ * Description  : number of times bytes were lost because the hardware rx fifo
+ *                overflowed
+ * Parameters   : NONE
+ * Returns      : uint32 - number of overflows since boot
+*******************************************************************************/
+uint32 ICACHE_FLASH_ATTR
+uart0_rx_ring_overflows(void)
+{
+    return rx_fifo_overflows;
+}
+#endif
 /******************************************************************************
  * FunctionName : uart0_rx_intr_handler
  * Description  : Internal used function
@@ -239,11 +490,25 @@ uart0_rx_intr_handler(void *para)
         WRITE_PERI_REG(UART_INT_CLR(uart_no), UART_FRM_ERR_INT_CLR);
     }else if(UART_RXFIFO_FULL_INT_ST == (READ_PERI_REG(UART_INT_ST(uart_no)) & UART_RXFIFO_FULL_INT_ST)){
         DBG("f");
+    #if UART_RX_RING_EN
+        if (rx_ring_enabled) {
+            uart0_rx_ring_fill();
+            WRITE_PERI_REG(UART_INT_CLR(UART0), UART_RXFIFO_FULL_INT_CLR);
+            return;
+        }
+    #endif
         uart_rx_intr_disable(UART0);
         WRITE_PERI_REG(UART_INT_CLR(UART0), UART_RXFIFO_FULL_INT_CLR);
         system_os_post(uart_recvTaskPrio, 0, 0);
     }else if(UART_RXFIFO_TOUT_INT_ST == (READ_PERI_REG(UART_INT_ST(uart_no)) & UART_RXFIFO_TOUT_INT_ST)){
         DBG("t");
+    #if UART_RX_RING_EN
+        if (rx_ring_enabled) {
+            uart0_rx_ring_fill();
+            WRITE_PERI_REG(UART_INT_CLR(UART0), UART_RXFIFO_TOUT_INT_CLR);
+            return;
+        }
+    #endif
         uart_rx_intr_disable(UART0);
         WRITE_PERI_REG(UART_INT_CLR(UART0), UART_RXFIFO_TOUT_INT_CLR);
         system_os_post(uart_recvTaskPrio, 0, 0);
@@ -254,15 +519,22 @@ uart0_rx_intr_handler(void *para)
 	/*ATTENTION:*/
 	/*IN NON-OS VERSION SDK, DO NOT USE "ICACHE_FLASH_ATTR" FUNCTIONS IN THE WHOLE HANDLER PROCESS*/
 	/*ALL THE FUNCTIONS CALLED IN INTERRUPT HANDLER MUST BE DECLARED IN RAM */
+	#if UART_TX_RING_EN
+		uart0_tx_ring_fill();
+	#else
 	CLEAR_PERI_REG_MASK(UART_INT_ENA(UART0), UART_TXFIFO_EMPTY_INT_ENA);
 	#if UART_BUFF_EN
 		tx_start_uart_buffer(UART0);
 	#endif
         //system_os_post(uart_recvTaskPrio, 1, 0);
         WRITE_PERI_REG(UART_INT_CLR(uart_no), UART_TXFIFO_EMPTY_INT_CLR);
+	#endif
         
     }else if(UART_RXFIFO_OVF_INT_ST  == (READ_PERI_REG(UART_INT_ST(uart_no)) & UART_RXFIFO_OVF_INT_ST)){
         WRITE_PERI_REG(UART_INT_CLR(uart_no), UART_RXFIFO_OVF_INT_CLR);
+    #if UART_RX_RING_EN
+        rx_fifo_overflows++;
+    #endif
         DBG1("RX OVF!!\r\n");
     }
 
@@ -343,6 +615,11 @@ uart_init(UartBautRate uart0_br, UartBautRate uart1_br)
     /*see uart0_write_char_no_wait:you can output via a buffer or output directly */
     /*os_printf output uart data via uart0 or uart buffer*/
     //os_install_putc1((void *)uart0_write_char_no_wait);  //use this to print via uart0
+
+    /*option 4: output from uart0 through the tx ring, never waits, bytes are dropped if the ring is full */
+    #if UART_TX_RING_EN
+    os_install_putc1((void *)uart0_write_char_ring);
+    #endif
     
     #if UART_SELFTEST&UART_BUFF_EN
     os_timer_disarm(&buff_timer_t);
@@ -611,7 +888,8 @@ void tx_start_uart_buffer(uint8 uart_no)
 #endif
 
 
-void uart_rx_intr_disable(uint8 uart_no)
+/* Called from the interrupt handler, must be in RAM */
+void __attribute__((section(".text"))) uart_rx_intr_disable(uint8 uart_no)
 {
 #if 1
     CLEAR_PERI_REG_MASK(UART_INT_ENA(uart_no), UART_RXFIFO_FULL_INT_ENA|UART_RXFIFO_TOUT_INT_ENA);
@@ -724,6 +1002,11 @@ UART_CheckOutputFinished(uint8 uart_no, uint32 time_out_us)
         }else{
             tx_buff_len = 0;
         }
+        #if UART_TX_RING_EN
+        if (uart_no == UART0) {
+            tx_buff_len += uart0_tx_ring_pending();
+        }
+        #endif
 		
         if( tx_fifo_len==0 && tx_buff_len==0){
             return TRUE;
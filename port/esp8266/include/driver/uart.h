@@ -35,6 +35,15 @@
 #define UART_BUFF_EN  0   //use uart buffer  , FOR UART0
 #define UART_SELFTEST  0  //set 1:enable the loop test demo for uart buffer, FOR UART0
 
+#define UART_TX_RING_EN  1   //os_printf and uart0_tx_buffer go through a ring drained by the tx fifo empty interrupt, FOR UART0
+#define UART_TX_RING_SIZE 1024  //must be a power of two
+#define UART_TX_DROP_NEWEST  0   //overflow policy: drop the bytes which do not fit
+#define UART_TX_DROP_OLDEST  1   //overflow policy: overwrite the oldest bytes still in the ring
+#define UART_TX_OVERFLOW_POLICY UART_TX_DROP_NEWEST
+
+#define UART_RX_RING_EN  1   //the rx interrupt moves bytes to a ring, see uart0_rx_ring_enable, FOR UART0
+#define UART_RX_RING_SIZE 1024  //must be a power of two
+
 #define UART_HW_RTS   0   //set 1: enable uart hw flow control RTS, PIN MTDO, FOR UART0
 #define UART_HW_CTS  0    //set1: enable uart hw flow contrl CTS , PIN MTCK, FOR UART0
 
@@ -205,6 +214,16 @@ void  Uart_rx_buff_enq();
 void  uart_rx_intr_enable(uint8 uart_no);
 void  uart_rx_intr_disable(uint8 uart_no);
 void uart0_tx_buffer(uint8 *buf, uint16 len);
+#if UART_TX_RING_EN
+uint16 uart0_tx_ring_pending(void);
+uint32 uart0_tx_ring_dropped(void);
+#endif
+#if UART_RX_RING_EN
+void uart0_rx_ring_enable(uint8 task_prio, uint8 full_thresh, uint8 tout_thresh);
+void uart0_rx_ring_ack(void);
+uint16 uart0_rx_ring_read(uint8 *buf, uint16 len);
+uint32 uart0_rx_ring_overflows(void);
+#endif
 
 //==============================================
 #define FUNC_UART0_CTS 4
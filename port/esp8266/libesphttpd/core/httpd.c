@@ -838,6 +838,10 @@ int ICACHE_FLASH_ATTR httpdConnectCb(ConnTypePtr conn, char *remIp, int remPort)
 	return 1;
 }
 
+//Called before the cgis restart the system. Does nothing unless the application overrides it.
+void ICACHE_FLASH_ATTR __attribute__((weak)) httpdBeforeRestart(void) {
+}
+
 //Httpd initialization routine. Call this to kick off webserver functionality.
 void ICACHE_FLASH_ATTR httpdInit(HttpdBuiltInUrl *fixedUrls, int port) {
 	int i;
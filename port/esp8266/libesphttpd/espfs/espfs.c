@@ -28,6 +28,10 @@ It's written for use with httpd, but doesn't need to be used as such.
 #include <stdlib.h>
 #include <string.h>
 #define ICACHE_FLASH_ATTR
+#define httpd_printf printf
+typedef uint32_t uint32;
+//Provided by the test tool, reading from the image as if it were in flash
+int spi_flash_read(uint32 addr, uint32 *dst, uint32 size);
 #endif
 
 #include "espfsformat.h"
@@ -39,6 +43,9 @@ It's written for use with httpd, but doesn't need to be used as such.
 #endif
 
 static char* espFsData = NULL;
+//Index of the image, see FLAG_INDEX, or NULL if it has none
+static char* espFsIndex = NULL;
+static int espFsIndexLen = 0;
 
 
 struct EspFsFile {
@@ -92,6 +99,12 @@ EspFsInitResult ICACHE_FLASH_ATTR espFsInit(void *flashAddress) {
 	}
 
 	espFsData = (char *)flashAddress;
+	espFsIndex = NULL;
+	espFsIndexLen = 0;
+	if (testHeader.flags & FLAG_INDEX) {
+		espFsIndex = espFsData+sizeof(EspFsHeader)+testHeader.nameLen;
+		espFsIndexLen = testHeader.fileLenComp/sizeof(EspFsIndexEntry);
+	}
 	return ESPFS_INIT_RESULT_OK;
 }
 
@@ -99,7 +112,6 @@ EspFsInitResult ICACHE_FLASH_ATTR espFsInit(void *flashAddress) {
 //aligned 32-bit reads. Yes, it's no too optimized but it's short and sweet and it works.
 
 //ToDo: perhaps memcpy also does unaligned accesses?
-#ifdef __ets__
 void ICACHE_FLASH_ATTR readFlashUnaligned(char *dst, char *src, int len) {
 	uint8_t src_offset = ((uint32_t)src) & 3;
 	uint32_t src_address = ((uint32_t)src) - src_offset;
@@ -108,9 +120,6 @@ void ICACHE_FLASH_ATTR readFlashUnaligned(char *dst, char *src, int len) {
 	spi_flash_read((uint32)src_address, (uint32*)tmp_buf, len+src_offset);
 	memcpy(dst, ((uint8_t*)tmp_buf)+src_offset, len);
 }
-#else
-#define readFlashUnaligned memcpy
-#endif
 
 // Returns flags of opened file.
 int ICACHE_FLASH_ATTR espFsFlags(EspFsFile *fh) {
@@ -124,6 +133,70 @@ int ICACHE_FLASH_ATTR espFsFlags(EspFsFile *fh) {
 	return (int)flags;
 }
 
+//Set up a file desc for the file with header h at hpos.
+static EspFsFile ICACHE_FLASH_ATTR *espFsOpenAt(char *hpos, EspFsHeader *h) {
+	EspFsFile *r;
+	char *p=hpos+sizeof(EspFsHeader)+h->nameLen; //Skip to content.
+	r=(EspFsFile *)malloc(sizeof(EspFsFile)); //Alloc file desc mem
+//	httpd_printf("Alloc %p\n", r);
+	if (r==NULL) return NULL;
+	r->header=(EspFsHeader *)hpos;
+	r->decompressor=h->compression;
+	r->posComp=p;
+	r->posStart=p;
+	r->posDecomp=0;
+	if (h->compression==COMPRESS_NONE) {
+		r->decompData=NULL;
+#ifdef ESPFS_HEATSHRINK
+	} else if (h->compression==COMPRESS_HEATSHRINK) {
+		//File is compressed with Heatshrink.
+		char parm;
+		heatshrink_decoder *dec;
+		//Decoder params are stored in 1st byte.
+		readFlashUnaligned(&parm, r->posComp, 1);
+		r->posComp++;
+		httpd_printf("Heatshrink compressed file; decode parms = %x\n", parm);
+		dec=heatshrink_decoder_alloc(16, (parm>>4)&0xf, parm&0xf);
+		r->decompData=dec;
+#endif
+	} else {
+		httpd_printf("Invalid compression: %d\n", h->compression);
+		return NULL;
+	}
+	return r;
+}
+
+//Look the file up in the index of the image: a binary search for the first entry with the hash of
+//the name, then a look at the name of every file with that hash. Returns NULL if it is not there.
+static char ICACHE_FLASH_ATTR *espFsFindIndexed(char *fileName, EspFsHeader *h) {
+	uint32_t hash=espFsHash(fileName);
+	EspFsIndexEntry e;
+	char namebuf[256];
+	int lo=0, hi=espFsIndexLen, mid, last=-1;
+	while (lo<hi) {
+		mid=(lo+hi)/2;
+		spi_flash_read((uint32)(espFsIndex+mid*sizeof(EspFsIndexEntry)), (uint32*)&e, sizeof(e));
+		last=mid;
+		if (e.hash<hash) lo=mid+1; else hi=mid;
+	}
+	for (; lo<espFsIndexLen; lo++) {
+		if (lo!=last) {
+			spi_flash_read((uint32)(espFsIndex+lo*sizeof(EspFsIndexEntry)), (uint32*)&e, sizeof(e));
+		}
+		if (e.hash!=hash) break;
+		char *hpos=espFsData+e.offset;
+		spi_flash_read((uint32)hpos, (uint32*)h, sizeof(EspFsHeader));
+		if (h->magic!=ESPFS_MAGIC || (uint16_t)h->nameLen>sizeof(namebuf)) {
+			httpd_printf("Magic mismatch. EspFS image broken.\n");
+			return NULL;
+		}
+		//Names are padded to 32 bits and zero-terminated
+		spi_flash_read((uint32)(hpos+sizeof(EspFsHeader)), (uint32*)&namebuf, h->nameLen);
+		if (strcmp(namebuf, fileName)==0) return hpos;
+	}
+	return NULL;
+}
+
 //Open a file and return a pointer to the file desc struct.
 EspFsFile ICACHE_FLASH_ATTR *espFsOpen(char *fileName) {
 	if (espFsData == NULL) {
@@ -134,10 +207,13 @@ EspFsFile ICACHE_FLASH_ATTR *espFsOpen(char *fileName) {
 	char *hpos;
 	char namebuf[256];
 	EspFsHeader h;
-	EspFsFile *r;
 	//Strip initial slashes
 	while(fileName[0]=='/') fileName++;
-	//Go find that file!
+	if (espFsIndex!=NULL) {
+		hpos=espFsFindIndexed(fileName, &h);
+		return hpos==NULL ? NULL : espFsOpenAt(hpos, &h);
+	}
+	//No index, go find that file!
 	while(1) {
 		hpos=p;
 		//Grab the next file header.
@@ -158,34 +234,7 @@ EspFsFile ICACHE_FLASH_ATTR *espFsOpen(char *fileName) {
 //				namebuf, (unsigned int)h.nameLen, (unsigned int)h.fileLenComp, h.compression, h.flags);
 		if (strcmp(namebuf, fileName)==0) {
 			//Yay, this is the file we need!
-			p+=h.nameLen; //Skip to content.
-			r=(EspFsFile *)malloc(sizeof(EspFsFile)); //Alloc file desc mem
-//			httpd_printf("Alloc %p\n", r);
-			if (r==NULL) return NULL;
-			r->header=(EspFsHeader *)hpos;
-			r->decompressor=h.compression;
-			r->posComp=p;
-			r->posStart=p;
-			r->posDecomp=0;
-			if (h.compression==COMPRESS_NONE) {
-				r->decompData=NULL;
-#ifdef ESPFS_HEATSHRINK
-			} else if (h.compression==COMPRESS_HEATSHRINK) {
-				//File is compressed with Heatshrink.
-				char parm;
-				heatshrink_decoder *dec;
-				//Decoder params are stored in 1st byte.
-				readFlashUnaligned(&parm, r->posComp, 1);
-				r->posComp++;
-				httpd_printf("Heatshrink compressed file; decode parms = %x\n", parm);
-				dec=heatshrink_decoder_alloc(16, (parm>>4)&0xf, parm&0xf);
-				r->decompData=dec;
-#endif
-			} else {
-				httpd_printf("Invalid compression: %d\n", h.compression);
-				return NULL;
-			}
-			return r;
+			return espFsOpenAt(hpos, &h);
 		}
 		//We don't need this file. Skip name and file
 		p+=h.nameLen+h.fileLenComp;
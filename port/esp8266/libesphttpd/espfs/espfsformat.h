@@ -15,8 +15,16 @@ with the FLAG_LASTFILE flag set.
 */
 
 
+/*
+Images made with mkespfsimage -i start with an index of the files, so that espFsOpen does not need to
+walk the image. The index is stored as the first file, with FLAG_INDEX set and named ESPFS_INDEX_NAME
+so that readers which do not know about it take it for an ordinary file nobody asks for. Its data is an
+EspFsIndexEntry for every other file, sorted by the hash of the name.
+*/
+
 #define FLAG_LASTFILE (1<<0)
 #define FLAG_GZIP (1<<1)
+#define FLAG_INDEX (1<<2)
 #define COMPRESS_NONE 0
 #define COMPRESS_HEATSHRINK 1
 #define ESPFS_MAGIC 0x73665345
@@ -30,4 +38,21 @@ typedef struct {
 	int32_t fileLenDecomp;
 } __attribute__((packed)) EspFsHeader;
 
+#define ESPFS_INDEX_NAME ".espfs-index"
+
+typedef struct {
+	uint32_t hash;   //espFsHash of the name
+	uint32_t offset; //of the header of the file, from the start of the image
+} __attribute__((packed)) EspFsIndexEntry;
+
+//32-bit FNV-1a hash of a file name, without the leading slashes
+static inline uint32_t espFsHash(const char *name) {
+	uint32_t h=2166136261u;
+	while (*name) {
+		h^=(uint8_t)*name++;
+		h*=16777619u;
+	}
+	return h;
+}
+
 #endif
\ No newline at end of file
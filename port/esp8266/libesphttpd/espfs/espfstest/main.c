@@ -1,9 +1,15 @@
 /*
-Simple and stupid file decompressor for an espfs image. Mostly used as a testbed for espfs.c and 
+Simple and stupid file decompressor for an espfs image. Mostly used as a testbed for espfs.c and
 the decompressors: code compiled natively is way easier to debug using gdb et all :)
+
+With -b, it instead opens every file of the image, and a file which is not there, and prints the
+flash reads each open takes, to compare images with and without an index (mkespfsimage -i). The
+contents of uncompressed files are checked against the image. 'make bench' does this for images of
+a growing number of files.
 */
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
 #include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -13,40 +19,131 @@ the decompressors: code compiled natively is way easier to debug using gdb et al
 
 
 #include "espfs.h"
+#include "espfsformat.h"
+
+//The image is read by espfs.c as if it were in flash at this address
+#define FLASH_ADDR 0x100000
+//Time of a flash read, as modeled by the flash emulator of the port
+#define READ_US(bytes) (5+(bytes)/5)
 
 char *espFsData;
+off_t espFsSize;
+
+int flashReads, flashReadBytes, flashReadUs;
+
+int spi_flash_read(uint32_t addr, uint32_t *dst, uint32_t size) {
+	if (addr<FLASH_ADDR || addr-FLASH_ADDR+size>espFsSize) {
+		//Past the end of the image, as the 256 bytes of a name read near the end can be
+		memset(dst, 0xff, size);
+		if (addr<FLASH_ADDR || addr-FLASH_ADDR>=espFsSize) return 0;
+		size=espFsSize-(addr-FLASH_ADDR);
+	}
+	memcpy(dst, espFsData+addr-FLASH_ADDR, size);
+	flashReads++;
+	flashReadBytes+=size;
+	flashReadUs+=READ_US(size);
+	return 0;
+}
+
+static void bench(void) {
+	char *p=espFsData;
+	EspFsHeader h;
+	char buff[128];
+	int files=0, indexed=0, maxReads=0, maxUs=0, sumReads=0, sumBytes=0, sumUs=0;
+	while (1) {
+		memcpy(&h, p, sizeof(h));
+		if (h.magic!=ESPFS_MAGIC) {
+			printf("Magic mismatch. EspFS image broken.\n");
+			exit(1);
+		}
+		if (h.flags&FLAG_LASTFILE) break;
+		if (h.flags&FLAG_INDEX) {
+			indexed=1;
+		} else {
+			char *name=p+sizeof(h);
+			flashReads=flashReadBytes=flashReadUs=0;
+			EspFsFile *ef=espFsOpen(name);
+			if (ef==NULL) {
+				printf("Couldn't find %s in image.\n", name);
+				exit(1);
+			}
+			files++;
+			sumReads+=flashReads;
+			sumBytes+=flashReadBytes;
+			sumUs+=flashReadUs;
+			if (flashReads>maxReads) maxReads=flashReads;
+			if (flashReadUs>maxUs) maxUs=flashReadUs;
+			if (h.compression==COMPRESS_NONE) {
+				char *data=name+h.nameLen;
+				int len, pos=0;
+				while ((len=espFsRead(ef, buff, sizeof(buff)))!=0) {
+					if (pos+len>h.fileLenComp || memcmp(buff, data+pos, len)!=0) {
+						printf("%s does not read back as it is in the image.\n", name);
+						exit(1);
+					}
+					pos+=len;
+				}
+				if (pos!=h.fileLenComp) {
+					printf("%s is short.\n", name);
+					exit(1);
+				}
+			}
+			espFsClose(ef);
+		}
+		p+=sizeof(h)+h.nameLen+h.fileLenComp;
+		if ((p-espFsData)&3) p+=4-((p-espFsData)&3);
+	}
+	if (files==0) {
+		printf("No files in image.\n");
+		exit(1);
+	}
+	flashReads=flashReadBytes=flashReadUs=0;
+	if (espFsOpen("no/such/file")!=NULL) {
+		printf("Found a file which is not there.\n");
+		exit(1);
+	}
+	printf("%-7s %5d %8.1f %8d %8.0f %8.1f %8d %8d\n", indexed ? "index" : "linear", files,
+		(double)sumReads/files, maxReads, (double)sumBytes/files, (double)sumUs/files, maxUs,
+		flashReads);
+}
 
 int main(int argc, char **argv) {
 	int f, out;
 	int len;
 	char buff[128];
 	EspFsFile *ef;
-	off_t size;
 	EspFsInitResult ir;
 
 	if (argc!=3) {
 		printf("Usage: %s espfs-image file\nExpands file from the espfs-image archive.\n", argv[0]);
+		printf("Usage: %s -b espfs-image\nPrints the flash reads of opening the files of the image.\n", argv[0]);
 		exit(0);
 	}
 
-	f=open(argv[1], O_RDONLY);
+	char *imageName=strcmp(argv[1], "-b")==0 ? argv[2] : argv[1];
+	f=open(imageName, O_RDONLY);
 	if (f<=0) {
-		perror(argv[1]);
+		perror(imageName);
 		exit(1);
 	}
-	size=lseek(f, 0, SEEK_END);
-	espFsData=mmap(NULL, size, PROT_READ, MAP_SHARED, f, 0);
+	espFsSize=lseek(f, 0, SEEK_END);
+	espFsData=mmap(NULL, espFsSize, PROT_READ, MAP_SHARED, f, 0);
 	if (espFsData==MAP_FAILED) {
 		perror("mmap");
 		exit(1);
 	}
 
-	ir=espFsInit(espFsData);
+	ir=espFsInit((void *)FLASH_ADDR);
 	if (ir != ESPFS_INIT_RESULT_OK) {
 		printf("Couldn't init espfs filesystem (code %d)\n", ir);
 		exit(1);
 	}
 
+	if (imageName==argv[2]) {
+		bench();
+		return 0;
+	}
+
 	ef=espFsOpen(argv[2]);
 	if (ef==NULL) {
 		printf("Couldn't find %s in image.\n", argv[2]);
@@ -58,7 +155,7 @@ int main(int argc, char **argv) {
 		perror(argv[2]);
 		exit(1);
 	}
-	
+
 	while ((len=espFsRead(ef, buff, 128))!=0) {
 		write(out, buff, len);
 	}
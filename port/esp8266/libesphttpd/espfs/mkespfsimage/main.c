@@ -48,6 +48,50 @@ int htoxl(int in) {
 	return *((int *)r);
 }
 
+//With -i, the image is kept in memory until the index, which goes in front of it, is known
+int makeIndex=0;
+char *image=NULL;
+size_t imageLen=0, imageMax=0;
+EspFsIndexEntry *indexEntries=NULL;
+int indexLen=0, indexMax=0;
+
+void emit(const void *buf, size_t len) {
+	if (!makeIndex) {
+		write(1, buf, len);
+		return;
+	}
+	if (imageLen+len>imageMax) {
+		imageMax=(imageLen+len)*2;
+		image=realloc(image, imageMax);
+		if (image==NULL) {
+			perror("allocating mem for image");
+			exit(1);
+		}
+	}
+	memcpy(image+imageLen, buf, len);
+	imageLen+=len;
+}
+
+void addIndexEntry(char *name) {
+	if (indexLen==indexMax) {
+		indexMax=indexMax ? indexMax*2 : 64;
+		indexEntries=realloc(indexEntries, indexMax*sizeof(EspFsIndexEntry));
+		if (indexEntries==NULL) {
+			perror("allocating mem for index");
+			exit(1);
+		}
+	}
+	indexEntries[indexLen].hash=espFsHash(name);
+	indexEntries[indexLen].offset=imageLen;
+	indexLen++;
+}
+
+int compareIndexEntries(const void *a, const void *b) {
+	const EspFsIndexEntry *x=a, *y=b;
+	if (x->hash!=y->hash) return x->hash<y->hash ? -1 : 1;
+	return x->offset<y->offset ? -1 : x->offset>y->offset;
+}
+
 #ifdef ESPFS_HEATSHRINK
 size_t compressHeatshrink(char *in, int insize, char *out, int outsize, int level) {
 	char *inp=in;
@@ -234,16 +278,17 @@ int handleFile(int f, char *name, int compression, int level, char **compName) {
 	h.fileLenComp=htoxl(csize);
 	h.fileLenDecomp=htoxl(size);
 	
-	write(1, &h, sizeof(EspFsHeader));
-	write(1, name, nameLen);
+	if (makeIndex) addIndexEntry(name);
+	emit(&h, sizeof(EspFsHeader));
+	emit(name, nameLen);
 	while (nameLen&3) {
-		write(1, "\000", 1);
+		emit("\000", 1);
 		nameLen++;
 	}
-	write(1, cdat, csize);
+	emit(cdat, csize);
 	//Pad out to 32bit boundary
 	while (csize&3) {
-		write(1, "\000", 1);
+		emit("\000", 1);
 		csize++;
 	}
 	free(fdat);
@@ -264,6 +309,31 @@ int handleFile(int f, char *name, int compression, int level, char **compName) {
 	return size ? (csize*100)/size : 100;
 }
 
+//Write the index, as the first file of the image, and then the image behind it.
+void writeIndexed() {
+	EspFsHeader h;
+	char name[sizeof(ESPFS_INDEX_NAME)+3]={0};
+	int nameLen=(sizeof(ESPFS_INDEX_NAME)+3)&~3;
+	int indexSize=indexLen*sizeof(EspFsIndexEntry);
+	int i;
+	strcpy(name, ESPFS_INDEX_NAME);
+	qsort(indexEntries, indexLen, sizeof(EspFsIndexEntry), compareIndexEntries);
+	for (i=0; i<indexLen; i++) {
+		indexEntries[i].offset=htoxl(indexEntries[i].offset+sizeof(EspFsHeader)+nameLen+indexSize);
+		indexEntries[i].hash=htoxl(indexEntries[i].hash);
+	}
+	h.magic=('E'<<0)+('S'<<8)+('f'<<16)+('s'<<24);
+	h.flags=FLAG_INDEX;
+	h.compression=COMPRESS_NONE;
+	h.nameLen=htoxs(nameLen);
+	h.fileLenComp=htoxl(indexSize);
+	h.fileLenDecomp=htoxl(indexSize);
+	write(1, &h, sizeof(EspFsHeader));
+	write(1, name, nameLen);
+	write(1, indexEntries, indexSize);
+	write(1, image, imageLen);
+}
+
 //Write final dummy header with FLAG_LASTFILE set.
 void finishArchive() {
 	EspFsHeader h;
@@ -273,7 +343,8 @@ void finishArchive() {
 	h.nameLen=htoxs(0);
 	h.fileLenComp=htoxl(0);
 	h.fileLenDecomp=htoxl(0);
-	write(1, &h, sizeof(EspFsHeader));
+	emit(&h, sizeof(EspFsHeader));
+	if (makeIndex) writeIndexed();
 }
 
 int main(int argc, char **argv) {
@@ -300,6 +371,8 @@ int main(int argc, char **argv) {
 		if (strcmp(argv[x], "-c")==0 && argc>=x-2) {
 			compType=atoi(argv[x+1]);
 			x++;
+		} else if (strcmp(argv[x], "-i")==0) {
+			makeIndex=1;
 		} else if (strcmp(argv[x], "-l")==0 && argc>=x-2) {
 			compLvl=atoi(argv[x+1]);
 			if (compLvl<1 || compLvl>9) err=1;
@@ -322,7 +395,7 @@ int main(int argc, char **argv) {
 
 	if (err) {
 		fprintf(stderr, "%s - Program to create espfs images\n", argv[0]);
-		fprintf(stderr, "Usage: \nfind | %s [-c compressor] [-l compression_level] ", argv[0]);
+		fprintf(stderr, "Usage: \nfind | %s [-c compressor] [-l compression_level] [-i] ", argv[0]);
 #ifdef ESPFS_GZIP
 		fprintf(stderr, "[-g gzipped_extensions] ");
 #endif
@@ -334,6 +407,7 @@ int main(int argc, char **argv) {
 		fprintf(stderr, "0 - None(default)\n");
 #endif
 		fprintf(stderr, "\nCompression level: 1 is worst but low RAM usage, higher is better compression \nbut uses more ram on decompression. -1 = compressors default.\n");
+		fprintf(stderr, "\n-i: put an index of the files in front of the image, so that espFsOpen finds \nthem without walking the image. Readers without index support still read it.\n");
 #ifdef ESPFS_GZIP
 		fprintf(stderr, "\nGzipped extensions: list of comma separated, case sensitive file extensions \nthat will be gzipped. Defaults to 'html,css,js'\n");
 #endif
@@ -88,6 +88,9 @@ void httpdFlushSendBuffer(HttpdConnData *conn);
 void httpdContinue(HttpdConnData *conn);
 void httpdConnSendStart(HttpdConnData *conn);
 void httpdConnSendFinish(HttpdConnData *conn);
+//Called by the cgi routines right before they restart the system. Does nothing, but the
+//application can define its own to save its state first.
+void httpdBeforeRestart(void);
 
 //Platform dependent code should call these.
 void httpdSentCb(ConnTypePtr conn, char *remIp, int remPort);
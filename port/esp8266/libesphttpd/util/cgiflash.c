@@ -273,6 +273,7 @@ int ICACHE_FLASH_ATTR cgiUploadFirmware(HttpdConnData *connData) {
 static os_timer_t resetTimer;
 
 static void ICACHE_FLASH_ATTR resetTimerCb(void *arg) {
+	httpdBeforeRestart();
 	system_upgrade_flag_set(UPGRADE_FLAG_FINISH);
 	system_upgrade_reboot();
 }
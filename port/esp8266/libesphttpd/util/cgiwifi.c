@@ -175,6 +175,7 @@ static void ICACHE_FLASH_ATTR resetTimerCb(void *arg) {
 		//Go to STA mode. This needs a reset, so do that.
 		httpd_printf("Got IP. Going into STA mode..\n");
 		wifi_set_opmode(1);
+		httpdBeforeRestart();
 		system_restart();
 	} else {
 		connTryStatus=CONNTRY_FAIL;
@@ -253,6 +254,7 @@ int ICACHE_FLASH_ATTR cgiWiFiSetMode(HttpdConnData *connData) {
 		httpd_printf("cgiWifiSetMode: %s\n", buff);
 #ifndef DEMO_MODE
 		wifi_set_opmode(atoi(buff));
+		httpdBeforeRestart();
 		system_restart();
 #endif
 	}
@@ -0,0 +1,79 @@
+/*
+ * Deferred logging, see PORT_LOG() in port_printf.h
+ *
+ * The log records are kept in a ring of 32-bit words: the format string
+ * pointer, the number of arguments, and the arguments. The ring is
+ * flushed from a timer shortly after the first record has been added,
+ * so the formatting and the UART output happen outside of the callback
+ * which logged the message. There is no user task priority left for
+ * this, see user_task.h.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "osapi.h"
+#include "espmissingincludes.h"
+
+#include "user_timer.h"
+#include "port_printf.h"
+
+#define LOG_BUF_WORDS 128
+
+/* How long to wait before formatting the messages */
+#define LOG_FLUSH_DELAY_MS 20
+
+static uint32_t log_buf[LOG_BUF_WORDS];
+/* Word indexes to log_buf, modulo LOG_BUF_WORDS */
+static uint32_t log_head;
+static uint32_t log_tail;
+/* Number of messages dropped because the ring was full */
+static uint32_t log_dropped;
+
+static struct user_timer log_timer;
+
+static void log_timer_cb(void *arg) {
+    port_log_flush();
+}
+
+void port_log_record(const char *fmt, const uint32_t *args, size_t num_args) {
+    if (num_args > PORT_LOG_MAX_ARGS) {
+        num_args = PORT_LOG_MAX_ARGS;
+    }
+    if (LOG_BUF_WORDS - (log_head - log_tail) < 2 + num_args) {
+        log_dropped++;
+        return;
+    }
+
+    bool was_empty = log_head == log_tail;
+    log_buf[log_head++ % LOG_BUF_WORDS] = (uint32_t) fmt;
+    log_buf[log_head++ % LOG_BUF_WORDS] = num_args;
+    size_t i = 0;
+    for (i = 0; i < num_args; i++) {
+        log_buf[log_head++ % LOG_BUF_WORDS] = args[i];
+    }
+
+    if (was_empty) {
+        user_timer_setfn(&log_timer, log_timer_cb, NULL);
+        user_timer_arm(&log_timer, LOG_FLUSH_DELAY_MS, false);
+    }
+}
+
+void port_log_flush(void) {
+    while (log_tail != log_head) {
+        const char *fmt = (const char *) log_buf[log_tail++ % LOG_BUF_WORDS];
+        uint32_t num_args = log_buf[log_tail++ % LOG_BUF_WORDS];
+        uint32_t a[PORT_LOG_MAX_ARGS] = { 0 };
+        uint32_t i = 0;
+        for (i = 0; i < num_args; i++) {
+            a[i] = log_buf[log_tail++ % LOG_BUF_WORDS];
+        }
+        /* Unused arguments are simply ignored by the format */
+        os_printf_plus(fmt, a[0], a[1], a[2], a[3]);
+    }
+
+    if (log_dropped > 0) {
+        os_printf("%d log messages dropped\n\r", log_dropped);
+        log_dropped = 0;
+    }
+}
@@ -2,11 +2,62 @@
 
 /* A useful printf macro to which can be easily disabled for production environments */
 
+#include <stdint.h>
+#include <stddef.h>
+
 #define WITH_PORT_PRINTF_OUTPUT 0
 
+/* Log levels, the same as in wish_debug.h */
+#define PORT_LOG_DEBUG      1
+#define PORT_LOG_WIRE       5
+#define PORT_LOG_CRITICAL   9
+#define PORT_LOG_OFF        10
+
+/* The compile-time log level. A module can set its own level by defining
+ * PORT_LOG_LEVEL before including this file. Any PORT_LOG() with a lower
+ * level compiles to nothing, format string included. Like WISHDEBUG(),
+ * logging is off in release builds unless a module asks for it. */
+#ifndef PORT_LOG_LEVEL
+#ifdef RELEASE_BUILD
+#define PORT_LOG_LEVEL PORT_LOG_OFF
+#else
+#define PORT_LOG_LEVEL PORT_LOG_CRITICAL
+#endif
+#endif
+
+/* Put the format strings in flash instead of RAM. os_printf_plus() can
+ * read its format from flash. The alignment is needed because flash can
+ * only be read in 32-bit words. */
+#define PORT_LOG_FMT_ATTR __attribute__((section(".irom.text"))) __attribute__((aligned(4)))
+
+int os_printf_plus(const char *format, ...);
+
 #if WITH_PORT_PRINTF_OUTPUT
-#define PORT_PRINTF(...) os_printf( __VA_ARGS__)
+#define PORT_PRINTF(fmt, ...) do { \
+        static const char port_printf_fmt[] PORT_LOG_FMT_ATTR = fmt; \
+        os_printf_plus(port_printf_fmt, ## __VA_ARGS__); \
+    } while (0)
 #else
 #define PORT_PRINTF(...)
 #endif
 
+/* Deferred logging. The format string pointer and the arguments are
+ * copied into a buffer, and formatted later outside the hot path (see
+ * port_log.c). As the formatting is deferred, the arguments must be
+ * integers; %s is only safe for strings which are constant. At most
+ * PORT_LOG_MAX_ARGS arguments are supported. */
+#define PORT_LOG_MAX_ARGS 4
+
+#define PORT_LOG(lvl, fmt, ...) do { \
+        if ((lvl) >= PORT_LOG_LEVEL) { \
+            static const char port_log_fmt[] PORT_LOG_FMT_ATTR = fmt "\n\r"; \
+            const uint32_t port_log_args[] = { 0, ## __VA_ARGS__ }; \
+            port_log_record(port_log_fmt, port_log_args + 1, \
+                sizeof(port_log_args) / sizeof(uint32_t) - 1); \
+        } \
+    } while (0)
+
+void port_log_record(const char *fmt, const uint32_t *args, size_t num_args);
+
+/* Format and print all the deferred log messages now */
+void port_log_flush(void);
@@ -31,7 +31,9 @@
 #include "wish_port_config.h"
 #include "utlist.h"
 #include "user_tcp.h"
-#include "port_printf.h"
+#include "user_stack.h"
+#include "user_metrics.h"
+#include "user_trace.h"
 
 static wish_core_t* core;
 
@@ -48,26 +50,41 @@ struct ipc_event {
 struct ipc_event *ipc_event_queue = NULL;
 os_event_t single_ets_ev;
 
+/* Record the length of the IPC queue after an event has been added to it */
+static void ipc_queue_appended(void) {
+    struct ipc_event *elt;
+    int queue_len = 0;
+    LL_COUNT(ipc_event_queue, elt, queue_len);
+    user_metric_set(USER_METRIC_IPC_QUEUE_DEPTH, queue_len);
+    user_histogram_observe(USER_HISTOGRAM_IPC_QUEUE_DEPTH, queue_len);
+}
+
 static void service_ipc_task(os_event_t *ets_ev) {
+    USER_STACK_ENTER(USER_STACK_PROBE_IPC_TASK);
     
     /* Take first eleent in queue*/
     struct ipc_event *event = ipc_event_queue;
    
     if (event == NULL) {
-        PORT_PRINTF("Unexpected: Event queue is empty!");
+        USER_TRACE(IPC_QUEUE_EMPTY, 0, 0);
+        USER_STACK_EXIT(USER_STACK_PROBE_IPC_TASK);
         return;
     }
     
-    if (user_get_send_queue_len() > 0) {
+    int send_queue_len = user_get_send_queue_len();
+    if (send_queue_len > 0) {
         /* Defer processing of the queue! */
+        USER_TRACE(IPC_DEFER, send_queue_len, 0);
         system_os_post(SERVICE_IPC_TASK_ID, 0, 0);
         //user_hold();
+        USER_STACK_EXIT(USER_STACK_PROBE_IPC_TASK);
         return;
     }
     else {
         //user_unhold();
     }
     
+    USER_TRACE(IPC_PROCESS, event->type, event->len);
     switch (event->type) {
         case EVENT_APP_TO_CORE:
             /* Feed the message to core */
@@ -80,7 +97,7 @@ static void service_ipc_task(os_event_t *ets_ev) {
             break;
         }
         default:
-            PORT_PRINTF("Bad ipc event!");
+            USER_TRACE(IPC_BAD_EVENT, event->type, 0);
     }
     
     LL_DELETE(ipc_event_queue, event);
@@ -90,14 +107,16 @@ static void service_ipc_task(os_event_t *ets_ev) {
     struct ipc_event *elt;
     int queue_len = 0;
     LL_COUNT(ipc_event_queue, elt, queue_len);
+    user_metric_set(USER_METRIC_IPC_QUEUE_DEPTH, queue_len);
     
     if ( queue_len > 0) {
         /* Continue processing the event queue */
         system_os_post(SERVICE_IPC_TASK_ID, 0, 0);
     }
     else {
-        PORT_PRINTF("IPC event queue is empty!\n  ");
+        USER_TRACE(IPC_QUEUE_DRAINED, 0, 0);
     }
+    USER_STACK_EXIT(USER_STACK_PROBE_IPC_TASK);
 }
 
 void core_service_ipc_init(wish_core_t* wish_core) {
@@ -114,20 +133,22 @@ void send_app_to_core(uint8_t *wsid, const uint8_t *data, size_t len) {
     
     struct ipc_event *event = os_malloc(sizeof(struct ipc_event));
     if (event == NULL) {
-        PORT_PRINTF("Could not allocate ipc event!\n");
+        USER_TRACE(IPC_EVENT_OOM, EVENT_APP_TO_CORE, 0);
         return;
     }
     else {
         event->data = os_malloc(len);
         if (event->data == NULL) {
-            PORT_PRINTF("Could not allocate ipc event data buffer: type %d\n", EVENT_APP_TO_CORE);
+            USER_TRACE(IPC_DATA_OOM, EVENT_APP_TO_CORE, len);
             return;
         }
         memcpy(event->data, data, len);
         event->len = len;
         event->app = wish_app_find_by_wsid(wsid);
         event->type = EVENT_APP_TO_CORE;
+        USER_TRACE(IPC_ENQUEUE, EVENT_APP_TO_CORE, len);
         LL_APPEND(ipc_event_queue, event);
+        ipc_queue_appended();
         system_os_post(SERVICE_IPC_TASK_ID, 0, 0);
     }
 }
@@ -152,20 +173,22 @@ void receive_core_to_app(wish_app_t *app, const uint8_t *data, size_t len) {
 void send_core_to_app(wish_core_t* core, const uint8_t wsid[WISH_ID_LEN], const uint8_t *data, size_t len) {
     struct ipc_event *event = os_malloc(sizeof(struct ipc_event));
     if (event == NULL) {
-        PORT_PRINTF("Could not allocate ipc event!\n");
+        USER_TRACE(IPC_EVENT_OOM, EVENT_CORE_TO_APP, 0);
         return;
     }
     else {
         event->data = os_malloc(len);
         if (event->data == NULL) {
-            PORT_PRINTF("Could not allocate ipc event data buffer: type %d\n", EVENT_CORE_TO_APP);
+            USER_TRACE(IPC_DATA_OOM, EVENT_CORE_TO_APP, len);
             return;
         }
         memcpy(event->data, data, len);
         event->len = len;
         event->app = wish_app_find_by_wsid((uint8_t*) wsid);
         event->type = EVENT_CORE_TO_APP;
+        USER_TRACE(IPC_ENQUEUE, EVENT_CORE_TO_APP, len);
         LL_APPEND(ipc_event_queue, event);
+        ipc_queue_appended();
         system_os_post(SERVICE_IPC_TASK_ID, 0, 0);
     }
 }
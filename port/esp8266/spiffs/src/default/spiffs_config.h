@@ -56,6 +56,15 @@
 #define SPIFFS_CACHE_WR                 1
 #endif
 
+// Replace read cache pages by segmented LRU instead of plain LRU. Pages
+// enter the cache on probation and are replaced first. Object lookup and
+// index pages read again while cached are protected, up to half of the
+// cache, so that scanning the lookup pages of every block or streaming a
+// file does not push them out.
+#ifndef  SPIFFS_CACHE_SLRU
+#define SPIFFS_CACHE_SLRU               1
+#endif
+
 // Enable/disable statistics on caching. Debug/test purpose only.
 #ifndef  SPIFFS_CACHE_STATS
 #define SPIFFS_CACHE_STATS              1
@@ -68,6 +77,15 @@
 #define SPIFFS_PAGE_CHECK               1
 #endif
 
+// Append more than a page of data in batches of consecutive free pages,
+// found in one pass over the object lookup and occupied with one lookup
+// write, each page written with its header in one write. The pages are
+// finalized after all their data has been written. On here, for the
+// tests, though the port turns it off.
+#ifndef SPIFFS_APPEND_BATCH
+#define SPIFFS_APPEND_BATCH             1
+#endif
+
 // Define maximum number of gc runs to perform to reach desired free pages.
 #ifndef SPIFFS_GC_MAX_RUNS
 #define SPIFFS_GC_MAX_RUNS              5
@@ -145,6 +163,11 @@
 #define SPIFFS_UNLOCK(fs)
 #endif
 
+// define this to a clock in microseconds, for SPIFFS_check_step to do as
+// much of the check as fits in the time it is given; if not defined, each
+// step does only one unit of the check
+// #define SPIFFS_CHECK_TIME_US()          get_time_us()
+
 // Enable if only one spiffs instance with constant configuration will exist
 // on the target. This will reduce calculations, flash and memory accesses.
 // Parts of configuration must be defined below instead of at time of mount.
@@ -253,6 +276,25 @@
 #define SPIFFS_IX_MAP                         1
 #endif
 
+// Number of objects in a RAM index of object index header pages, or 0 to
+// disable. The index maps object ids and name hashes to the pages of the
+// object index headers, so that opening a file by name, or creating one,
+// does not need to scan the object lookup pages of every block. It is built
+// at mount and kept up to date as objects are created, changed and removed.
+// With more objects than entries, misses fall back to scanning the medium.
+// Costs 8 bytes of RAM per entry in the spiffs struct.
+#ifndef SPIFFS_LU_INDEX
+#define SPIFFS_LU_INDEX                       16
+#endif
+
+// Enable SPIFFS_get_mount_state and SPIFFS_mount_from_state, which save
+// and restore what mounting learns by scanning the object lookup pages of
+// every block: the free block count and cursor, the page counts, the max
+// erase count and the RAM index of object index headers.
+#ifndef SPIFFS_MOUNT_STATE
+#define SPIFFS_MOUNT_STATE                    1
+#endif
+
 // Set SPIFFS_TEST_VISUALISATION to non-zero to enable SPIFFS_vis function
 // in the api. This function will visualize all filesystem using given printf
 // function.
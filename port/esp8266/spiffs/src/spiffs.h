@@ -225,6 +225,34 @@ typedef struct {
 #endif
 } spiffs_config;
 
+#if SPIFFS_LU_INDEX
+// entry of the RAM index of object index header pages
+typedef struct {
+  // object id without the index flag, SPIFFS_OBJ_ID_DELETED if unused
+  spiffs_obj_id obj_id;
+  // page of the object index header
+  spiffs_page_ix pix;
+  // hash of the object name
+  u32_t name_hash;
+} spiffs_lu_index_entry;
+#endif
+
+#if SPIFFS_MOUNT_STATE
+// what mounting finds out by scanning the medium, see SPIFFS_get_mount_state
+typedef struct {
+  u32_t free_blocks;
+  u32_t stats_p_allocated;
+  u32_t stats_p_deleted;
+  u32_t free_cursor_obj_lu_entry;
+  spiffs_block_ix free_cursor_block_ix;
+  spiffs_obj_id max_erase_count;
+#if SPIFFS_LU_INDEX
+  u8_t lu_index_complete;
+  spiffs_lu_index_entry lu_index[SPIFFS_LU_INDEX];
+#endif
+} spiffs_mount_state;
+#endif
+
 typedef struct spiffs_t {
   // file system configuration
   spiffs_config cfg;
@@ -263,8 +291,17 @@ typedef struct spiffs_t {
   // max erase count amongst all blocks
   spiffs_obj_id max_erase_count;
 
+#if SPIFFS_LU_INDEX
+  // RAM index of object index header pages
+  spiffs_lu_index_entry lu_index[SPIFFS_LU_INDEX];
+  // nonzero if all objects on the medium are in the index
+  u8_t lu_index_complete;
+#endif
+
 #if SPIFFS_GC_STATS
   u32_t stats_gc_runs;
+  // pages moved out of blocks being garbage collected
+  u32_t stats_gc_pages_moved;
 #endif
 
 #if SPIFFS_CACHE
@@ -275,11 +312,30 @@ typedef struct spiffs_t {
 #if SPIFFS_CACHE_STATS
   u32_t cache_hits;
   u32_t cache_misses;
+  // the above by the kind of page read
+  u32_t cache_lu_hits;
+  u32_t cache_lu_misses;
+  u32_t cache_ix_hits;
+  u32_t cache_ix_misses;
+  u32_t cache_data_hits;
+  u32_t cache_data_misses;
 #endif
 #endif
 
   // check callback function
   spiffs_check_callback check_cb_f;
+#if !SPIFFS_READ_ONLY
+  // phase of the consistency check in progress, see SPIFFS_check_step
+  u8_t check_phase;
+  // nonzero if the file system was used since the last unit of the check
+  u8_t check_disturbed;
+  // block the check continues from
+  spiffs_block_ix check_block;
+  // first page of the range of pages the page check is at
+  spiffs_page_ix check_pix_offset;
+  // next entry of the object id fifo of the object index check
+  u32_t check_obj_id_log_ix;
+#endif
   // file callback function
   spiffs_file_callback file_cb_f;
   // mounted flag
@@ -313,6 +369,10 @@ typedef struct {
   int entry;
 } spiffs_DIR;
 
+/* file listing callback function, see SPIFFS_list */
+typedef s32_t (*spiffs_list_callback)(struct spiffs_t *fs, const struct spiffs_dirent *e,
+    u32_t pages, void *user);
+
 #if SPIFFS_IX_MAP
 
 typedef struct {
@@ -384,6 +444,29 @@ s32_t SPIFFS_mount(spiffs *fs, spiffs_config *config, u8_t *work,
     void *cache, u32_t cache_size,
     spiffs_check_callback check_cb_f);
 
+#if SPIFFS_MOUNT_STATE
+/**
+ * Like SPIFFS_mount, but takes what would be found out by scanning the
+ * object lookup pages of every block from a state saved with
+ * SPIFFS_get_mount_state. The medium must not have changed since the
+ * state was saved, it is not checked.
+ * @param state         the saved state
+ */
+s32_t SPIFFS_mount_from_state(spiffs *fs, spiffs_config *config, u8_t *work,
+    u8_t *fd_space, u32_t fd_space_size,
+    void *cache, u32_t cache_size,
+    spiffs_check_callback check_cb_f,
+    const spiffs_mount_state *state);
+
+/**
+ * Saves the state SPIFFS_mount_from_state needs. The file system must be
+ * mounted, or just unmounted, so that the state matches the medium.
+ * @param fs            the file system struct
+ * @param state         the state
+ */
+void SPIFFS_get_mount_state(spiffs *fs, spiffs_mount_state *state);
+#endif
+
 /**
  * Unmounts the file system. All file handles will be flushed of any
  * cached writes and closed.
@@ -562,12 +645,43 @@ s32_t SPIFFS_closedir(spiffs_DIR *d);
  */
 struct spiffs_dirent *SPIFFS_readdir(spiffs_DIR *d, struct spiffs_dirent *e);
 
+/**
+ * Lists the files of a directory stream in one pass over the look up pages,
+ * reading the index header of each file once. For each file the callback is
+ * given what SPIFFS_readdir would give, and the number of pages the file takes,
+ * index pages included, as follows from its size. The callback returns
+ * SPIFFS_OK to go on, a positive value to stop before the file, which then is
+ * the first one listed by the next call, or a negative error which ends the
+ * listing. The callback must not call SPIFFS.
+ * @param d             pointer to the directory stream
+ * @param cb            the callback
+ * @param user          any pointer, passed to the callback
+ * @returns number of files listed, 0 at the end of the stream, or error
+ */
+s32_t SPIFFS_list(spiffs_DIR *d, spiffs_list_callback cb, void *user);
+
 /**
  * Runs a consistency check on given filesystem.
+ * A stepped check in progress, see SPIFFS_check_step, is started over.
  * @param fs            the file system struct
  */
 s32_t SPIFFS_check(spiffs *fs);
 
+/**
+ * Runs a part of a consistency check on given filesystem, starting one if none
+ * is in progress. Does the check in units of about one block, until one is done
+ * after budget_us microseconds have passed as told by SPIFFS_CHECK_TIME_US, or
+ * only one if that is not defined. The file system can be used between the
+ * steps, but then the step after rereads what the check was in the middle of,
+ * so the check needs the file system left alone for long enough to finish.
+ * The check ends as SPIFFS_check would, with the same mending and callbacks.
+ * @param fs            the file system struct
+ * @param budget_us     microseconds to spend on the check
+ * @returns 0 when the check is done, the progress of the check from 1 to 255
+ *          when there is more to do, or an error
+ */
+s32_t SPIFFS_check_step(spiffs *fs, u32_t budget_us);
+
 /**
  * Returns number of total bytes available and number of used bytes.
  * This is an estimation, and depends on if there a many files with little
@@ -628,6 +742,23 @@ u8_t SPIFFS_mounted(spiffs *fs);
  */
 s32_t SPIFFS_gc_quick(spiffs *fs, u16_t max_free_pages);
 
+/**
+ * Does one bounded step of garbage collection: erases a block holding only
+ * deleted pages if there is one, otherwise moves the live pages out of the
+ * best candidate block and erases it. At most one block is erased per call,
+ * so the cost of a step is bounded by one block clean.
+ *
+ * Meant to be called repeatedly while the system is idle, so that the
+ * automatic garbage collection in the write path seldom has to run.
+ *
+ * Will set err_no to SPIFFS_OK if a block was erased,
+ * SPIFFS_ERR_NO_DELETED_BLOCKS if there was nothing to collect,
+ * or other error.
+ *
+ * @param fs            the file system struct
+ */
+s32_t SPIFFS_gc_step(spiffs *fs);
+
 /**
  * Will try to make room for given amount of bytes in the filesystem by moving
  * pages and erasing blocks.
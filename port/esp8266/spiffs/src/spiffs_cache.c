@@ -85,6 +85,55 @@ static s32_t spiffs_cache_page_remove_oldest(spiffs *fs, u8_t flag_mask, u8_t fl
   return res;
 }
 
+#if SPIFFS_CACHE_SLRU
+// segmented LRU: a read page enters the cache on probation, and a lookup or
+// index page which is read again while cached is protected. Pages on
+// probation are replaced first, so that a scan over the lookup pages of
+// every block, or a file streamed through the cache, does not push out
+// the lookup and index pages in use. At most cpage_protected_max, half of
+// the cache pages, are protected, beyond that the oldest protected page is
+// put back on probation. With none protected, this is plain LRU.
+
+// protects a cached read page
+static void spiffs_cache_page_protect(spiffs *fs, spiffs_cache_page *cp) {
+  spiffs_cache *cache = spiffs_get_cache(fs);
+  if (cp->flags & (SPIFFS_CACHE_FLAG_DATA | SPIFFS_CACHE_FLAG_PROTECTED)) return;
+  int i;
+  int protected = 0;
+  int oldest_ix = -1;
+  u32_t oldest_val = 0;
+  for (i = 0; i < cache->cpage_count; i++) {
+    spiffs_cache_page *p = spiffs_get_cache_page_hdr(fs, cache, i);
+    if ((cache->cpage_use_map & (1<<i)) &&
+        (p->flags & (SPIFFS_CACHE_FLAG_TYPE_WR | SPIFFS_CACHE_FLAG_PROTECTED)) == SPIFFS_CACHE_FLAG_PROTECTED) {
+      protected++;
+      if ((cache->last_access - p->last_access) >= oldest_val) {
+        oldest_val = cache->last_access - p->last_access;
+        oldest_ix = i;
+      }
+    }
+  }
+  if (protected >= cache->cpage_protected_max) {
+    if (oldest_ix < 0) return;
+    spiffs_get_cache_page_hdr(fs, cache, oldest_ix)->flags &= ~SPIFFS_CACHE_FLAG_PROTECTED;
+  }
+  cp->flags |= SPIFFS_CACHE_FLAG_PROTECTED;
+}
+
+// removes the oldest accessed read page on probation, or the oldest
+// protected one if there is none
+static s32_t spiffs_cache_page_remove_probation(spiffs *fs) {
+  spiffs_cache *cache = spiffs_get_cache(fs);
+  s32_t res = spiffs_cache_page_remove_oldest(fs,
+      SPIFFS_CACHE_FLAG_TYPE_WR | SPIFFS_CACHE_FLAG_PROTECTED, 0);
+  if (res == SPIFFS_OK &&
+      (cache->cpage_use_map & cache->cpage_use_mask) == cache->cpage_use_mask) {
+    res = spiffs_cache_page_remove_oldest(fs, SPIFFS_CACHE_FLAG_TYPE_WR, 0);
+  }
+  return res;
+}
+#endif
+
 // allocates a new cached page and returns it, or null if all cache pages are busy
 static spiffs_cache_page *spiffs_cache_page_allocate(spiffs *fs) {
   spiffs_cache *cache = spiffs_get_cache(fs);
@@ -128,13 +177,25 @@ s32_t spiffs_phys_rd(
   s32_t res = SPIFFS_OK;
   spiffs_cache *cache = spiffs_get_cache(fs);
   spiffs_cache_page *cp =  spiffs_cache_page_get(fs, SPIFFS_PADDR_TO_PAGE(fs, addr));
+  u8_t kind;
+  switch (op & SPIFFS_OP_TYPE_MASK) {
+  case SPIFFS_OP_T_OBJ_IX: kind = SPIFFS_CACHE_FLAG_OBJIX; break;
+  case SPIFFS_OP_T_OBJ_DA: kind = SPIFFS_CACHE_FLAG_DATA; break;
+  default: kind = SPIFFS_CACHE_FLAG_OBJLU; break;
+  }
   cache->last_access++;
   if (cp) {
     // we've already got one, you see
 #if SPIFFS_CACHE_STATS
     fs->cache_hits++;
+    if (kind == SPIFFS_CACHE_FLAG_OBJIX) fs->cache_ix_hits++;
+    else if (kind == SPIFFS_CACHE_FLAG_DATA) fs->cache_data_hits++;
+    else fs->cache_lu_hits++;
 #endif
     cp->last_access = cache->last_access;
+#if SPIFFS_CACHE_SLRU
+    spiffs_cache_page_protect(fs, cp);
+#endif
     u8_t *mem =  spiffs_get_cache_page(fs, cache, cp->ix);
     memcpy(dst, &mem[SPIFFS_PADDR_TO_PAGE_OFFSET(fs, addr)], len);
   } else {
@@ -144,14 +205,21 @@ s32_t spiffs_phys_rd(
     }
 #if SPIFFS_CACHE_STATS
     fs->cache_misses++;
+    if (kind == SPIFFS_CACHE_FLAG_OBJIX) fs->cache_ix_misses++;
+    else if (kind == SPIFFS_CACHE_FLAG_DATA) fs->cache_data_misses++;
+    else fs->cache_lu_misses++;
 #endif
     // this operation will always free one cache page (unless all already free),
     // the result code stems from the write operation of the possibly freed cache page
+#if SPIFFS_CACHE_SLRU
+    res = spiffs_cache_page_remove_probation(fs);
+#else
     res = spiffs_cache_page_remove_oldest(fs, SPIFFS_CACHE_FLAG_TYPE_WR, 0);
+#endif
 
     cp = spiffs_cache_page_allocate(fs);
     if (cp) {
-      cp->flags = SPIFFS_CACHE_FLAG_WRTHRU;
+      cp->flags = SPIFFS_CACHE_FLAG_WRTHRU | kind;
       cp->pix = SPIFFS_PADDR_TO_PAGE(fs, addr);
 
       s32_t res2 = SPIFFS_HAL_READ(fs,
@@ -246,7 +314,11 @@ spiffs_cache_page *spiffs_cache_page_get_by_fd(spiffs *fs, spiffs_fd *fd) {
 spiffs_cache_page *spiffs_cache_page_allocate_by_fd(spiffs *fs, spiffs_fd *fd) {
   // before this function is called, it is ensured that there is no already existing
   // cache page with same object id
+#if SPIFFS_CACHE_SLRU
+  spiffs_cache_page_remove_probation(fs);
+#else
   spiffs_cache_page_remove_oldest(fs, SPIFFS_CACHE_FLAG_TYPE_WR, 0);
+#endif
   spiffs_cache_page *cp = spiffs_cache_page_allocate(fs);
   if (cp == 0) {
     // could not get cache page
@@ -295,6 +367,9 @@ void spiffs_cache_init(spiffs *fs) {
   spiffs_cache cache;
   memset(&cache, 0, sizeof(spiffs_cache));
   cache.cpage_count = cache_entries;
+#if SPIFFS_CACHE_SLRU
+  cache.cpage_protected_max = cache_entries / 2;
+#endif
   cache.cpages = (u8_t *)((u8_t *)fs->cache + sizeof(spiffs_cache));
 
   cache.cpage_use_map = 0xffffffff;
@@ -470,26 +470,14 @@ static s32_t spiffs_lookup_check_v(spiffs *fs, spiffs_obj_id obj_id, spiffs_bloc
 }
 
 
-// Scans all object look up. For each entry, corresponding page header is checked for validity.
-// If an object index header page is found, this is also checked
-s32_t spiffs_lookup_consistency_check(spiffs *fs, u8_t check_all_objects) {
-  (void)check_all_objects;
-  s32_t res = SPIFFS_OK;
-
-  CHECK_CB(fs, SPIFFS_CHECK_LOOKUP, SPIFFS_CHECK_PROGRESS, 0, 0);
-
-  res = spiffs_obj_lu_find_entry_visitor(fs, 0, 0, 0, 0, spiffs_lookup_check_v, 0, 0, 0, 0);
-
+// Scans the object look up of block bix. For each entry, corresponding page header is
+// checked for validity. If an object index header page is found, this is also checked
+static s32_t spiffs_lookup_consistency_check_block(spiffs *fs, spiffs_block_ix bix) {
+  s32_t res = spiffs_obj_lu_find_entry_visitor(fs, bix, 0, SPIFFS_VIS_ONE_BLOCK, 0,
+      spiffs_lookup_check_v, 0, 0, 0, 0);
   if (res == SPIFFS_VIS_END) {
     res = SPIFFS_OK;
   }
-
-  if (res != SPIFFS_OK) {
-    CHECK_CB(fs, SPIFFS_CHECK_LOOKUP, SPIFFS_CHECK_ERROR, res, 0);
-  }
-
-  CHECK_CB(fs, SPIFFS_CHECK_LOOKUP, SPIFFS_CHECK_PROGRESS, 256, 0);
-
   return res;
 }
 
@@ -506,358 +494,345 @@ s32_t spiffs_lookup_consistency_check(spiffs *fs, u8_t check_all_objects) {
 //  * x011 used, referenced only once, not index
 //  * x101 used, unreferenced, index
 // The working memory might not fit all pages so several scans might be needed
-static s32_t spiffs_page_consistency_check_i(spiffs *fs) {
+//
+// Adds the pages in block cur_block to the consistency bitmap of the range of
+// pages starting at pix_offset, and the pages referenced from the index pages in
+// the block. Sets *restart if something was mended and the range must be
+// scanned again.
+static s32_t spiffs_page_consistency_check_block(spiffs *fs, spiffs_page_ix pix_offset,
+    spiffs_block_ix cur_block, u8_t *restart_p) {
   const u32_t bits = 4;
   const spiffs_page_ix pages_per_scan = SPIFFS_CFG_LOG_PAGE_SZ(fs) * 8 / bits;
 
   s32_t res = SPIFFS_OK;
-  spiffs_page_ix pix_offset = 0;
-
-  // for each range of pages fitting into work memory
-  while (pix_offset < SPIFFS_PAGES_PER_BLOCK(fs) * fs->block_count) {
-    // set this flag to abort all checks and rescan the page range
-    u8_t restart = 0;
-    memset(fs->work, 0, SPIFFS_CFG_LOG_PAGE_SZ(fs));
-
-    spiffs_block_ix cur_block = 0;
-    // build consistency bitmap for id range traversing all blocks
-    while (!restart && cur_block < fs->block_count) {
-      CHECK_CB(fs, SPIFFS_CHECK_PAGE, SPIFFS_CHECK_PROGRESS,
-          (pix_offset*256)/(SPIFFS_PAGES_PER_BLOCK(fs) * fs->block_count) +
-          ((((cur_block * pages_per_scan * 256)/ (SPIFFS_PAGES_PER_BLOCK(fs) * fs->block_count))) / fs->block_count),
-          0);
-      // traverse each page except for lookup pages
-      spiffs_page_ix cur_pix = SPIFFS_OBJ_LOOKUP_PAGES(fs) + SPIFFS_PAGES_PER_BLOCK(fs) * cur_block;
-      while (!restart && cur_pix < SPIFFS_PAGES_PER_BLOCK(fs) * (cur_block+1)) {
-        //if ((cur_pix & 0xff) == 0)
-        //  SPIFFS_CHECK_DBG("PA: processing pix %08x, block %08x of pix %08x, block %08x\n",
-        //      cur_pix, cur_block, SPIFFS_PAGES_PER_BLOCK(fs) * fs->block_count, fs->block_count);
-
-        // read header
-        spiffs_page_header p_hdr;
-        res = _spiffs_rd(fs, SPIFFS_OP_T_OBJ_LU2 | SPIFFS_OP_C_READ,
-            0, SPIFFS_PAGE_TO_PADDR(fs, cur_pix), sizeof(spiffs_page_header), (u8_t*)&p_hdr);
-        SPIFFS_CHECK_RES(res);
+  u8_t restart = 0;
+  CHECK_CB(fs, SPIFFS_CHECK_PAGE, SPIFFS_CHECK_PROGRESS,
+      (pix_offset*256)/(SPIFFS_PAGES_PER_BLOCK(fs) * fs->block_count) +
+      ((((cur_block * pages_per_scan * 256)/ (SPIFFS_PAGES_PER_BLOCK(fs) * fs->block_count))) / fs->block_count),
+      0);
+  // traverse each page except for lookup pages
+  spiffs_page_ix cur_pix = SPIFFS_OBJ_LOOKUP_PAGES(fs) + SPIFFS_PAGES_PER_BLOCK(fs) * cur_block;
+  while (!restart && cur_pix < SPIFFS_PAGES_PER_BLOCK(fs) * (cur_block+1)) {
+    //if ((cur_pix & 0xff) == 0)
+    //  SPIFFS_CHECK_DBG("PA: processing pix %08x, block %08x of pix %08x, block %08x\n",
+    //      cur_pix, cur_block, SPIFFS_PAGES_PER_BLOCK(fs) * fs->block_count, fs->block_count);
+
+    // read header
+    spiffs_page_header p_hdr;
+    res = _spiffs_rd(fs, SPIFFS_OP_T_OBJ_LU2 | SPIFFS_OP_C_READ,
+        0, SPIFFS_PAGE_TO_PADDR(fs, cur_pix), sizeof(spiffs_page_header), (u8_t*)&p_hdr);
+    SPIFFS_CHECK_RES(res);
 
-        u8_t within_range = (cur_pix >= pix_offset && cur_pix < pix_offset + pages_per_scan);
-        const u32_t pix_byte_ix = (cur_pix - pix_offset) / (8/bits);
-        const u8_t pix_bit_ix = (cur_pix & ((8/bits)-1)) * bits;
+    u8_t within_range = (cur_pix >= pix_offset && cur_pix < pix_offset + pages_per_scan);
+    const u32_t pix_byte_ix = (cur_pix - pix_offset) / (8/bits);
+    const u8_t pix_bit_ix = (cur_pix & ((8/bits)-1)) * bits;
 
-        if (within_range &&
-            (p_hdr.flags & SPIFFS_PH_FLAG_DELET) && (p_hdr.flags & SPIFFS_PH_FLAG_USED) == 0) {
-          // used
-          fs->work[pix_byte_ix] |= (1<<(pix_bit_ix + 0));
-        }
-        if ((p_hdr.flags & SPIFFS_PH_FLAG_DELET) &&
-            (p_hdr.flags & SPIFFS_PH_FLAG_IXDELE) &&
-            (p_hdr.flags & (SPIFFS_PH_FLAG_INDEX | SPIFFS_PH_FLAG_USED)) == 0) {
-          // found non-deleted index
-          if (within_range) {
-            fs->work[pix_byte_ix] |= (1<<(pix_bit_ix + 2));
-          }
+    if (within_range &&
+        (p_hdr.flags & SPIFFS_PH_FLAG_DELET) && (p_hdr.flags & SPIFFS_PH_FLAG_USED) == 0) {
+      // used
+      fs->work[pix_byte_ix] |= (1<<(pix_bit_ix + 0));
+    }
+    if ((p_hdr.flags & SPIFFS_PH_FLAG_DELET) &&
+        (p_hdr.flags & SPIFFS_PH_FLAG_IXDELE) &&
+        (p_hdr.flags & (SPIFFS_PH_FLAG_INDEX | SPIFFS_PH_FLAG_USED)) == 0) {
+      // found non-deleted index
+      if (within_range) {
+        fs->work[pix_byte_ix] |= (1<<(pix_bit_ix + 2));
+      }
 
-          // load non-deleted index
-          res = _spiffs_rd(fs, SPIFFS_OP_T_OBJ_LU2 | SPIFFS_OP_C_READ,
-              0, SPIFFS_PAGE_TO_PADDR(fs, cur_pix), SPIFFS_CFG_LOG_PAGE_SZ(fs), fs->lu_work);
-          SPIFFS_CHECK_RES(res);
+      // load non-deleted index
+      res = _spiffs_rd(fs, SPIFFS_OP_T_OBJ_LU2 | SPIFFS_OP_C_READ,
+          0, SPIFFS_PAGE_TO_PADDR(fs, cur_pix), SPIFFS_CFG_LOG_PAGE_SZ(fs), fs->lu_work);
+      SPIFFS_CHECK_RES(res);
+
+      // traverse index for referenced pages
+      spiffs_page_ix *object_page_index;
+      spiffs_page_header *objix_p_hdr = (spiffs_page_header *)fs->lu_work;
+
+      int entries;
+      int i;
+      spiffs_span_ix data_spix_offset;
+      if (p_hdr.span_ix == 0) {
+        // object header page index
+        entries = SPIFFS_OBJ_HDR_IX_LEN(fs);
+        data_spix_offset = 0;
+        object_page_index = (spiffs_page_ix *)((u8_t *)fs->lu_work + sizeof(spiffs_page_object_ix_header));
+      } else {
+        // object page index
+        entries = SPIFFS_OBJ_IX_LEN(fs);
+        data_spix_offset = SPIFFS_OBJ_HDR_IX_LEN(fs) + SPIFFS_OBJ_IX_LEN(fs) * (p_hdr.span_ix - 1);
+        object_page_index = (spiffs_page_ix *)((u8_t *)fs->lu_work + sizeof(spiffs_page_object_ix));
+      }
 
-          // traverse index for referenced pages
-          spiffs_page_ix *object_page_index;
-          spiffs_page_header *objix_p_hdr = (spiffs_page_header *)fs->lu_work;
-
-          int entries;
-          int i;
-          spiffs_span_ix data_spix_offset;
-          if (p_hdr.span_ix == 0) {
-            // object header page index
-            entries = SPIFFS_OBJ_HDR_IX_LEN(fs);
-            data_spix_offset = 0;
-            object_page_index = (spiffs_page_ix *)((u8_t *)fs->lu_work + sizeof(spiffs_page_object_ix_header));
+      // for all entries in index
+      for (i = 0; !restart && i < entries; i++) {
+        spiffs_page_ix rpix = object_page_index[i];
+        u8_t rpix_within_range = rpix >= pix_offset && rpix < pix_offset + pages_per_scan;
+
+        if ((rpix != (spiffs_page_ix)-1 && rpix > SPIFFS_MAX_PAGES(fs))
+            || (rpix_within_range && SPIFFS_IS_LOOKUP_PAGE(fs, rpix))) {
+
+          // bad reference
+          SPIFFS_CHECK_DBG("PA: pix %04x bad pix / LU referenced from page %04x\n",
+              rpix, cur_pix);
+          // check for data page elsewhere
+          spiffs_page_ix data_pix;
+          res = spiffs_obj_lu_find_id_and_span(fs, objix_p_hdr->obj_id & ~SPIFFS_OBJ_ID_IX_FLAG,
+              data_spix_offset + i, 0, &data_pix);
+          if (res == SPIFFS_ERR_NOT_FOUND) {
+            res = SPIFFS_OK;
+            data_pix = 0;
+          }
+          SPIFFS_CHECK_RES(res);
+          if (data_pix == 0) {
+            // if not, allocate free page
+            spiffs_page_header new_ph;
+            new_ph.flags = 0xff & ~(SPIFFS_PH_FLAG_USED | SPIFFS_PH_FLAG_FINAL);
+            new_ph.obj_id = objix_p_hdr->obj_id & ~SPIFFS_OBJ_ID_IX_FLAG;
+            new_ph.span_ix = data_spix_offset + i;
+            res = spiffs_page_allocate_data(fs, new_ph.obj_id, &new_ph, 0, 0, 0, 1, &data_pix);
+            SPIFFS_CHECK_RES(res);
+            SPIFFS_CHECK_DBG("PA: FIXUP: found no existing data page, created new @ %04x\n", data_pix);
+          }
+          // remap index
+          SPIFFS_CHECK_DBG("PA: FIXUP: rewriting index pix %04x\n", cur_pix);
+          res = spiffs_rewrite_index(fs, objix_p_hdr->obj_id | SPIFFS_OBJ_ID_IX_FLAG,
+              data_spix_offset + i, data_pix, cur_pix);
+          if (res <= _SPIFFS_ERR_CHECK_FIRST && res > _SPIFFS_ERR_CHECK_LAST) {
+            // index bad also, cannot mend this file
+            SPIFFS_CHECK_DBG("PA: FIXUP: index bad %i, cannot mend - delete object\n", res);
+            CHECK_CB(fs, SPIFFS_CHECK_PAGE, SPIFFS_CHECK_DELETE_BAD_FILE, objix_p_hdr->obj_id, 0);
+            // delete file
+            res = spiffs_page_delete(fs, cur_pix);
           } else {
-            // object page index
-            entries = SPIFFS_OBJ_IX_LEN(fs);
-            data_spix_offset = SPIFFS_OBJ_HDR_IX_LEN(fs) + SPIFFS_OBJ_IX_LEN(fs) * (p_hdr.span_ix - 1);
-            object_page_index = (spiffs_page_ix *)((u8_t *)fs->lu_work + sizeof(spiffs_page_object_ix));
+            CHECK_CB(fs, SPIFFS_CHECK_PAGE, SPIFFS_CHECK_FIX_INDEX, objix_p_hdr->obj_id, objix_p_hdr->span_ix);
           }
+          SPIFFS_CHECK_RES(res);
+          restart = 1;
 
-          // for all entries in index
-          for (i = 0; !restart && i < entries; i++) {
-            spiffs_page_ix rpix = object_page_index[i];
-            u8_t rpix_within_range = rpix >= pix_offset && rpix < pix_offset + pages_per_scan;
+        } else if (rpix_within_range) {
 
-            if ((rpix != (spiffs_page_ix)-1 && rpix > SPIFFS_MAX_PAGES(fs))
-                || (rpix_within_range && SPIFFS_IS_LOOKUP_PAGE(fs, rpix))) {
+          // valid reference
+          // read referenced page header
+          spiffs_page_header rp_hdr;
+          res = _spiffs_rd(fs, SPIFFS_OP_T_OBJ_LU2 | SPIFFS_OP_C_READ,
+              0, SPIFFS_PAGE_TO_PADDR(fs, rpix), sizeof(spiffs_page_header), (u8_t*)&rp_hdr);
+          SPIFFS_CHECK_RES(res);
 
-              // bad reference
-              SPIFFS_CHECK_DBG("PA: pix %04x bad pix / LU referenced from page %04x\n",
+          // cross reference page header check
+          if (rp_hdr.obj_id != (p_hdr.obj_id & ~SPIFFS_OBJ_ID_IX_FLAG) ||
+              rp_hdr.span_ix != data_spix_offset + i ||
+              (rp_hdr.flags & (SPIFFS_PH_FLAG_DELET | SPIFFS_PH_FLAG_INDEX | SPIFFS_PH_FLAG_USED)) !=
+                  (SPIFFS_PH_FLAG_DELET | SPIFFS_PH_FLAG_INDEX)) {
+           SPIFFS_CHECK_DBG("PA: pix %04x has inconsistent page header ix id/span:%04x/%04x, ref id/span:%04x/%04x flags:%02x\n",
+                rpix, p_hdr.obj_id & ~SPIFFS_OBJ_ID_IX_FLAG, data_spix_offset + i,
+                rp_hdr.obj_id, rp_hdr.span_ix, rp_hdr.flags);
+           // try finding correct page
+           spiffs_page_ix data_pix;
+           res = spiffs_obj_lu_find_id_and_span(fs, p_hdr.obj_id & ~SPIFFS_OBJ_ID_IX_FLAG,
+               data_spix_offset + i, rpix, &data_pix);
+           if (res == SPIFFS_ERR_NOT_FOUND) {
+             res = SPIFFS_OK;
+             data_pix = 0;
+           }
+           SPIFFS_CHECK_RES(res);
+           if (data_pix == 0) {
+             // not found, this index is badly borked
+             SPIFFS_CHECK_DBG("PA: FIXUP: index bad, delete object id %04x\n", p_hdr.obj_id);
+             CHECK_CB(fs, SPIFFS_CHECK_PAGE, SPIFFS_CHECK_DELETE_BAD_FILE, p_hdr.obj_id, 0);
+             res = spiffs_delete_obj_lazy(fs, p_hdr.obj_id);
+             SPIFFS_CHECK_RES(res);
+             break;
+           } else {
+             // found it, so rewrite index
+             SPIFFS_CHECK_DBG("PA: FIXUP: found correct data pix %04x, rewrite ix pix %04x id %04x\n",
+                 data_pix, cur_pix, p_hdr.obj_id);
+             res = spiffs_rewrite_index(fs, p_hdr.obj_id, data_spix_offset + i, data_pix, cur_pix);
+             if (res <= _SPIFFS_ERR_CHECK_FIRST && res > _SPIFFS_ERR_CHECK_LAST) {
+               // index bad also, cannot mend this file
+               SPIFFS_CHECK_DBG("PA: FIXUP: index bad %i, cannot mend!\n", res);
+               CHECK_CB(fs, SPIFFS_CHECK_PAGE, SPIFFS_CHECK_DELETE_BAD_FILE, p_hdr.obj_id, 0);
+               res = spiffs_delete_obj_lazy(fs, p_hdr.obj_id);
+             } else {
+               CHECK_CB(fs, SPIFFS_CHECK_PAGE, SPIFFS_CHECK_FIX_INDEX, p_hdr.obj_id, p_hdr.span_ix);
+             }
+             SPIFFS_CHECK_RES(res);
+             restart = 1;
+           }
+          }
+          else {
+            // mark rpix as referenced
+            const u32_t rpix_byte_ix = (rpix - pix_offset) / (8/bits);
+            const u8_t rpix_bit_ix = (rpix & ((8/bits)-1)) * bits;
+            if (fs->work[rpix_byte_ix] & (1<<(rpix_bit_ix + 1))) {
+              SPIFFS_CHECK_DBG("PA: pix %04x multiple referenced from page %04x\n",
                   rpix, cur_pix);
-              // check for data page elsewhere
-              spiffs_page_ix data_pix;
-              res = spiffs_obj_lu_find_id_and_span(fs, objix_p_hdr->obj_id & ~SPIFFS_OBJ_ID_IX_FLAG,
-                  data_spix_offset + i, 0, &data_pix);
-              if (res == SPIFFS_ERR_NOT_FOUND) {
-                res = SPIFFS_OK;
-                data_pix = 0;
-              }
+              // Here, we should have fixed all broken references - getting this means there
+              // must be multiple files with same object id. Only solution is to delete
+              // the object which is referring to this page
+              SPIFFS_CHECK_DBG("PA: FIXUP: removing object %04x and page %04x\n",
+                  p_hdr.obj_id, cur_pix);
+              CHECK_CB(fs, SPIFFS_CHECK_PAGE, SPIFFS_CHECK_DELETE_BAD_FILE, p_hdr.obj_id, 0);
+              res = spiffs_delete_obj_lazy(fs, p_hdr.obj_id);
               SPIFFS_CHECK_RES(res);
-              if (data_pix == 0) {
-                // if not, allocate free page
-                spiffs_page_header new_ph;
-                new_ph.flags = 0xff & ~(SPIFFS_PH_FLAG_USED | SPIFFS_PH_FLAG_FINAL);
-                new_ph.obj_id = objix_p_hdr->obj_id & ~SPIFFS_OBJ_ID_IX_FLAG;
-                new_ph.span_ix = data_spix_offset + i;
-                res = spiffs_page_allocate_data(fs, new_ph.obj_id, &new_ph, 0, 0, 0, 1, &data_pix);
-                SPIFFS_CHECK_RES(res);
-                SPIFFS_CHECK_DBG("PA: FIXUP: found no existing data page, created new @ %04x\n", data_pix);
-              }
-              // remap index
-              SPIFFS_CHECK_DBG("PA: FIXUP: rewriting index pix %04x\n", cur_pix);
-              res = spiffs_rewrite_index(fs, objix_p_hdr->obj_id | SPIFFS_OBJ_ID_IX_FLAG,
-                  data_spix_offset + i, data_pix, cur_pix);
-              if (res <= _SPIFFS_ERR_CHECK_FIRST && res > _SPIFFS_ERR_CHECK_LAST) {
-                // index bad also, cannot mend this file
-                SPIFFS_CHECK_DBG("PA: FIXUP: index bad %i, cannot mend - delete object\n", res);
-                CHECK_CB(fs, SPIFFS_CHECK_PAGE, SPIFFS_CHECK_DELETE_BAD_FILE, objix_p_hdr->obj_id, 0);
-                // delete file
-                res = spiffs_page_delete(fs, cur_pix);
-              } else {
-                CHECK_CB(fs, SPIFFS_CHECK_PAGE, SPIFFS_CHECK_FIX_INDEX, objix_p_hdr->obj_id, objix_p_hdr->span_ix);
-              }
+              // extra precaution, delete this page also
+              res = spiffs_page_delete(fs, cur_pix);
               SPIFFS_CHECK_RES(res);
               restart = 1;
+            }
+            fs->work[rpix_byte_ix] |= (1<<(rpix_bit_ix + 1));
+          }
+        }
+      } // for all index entries
+    } // found index
 
-            } else if (rpix_within_range) {
+    // next page
+    cur_pix++;
+  }
+  *restart_p = restart;
+  return res;
+}
 
-              // valid reference
-              // read referenced page header
-              spiffs_page_header rp_hdr;
-              res = _spiffs_rd(fs, SPIFFS_OP_T_OBJ_LU2 | SPIFFS_OP_C_READ,
-                  0, SPIFFS_PAGE_TO_PADDR(fs, rpix), sizeof(spiffs_page_header), (u8_t*)&rp_hdr);
-              SPIFFS_CHECK_RES(res);
+// Checks the consistency bitmap of the range of pages starting at pix_offset,
+// built by spiffs_page_consistency_check_block for all blocks. Sets *restart if
+// something was mended and the range must be scanned again.
+static s32_t spiffs_page_consistency_check_bitmap(spiffs *fs, spiffs_page_ix pix_offset,
+    u8_t *restart_p) {
+  const u32_t bits = 4;
 
-              // cross reference page header check
-              if (rp_hdr.obj_id != (p_hdr.obj_id & ~SPIFFS_OBJ_ID_IX_FLAG) ||
-                  rp_hdr.span_ix != data_spix_offset + i ||
-                  (rp_hdr.flags & (SPIFFS_PH_FLAG_DELET | SPIFFS_PH_FLAG_INDEX | SPIFFS_PH_FLAG_USED)) !=
-                      (SPIFFS_PH_FLAG_DELET | SPIFFS_PH_FLAG_INDEX)) {
-               SPIFFS_CHECK_DBG("PA: pix %04x has inconsistent page header ix id/span:%04x/%04x, ref id/span:%04x/%04x flags:%02x\n",
-                    rpix, p_hdr.obj_id & ~SPIFFS_OBJ_ID_IX_FLAG, data_spix_offset + i,
-                    rp_hdr.obj_id, rp_hdr.span_ix, rp_hdr.flags);
-               // try finding correct page
-               spiffs_page_ix data_pix;
-               res = spiffs_obj_lu_find_id_and_span(fs, p_hdr.obj_id & ~SPIFFS_OBJ_ID_IX_FLAG,
-                   data_spix_offset + i, rpix, &data_pix);
-               if (res == SPIFFS_ERR_NOT_FOUND) {
-                 res = SPIFFS_OK;
-                 data_pix = 0;
-               }
-               SPIFFS_CHECK_RES(res);
-               if (data_pix == 0) {
-                 // not found, this index is badly borked
-                 SPIFFS_CHECK_DBG("PA: FIXUP: index bad, delete object id %04x\n", p_hdr.obj_id);
-                 CHECK_CB(fs, SPIFFS_CHECK_PAGE, SPIFFS_CHECK_DELETE_BAD_FILE, p_hdr.obj_id, 0);
-                 res = spiffs_delete_obj_lazy(fs, p_hdr.obj_id);
-                 SPIFFS_CHECK_RES(res);
-                 break;
-               } else {
-                 // found it, so rewrite index
-                 SPIFFS_CHECK_DBG("PA: FIXUP: found correct data pix %04x, rewrite ix pix %04x id %04x\n",
-                     data_pix, cur_pix, p_hdr.obj_id);
-                 res = spiffs_rewrite_index(fs, p_hdr.obj_id, data_spix_offset + i, data_pix, cur_pix);
-                 if (res <= _SPIFFS_ERR_CHECK_FIRST && res > _SPIFFS_ERR_CHECK_LAST) {
-                   // index bad also, cannot mend this file
-                   SPIFFS_CHECK_DBG("PA: FIXUP: index bad %i, cannot mend!\n", res);
-                   CHECK_CB(fs, SPIFFS_CHECK_PAGE, SPIFFS_CHECK_DELETE_BAD_FILE, p_hdr.obj_id, 0);
-                   res = spiffs_delete_obj_lazy(fs, p_hdr.obj_id);
-                 } else {
-                   CHECK_CB(fs, SPIFFS_CHECK_PAGE, SPIFFS_CHECK_FIX_INDEX, p_hdr.obj_id, p_hdr.span_ix);
-                 }
-                 SPIFFS_CHECK_RES(res);
-                 restart = 1;
-               }
-              }
-              else {
-                // mark rpix as referenced
-                const u32_t rpix_byte_ix = (rpix - pix_offset) / (8/bits);
-                const u8_t rpix_bit_ix = (rpix & ((8/bits)-1)) * bits;
-                if (fs->work[rpix_byte_ix] & (1<<(rpix_bit_ix + 1))) {
-                  SPIFFS_CHECK_DBG("PA: pix %04x multiple referenced from page %04x\n",
-                      rpix, cur_pix);
-                  // Here, we should have fixed all broken references - getting this means there
-                  // must be multiple files with same object id. Only solution is to delete
-                  // the object which is referring to this page
-                  SPIFFS_CHECK_DBG("PA: FIXUP: removing object %04x and page %04x\n",
-                      p_hdr.obj_id, cur_pix);
-                  CHECK_CB(fs, SPIFFS_CHECK_PAGE, SPIFFS_CHECK_DELETE_BAD_FILE, p_hdr.obj_id, 0);
-                  res = spiffs_delete_obj_lazy(fs, p_hdr.obj_id);
-                  SPIFFS_CHECK_RES(res);
-                  // extra precaution, delete this page also
-                  res = spiffs_page_delete(fs, cur_pix);
-                  SPIFFS_CHECK_RES(res);
-                  restart = 1;
-                }
-                fs->work[rpix_byte_ix] |= (1<<(rpix_bit_ix + 1));
-              }
-            }
-          } // for all index entries
-        } // found index
+  s32_t res = SPIFFS_OK;
+  u8_t restart = 0;
+  spiffs_page_ix objix_pix;
+  spiffs_page_ix rpix;
 
-        // next page
-        cur_pix++;
-      }
-      // next block
-      cur_block++;
-    }
-    // check consistency bitmap
-    if (!restart) {
-      spiffs_page_ix objix_pix;
-      spiffs_page_ix rpix;
+  u32_t byte_ix;
+  u8_t bit_ix;
+  for (byte_ix = 0; !restart && byte_ix < SPIFFS_CFG_LOG_PAGE_SZ(fs); byte_ix++) {
+    for (bit_ix = 0; !restart && bit_ix < 8/bits; bit_ix ++) {
+      u8_t bitmask = (fs->work[byte_ix] >> (bit_ix * bits)) & 0x7;
+      spiffs_page_ix cur_pix = pix_offset + byte_ix * (8/bits) + bit_ix;
 
-      u32_t byte_ix;
-      u8_t bit_ix;
-      for (byte_ix = 0; !restart && byte_ix < SPIFFS_CFG_LOG_PAGE_SZ(fs); byte_ix++) {
-        for (bit_ix = 0; !restart && bit_ix < 8/bits; bit_ix ++) {
-          u8_t bitmask = (fs->work[byte_ix] >> (bit_ix * bits)) & 0x7;
-          spiffs_page_ix cur_pix = pix_offset + byte_ix * (8/bits) + bit_ix;
+      // 000 ok - free, unreferenced, not index
 
-          // 000 ok - free, unreferenced, not index
+      if (bitmask == 0x1) {
 
-          if (bitmask == 0x1) {
+        // 001
+        SPIFFS_CHECK_DBG("PA: pix %04x USED, UNREFERENCED, not index\n", cur_pix);
 
-            // 001
-            SPIFFS_CHECK_DBG("PA: pix %04x USED, UNREFERENCED, not index\n", cur_pix);
+        u8_t rewrite_ix_to_this = 0;
+        u8_t delete_page = 0;
+        // check corresponding object index entry
+        spiffs_page_header p_hdr;
+        res = _spiffs_rd(fs, SPIFFS_OP_T_OBJ_LU2 | SPIFFS_OP_C_READ,
+            0, SPIFFS_PAGE_TO_PADDR(fs, cur_pix), sizeof(spiffs_page_header), (u8_t*)&p_hdr);
+        SPIFFS_CHECK_RES(res);
 
-            u8_t rewrite_ix_to_this = 0;
-            u8_t delete_page = 0;
-            // check corresponding object index entry
-            spiffs_page_header p_hdr;
+        res = spiffs_object_get_data_page_index_reference(fs, p_hdr.obj_id, p_hdr.span_ix,
+            &rpix, &objix_pix);
+        if (res == SPIFFS_OK) {
+          if (((rpix == (spiffs_page_ix)-1 || rpix > SPIFFS_MAX_PAGES(fs)) || (SPIFFS_IS_LOOKUP_PAGE(fs, rpix)))) {
+            // pointing to a bad page altogether, rewrite index to this
+            rewrite_ix_to_this = 1;
+            SPIFFS_CHECK_DBG("PA: corresponding ref is bad: %04x, rewrite to this %04x\n", rpix, cur_pix);
+          } else {
+            // pointing to something else, check what
+            spiffs_page_header rp_hdr;
             res = _spiffs_rd(fs, SPIFFS_OP_T_OBJ_LU2 | SPIFFS_OP_C_READ,
-                0, SPIFFS_PAGE_TO_PADDR(fs, cur_pix), sizeof(spiffs_page_header), (u8_t*)&p_hdr);
+                0, SPIFFS_PAGE_TO_PADDR(fs, rpix), sizeof(spiffs_page_header), (u8_t*)&rp_hdr);
             SPIFFS_CHECK_RES(res);
-
-            res = spiffs_object_get_data_page_index_reference(fs, p_hdr.obj_id, p_hdr.span_ix,
-                &rpix, &objix_pix);
-            if (res == SPIFFS_OK) {
-              if (((rpix == (spiffs_page_ix)-1 || rpix > SPIFFS_MAX_PAGES(fs)) || (SPIFFS_IS_LOOKUP_PAGE(fs, rpix)))) {
-                // pointing to a bad page altogether, rewrite index to this
+            if (((p_hdr.obj_id & ~SPIFFS_OBJ_ID_IX_FLAG) == rp_hdr.obj_id) &&
+                ((rp_hdr.flags & (SPIFFS_PH_FLAG_INDEX | SPIFFS_PH_FLAG_DELET | SPIFFS_PH_FLAG_USED | SPIFFS_PH_FLAG_FINAL)) ==
+                    (SPIFFS_PH_FLAG_INDEX | SPIFFS_PH_FLAG_DELET))) {
+              // pointing to something else valid, just delete this page then
+              SPIFFS_CHECK_DBG("PA: corresponding ref is good but different: %04x, delete this %04x\n", rpix, cur_pix);
+              delete_page = 1;
+            } else {
+              // pointing to something weird, update index to point to this page instead
+              if (rpix != cur_pix) {
+                SPIFFS_CHECK_DBG("PA: corresponding ref is weird: %04x %s%s%s%s, rewrite this %04x\n", rpix,
+                    (rp_hdr.flags & SPIFFS_PH_FLAG_INDEX) ? "" : "INDEX ",
+                        (rp_hdr.flags & SPIFFS_PH_FLAG_DELET) ? "" : "DELETED ",
+                            (rp_hdr.flags & SPIFFS_PH_FLAG_USED) ? "NOTUSED " : "",
+                                (rp_hdr.flags & SPIFFS_PH_FLAG_FINAL) ? "NOTFINAL " : "",
+                    cur_pix);
                 rewrite_ix_to_this = 1;
-                SPIFFS_CHECK_DBG("PA: corresponding ref is bad: %04x, rewrite to this %04x\n", rpix, cur_pix);
               } else {
-                // pointing to something else, check what
-                spiffs_page_header rp_hdr;
-                res = _spiffs_rd(fs, SPIFFS_OP_T_OBJ_LU2 | SPIFFS_OP_C_READ,
-                    0, SPIFFS_PAGE_TO_PADDR(fs, rpix), sizeof(spiffs_page_header), (u8_t*)&rp_hdr);
-                SPIFFS_CHECK_RES(res);
-                if (((p_hdr.obj_id & ~SPIFFS_OBJ_ID_IX_FLAG) == rp_hdr.obj_id) &&
-                    ((rp_hdr.flags & (SPIFFS_PH_FLAG_INDEX | SPIFFS_PH_FLAG_DELET | SPIFFS_PH_FLAG_USED | SPIFFS_PH_FLAG_FINAL)) ==
-                        (SPIFFS_PH_FLAG_INDEX | SPIFFS_PH_FLAG_DELET))) {
-                  // pointing to something else valid, just delete this page then
-                  SPIFFS_CHECK_DBG("PA: corresponding ref is good but different: %04x, delete this %04x\n", rpix, cur_pix);
-                  delete_page = 1;
-                } else {
-                  // pointing to something weird, update index to point to this page instead
-                  if (rpix != cur_pix) {
-                    SPIFFS_CHECK_DBG("PA: corresponding ref is weird: %04x %s%s%s%s, rewrite this %04x\n", rpix,
-                        (rp_hdr.flags & SPIFFS_PH_FLAG_INDEX) ? "" : "INDEX ",
-                            (rp_hdr.flags & SPIFFS_PH_FLAG_DELET) ? "" : "DELETED ",
-                                (rp_hdr.flags & SPIFFS_PH_FLAG_USED) ? "NOTUSED " : "",
-                                    (rp_hdr.flags & SPIFFS_PH_FLAG_FINAL) ? "NOTFINAL " : "",
-                        cur_pix);
-                    rewrite_ix_to_this = 1;
-                  } else {
-                    // should not happen, destined for fubar
-                  }
-                }
+                // should not happen, destined for fubar
               }
-            } else if (res == SPIFFS_ERR_NOT_FOUND) {
-              SPIFFS_CHECK_DBG("PA: corresponding ref not found, delete %04x\n", cur_pix);
-              delete_page = 1;
-              res = SPIFFS_OK;
             }
+          }
+        } else if (res == SPIFFS_ERR_NOT_FOUND) {
+          SPIFFS_CHECK_DBG("PA: corresponding ref not found, delete %04x\n", cur_pix);
+          delete_page = 1;
+          res = SPIFFS_OK;
+        }
 
-            if (rewrite_ix_to_this) {
-              // if pointing to invalid page, redirect index to this page
-              SPIFFS_CHECK_DBG("PA: FIXUP: rewrite index id %04x data spix %04x to point to this pix: %04x\n",
-                  p_hdr.obj_id, p_hdr.span_ix, cur_pix);
-              res = spiffs_rewrite_index(fs, p_hdr.obj_id, p_hdr.span_ix, cur_pix, objix_pix);
-              if (res <= _SPIFFS_ERR_CHECK_FIRST && res > _SPIFFS_ERR_CHECK_LAST) {
-                // index bad also, cannot mend this file
-                SPIFFS_CHECK_DBG("PA: FIXUP: index bad %i, cannot mend!\n", res);
-                CHECK_CB(fs, SPIFFS_CHECK_PAGE, SPIFFS_CHECK_DELETE_BAD_FILE, p_hdr.obj_id, 0);
-                res = spiffs_page_delete(fs, cur_pix);
-                SPIFFS_CHECK_RES(res);
-                res = spiffs_delete_obj_lazy(fs, p_hdr.obj_id);
-              } else {
-                CHECK_CB(fs, SPIFFS_CHECK_PAGE, SPIFFS_CHECK_FIX_INDEX, p_hdr.obj_id, p_hdr.span_ix);
-              }
-              SPIFFS_CHECK_RES(res);
-              restart = 1;
-              continue;
-            } else if (delete_page) {
-              SPIFFS_CHECK_DBG("PA: FIXUP: deleting page %04x\n", cur_pix);
-              CHECK_CB(fs, SPIFFS_CHECK_PAGE, SPIFFS_CHECK_DELETE_PAGE, cur_pix, 0);
-              res = spiffs_page_delete(fs, cur_pix);
-            }
+        if (rewrite_ix_to_this) {
+          // if pointing to invalid page, redirect index to this page
+          SPIFFS_CHECK_DBG("PA: FIXUP: rewrite index id %04x data spix %04x to point to this pix: %04x\n",
+              p_hdr.obj_id, p_hdr.span_ix, cur_pix);
+          res = spiffs_rewrite_index(fs, p_hdr.obj_id, p_hdr.span_ix, cur_pix, objix_pix);
+          if (res <= _SPIFFS_ERR_CHECK_FIRST && res > _SPIFFS_ERR_CHECK_LAST) {
+            // index bad also, cannot mend this file
+            SPIFFS_CHECK_DBG("PA: FIXUP: index bad %i, cannot mend!\n", res);
+            CHECK_CB(fs, SPIFFS_CHECK_PAGE, SPIFFS_CHECK_DELETE_BAD_FILE, p_hdr.obj_id, 0);
+            res = spiffs_page_delete(fs, cur_pix);
             SPIFFS_CHECK_RES(res);
+            res = spiffs_delete_obj_lazy(fs, p_hdr.obj_id);
+          } else {
+            CHECK_CB(fs, SPIFFS_CHECK_PAGE, SPIFFS_CHECK_FIX_INDEX, p_hdr.obj_id, p_hdr.span_ix);
           }
-          if (bitmask == 0x2) {
+          SPIFFS_CHECK_RES(res);
+          restart = 1;
+          continue;
+        } else if (delete_page) {
+          SPIFFS_CHECK_DBG("PA: FIXUP: deleting page %04x\n", cur_pix);
+          CHECK_CB(fs, SPIFFS_CHECK_PAGE, SPIFFS_CHECK_DELETE_PAGE, cur_pix, 0);
+          res = spiffs_page_delete(fs, cur_pix);
+        }
+        SPIFFS_CHECK_RES(res);
+      }
+      if (bitmask == 0x2) {
 
-            // 010
-            SPIFFS_CHECK_DBG("PA: pix %04x FREE, REFERENCED, not index\n", cur_pix);
+        // 010
+        SPIFFS_CHECK_DBG("PA: pix %04x FREE, REFERENCED, not index\n", cur_pix);
 
-            // no op, this should be taken care of when checking valid references
-          }
+        // no op, this should be taken care of when checking valid references
+      }
 
-          // 011 ok - busy, referenced, not index
+      // 011 ok - busy, referenced, not index
 
-          if (bitmask == 0x4) {
+      if (bitmask == 0x4) {
 
-            // 100
-            SPIFFS_CHECK_DBG("PA: pix %04x FREE, unreferenced, INDEX\n", cur_pix);
+        // 100
+        SPIFFS_CHECK_DBG("PA: pix %04x FREE, unreferenced, INDEX\n", cur_pix);
 
-            // this should never happen, major fubar
-          }
+        // this should never happen, major fubar
+      }
 
-          // 101 ok - busy, unreferenced, index
+      // 101 ok - busy, unreferenced, index
 
-          if (bitmask == 0x6) {
+      if (bitmask == 0x6) {
 
-            // 110
-            SPIFFS_CHECK_DBG("PA: pix %04x FREE, REFERENCED, INDEX\n", cur_pix);
+        // 110
+        SPIFFS_CHECK_DBG("PA: pix %04x FREE, REFERENCED, INDEX\n", cur_pix);
 
-            // no op, this should be taken care of when checking valid references
-          }
-          if (bitmask == 0x7) {
+        // no op, this should be taken care of when checking valid references
+      }
+      if (bitmask == 0x7) {
 
-            // 111
-            SPIFFS_CHECK_DBG("PA: pix %04x USED, REFERENCED, INDEX\n", cur_pix);
+        // 111
+        SPIFFS_CHECK_DBG("PA: pix %04x USED, REFERENCED, INDEX\n", cur_pix);
 
-            // no op, this should be taken care of when checking valid references
-          }
-        }
+        // no op, this should be taken care of when checking valid references
       }
     }
-
-    SPIFFS_CHECK_DBG("PA: processed %04x, restart %i\n", pix_offset, restart);
-    // next page range
-    if (!restart) {
-      pix_offset += pages_per_scan;
-    }
-  } // while page range not reached end
-  return res;
-}
-
-// Checks consistency amongst all pages and fixes irregularities
-s32_t spiffs_page_consistency_check(spiffs *fs) {
-  CHECK_CB(fs, SPIFFS_CHECK_PAGE, SPIFFS_CHECK_PROGRESS, 0, 0);
-  s32_t res = spiffs_page_consistency_check_i(fs);
-  if (res != SPIFFS_OK) {
-    CHECK_CB(fs, SPIFFS_CHECK_PAGE, SPIFFS_CHECK_ERROR, res, 0);
   }
-  CHECK_CB(fs, SPIFFS_CHECK_PAGE, SPIFFS_CHECK_PROGRESS, 256, 0);
+  *restart_p = restart;
   return res;
 }
 
+
 //---------------------------------------
 // Object index consistency
 
@@ -966,30 +941,250 @@ static s32_t spiffs_object_index_consistency_check_v(spiffs *fs, spiffs_obj_id o
   return res_c;
 }
 
-// Removes orphaned and partially deleted index pages.
+// Removes orphaned and partially deleted index pages in block bix.
 // Scans for index pages. When an index page is found, corresponding index header is searched for.
 // If no such page exists, the index page cannot be reached as no index header exists and must be
 // deleted.
-s32_t spiffs_object_index_consistency_check(spiffs *fs) {
-  s32_t res = SPIFFS_OK;
-  // impl note:
-  // fs->work is used for a temporary object index memory, listing found object ids and
-  // indicating whether they can be reached or not. Acting as a fifo if object ids cannot fit.
-  // In the temporary object index memory, SPIFFS_OBJ_ID_IX_FLAG bit is used to indicate
-  // a reachable/unreachable object id.
-  memset(fs->work, 0, SPIFFS_CFG_LOG_PAGE_SZ(fs));
-  u32_t obj_id_log_ix = 0;
-  CHECK_CB(fs, SPIFFS_CHECK_INDEX, SPIFFS_CHECK_PROGRESS, 0, 0);
-  res = spiffs_obj_lu_find_entry_visitor(fs, 0, 0, 0, 0, spiffs_object_index_consistency_check_v, 0, &obj_id_log_ix,
-        0, 0);
+// impl note:
+// fs->work is used for a temporary object index memory, listing found object ids and
+// indicating whether they can be reached or not. Acting as a fifo if object ids cannot fit.
+// In the temporary object index memory, SPIFFS_OBJ_ID_IX_FLAG bit is used to indicate
+// a reachable/unreachable object id. *obj_id_log_ix is the next entry of the fifo.
+static s32_t spiffs_object_index_consistency_check_block(spiffs *fs, spiffs_block_ix bix,
+    u32_t *obj_id_log_ix) {
+  s32_t res = spiffs_obj_lu_find_entry_visitor(fs, bix, 0, SPIFFS_VIS_ONE_BLOCK, 0,
+      spiffs_object_index_consistency_check_v, 0, obj_id_log_ix, 0, 0);
   if (res == SPIFFS_VIS_END) {
     res = SPIFFS_OK;
   }
-  if (res != SPIFFS_OK) {
-    CHECK_CB(fs, SPIFFS_CHECK_INDEX, SPIFFS_CHECK_ERROR, res, 0);
+  return res;
+}
+
+// What the final scan has counted in the blocks before check_block, kept in
+// fs->work. The file system statistics are only set from it at the end, as
+// they are kept up to date by the use of the file system between units.
+typedef struct {
+  u32_t free_blocks;
+  u32_t p_allocated;
+  u32_t p_deleted;
+  spiffs_obj_id erase_count_min;
+  spiffs_obj_id erase_count_max;
+  u8_t lu_index_full;
+} spiffs_check_scan;
+
+static s32_t spiffs_check_scan_v(spiffs *fs, spiffs_obj_id obj_id, spiffs_block_ix bix, int ix_entry,
+    const void *user_const_p, void *user_var_p) {
+  (void)fs;
+  (void)bix;
+  (void)user_const_p;
+  spiffs_check_scan *scan = (spiffs_check_scan *)user_var_p;
+  if (obj_id == SPIFFS_OBJ_ID_FREE) {
+    if (ix_entry == 0) {
+      scan->free_blocks++;
+    }
+  } else if (obj_id == SPIFFS_OBJ_ID_DELETED) {
+    scan->p_deleted++;
+  } else {
+    scan->p_allocated++;
+  }
+  return SPIFFS_VIS_COUNTINUE;
+}
+
+// Counts the pages of block bix and reads its erase count, as spiffs_obj_lu_scan
+// does for all blocks at mount, and adds its objects to the lookup index. The
+// mount has already dealt with a block left unerased, so the magic is not
+// checked.
+static s32_t spiffs_check_scan_block(spiffs *fs, spiffs_block_ix bix) {
+  spiffs_check_scan *scan = (spiffs_check_scan *)fs->work;
+  spiffs_obj_id erase_count;
+  s32_t res;
+  if (bix == 0) {
+    memset(scan, 0, sizeof(spiffs_check_scan));
+    scan->erase_count_min = SPIFFS_OBJ_ID_FREE;
+#if SPIFFS_LU_INDEX
+    memset(fs->lu_index, 0, sizeof(fs->lu_index));
+    fs->lu_index_complete = 0;
+#endif
+  }
+  res = _spiffs_rd(fs, SPIFFS_OP_T_OBJ_LU2 | SPIFFS_OP_C_READ,
+      0, SPIFFS_ERASE_COUNT_PADDR(fs, bix), sizeof(spiffs_obj_id), (u8_t *)&erase_count);
+  SPIFFS_CHECK_RES(res);
+  if (erase_count != SPIFFS_OBJ_ID_FREE) {
+    scan->erase_count_min = MIN(scan->erase_count_min, erase_count);
+    scan->erase_count_max = MAX(scan->erase_count_max, erase_count);
+  }
+  res = spiffs_obj_lu_find_entry_visitor(fs, bix, 0, SPIFFS_VIS_ONE_BLOCK, 0,
+      spiffs_check_scan_v, 0, scan, 0, 0);
+  if (res == SPIFFS_VIS_END) {
+    res = SPIFFS_OK;
   }
-  CHECK_CB(fs, SPIFFS_CHECK_INDEX, SPIFFS_CHECK_PROGRESS, 256, 0);
+  SPIFFS_CHECK_RES(res);
+#if SPIFFS_LU_INDEX
+  res = spiffs_lu_index_build_block(fs, bix, &scan->lu_index_full);
+  SPIFFS_CHECK_RES(res);
+#endif
   return res;
 }
 
+// Sets the file system statistics from the scan of all blocks
+static void spiffs_check_scan_end(spiffs *fs) {
+  spiffs_check_scan *scan = (spiffs_check_scan *)fs->work;
+  fs->free_blocks = scan->free_blocks;
+  fs->stats_p_allocated = scan->p_allocated;
+  fs->stats_p_deleted = scan->p_deleted;
+  fs->max_erase_count = spiffs_obj_lu_erase_count_next(scan->erase_count_min, scan->erase_count_max);
+#if SPIFFS_LU_INDEX
+  fs->lu_index_complete = !scan->lu_index_full;
+#endif
+}
+
+//---------------------------------------
+// Stepping
+
+// The check is done in units: a block of the look up check, a block of the object
+// index check, a block of a range of pages of the page check or the check of the
+// bitmap of the range, and a block of the final scan. The state between units is
+// in fs.
+
+static spiffs_check_type spiffs_check_phase_type(u8_t phase) {
+  switch (phase) {
+  case SPIFFS_CHECK_PHASE_LOOKUP: return SPIFFS_CHECK_LOOKUP;
+  case SPIFFS_CHECK_PHASE_INDEX: return SPIFFS_CHECK_INDEX;
+  default: return SPIFFS_CHECK_PAGE;
+  }
+}
+
+static void spiffs_check_phase_begin(spiffs *fs, u8_t phase) {
+  fs->check_phase = phase;
+  fs->check_block = 0;
+  fs->check_pix_offset = 0;
+  fs->check_obj_id_log_ix = 0;
+  memset(fs->work, 0, SPIFFS_CFG_LOG_PAGE_SZ(fs));
+  if (phase != SPIFFS_CHECK_PHASE_SCAN) {
+    CHECK_CB(fs, spiffs_check_phase_type(phase), SPIFFS_CHECK_PROGRESS, 0, 0);
+  }
+}
+
+// ends the current phase, reporting res if it failed, and begins the next one
+static void spiffs_check_phase_end(spiffs *fs, s32_t res) {
+  spiffs_check_type type = spiffs_check_phase_type(fs->check_phase);
+  if (res != SPIFFS_OK) {
+    CHECK_CB(fs, type, SPIFFS_CHECK_ERROR, res, 0);
+  }
+  CHECK_CB(fs, type, SPIFFS_CHECK_PROGRESS, 256, 0);
+  spiffs_check_phase_begin(fs, fs->check_phase + 1);
+}
+
+void spiffs_check_begin(spiffs *fs) {
+#if SPIFFS_LU_INDEX
+  // the checks must see the object lookup as it is on the medium
+  memset(fs->lu_index, 0, sizeof(fs->lu_index));
+  fs->lu_index_complete = 0;
+#endif
+  fs->check_disturbed = 0;
+  spiffs_check_phase_begin(fs, SPIFFS_CHECK_PHASE_LOOKUP);
+}
+
+s32_t spiffs_check_step(spiffs *fs) {
+  const spiffs_page_ix pages_per_scan = SPIFFS_CFG_LOG_PAGE_SZ(fs) * 8 / 4;
+  s32_t res = SPIFFS_OK;
+  u8_t restart = 0;
+  u8_t range_done = 0;
+
+  if (fs->check_disturbed) {
+    // fs->work was used by others since the last unit, and the pages may have changed
+    fs->check_disturbed = 0;
+    if (fs->check_phase == SPIFFS_CHECK_PHASE_INDEX) {
+      // forget the object ids seen, they are looked up again
+      memset(fs->work, 0, SPIFFS_CFG_LOG_PAGE_SZ(fs));
+      fs->check_obj_id_log_ix = 0;
+    } else if (fs->check_phase == SPIFFS_CHECK_PHASE_PAGE) {
+      // build the bitmap of the current range again
+      memset(fs->work, 0, SPIFFS_CFG_LOG_PAGE_SZ(fs));
+      fs->check_block = 0;
+    } else if (fs->check_phase == SPIFFS_CHECK_PHASE_SCAN) {
+      // count from the first block again
+      fs->check_block = 0;
+    }
+  }
+
+  switch (fs->check_phase) {
+  case SPIFFS_CHECK_PHASE_LOOKUP:
+    res = spiffs_lookup_consistency_check_block(fs, fs->check_block);
+    if (res != SPIFFS_OK || ++fs->check_block >= fs->block_count) {
+      spiffs_check_phase_end(fs, res);
+    }
+    break;
+  case SPIFFS_CHECK_PHASE_INDEX:
+    res = spiffs_object_index_consistency_check_block(fs, fs->check_block, &fs->check_obj_id_log_ix);
+    if (res != SPIFFS_OK || ++fs->check_block >= fs->block_count) {
+      spiffs_check_phase_end(fs, res);
+    }
+    break;
+  case SPIFFS_CHECK_PHASE_PAGE:
+    if (fs->check_block < fs->block_count) {
+      res = spiffs_page_consistency_check_block(fs, fs->check_pix_offset, fs->check_block, &restart);
+      fs->check_block++;
+    } else {
+      res = spiffs_page_consistency_check_bitmap(fs, fs->check_pix_offset, &restart);
+      range_done = 1;
+    }
+    if (res == SPIFFS_OK && (restart || range_done)) {
+      SPIFFS_CHECK_DBG("PA: processed %04x, restart %i\n", fs->check_pix_offset, restart);
+      // next page range
+      if (!restart) {
+        fs->check_pix_offset += pages_per_scan;
+      }
+      fs->check_block = 0;
+      memset(fs->work, 0, SPIFFS_CFG_LOG_PAGE_SZ(fs));
+    }
+    if (res != SPIFFS_OK ||
+        fs->check_pix_offset >= SPIFFS_PAGES_PER_BLOCK(fs) * fs->block_count) {
+      spiffs_check_phase_end(fs, res);
+    }
+    break;
+  case SPIFFS_CHECK_PHASE_SCAN:
+    res = spiffs_check_scan_block(fs, fs->check_block);
+    if (res != SPIFFS_OK) {
+      fs->check_phase = SPIFFS_CHECK_PHASE_NONE;
+      return res;
+    }
+    if (++fs->check_block >= fs->block_count) {
+      spiffs_check_scan_end(fs);
+      fs->check_phase = SPIFFS_CHECK_PHASE_NONE;
+      return SPIFFS_OK;
+    }
+    break;
+  default:
+    return SPIFFS_OK;
+  }
+  return 1;
+}
+
+u8_t spiffs_check_progress(spiffs *fs) {
+  const spiffs_page_ix pages_per_scan = SPIFFS_CFG_LOG_PAGE_SZ(fs) * 8 / 4;
+  u32_t ranges = (SPIFFS_PAGES_PER_BLOCK(fs) * fs->block_count + pages_per_scan - 1) / pages_per_scan;
+  u32_t units = 3 * fs->block_count + ranges * (fs->block_count + 1);
+  u32_t done;
+  switch (fs->check_phase) {
+  case SPIFFS_CHECK_PHASE_LOOKUP:
+    done = fs->check_block;
+    break;
+  case SPIFFS_CHECK_PHASE_INDEX:
+    done = fs->block_count + fs->check_block;
+    break;
+  case SPIFFS_CHECK_PHASE_PAGE:
+    done = 2 * fs->block_count + (fs->check_pix_offset / pages_per_scan) * (fs->block_count + 1) +
+        fs->check_block;
+    break;
+  case SPIFFS_CHECK_PHASE_SCAN:
+    done = 2 * fs->block_count + ranges * (fs->block_count + 1) + fs->check_block;
+    break;
+  default:
+    done = units - 1;
+    break;
+  }
+  return 1 + (done * 254) / units;
+}
+
 #endif // !SPIFFS_READ_ONLY
@@ -195,6 +195,53 @@ s32_t spiffs_gc_check(
   return res;
 }
 
+// Performs one bounded unit of garbage collection: erases a fully deleted block
+// if there is one, else cleans and erases the best candidate block. Meant to be
+// called repeatedly from idle time so that spiffs_gc_check rarely has to run
+// in the write path. Returns SPIFFS_ERR_NO_DELETED_BLOCKS if there is nothing
+// worth collecting.
+s32_t spiffs_gc_step(
+    spiffs *fs) {
+  s32_t res;
+  spiffs_block_ix *cands;
+  int count;
+  spiffs_block_ix cand;
+
+  if (fs->stats_p_deleted == 0) {
+    return SPIFFS_ERR_NO_DELETED_BLOCKS;
+  }
+
+  res = spiffs_gc_quick(fs, 0);
+  if (res != SPIFFS_ERR_NO_DELETED_BLOCKS) {
+    return res;
+  }
+#if SPIFFS_GC_STATS
+  // nothing was erased, do not count the quick scan as a run
+  fs->stats_gc_runs--;
+#endif
+
+  res = spiffs_gc_find_candidate(fs, &cands, &count, 0);
+  SPIFFS_CHECK_RES(res);
+  if (count == 0) {
+    SPIFFS_GC_DBG("gc_step: no candidates\n");
+    return SPIFFS_ERR_NO_DELETED_BLOCKS;
+  }
+#if SPIFFS_GC_STATS
+  fs->stats_gc_runs++;
+#endif
+  cand = cands[0];
+  fs->cleaning = 1;
+  res = spiffs_gc_clean(fs, cand);
+  fs->cleaning = 0;
+  SPIFFS_GC_DBG("gc_step: cleaning block %i, result %i\n", cand, res);
+  SPIFFS_CHECK_RES(res);
+
+  res = spiffs_gc_erase_page_stats(fs, cand);
+  SPIFFS_CHECK_RES(res);
+
+  return spiffs_gc_erase_block(fs, cand);
+}
+
 // Updates page statistics for a block that is about to be erased
 s32_t spiffs_gc_erase_page_stats(
     spiffs *fs,
@@ -448,6 +495,9 @@ s32_t spiffs_gc_clean(spiffs *fs, spiffs_block_ix bix) {
                 res = spiffs_page_move(fs, 0, 0, obj_id, &p_hdr, cur_pix, &new_data_pix);
                 SPIFFS_GC_DBG("gc_clean: MOVE_DATA move objix %04x:%04x page %04x to %04x\n", gc.cur_obj_id, p_hdr.span_ix, cur_pix, new_data_pix);
                 SPIFFS_CHECK_RES(res);
+#if SPIFFS_GC_STATS
+                fs->stats_gc_pages_moved++;
+#endif
                 // move wipes obj_lu, reload it
                 res = _spiffs_rd(fs, SPIFFS_OP_T_OBJ_LU | SPIFFS_OP_C_READ,
                     0, bix * SPIFFS_CFG_LOG_BLOCK_SZ(fs) + SPIFFS_PAGE_TO_PADDR(fs, obj_lookup_page),
@@ -491,6 +541,9 @@ s32_t spiffs_gc_clean(spiffs *fs, spiffs_block_ix bix) {
               res = spiffs_page_move(fs, 0, 0, obj_id, &p_hdr, cur_pix, &new_pix);
               SPIFFS_GC_DBG("gc_clean: MOVE_OBJIX move objix %04x:%04x page %04x to %04x\n", obj_id, p_hdr.span_ix, cur_pix, new_pix);
               SPIFFS_CHECK_RES(res);
+#if SPIFFS_GC_STATS
+              fs->stats_gc_pages_moved++;
+#endif
               spiffs_cb_object_event(fs, (spiffs_page_object_ix *)&p_hdr,
                   SPIFFS_EV_IX_MOV, obj_id, p_hdr.span_ix, new_pix, 0);
               // move wipes obj_lu, reload it
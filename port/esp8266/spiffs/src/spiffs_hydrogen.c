@@ -75,10 +75,11 @@ s32_t SPIFFS_probe_fs(spiffs_config *config) {
 
 #endif // SPIFFS_USE_MAGIC && SPIFFS_USE_MAGIC_LENGTH && SPIFFS_SINGLETON==0
 
-s32_t SPIFFS_mount(spiffs *fs, spiffs_config *config, u8_t *work,
+static s32_t spiffs_mount(spiffs *fs, spiffs_config *config, u8_t *work,
     u8_t *fd_space, u32_t fd_space_size,
     void *cache, u32_t cache_size,
-    spiffs_check_callback check_cb_f) {
+    spiffs_check_callback check_cb_f,
+    const void *state) {
   void *user_data;
   SPIFFS_LOCK(fs);
   user_data = fs->user_data;
@@ -126,8 +127,32 @@ s32_t SPIFFS_mount(spiffs *fs, spiffs_config *config, u8_t *work,
 
   fs->config_magic = SPIFFS_CONFIG_MAGIC;
 
-  res = spiffs_obj_lu_scan(fs);
-  SPIFFS_API_CHECK_RES_UNLOCK(fs, res);
+#if SPIFFS_MOUNT_STATE
+  if (state) {
+    const spiffs_mount_state *st = (const spiffs_mount_state *)state;
+    fs->free_blocks = st->free_blocks;
+    fs->stats_p_allocated = st->stats_p_allocated;
+    fs->stats_p_deleted = st->stats_p_deleted;
+    fs->free_cursor_block_ix = st->free_cursor_block_ix;
+    fs->free_cursor_obj_lu_entry = st->free_cursor_obj_lu_entry;
+    fs->max_erase_count = st->max_erase_count;
+#if SPIFFS_LU_INDEX
+    memcpy(fs->lu_index, st->lu_index, sizeof(fs->lu_index));
+    fs->lu_index_complete = st->lu_index_complete;
+#endif
+  } else
+#else
+  (void)state;
+#endif
+  {
+    res = spiffs_obj_lu_scan(fs);
+    SPIFFS_API_CHECK_RES_UNLOCK(fs, res);
+
+#if SPIFFS_LU_INDEX
+    res = spiffs_lu_index_build(fs);
+    SPIFFS_API_CHECK_RES_UNLOCK(fs, res);
+#endif
+  }
 
   SPIFFS_DBG("page index byte len:         %i\n", SPIFFS_CFG_LOG_PAGE_SZ(fs));
   SPIFFS_DBG("object lookup pages:         %i\n", SPIFFS_OBJ_LOOKUP_PAGES(fs));
@@ -147,6 +172,39 @@ s32_t SPIFFS_mount(spiffs *fs, spiffs_config *config, u8_t *work,
   return 0;
 }
 
+s32_t SPIFFS_mount(spiffs *fs, spiffs_config *config, u8_t *work,
+    u8_t *fd_space, u32_t fd_space_size,
+    void *cache, u32_t cache_size,
+    spiffs_check_callback check_cb_f) {
+  return spiffs_mount(fs, config, work, fd_space, fd_space_size,
+      cache, cache_size, check_cb_f, 0);
+}
+
+#if SPIFFS_MOUNT_STATE
+s32_t SPIFFS_mount_from_state(spiffs *fs, spiffs_config *config, u8_t *work,
+    u8_t *fd_space, u32_t fd_space_size,
+    void *cache, u32_t cache_size,
+    spiffs_check_callback check_cb_f,
+    const spiffs_mount_state *state) {
+  return spiffs_mount(fs, config, work, fd_space, fd_space_size,
+      cache, cache_size, check_cb_f, state);
+}
+
+void SPIFFS_get_mount_state(spiffs *fs, spiffs_mount_state *state) {
+  memset(state, 0, sizeof(*state));
+  state->free_blocks = fs->free_blocks;
+  state->stats_p_allocated = fs->stats_p_allocated;
+  state->stats_p_deleted = fs->stats_p_deleted;
+  state->free_cursor_block_ix = fs->free_cursor_block_ix;
+  state->free_cursor_obj_lu_entry = fs->free_cursor_obj_lu_entry;
+  state->max_erase_count = fs->max_erase_count;
+#if SPIFFS_LU_INDEX
+  memcpy(state->lu_index, fs->lu_index, sizeof(state->lu_index));
+  state->lu_index_complete = fs->lu_index_complete;
+#endif
+}
+#endif
+
 void SPIFFS_unmount(spiffs *fs) {
   if (!SPIFFS_CHECK_CFG(fs) || !SPIFFS_CHECK_MOUNT(fs)) return;
   SPIFFS_LOCK(fs);
@@ -963,6 +1021,83 @@ struct spiffs_dirent *SPIFFS_readdir(spiffs_DIR *d, struct spiffs_dirent *e) {
   return ret;
 }
 
+typedef struct {
+  spiffs_list_callback cb;
+  void *user;
+  s32_t count;
+} spiffs_list_state;
+
+// Pages taken by the index and data pages of an object of given size
+static u32_t spiffs_obj_pages(spiffs *fs, u32_t size) {
+  u32_t data_pages = (size + SPIFFS_DATA_PAGE_SIZE(fs) - 1) / SPIFFS_DATA_PAGE_SIZE(fs);
+  u32_t ix_pages = 1;
+  if (data_pages > SPIFFS_OBJ_HDR_IX_LEN(fs)) {
+    ix_pages += (data_pages - SPIFFS_OBJ_HDR_IX_LEN(fs) + SPIFFS_OBJ_IX_LEN(fs) - 1) /
+        SPIFFS_OBJ_IX_LEN(fs);
+  }
+  return ix_pages + data_pages;
+}
+
+static s32_t spiffs_list_v(
+    spiffs *fs,
+    spiffs_obj_id obj_id,
+    spiffs_block_ix bix,
+    int ix_entry,
+    const void *user_const_p,
+    void *user_var_p) {
+  (void)user_const_p;
+  spiffs_list_state *state = (spiffs_list_state *)user_var_p;
+  struct spiffs_dirent e;
+  s32_t res = spiffs_read_dir_v(fs, obj_id, bix, ix_entry, 0, &e);
+  if (res != SPIFFS_OK) return res;
+  res = state->cb(fs, &e, spiffs_obj_pages(fs, e.size), state->user);
+  if (res != SPIFFS_OK) return res;
+  state->count++;
+  return SPIFFS_VIS_COUNTINUE;
+}
+
+s32_t SPIFFS_list(spiffs_DIR *d, spiffs_list_callback cb, void *user) {
+  SPIFFS_API_CHECK_CFG(d->fs);
+  if (!SPIFFS_CHECK_MOUNT(d->fs)) {
+    d->fs->err_code = SPIFFS_ERR_NOT_MOUNTED;
+    return SPIFFS_ERR_NOT_MOUNTED;
+  }
+  if (d->block >= d->fs->block_count) {
+    return 0;
+  }
+  SPIFFS_LOCK(d->fs);
+
+  spiffs_block_ix bix;
+  int entry;
+  s32_t res;
+  spiffs_list_state state = { .cb = cb, .user = user, .count = 0 };
+
+  res = spiffs_obj_lu_find_entry_visitor(d->fs,
+      d->block,
+      d->entry,
+      SPIFFS_VIS_NO_WRAP,
+      0,
+      spiffs_list_v,
+      0,
+      &state,
+      &bix,
+      &entry);
+  if (res == SPIFFS_VIS_END) {
+    d->block = d->fs->block_count;
+    d->entry = 0;
+    res = state.count;
+  } else if (res > 0) {
+    // stopped by the callback before this file
+    d->block = bix;
+    d->entry = entry;
+    res = state.count;
+  } else {
+    d->fs->err_code = res;
+  }
+  SPIFFS_UNLOCK(d->fs);
+  return res;
+}
+
 s32_t SPIFFS_closedir(spiffs_DIR *d) {
   SPIFFS_API_CHECK_CFG(d->fs);
   SPIFFS_API_CHECK_MOUNT(d->fs);
@@ -979,13 +1114,53 @@ s32_t SPIFFS_check(spiffs *fs) {
   SPIFFS_API_CHECK_MOUNT(fs);
   SPIFFS_LOCK(fs);
 
-  res = spiffs_lookup_consistency_check(fs, 0);
+  spiffs_check_begin(fs);
+  do {
+    res = spiffs_check_step(fs);
+  } while (res > 0);
 
-  res = spiffs_object_index_consistency_check(fs);
+  SPIFFS_UNLOCK(fs);
+  return res;
+#endif // SPIFFS_READ_ONLY
+}
 
-  res = spiffs_page_consistency_check(fs);
+s32_t SPIFFS_check_step(spiffs *fs, u32_t budget_us) {
+#if SPIFFS_READ_ONLY
+  (void)fs; (void)budget_us;
+  return SPIFFS_ERR_RO_NOT_IMPL;
+#else
+  s32_t res;
+  SPIFFS_API_CHECK_CFG(fs);
+  // not SPIFFS_API_CHECK_MOUNT, the check does not disturb itself
+  if (!SPIFFS_CHECK_MOUNT(fs)) {
+    fs->err_code = SPIFFS_ERR_NOT_MOUNTED;
+    return SPIFFS_ERR_NOT_MOUNTED;
+  }
+  SPIFFS_LOCK(fs);
 
-  res = spiffs_obj_lu_scan(fs);
+  if (fs->check_phase == SPIFFS_CHECK_PHASE_NONE) {
+    spiffs_check_begin(fs);
+  }
+#ifdef SPIFFS_CHECK_TIME_US
+  u32_t start = SPIFFS_CHECK_TIME_US();
+  do {
+    res = spiffs_check_step(fs);
+  } while (res > 0 && (u32_t)(SPIFFS_CHECK_TIME_US() - start) < budget_us);
+#else
+  (void)budget_us;
+  res = spiffs_check_step(fs);
+#endif
+  if (res > 0) {
+    res = spiffs_check_progress(fs);
+#if SPIFFS_LU_INDEX
+    // the objects in the index may have been mended or deleted since, but
+    // the final scan builds it again from what it has left
+    if (fs->check_phase != SPIFFS_CHECK_PHASE_SCAN) {
+      memset(fs->lu_index, 0, sizeof(fs->lu_index));
+      fs->lu_index_complete = 0;
+    }
+#endif
+  }
 
   SPIFFS_UNLOCK(fs);
   return res;
@@ -1035,6 +1210,25 @@ s32_t SPIFFS_gc_quick(spiffs *fs, u16_t max_free_pages) {
 }
 
 
+s32_t SPIFFS_gc_step(spiffs *fs) {
+#if SPIFFS_READ_ONLY
+  (void)fs;
+  return SPIFFS_ERR_RO_NOT_IMPL;
+#else
+  s32_t res;
+  SPIFFS_API_CHECK_CFG(fs);
+  SPIFFS_API_CHECK_MOUNT(fs);
+  SPIFFS_LOCK(fs);
+
+  res = spiffs_gc_step(fs);
+
+  SPIFFS_API_CHECK_RES_UNLOCK(fs, res);
+  SPIFFS_UNLOCK(fs);
+  return 0;
+#endif // SPIFFS_READ_ONLY
+}
+
+
 s32_t SPIFFS_gc(spiffs *fs, u32_t size) {
 #if SPIFFS_READ_ONLY
   (void)fs; (void)size;
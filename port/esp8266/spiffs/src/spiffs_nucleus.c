@@ -203,6 +203,10 @@ s32_t spiffs_obj_lu_find_entry_visitor(
       } // per entry
       obj_lookup_page++;
     } // per object lookup page
+    if (flags & SPIFFS_VIS_ONE_BLOCK) {
+      SPIFFS_CHECK_RES(res);
+      return SPIFFS_VIS_END;
+    }
     cur_entry = 0;
     cur_block++;
     cur_block_addr += SPIFFS_CFG_LOG_BLOCK_SZ(fs);
@@ -342,6 +346,22 @@ static s32_t spiffs_obj_lu_scan_v(
 }
 
 
+// Erase count for the next block erased, from the smallest and largest
+// erase counts found in the blocks
+spiffs_obj_id spiffs_obj_lu_erase_count_next(
+    spiffs_obj_id erase_count_min,
+    spiffs_obj_id erase_count_max) {
+  if (erase_count_min == 0 && erase_count_max == SPIFFS_OBJ_ID_FREE) {
+    // clean system, set counter to zero
+    return 0;
+  } else if (erase_count_max - erase_count_min > (SPIFFS_OBJ_ID_FREE)/2) {
+    // wrap, take min
+    return erase_count_min+1;
+  } else {
+    return erase_count_max+1;
+  }
+}
+
 // Scans thru all obj lu and counts free, deleted and used pages
 // Find the maximum block erase count
 // Checks magic if enabled
@@ -357,7 +377,6 @@ s32_t spiffs_obj_lu_scan(
   // find out erase count
   // if enabled, check magic
   bix = 0;
-  spiffs_obj_id erase_count_final;
   spiffs_obj_id erase_count_min = SPIFFS_OBJ_ID_FREE;
   spiffs_obj_id erase_count_max = 0;
   while (bix < fs->block_count) {
@@ -392,17 +411,7 @@ s32_t spiffs_obj_lu_scan(
     bix++;
   }
 
-  if (erase_count_min == 0 && erase_count_max == SPIFFS_OBJ_ID_FREE) {
-    // clean system, set counter to zero
-    erase_count_final = 0;
-  } else if (erase_count_max - erase_count_min > (SPIFFS_OBJ_ID_FREE)/2) {
-    // wrap, take min
-    erase_count_final = erase_count_min+1;
-  } else {
-    erase_count_final = erase_count_max+1;
-  }
-
-  fs->max_erase_count = erase_count_final;
+  fs->max_erase_count = spiffs_obj_lu_erase_count_next(erase_count_min, erase_count_max);
 
 #if SPIFFS_USE_MAGIC
   if (unerased_bix != (spiffs_block_ix)-1) {
@@ -534,6 +543,15 @@ s32_t spiffs_obj_lu_find_id_and_span(
   spiffs_block_ix bix;
   int entry;
 
+#if SPIFFS_LU_INDEX
+  if ((obj_id & SPIFFS_OBJ_ID_IX_FLAG) && spix == 0) {
+    res = spiffs_lu_index_find_id(fs, obj_id, exclusion_pix, pix);
+    if (res != SPIFFS_VIS_COUNTINUE) {
+      return res;
+    }
+  }
+#endif
+
   res = spiffs_obj_lu_find_entry_visitor(fs,
       fs->cursor_block_ix,
       fs->cursor_obj_lu_entry,
@@ -1077,6 +1095,12 @@ void spiffs_cb_object_event(
 
 #endif
 
+#if SPIFFS_LU_INDEX
+  if (spix == 0) {
+    spiffs_lu_index_event(fs, objix, ev, obj_id, new_pix);
+  }
+#endif
+
   // callback to user if object index header
   if (fs->file_cb_f && spix == 0 && (obj_id_raw & SPIFFS_OBJ_ID_IX_FLAG)) {
     spiffs_fileop_type op;
@@ -1152,6 +1176,99 @@ s32_t spiffs_object_open_by_page(
   return res;
 }
 
+#if !SPIFFS_READ_ONLY && SPIFFS_APPEND_BATCH
+// Appends whole data pages from data_spix on, as many as fit in the current
+// object index page in fs->work and as there are consecutive free pages with
+// entries in the same object lookup page.
+// The free pages are found in one pass over the object lookup entries and
+// occupied with one lookup write, and each page is written with its header
+// in one write from fs->lu_work, so that consecutive pages make contiguous
+// writes. The pages are finalized only after the data of all of them is
+// written. The object index is only updated in memory, as for single pages.
+// Returns number of bytes written in *written.
+static s32_t spiffs_object_append_batch(
+    spiffs_fd *fd,
+    spiffs_span_ix cur_objix_spix,
+    spiffs_span_ix data_spix,
+    u8_t *data,
+    u32_t len,
+    u32_t *written) {
+  spiffs *fs = fd->fs;
+  s32_t res;
+  spiffs_block_ix bix;
+  int entry;
+  spiffs_obj_id obj_id = fd->obj_id & ~SPIFFS_OBJ_ID_IX_FLAG;
+  spiffs_obj_id *obj_lu_buf = (spiffs_obj_id *)fs->lu_work;
+  u32_t pages = (len + SPIFFS_DATA_PAGE_SIZE(fs) - 1) / SPIFFS_DATA_PAGE_SIZE(fs);
+  u32_t i;
+
+  *written = 0;
+  // stay within current object index page
+  pages = MIN(pages, (u32_t)(SPIFFS_DATA_SPAN_IX_FOR_OBJ_IX_SPAN_IX(fs, cur_objix_spix) +
+      (cur_objix_spix == 0 ? SPIFFS_OBJ_HDR_IX_LEN(fs) : SPIFFS_OBJ_IX_LEN(fs)) - data_spix));
+
+  // find first free entry, and count the free entries after it in same
+  // object lookup page
+  res = spiffs_obj_lu_find_free(fs, fs->free_cursor_block_ix, fs->free_cursor_obj_lu_entry, &bix, &entry);
+  SPIFFS_CHECK_RES(res);
+  u32_t entries_per_page = SPIFFS_CFG_LOG_PAGE_SZ(fs) / sizeof(spiffs_obj_id);
+  pages = MIN(pages, entries_per_page - entry % entries_per_page);
+  pages = MIN(pages, (u32_t)(SPIFFS_OBJ_LOOKUP_MAX_ENTRIES(fs) - entry));
+  if (pages > 1) {
+    res = _spiffs_rd(fs, SPIFFS_OP_T_OBJ_LU | SPIFFS_OP_C_READ,
+        0, SPIFFS_BLOCK_TO_PADDR(fs, bix) + (entry + 1) * sizeof(spiffs_obj_id),
+        (pages - 1) * sizeof(spiffs_obj_id), fs->lu_work);
+    SPIFFS_CHECK_RES(res);
+    for (i = 1; i < pages && obj_lu_buf[i - 1] == SPIFFS_OBJ_ID_FREE; i++);
+    pages = i;
+  }
+
+  // occupy pages in object lookup
+  for (i = 0; i < pages; i++) {
+    obj_lu_buf[i] = obj_id;
+  }
+  res = _spiffs_wr(fs, SPIFFS_OP_T_OBJ_LU | SPIFFS_OP_C_UPDT,
+      0, SPIFFS_BLOCK_TO_PADDR(fs, bix) + entry * sizeof(spiffs_obj_id),
+      pages * sizeof(spiffs_obj_id), fs->lu_work);
+  SPIFFS_CHECK_RES(res);
+  fs->free_cursor_obj_lu_entry = entry + pages;
+  fs->stats_p_allocated += pages;
+
+  spiffs_page_ix *objix_entries = cur_objix_spix == 0 ?
+      (spiffs_page_ix *)(fs->work + sizeof(spiffs_page_object_ix_header)) :
+      (spiffs_page_ix *)(fs->work + sizeof(spiffs_page_object_ix));
+  spiffs_page_header *p_hdr = (spiffs_page_header *)fs->lu_work;
+  for (i = 0; i < pages; i++) {
+    u32_t to_write = MIN(len - *written, SPIFFS_DATA_PAGE_SIZE(fs));
+    spiffs_page_ix data_page = SPIFFS_OBJ_LOOKUP_ENTRY_TO_PIX(fs, bix, entry + i);
+    // page header, not finalized yet, followed by data
+    p_hdr->obj_id = obj_id;
+    p_hdr->span_ix = data_spix + i;
+    p_hdr->flags = 0xff & ~SPIFFS_PH_FLAG_USED;
+    memcpy(fs->lu_work + sizeof(spiffs_page_header), &data[*written], to_write);
+    res = _spiffs_wr(fs, SPIFFS_OP_T_OBJ_DA | SPIFFS_OP_C_UPDT,
+        0, SPIFFS_PAGE_TO_PADDR(fs, data_page), sizeof(spiffs_page_header) + to_write, fs->lu_work);
+    SPIFFS_CHECK_RES(res);
+    SPIFFS_DBG("append: %04x store new data page in batch, %04x:%04x len %i, written %i\n", fd->obj_id,
+        data_page, data_spix + i, to_write, *written);
+    objix_entries[SPIFFS_OBJ_IX_ENTRY(fs, data_spix + i)] = data_page;
+    *written += to_write;
+  }
+
+  // finalize the pages once all their data is programmed, so that a page
+  // torn by a power loss is not final, and is removed by a check
+  u8_t flags = 0xff & ~(SPIFFS_PH_FLAG_FINAL | SPIFFS_PH_FLAG_USED);
+  for (i = 0; i < pages; i++) {
+    res = _spiffs_wr(fs, SPIFFS_OP_T_OBJ_DA | SPIFFS_OP_C_UPDT,
+        0, SPIFFS_OBJ_LOOKUP_ENTRY_TO_PADDR(fs, bix, entry + i) + offsetof(spiffs_page_header, flags),
+        sizeof(u8_t), &flags);
+    SPIFFS_CHECK_RES(res);
+  }
+
+  return res;
+}
+#endif // !SPIFFS_READ_ONLY && SPIFFS_APPEND_BATCH
+
 #if !SPIFFS_READ_ONLY
 // Append to object
 // keep current object index (header) page in fs->work buffer
@@ -1185,6 +1302,9 @@ s32_t spiffs_object_append(spiffs_fd *fd, u32_t offset, u8_t *data, u32_t len) {
   spiffs_span_ix data_spix = offset / SPIFFS_DATA_PAGE_SIZE(fs);
   spiffs_page_ix data_page;
   u32_t page_offs = offset % SPIFFS_DATA_PAGE_SIZE(fs);
+#if SPIFFS_APPEND_BATCH
+  u8_t batched = 0;
+#endif
 
   // write all data
   while (res == SPIFFS_OK && written < len) {
@@ -1288,6 +1408,25 @@ s32_t spiffs_object_append(spiffs_fd *fd, u32_t offset, u8_t *data, u32_t len) {
       prev_objix_spix = cur_objix_spix;
     }
 
+#if SPIFFS_APPEND_BATCH
+    if (page_offs == 0 && (batched || len-written > SPIFFS_DATA_PAGE_SIZE(fs))) {
+      // at beginning of a page with more than a page left, write a batch of
+      // pages, and the rest of the data too once batched, so that no page of
+      // the write is finalized before its data is programmed
+      u32_t batch_written;
+      batched = 1;
+      res = spiffs_object_append_batch(fd, cur_objix_spix, data_spix,
+          &data[written], len-written, &batch_written);
+      data_spix += (batch_written + SPIFFS_DATA_PAGE_SIZE(fs) - 1) / SPIFFS_DATA_PAGE_SIZE(fs);
+      written += batch_written;
+      if (cur_objix_spix == 0) {
+        objix_hdr->size = offset+written;
+      }
+      if (res != SPIFFS_OK) break;
+      continue;
+    }
+#endif
+
     // write data
     u32_t to_write = MIN(len-written, SPIFFS_DATA_PAGE_SIZE(fs) - page_offs);
     if (page_offs == 0) {
@@ -1604,6 +1743,210 @@ s32_t spiffs_object_modify(spiffs_fd *fd, u32_t offset, u8_t *data, u32_t len) {
 } // spiffs_object_modify
 #endif // !SPIFFS_READ_ONLY
 
+#if SPIFFS_LU_INDEX
+// RAM index of object index header pages.
+//
+// Maps object ids, and hashes of object names, to the pages of the object
+// index headers, so that finding an object by name or id does not need to
+// scan the object lookup pages of every block. The index is built at mount
+// and kept up to date from the object index events. A hit is always
+// verified against the page header on the medium, so a stale entry only
+// costs a scan. Once the index has been full, it no longer knows of every
+// object, and a miss has to be confirmed by a scan.
+
+static u32_t spiffs_hash(spiffs *fs, const u8_t *name);
+
+static spiffs_lu_index_entry *spiffs_lu_index_get(
+    spiffs *fs,
+    spiffs_obj_id obj_id) {
+  int i;
+  for (i = 0; i < SPIFFS_LU_INDEX; i++) {
+    if (fs->lu_index[i].obj_id == obj_id) {
+      return &fs->lu_index[i];
+    }
+  }
+  return 0;
+}
+
+// Sets the page of an object, and its name if name is given. An object not
+// in the index is only added if the name is known. Returns 0 if the object
+// is not in the index.
+static u8_t spiffs_lu_index_put(
+    spiffs *fs,
+    spiffs_obj_id obj_id,
+    const u8_t *name,
+    spiffs_page_ix pix) {
+  obj_id &= ~SPIFFS_OBJ_ID_IX_FLAG;
+  spiffs_lu_index_entry *e = spiffs_lu_index_get(fs, obj_id);
+  if (e == 0) {
+    e = name ? spiffs_lu_index_get(fs, SPIFFS_OBJ_ID_DELETED) : 0;
+    if (e == 0) {
+      SPIFFS_DBG("lu index: cannot add %04x\n", obj_id);
+      fs->lu_index_complete = 0;
+      return 0;
+    }
+    e->obj_id = obj_id;
+  }
+  if (name) {
+    e->name_hash = spiffs_hash(fs, name);
+  }
+  e->pix = pix;
+  return 1;
+}
+
+static void spiffs_lu_index_drop(
+    spiffs *fs,
+    spiffs_lu_index_entry *e) {
+  SPIFFS_DBG("lu index: stale entry %04x page %04x\n", e->obj_id, e->pix);
+  e->obj_id = SPIFFS_OBJ_ID_DELETED;
+  fs->lu_index_complete = 0;
+}
+
+static s32_t spiffs_lu_index_build_v(
+    spiffs *fs,
+    spiffs_obj_id obj_id,
+    spiffs_block_ix bix,
+    int ix_entry,
+    const void *user_const_p,
+    void *user_var_p) {
+  (void)user_const_p;
+  u8_t *full = (u8_t *)user_var_p;
+  s32_t res;
+  spiffs_page_object_ix_header objix_hdr;
+  spiffs_page_ix pix = SPIFFS_OBJ_LOOKUP_ENTRY_TO_PIX(fs, bix, ix_entry);
+  if (obj_id == SPIFFS_OBJ_ID_FREE || obj_id == SPIFFS_OBJ_ID_DELETED ||
+      (obj_id & SPIFFS_OBJ_ID_IX_FLAG) == 0) {
+    return SPIFFS_VIS_COUNTINUE;
+  }
+  res = _spiffs_rd(fs, SPIFFS_OP_T_OBJ_LU2 | SPIFFS_OP_C_READ,
+      0, SPIFFS_PAGE_TO_PADDR(fs, pix), sizeof(spiffs_page_object_ix_header), (u8_t *)&objix_hdr);
+  SPIFFS_CHECK_RES(res);
+  if (objix_hdr.p_hdr.span_ix == 0 &&
+      (objix_hdr.p_hdr.flags & (SPIFFS_PH_FLAG_DELET | SPIFFS_PH_FLAG_FINAL | SPIFFS_PH_FLAG_IXDELE)) ==
+          (SPIFFS_PH_FLAG_DELET | SPIFFS_PH_FLAG_IXDELE)) {
+    if (!spiffs_lu_index_put(fs, obj_id, objix_hdr.name, pix)) {
+      *full = 1;
+    }
+  }
+  return SPIFFS_VIS_COUNTINUE;
+}
+
+// Builds the index from the object lookup pages
+s32_t spiffs_lu_index_build(
+    spiffs *fs) {
+  s32_t res;
+  u8_t full = 0;
+  memset(fs->lu_index, 0, sizeof(fs->lu_index));
+  res = spiffs_obj_lu_find_entry_visitor(fs, 0, 0, 0, 0,
+      spiffs_lu_index_build_v, 0, &full, 0, 0);
+  if (res == SPIFFS_VIS_END) {
+    res = SPIFFS_OK;
+  }
+  fs->lu_index_complete = res == SPIFFS_OK && !full;
+  return res;
+}
+
+// Adds the objects of block bix to the index, setting *full if one did not
+// fit. The index is complete once all blocks are added to an empty index
+// with none left out.
+s32_t spiffs_lu_index_build_block(
+    spiffs *fs,
+    spiffs_block_ix bix,
+    u8_t *full) {
+  s32_t res = spiffs_obj_lu_find_entry_visitor(fs, bix, 0, SPIFFS_VIS_ONE_BLOCK, 0,
+      spiffs_lu_index_build_v, 0, full, 0, 0);
+  if (res == SPIFFS_VIS_END) {
+    res = SPIFFS_OK;
+  }
+  return res;
+}
+
+// Updates the index on an object index header event
+void spiffs_lu_index_event(
+    spiffs *fs,
+    spiffs_page_object_ix *objix,
+    int ev,
+    spiffs_obj_id obj_id,
+    spiffs_page_ix new_pix) {
+  if (ev == SPIFFS_EV_IX_DEL) {
+    spiffs_lu_index_entry *e = spiffs_lu_index_get(fs, obj_id & ~SPIFFS_OBJ_ID_IX_FLAG);
+    if (e) {
+      e->obj_id = SPIFFS_OBJ_ID_DELETED;
+    }
+  } else if (ev == SPIFFS_EV_IX_MOV || objix == 0) {
+    // only the page header is given on moves
+    spiffs_lu_index_put(fs, obj_id, 0, new_pix);
+  } else {
+    spiffs_lu_index_put(fs, obj_id, ((spiffs_page_object_ix_header *)objix)->name, new_pix);
+  }
+}
+
+// Finds the object index header page of an object id from the index.
+// Returns SPIFFS_VIS_COUNTINUE if the object lookup must be scanned.
+s32_t spiffs_lu_index_find_id(
+    spiffs *fs,
+    spiffs_obj_id obj_id,
+    spiffs_page_ix exclusion_pix,
+    spiffs_page_ix *pix) {
+  s32_t res;
+  spiffs_page_header ph;
+  spiffs_lu_index_entry *e = spiffs_lu_index_get(fs, obj_id & ~SPIFFS_OBJ_ID_IX_FLAG);
+  if (e == 0 || (exclusion_pix && e->pix == exclusion_pix)) {
+    return SPIFFS_VIS_COUNTINUE;
+  }
+  res = _spiffs_rd(fs, SPIFFS_OP_T_OBJ_LU2 | SPIFFS_OP_C_READ,
+      0, SPIFFS_PAGE_TO_PADDR(fs, e->pix), sizeof(spiffs_page_header), (u8_t *)&ph);
+  SPIFFS_CHECK_RES(res);
+  if (ph.obj_id != (obj_id | SPIFFS_OBJ_ID_IX_FLAG) || ph.span_ix != 0 ||
+      (ph.flags & (SPIFFS_PH_FLAG_FINAL | SPIFFS_PH_FLAG_DELET | SPIFFS_PH_FLAG_USED |
+          SPIFFS_PH_FLAG_IXDELE)) != (SPIFFS_PH_FLAG_DELET | SPIFFS_PH_FLAG_IXDELE)) {
+    spiffs_lu_index_drop(fs, e);
+    return SPIFFS_VIS_COUNTINUE;
+  }
+  if (pix) {
+    *pix = e->pix;
+  }
+  return SPIFFS_OK;
+}
+
+// Finds the object index header page of a name from the index. Returns
+// SPIFFS_ERR_NOT_FOUND only if the index knows of all objects, and
+// SPIFFS_VIS_COUNTINUE if the object lookup must be scanned.
+static s32_t spiffs_lu_index_find_name(
+    spiffs *fs,
+    const u8_t name[SPIFFS_OBJ_NAME_LEN],
+    spiffs_page_ix *pix) {
+  s32_t res;
+  spiffs_page_object_ix_header objix_hdr;
+  u32_t name_hash = spiffs_hash(fs, name);
+  int i;
+  for (i = 0; i < SPIFFS_LU_INDEX; i++) {
+    spiffs_lu_index_entry *e = &fs->lu_index[i];
+    if (e->obj_id == SPIFFS_OBJ_ID_DELETED || e->name_hash != name_hash) {
+      continue;
+    }
+    res = _spiffs_rd(fs, SPIFFS_OP_T_OBJ_LU2 | SPIFFS_OP_C_READ,
+        0, SPIFFS_PAGE_TO_PADDR(fs, e->pix), sizeof(spiffs_page_object_ix_header), (u8_t *)&objix_hdr);
+    SPIFFS_CHECK_RES(res);
+    if (objix_hdr.p_hdr.obj_id != (e->obj_id | SPIFFS_OBJ_ID_IX_FLAG) ||
+        objix_hdr.p_hdr.span_ix != 0 ||
+        (objix_hdr.p_hdr.flags & (SPIFFS_PH_FLAG_DELET | SPIFFS_PH_FLAG_FINAL | SPIFFS_PH_FLAG_IXDELE)) !=
+            (SPIFFS_PH_FLAG_DELET | SPIFFS_PH_FLAG_IXDELE)) {
+      spiffs_lu_index_drop(fs, e);
+      continue;
+    }
+    if (strcmp((const char*)name, (char*)objix_hdr.name) == 0) {
+      if (pix) {
+        *pix = e->pix;
+      }
+      return SPIFFS_OK;
+    }
+    // hash collision
+  }
+  return fs->lu_index_complete ? SPIFFS_ERR_NOT_FOUND : SPIFFS_VIS_COUNTINUE;
+}
+#endif // SPIFFS_LU_INDEX
+
 static s32_t spiffs_object_find_object_index_header_by_name_v(
     spiffs *fs,
     spiffs_obj_id obj_id,
@@ -1611,7 +1954,6 @@ static s32_t spiffs_object_find_object_index_header_by_name_v(
     int ix_entry,
     const void *user_const_p,
     void *user_var_p) {
-  (void)user_var_p;
   s32_t res;
   spiffs_page_object_ix_header objix_hdr;
   spiffs_page_ix pix = SPIFFS_OBJ_LOOKUP_ENTRY_TO_PIX(fs, bix, ix_entry);
@@ -1626,6 +1968,7 @@ static s32_t spiffs_object_find_object_index_header_by_name_v(
       (objix_hdr.p_hdr.flags & (SPIFFS_PH_FLAG_DELET | SPIFFS_PH_FLAG_FINAL | SPIFFS_PH_FLAG_IXDELE)) ==
           (SPIFFS_PH_FLAG_DELET | SPIFFS_PH_FLAG_IXDELE)) {
     if (strcmp((const char*)user_const_p, (char*)objix_hdr.name) == 0) {
+      *((spiffs_obj_id *)user_var_p) = obj_id;
       return SPIFFS_OK;
     }
   }
@@ -1641,6 +1984,14 @@ s32_t spiffs_object_find_object_index_header_by_name(
   s32_t res;
   spiffs_block_ix bix;
   int entry;
+  spiffs_obj_id obj_id;
+
+#if SPIFFS_LU_INDEX
+  res = spiffs_lu_index_find_name(fs, name, pix);
+  if (res != SPIFFS_VIS_COUNTINUE) {
+    return res;
+  }
+#endif
 
   res = spiffs_obj_lu_find_entry_visitor(fs,
       fs->cursor_block_ix,
@@ -1649,7 +2000,7 @@ s32_t spiffs_object_find_object_index_header_by_name(
       0,
       spiffs_object_find_object_index_header_by_name_v,
       name,
-      0,
+      &obj_id,
       &bix,
       &entry);
 
@@ -1658,6 +2009,10 @@ s32_t spiffs_object_find_object_index_header_by_name(
   }
   SPIFFS_CHECK_RES(res);
 
+#if SPIFFS_LU_INDEX
+  spiffs_lu_index_put(fs, obj_id, name, SPIFFS_OBJ_LOOKUP_ENTRY_TO_PIX(fs, bix, entry));
+#endif
+
   if (pix) {
     *pix = SPIFFS_OBJ_LOOKUP_ENTRY_TO_PIX(fs, bix, entry);
   }
@@ -2171,7 +2526,7 @@ s32_t spiffs_obj_lu_find_free_obj_id(spiffs *fs, spiffs_obj_id *obj_id, const u8
 }
 #endif // !SPIFFS_READ_ONLY
 
-#if SPIFFS_TEMPORAL_FD_CACHE
+#if SPIFFS_TEMPORAL_FD_CACHE || SPIFFS_LU_INDEX
 // djb2 hash
 static u32_t spiffs_hash(spiffs *fs, const u8_t *name) {
   (void)fs;
@@ -281,11 +281,21 @@
     if ((res) < SPIFFS_OK) return (res); \
   } while (0);
 
+#if SPIFFS_READ_ONLY
+#define SPIFFS_CHECK_DISTURB(fs)
+#else
+// a stepped consistency check in progress must not trust fs->work or what
+// it has seen of the pages after the file system has been used
+#define SPIFFS_CHECK_DISTURB(fs) \
+  (fs)->check_disturbed = 1
+#endif
+
 #define SPIFFS_API_CHECK_MOUNT(fs) \
   if (!SPIFFS_CHECK_MOUNT((fs))) { \
     (fs)->err_code = SPIFFS_ERR_NOT_MOUNTED; \
     return SPIFFS_ERR_NOT_MOUNTED; \
-  }
+  } \
+  SPIFFS_CHECK_DISTURB(fs)
 
 #define SPIFFS_API_CHECK_CFG(fs) \
   if (!SPIFFS_CHECK_CFG((fs))) { \
@@ -330,6 +340,8 @@
 #define SPIFFS_VIS_CHECK_PH     (1<<1)
 // stop searching at end of all look up pages
 #define SPIFFS_VIS_NO_WRAP      (1<<2)
+// stop searching at end of the look up pages of the starting block
+#define SPIFFS_VIS_ONE_BLOCK    (1<<3)
 
 #if SPIFFS_HAL_CALLBACK_EXTRA
 
@@ -358,6 +370,7 @@
 #define SPIFFS_CACHE_FLAG_OBJLU       (1<<2)
 #define SPIFFS_CACHE_FLAG_OBJIX       (1<<3)
 #define SPIFFS_CACHE_FLAG_DATA        (1<<4)
+#define SPIFFS_CACHE_FLAG_PROTECTED   (1<<5)
 #define SPIFFS_CACHE_FLAG_TYPE_WR     (1<<7)
 
 #define SPIFFS_CACHE_PAGE_SIZE(fs) \
@@ -403,6 +416,10 @@ typedef struct {
 // cache struct
 typedef struct {
   u8_t cpage_count;
+#if SPIFFS_CACHE_SLRU
+  // most read pages which are protected, half of the cache pages
+  u8_t cpage_protected_max;
+#endif
   u32_t last_access;
   u32_t cpage_use_map;
   u32_t cpage_use_mask;
@@ -567,6 +584,10 @@ s32_t spiffs_probe(
 
 // ---------------
 
+spiffs_obj_id spiffs_obj_lu_erase_count_next(
+    spiffs_obj_id erase_count_min,
+    spiffs_obj_id erase_count_max);
+
 s32_t spiffs_obj_lu_scan(
     spiffs *fs);
 
@@ -709,6 +730,29 @@ s32_t spiffs_object_find_object_index_header_by_name(
     const u8_t name[SPIFFS_OBJ_NAME_LEN],
     spiffs_page_ix *pix);
 
+#if SPIFFS_LU_INDEX
+s32_t spiffs_lu_index_build(
+    spiffs *fs);
+
+s32_t spiffs_lu_index_build_block(
+    spiffs *fs,
+    spiffs_block_ix bix,
+    u8_t *full);
+
+void spiffs_lu_index_event(
+    spiffs *fs,
+    spiffs_page_object_ix *objix,
+    int ev,
+    spiffs_obj_id obj_id,
+    spiffs_page_ix new_pix);
+
+s32_t spiffs_lu_index_find_id(
+    spiffs *fs,
+    spiffs_obj_id obj_id,
+    spiffs_page_ix exclusion_pix,
+    spiffs_page_ix *pix);
+#endif
+
 // ---------------
 
 s32_t spiffs_gc_check(
@@ -732,6 +776,9 @@ s32_t spiffs_gc_clean(
 s32_t spiffs_gc_quick(
     spiffs *fs, u16_t max_free_pages);
 
+s32_t spiffs_gc_step(
+    spiffs *fs);
+
 // ---------------
 
 s32_t spiffs_fd_find_new(
@@ -778,14 +825,26 @@ spiffs_cache_page *spiffs_cache_page_get_by_fd(
 #endif
 #endif
 
-s32_t spiffs_lookup_consistency_check(
-    spiffs *fs,
-    u8_t check_all_objects);
+#if !SPIFFS_READ_ONLY
+// phases of the consistency check, in order
+#define SPIFFS_CHECK_PHASE_NONE         0
+#define SPIFFS_CHECK_PHASE_LOOKUP       1
+#define SPIFFS_CHECK_PHASE_INDEX        2
+#define SPIFFS_CHECK_PHASE_PAGE         3
+#define SPIFFS_CHECK_PHASE_SCAN         4
 
-s32_t spiffs_page_consistency_check(
+// starts a consistency check, which is then done by spiffs_check_step
+void spiffs_check_begin(
     spiffs *fs);
 
-s32_t spiffs_object_index_consistency_check(
+// does the next unit of the consistency check, returns 1 if there are more,
+// or the result of the check when it is done
+s32_t spiffs_check_step(
     spiffs *fs);
 
+// estimated progress of the consistency check in progress, 1 to 255
+u8_t spiffs_check_progress(
+    spiffs *fs);
+#endif
+
 #endif /* SPIFFS_NUCLEUS_H_ */
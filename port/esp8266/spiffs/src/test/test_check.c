@@ -413,6 +413,167 @@ TEST(index_cons4) {
   return TEST_RES_OK;
 } TEST_END
 
+// corrupts an index and a look up entry, and mounts the file system again
+// from flash, returning the flash contents in *image
+static void check_step_setup(u8_t **image) {
+  int size = SPIFFS_DATA_PAGE_SIZE(FS)*3;
+  int res = test_create_and_write_file("file", size, size);
+  ASSERT(res >= 0, "setting up check_step");
+  res = test_create_and_write_file("file2", size, size);
+  ASSERT(res >= 0, "setting up check_step");
+  res = test_create_and_write_file("file3", size, size);
+  ASSERT(res >= 0, "setting up check_step");
+
+  spiffs_stat s;
+  spiffs_page_ix pix;
+  // set index entries of file to a bad page
+  res = SPIFFS_stat(FS, "file", &s);
+  ASSERT(res >= 0, "setting up check_step");
+  res = spiffs_obj_lu_find_id_and_span(FS, s.obj_id | SPIFFS_OBJ_ID_IX_FLAG, 0, 0, &pix);
+  ASSERT(res >= 0, "setting up check_step");
+  u32_t addr = SPIFFS_PAGE_TO_PADDR(FS, pix) + sizeof(spiffs_page_object_ix_header);
+  spiffs_page_ix bad_pix_ref = 0x55;
+  area_write(addr, (u8_t*)&bad_pix_ref, sizeof(spiffs_page_ix));
+  area_write(addr + sizeof(spiffs_page_ix), (u8_t*)&bad_pix_ref, sizeof(spiffs_page_ix));
+
+  // reset look up entry of data page 1 of file2 to being erased
+  res = SPIFFS_stat(FS, "file2", &s);
+  ASSERT(res >= 0, "setting up check_step");
+  res = spiffs_obj_lu_find_id_and_span(FS, s.obj_id & ~SPIFFS_OBJ_ID_IX_FLAG, 1, 0, &pix);
+  ASSERT(res >= 0, "setting up check_step");
+  spiffs_obj_id obj_id = SPIFFS_OBJ_ID_DELETED;
+  addr = SPIFFS_BLOCK_TO_PADDR(FS, SPIFFS_BLOCK_FOR_PAGE(FS, pix)) +
+      SPIFFS_OBJ_LOOKUP_ENTRY_FOR_PAGE(FS, pix) * sizeof(spiffs_obj_id);
+  area_write(addr, (u8_t*)&obj_id, sizeof(spiffs_obj_id));
+
+  spiffs_config cfg = (FS)->cfg;
+  SPIFFS_unmount(FS);
+  *image = malloc(cfg.phys_size);
+  ASSERT(*image != NULL, "setting up check_step");
+  area_read(cfg.phys_addr, *image, cfg.phys_size);
+  res = fs_mount_specific(cfg.phys_addr, cfg.phys_size, cfg.phys_erase_block,
+      cfg.log_block_size, cfg.log_page_size);
+  ASSERT(res == SPIFFS_OK, "mounting for check_step");
+}
+
+// mounts the file system again from image
+static void check_step_remount(u8_t *image) {
+  spiffs_config cfg = (FS)->cfg;
+  SPIFFS_unmount(FS);
+  area_write(cfg.phys_addr, image, cfg.phys_size);
+  s32_t res = fs_mount_specific(cfg.phys_addr, cfg.phys_size, cfg.phys_erase_block,
+      cfg.log_block_size, cfg.log_page_size);
+  ASSERT(res == SPIFFS_OK, "mounting for check_step");
+}
+
+TEST(check_step) {
+  u8_t *image, *checked, *stepped;
+  check_step_setup(&image);
+  u32_t size = SPIFFS_CFG_PHYS_SZ(FS);
+  u32_t addr = SPIFFS_CFG_PHYS_ADDR(FS);
+  checked = malloc(size);
+  stepped = malloc(size);
+  TEST_CHECK(checked != NULL && stepped != NULL);
+
+  // blocking check
+  u32_t fixes = get_check_fixes();
+  TEST_CHECK(SPIFFS_check(FS) == SPIFFS_OK);
+  u32_t checked_fixes = get_check_fixes() - fixes;
+  TEST_CHECK(checked_fixes > 0);
+  area_read(addr, checked, size);
+  u32_t free_blocks = (FS)->free_blocks;
+  u32_t p_allocated = (FS)->stats_p_allocated;
+  u32_t p_deleted = (FS)->stats_p_deleted;
+  spiffs_obj_id max_erase_count = (FS)->max_erase_count;
+  TEST_CHECK(read_and_verify("file") >= 0);
+  TEST_CHECK(read_and_verify("file2") >= 0);
+  TEST_CHECK(read_and_verify("file3") >= 0);
+
+  // one unit at a time, must mend the same way, and count the pages of each
+  // block in a unit of its own
+  check_step_remount(image);
+  fixes = get_check_fixes();
+  s32_t res;
+  u32_t steps = 0;
+  while ((res = SPIFFS_check_step(FS, 0)) > 0) {
+    TEST_CHECK(res <= 255);
+    steps++;
+  }
+  TEST_CHECK(res == SPIFFS_OK);
+  printf("  %i steps\n", steps);
+  TEST_CHECK(steps > 3 * (FS)->block_count);
+  TEST_CHECK(get_check_fixes() - fixes == checked_fixes);
+  area_read(addr, stepped, size);
+  TEST_CHECK(memcmp(checked, stepped, size) == 0);
+  TEST_CHECK((FS)->free_blocks == free_blocks);
+  TEST_CHECK((FS)->stats_p_allocated == p_allocated);
+  TEST_CHECK((FS)->stats_p_deleted == p_deleted);
+  TEST_CHECK((FS)->max_erase_count == max_erase_count);
+  TEST_CHECK(read_and_verify("file") >= 0);
+  TEST_CHECK(read_and_verify("file2") >= 0);
+  TEST_CHECK(read_and_verify("file3") >= 0);
+
+  // with the file system read between the steps now and then, the part of
+  // the check in progress is done again
+  check_step_remount(image);
+  fixes = get_check_fixes();
+  steps = 0;
+  while ((res = SPIFFS_check_step(FS, 0)) > 0) {
+    if (++steps % ((FS)->block_count + 3) == 0) {
+      TEST_CHECK(read_and_verify("file3") >= 0);
+    }
+  }
+  TEST_CHECK(res == SPIFFS_OK);
+  TEST_CHECK(get_check_fixes() - fixes == checked_fixes);
+  area_read(addr, stepped, size);
+  TEST_CHECK(memcmp(checked, stepped, size) == 0);
+
+  // with files written and removed and garbage collected between the steps
+  // now and then, the check finishes and leaves the files intact
+  check_step_remount(image);
+  char name[16];
+  int files = 0, gcs = 0;
+  steps = 0;
+  while ((res = SPIFFS_check_step(FS, 0)) > 0 && steps < 100 * (FS)->block_count) {
+    if (++steps % ((FS)->block_count + 3) == 0) {
+      sprintf(name, "temp%i", files);
+      TEST_CHECK(test_create_and_write_file(name, SPIFFS_DATA_PAGE_SIZE(FS) * 2 + 17, 100) >= 0);
+      if (files > 0) {
+        sprintf(name, "temp%i", files - 1);
+        TEST_CHECK(SPIFFS_remove(FS, name) == SPIFFS_OK);
+      }
+      files++;
+      if (SPIFFS_gc_step(FS) == SPIFFS_OK) {
+        gcs++;
+      } else {
+        TEST_CHECK(SPIFFS_errno(FS) == SPIFFS_ERR_NO_DELETED_BLOCKS);
+      }
+    }
+  }
+  TEST_CHECK(res == SPIFFS_OK);
+  printf("  %i steps, %i files written, %i blocks collected\n", steps, files, gcs);
+  TEST_CHECK(files > 2);
+  TEST_CHECK(gcs > 0);
+  TEST_CHECK(read_and_verify("file") >= 0);
+  TEST_CHECK(read_and_verify("file2") >= 0);
+  TEST_CHECK(read_and_verify("file3") >= 0);
+  sprintf(name, "temp%i", files - 1);
+  TEST_CHECK(read_and_verify(name) >= 0);
+  sprintf(name, "temp%i", files - 2);
+  spiffs_stat s;
+  TEST_CHECK(SPIFFS_stat(FS, name, &s) == SPIFFS_ERR_NOT_FOUND);
+
+  // a blocking check is clean after that
+  fixes = get_check_fixes();
+  TEST_CHECK(SPIFFS_check(FS) == SPIFFS_OK);
+  TEST_CHECK(get_check_fixes() == fixes);
+
+  free(image);
+  free(checked);
+  free(stepped);
+  return TEST_RES_OK;
+} TEST_END
+
 SUITE_TESTS(check_tests)
   ADD_TEST(evil_write)
   ADD_TEST(lu_check1)
@@ -424,4 +585,5 @@ SUITE_TESTS(check_tests)
   ADD_TEST(index_cons2)
   ADD_TEST(index_cons3)
   ADD_TEST(index_cons4)
+  ADD_TEST(check_step)
 SUITE_END(check_tests)
@@ -427,6 +427,102 @@ TEST(list_dir)
 TEST_END
 
 
+typedef struct {
+  int max;
+  int count;
+  u32_t pages;
+  spiffs_obj_id obj_ids[8];
+  u32_t sizes[8];
+} list_files_state;
+
+static s32_t list_files_cb(spiffs *fs, const struct spiffs_dirent *e, u32_t pages, void *user) {
+  list_files_state *st = (list_files_state *)user;
+  (void)fs;
+  if (st->count >= st->max) {
+    return 1;
+  }
+  printf("  %s [%04x] size:%i pages:%i\n", e->name, e->obj_id, e->size, pages);
+  st->obj_ids[st->count] = e->obj_id;
+  st->sizes[st->count] = e->size;
+  st->pages += pages;
+  st->count++;
+  return SPIFFS_OK;
+}
+
+TEST(list_files)
+{
+  int res;
+
+  // empty, one page, some pages, and more pages than the index header holds
+  char *files[4] = {
+      "empty",
+      "small",
+      "medium",
+      "large"
+  };
+  int sizes[4] = {
+      0,
+      SPIFFS_DATA_PAGE_SIZE(FS) / 2,
+      SPIFFS_DATA_PAGE_SIZE(FS) * 5,
+      SPIFFS_DATA_PAGE_SIZE(FS) * (SPIFFS_OBJ_HDR_IX_LEN(FS) + SPIFFS_OBJ_IX_LEN(FS) + 3)
+  };
+  int file_cnt = sizeof(files)/sizeof(char *);
+
+  int i;
+
+  for (i = 0; i < file_cnt; i++) {
+    res = test_create_and_write_file(files[i], sizes[i], 256);
+    TEST_CHECK(res >= 0);
+  }
+
+  // all in one go, which must agree with readdir
+  spiffs_DIR d;
+  list_files_state all;
+  memset(&all, 0, sizeof(all));
+  all.max = 8;
+  SPIFFS_opendir(FS, "/", &d);
+  res = SPIFFS_list(&d, list_files_cb, &all);
+  TEST_CHECK(res == file_cnt);
+  TEST_CHECK(all.count == file_cnt);
+  res = SPIFFS_list(&d, list_files_cb, &all);
+  TEST_CHECK(res == 0);
+  SPIFFS_closedir(&d);
+
+  struct spiffs_dirent e;
+  struct spiffs_dirent *pe = &e;
+  SPIFFS_opendir(FS, "/", &d);
+  i = 0;
+  while ((pe = SPIFFS_readdir(&d, pe))) {
+    TEST_CHECK(i < all.count);
+    TEST_CHECK(pe->obj_id == all.obj_ids[i]);
+    TEST_CHECK(pe->size == all.sizes[i]);
+    i++;
+  }
+  SPIFFS_closedir(&d);
+  TEST_CHECK(i == file_cnt);
+
+  // the files are all there is, so their pages are all allocated pages
+  TEST_CHECK(all.pages == __fs.stats_p_allocated);
+
+  // one file per call
+  list_files_state one;
+  memset(&one, 0, sizeof(one));
+  SPIFFS_opendir(FS, "/", &d);
+  do {
+    one.max = one.count + 1;
+    res = SPIFFS_list(&d, list_files_cb, &one);
+    TEST_CHECK(res >= 0);
+  } while (res > 0);
+  SPIFFS_closedir(&d);
+  TEST_CHECK(one.count == file_cnt);
+  TEST_CHECK(memcmp(one.obj_ids, all.obj_ids, sizeof(all.obj_ids)) == 0);
+  TEST_CHECK(one.pages == all.pages);
+
+  return TEST_RES_OK;
+}
+TEST_END
+
+
 TEST(open_by_dirent) {
   int res;
 
@@ -1481,6 +1577,193 @@ TEST(lseek_read) {
 TEST_END
 
 
+TEST(lu_index_open)
+{
+  char name[32];
+  int f, r;
+  int res;
+  int files = 12;
+  int rounds = 20;
+  spiffs_file fd;
+  spiffs_stat st;
+
+  for (f = 0; f < files; f++) {
+    sprintf(name, "ix%i", f);
+    res = test_create_and_write_file(name, SPIFFS_DATA_PAGE_SIZE(FS) * 2, 100);
+    TEST_CHECK(res >= 0);
+  }
+
+  // open existing files by name
+  clear_flash_ops_log();
+  for (r = 0; r < rounds; r++) {
+    for (f = 0; f < files; f++) {
+      sprintf(name, "ix%i", f);
+      fd = SPIFFS_open(FS, name, SPIFFS_RDONLY, 0);
+      TEST_CHECK(fd > 0);
+      SPIFFS_close(FS, fd);
+    }
+  }
+  printf("  open:   %i reads, %i bytes per open\n",
+      get_flash_ops_log_reads() / (rounds * files),
+      get_flash_ops_log_read_bytes() / (rounds * files));
+
+  // names which do not exist
+  clear_flash_ops_log();
+  for (r = 0; r < rounds * files; r++) {
+    sprintf(name, "none%i", r);
+    fd = SPIFFS_open(FS, name, SPIFFS_RDONLY, 0);
+    TEST_CHECK(fd < 0);
+    TEST_CHECK(SPIFFS_errno(FS) == SPIFFS_ERR_NOT_FOUND);
+  }
+  printf("  miss:   %i reads, %i bytes per open\n",
+      get_flash_ops_log_reads() / (rounds * files),
+      get_flash_ops_log_read_bytes() / (rounds * files));
+
+  // the index follows renames and removes
+  res = SPIFFS_rename(FS, "ix0", "renamed");
+  TEST_CHECK(res >= 0);
+  res = SPIFFS_stat(FS, "ix0", &st);
+  TEST_CHECK(res < 0);
+  res = SPIFFS_stat(FS, "renamed", &st);
+  TEST_CHECK(res >= 0);
+  res = SPIFFS_remove(FS, "ix1");
+  TEST_CHECK(res >= 0);
+  fd = SPIFFS_open(FS, "ix1", SPIFFS_RDONLY, 0);
+  TEST_CHECK(fd < 0);
+
+  // more files than the index holds, and garbage collection moving the
+  // object index headers around
+  for (f = files; f < files + 2 * SPIFFS_LU_INDEX + 4; f++) {
+    sprintf(name, "ix%i", f);
+    res = test_create_and_write_file(name, SPIFFS_DATA_PAGE_SIZE(FS), 100);
+    TEST_CHECK(res >= 0);
+  }
+  res = test_create_and_write_file("big", FS_PURE_DATA_PAGES(FS) / 2 * SPIFFS_DATA_PAGE_SIZE(FS), 1000);
+  TEST_CHECK(res >= 0);
+  res = SPIFFS_remove(FS, "big");
+  TEST_CHECK(res >= 0);
+  res = test_create_and_write_file("big2", FS_PURE_DATA_PAGES(FS) / 2 * SPIFFS_DATA_PAGE_SIZE(FS), 1000);
+  TEST_CHECK(res >= 0);
+  for (f = 2; f < files + 2 * SPIFFS_LU_INDEX + 4; f++) {
+    sprintf(name, "ix%i", f);
+    res = read_and_verify(name);
+    TEST_CHECK(res >= 0);
+  }
+  res = SPIFFS_stat(FS, "renamed", &st);
+  TEST_CHECK(res >= 0);
+  res = SPIFFS_stat(FS, "ix1", &st);
+  TEST_CHECK(res < 0);
+
+  return TEST_RES_OK;
+}
+TEST_END
+
+
+TEST(append_batch)
+{
+  int pages = SPIFFS_OBJ_HDR_IX_LEN(FS) + SPIFFS_OBJ_IX_LEN(FS) + 10;
+  int size = SPIFFS_DATA_PAGE_SIZE(FS) * pages;
+  int res;
+
+  // in one write, across object index pages
+  clear_flash_ops_log();
+  res = test_create_and_write_file("batch", size, size);
+  TEST_CHECK(res >= 0);
+  u32_t writes = get_flash_ops_log_writes();
+  printf("  %i writes for %i pages\n", writes, pages);
+#if SPIFFS_APPEND_BATCH
+  // a write of each page with its header and one finalizing it, instead of
+  // three writes per page
+  TEST_CHECK(writes < pages * 2 + pages / 4);
+#endif
+  res = read_and_verify("batch");
+  TEST_CHECK(res >= 0);
+
+  // in writes starting and ending within pages
+  res = test_create_and_write_file("chunks", size, SPIFFS_DATA_PAGE_SIZE(FS) * 5 + 37);
+  TEST_CHECK(res >= 0);
+  res = read_and_verify("chunks");
+  TEST_CHECK(res >= 0);
+
+  TEST_CHECK(SPIFFS_check(FS) == SPIFFS_OK);
+  return TEST_RES_OK;
+}
+TEST_END
+
+
+#if SPIFFS_CACHE && SPIFFS_CACHE_SLRU && SPIFFS_CACHE_STATS
+TEST(cache_slru)
+{
+  char name[32];
+  u8_t buf[32];
+  int f, r, lru;
+  int res;
+  int files = 6;
+  int rounds = 20;
+  spiffs_file fd;
+  spiffs_cache *cache = spiffs_get_cache(FS);
+  u8_t protected_max = cache->cpage_protected_max;
+  u32_t lu_ix_hits[2];
+
+  for (f = 0; f < files; f++) {
+    sprintf(name, "db%i", f);
+    res = test_create_and_write_file(name, SPIFFS_DATA_PAGE_SIZE(FS) * 2, 100);
+    TEST_CHECK(res >= 0);
+  }
+  res = test_create_and_write_file("stream", SPIFFS_DATA_PAGE_SIZE(FS) * 40, 256);
+  TEST_CHECK(res >= 0);
+
+  // the same workload from an empty cache, with no page ever protected,
+  // which is plain LRU, and then as segmented LRU
+  for (lru = 1; lru >= 0; lru--) {
+    cache->cpage_use_map = 0;
+    cache->cpage_protected_max = lru ? 0 : protected_max;
+    (FS)->cache_hits = (FS)->cache_misses = 0;
+    (FS)->cache_lu_hits = (FS)->cache_lu_misses = 0;
+    (FS)->cache_ix_hits = (FS)->cache_ix_misses = 0;
+    (FS)->cache_data_hits = (FS)->cache_data_misses = 0;
+    for (r = 0; r < rounds; r++) {
+      // a large file streamed through, then the small databases loaded in
+      // records and a record appended to a log
+      res = read_and_verify("stream");
+      TEST_CHECK(res >= 0);
+      for (f = 0; f < files; f++) {
+        sprintf(name, "db%i", f);
+        fd = SPIFFS_open(FS, name, SPIFFS_RDONLY, 0);
+        TEST_CHECK(fd > 0);
+        while ((res = SPIFFS_read(FS, fd, buf, sizeof(buf))) == sizeof(buf));
+        SPIFFS_close(FS, fd);
+      }
+      fd = SPIFFS_open(FS, "log", SPIFFS_CREAT | SPIFFS_RDWR | SPIFFS_APPEND, 0);
+      TEST_CHECK(fd > 0);
+      memset(buf, r, 24);
+      res = SPIFFS_write(FS, fd, buf, 24);
+      TEST_CHECK(res == 24);
+      SPIFFS_close(FS, fd);
+    }
+    TEST_CHECK(SPIFFS_remove(FS, "log") == SPIFFS_OK);
+    printf("  %s\n", lru ? "plain LRU" : "segmented LRU");
+    printf("  lookup: %6i hits %6i misses\n", (FS)->cache_lu_hits, (FS)->cache_lu_misses);
+    printf("  index:  %6i hits %6i misses\n", (FS)->cache_ix_hits, (FS)->cache_ix_misses);
+    printf("  data:   %6i hits %6i misses\n", (FS)->cache_data_hits, (FS)->cache_data_misses);
+    TEST_CHECK((FS)->cache_hits == (FS)->cache_lu_hits + (FS)->cache_ix_hits + (FS)->cache_data_hits);
+    TEST_CHECK((FS)->cache_misses == (FS)->cache_lu_misses + (FS)->cache_ix_misses + (FS)->cache_data_misses);
+    lu_ix_hits[lru] = (FS)->cache_lu_hits + (FS)->cache_ix_hits;
+  }
+  // the lookup and index pages in use are not pushed out by the stream
+  TEST_CHECK(lu_ix_hits[0] > lu_ix_hits[1]);
+
+  for (f = 0; f < files; f++) {
+    sprintf(name, "db%i", f);
+    res = read_and_verify(name);
+    TEST_CHECK(res >= 0);
+  }
+  return TEST_RES_OK;
+}
+TEST_END
+#endif
+
+
 TEST(gc_quick)
 {
   char name[32];
@@ -2318,6 +2601,7 @@ SUITE_TESTS(hydrogen_tests)
   ADD_TEST(open_fh_offs)
 #endif
   ADD_TEST(list_dir)
+  ADD_TEST(list_files)
   ADD_TEST(open_by_dirent)
   ADD_TEST(open_by_page)
   ADD_TEST(user_callback_basic)
@@ -2348,6 +2632,11 @@ SUITE_TESTS(hydrogen_tests)
   ADD_TEST(lseek_modification_append)
   ADD_TEST(lseek_modification_append_multi)
   ADD_TEST(lseek_read)
+  ADD_TEST(lu_index_open)
+  ADD_TEST(append_batch)
+#if SPIFFS_CACHE && SPIFFS_CACHE_SLRU && SPIFFS_CACHE_STATS
+  ADD_TEST(cache_slru)
+#endif
   ADD_TEST(gc_quick)
   ADD_TEST(write_small_file_chunks_1)
   ADD_TEST(write_small_files_chunks_1)
@@ -567,10 +567,22 @@ u32_t get_flash_ops_log_read_bytes() {
   return bytes_rd;
 }
 
+u32_t get_flash_ops_log_reads() {
+  return reads;
+}
+
 u32_t get_flash_ops_log_write_bytes() {
   return bytes_wr;
 }
 
+u32_t get_flash_ops_log_writes() {
+  return writes;
+}
+
+u32_t get_check_fixes() {
+  return fs_check_fixes;
+}
+
 void invoke_error_after_read_bytes(u32_t b, char once_only) {
   error_after_bytes_read = b;
   error_after_bytes_read_once_only = once_only;
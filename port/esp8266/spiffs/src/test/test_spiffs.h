@@ -85,7 +85,10 @@ void dump_flash_access_stats();
 void set_flash_ops_log(int enable);
 void clear_flash_ops_log();
 u32_t get_flash_ops_log_read_bytes();
+u32_t get_flash_ops_log_reads();
 u32_t get_flash_ops_log_write_bytes();
+u32_t get_flash_ops_log_writes();
+u32_t get_check_fixes();
 void invoke_error_after_read_bytes(u32_t b, char once_only);
 void invoke_error_after_write_bytes(u32_t b, char once_only);
 void fs_set_validate_flashing(int i);
@@ -69,9 +69,19 @@ typedef uint8_t u8_t;
 #define SPIFFS_CACHE_WR                 1
 #endif
 
+// Replace read cache pages by segmented LRU instead of plain LRU. Pages
+// enter the cache on probation and are replaced first. Object lookup and
+// index pages read again while cached are protected, up to half of the
+// cache, so that scanning the lookup pages of every block or streaming a
+// file does not push them out.
+#ifndef  SPIFFS_CACHE_SLRU
+#define SPIFFS_CACHE_SLRU               1
+#endif
+
 // Enable/disable statistics on caching. Debug/test purpose only.
+// Enabled, as the cache hits and misses are reported by fsStats.
 #ifndef  SPIFFS_CACHE_STATS
-#define SPIFFS_CACHE_STATS              0
+#define SPIFFS_CACHE_STATS              1
 #endif
 #endif
 
@@ -81,14 +91,26 @@ typedef uint8_t u8_t;
 #define SPIFFS_PAGE_CHECK               1
 #endif
 
+// Append more than a page of data in batches of consecutive free pages,
+// found in one pass over the object lookup and occupied with one lookup
+// write, each page written with its header in one write. The pages are
+// finalized after all their data has been written. Off, as finalizing is
+// a program per page, and with SPIFFS_HAL_WRITE_COALESCE the pages are
+// written in fewer programs one at a time.
+#ifndef SPIFFS_APPEND_BATCH
+#define SPIFFS_APPEND_BATCH             0
+#endif
+
 // Define maximum number of gc runs to perform to reach desired free pages.
 #ifndef SPIFFS_GC_MAX_RUNS
 #define SPIFFS_GC_MAX_RUNS              5
 #endif
 
 // Enable/disable statistics on gc. Debug/test purpose only.
+// Enabled, as the GC runs and the pages they move are reported in the
+// runtime metrics and by fsStats.
 #ifndef SPIFFS_GC_STATS
-#define SPIFFS_GC_STATS                 0
+#define SPIFFS_GC_STATS                 1
 #endif
 
 // Garbage collecting examines all pages in a block which and sums up
@@ -158,31 +180,55 @@ typedef uint8_t u8_t;
 #define SPIFFS_UNLOCK(fs)
 #endif
 
+// Clock of SPIFFS_check_step, in microseconds, of spiffs_integration.c
+uint32_t my_spiffs_time_us(void);
+#ifndef SPIFFS_CHECK_TIME_US
+#define SPIFFS_CHECK_TIME_US()          my_spiffs_time_us()
+#endif
+
+// The default SPIFFS partition, normally given by the partition table in
+// the Makefile. A partition descriptor in flash overrides it at run time,
+// see spiffs_integration.c.
+#ifndef SPIFFS_PART_ADDR
+/* This is a suitable setting for Sonoff with 1024Kb flash */
+#define SPIFFS_PART_ADDR                (0xf2000)
+#endif
+#ifndef SPIFFS_PART_SIZE
+#define SPIFFS_PART_SIZE                (32768)
+#endif
+#ifndef SPIFFS_PART_BLOCK_SIZE
+#define SPIFFS_PART_BLOCK_SIZE          (4096)
+#endif
+#ifndef SPIFFS_PART_PAGE_SIZE
+#define SPIFFS_PART_PAGE_SIZE           (256)
+#endif
+
 // Enable if only one spiffs instance with constant configuration will exist
 // on the target. This will reduce calculations, flash and memory accesses.
 // Parts of configuration must be defined below instead of at time of mount.
+// Disabled, so that the partition can be chosen at run time. With the
+// singleton, only the default partition can be mounted.
 #ifndef SPIFFS_SINGLETON
-#define SPIFFS_SINGLETON 1
+#define SPIFFS_SINGLETON 0
 #endif
 
 #if SPIFFS_SINGLETON
 // Instead of giving parameters in config struct, singleton build must
 // give parameters in defines below.
 #ifndef SPIFFS_CFG_PHYS_SZ
-#define SPIFFS_CFG_PHYS_SZ(ignore)          (32768)
+#define SPIFFS_CFG_PHYS_SZ(ignore)          (SPIFFS_PART_SIZE)
 #endif
 #ifndef SPIFFS_CFG_PHYS_ERASE_SZ
 #define SPIFFS_CFG_PHYS_ERASE_SZ(ignore)    (4096)
 #endif
 #ifndef SPIFFS_CFG_PHYS_ADDR
-/* This is a suitable setting for Sonoff with 1024Kb flash */
-#define SPIFFS_CFG_PHYS_ADDR(ignore)        (0xf2000)
+#define SPIFFS_CFG_PHYS_ADDR(ignore)        (SPIFFS_PART_ADDR)
 #endif
 #ifndef SPIFFS_CFG_LOG_PAGE_SZ
-#define SPIFFS_CFG_LOG_PAGE_SZ(ignore)      (256)
+#define SPIFFS_CFG_LOG_PAGE_SZ(ignore)      (SPIFFS_PART_PAGE_SIZE)
 #endif
 #ifndef SPIFFS_CFG_LOG_BLOCK_SZ
-#define SPIFFS_CFG_LOG_BLOCK_SZ(ignore)     (4096)
+#define SPIFFS_CFG_LOG_BLOCK_SZ(ignore)     (SPIFFS_PART_BLOCK_SIZE)
 #endif
 #endif
 
@@ -268,6 +314,30 @@ typedef uint8_t u8_t;
 #define SPIFFS_IX_MAP                         1
 #endif
 
+// Number of objects in a RAM index of object index header pages, or 0 to
+// disable. The index maps object ids and name hashes to the pages of the
+// object index headers, so that opening a file by name, or creating one,
+// does not need to scan the object lookup pages of every block. It is built
+// at mount and kept up to date as objects are created, changed and removed.
+// With more objects than entries, misses fall back to scanning the medium.
+// Costs 8 bytes of RAM per entry in the spiffs struct.
+// The port opens the identity and contact databases, the settings and the
+// mappings many times a minute, with only a couple of file descriptors for
+// the temporal cache.
+#ifndef SPIFFS_LU_INDEX
+#define SPIFFS_LU_INDEX                       16
+#endif
+
+// Enable SPIFFS_get_mount_state and SPIFFS_mount_from_state, which save
+// and restore what mounting learns by scanning the object lookup pages of
+// every block: the free block count and cursor, the page counts, the max
+// erase count and the RAM index of object index headers. The port keeps
+// these in a checkpoint in flash, so that a partition which has not
+// changed since the checkpoint mounts without a scan.
+#ifndef SPIFFS_MOUNT_STATE
+#define SPIFFS_MOUNT_STATE                    1
+#endif
+
 // Set SPIFFS_TEST_VISUALISATION to non-zero to enable SPIFFS_vis function
 // in the api. This function will visualize all filesystem using given printf
 // function.
@@ -1,6 +1,7 @@
 
 
 #include <stdint.h>
+#include <stdbool.h>
 #include "wish_fs.h"
 
 /* spi_flash_* functions of Espressif SDK assume these odd definitions */
@@ -10,7 +11,11 @@ typedef uint16_t uint16;
 
 #include "spi_flash.h"
 #include "spiffs.h"
+#include "spiffs_nucleus.h"
 #include "spiffs_integration.h"
+#include "user_metrics.h"
+#include "user_timer.h"
+#include "user_crc.h"
 
 /* The SPI HAL layer functions */
 int32_t my_spi_read(uint32_t addr, uint32_t size, uint8_t *dst);
@@ -20,6 +25,81 @@ int32_t my_spi_erase(uint32_t addr, uint32_t size);
 
 #define LOG_PAGE_SIZE       256
 
+/* Gather small writes to a flash page to a single flash write, see
+ * my_spi_write() */
+#ifndef SPIFFS_HAL_WRITE_COALESCE
+#define SPIFFS_HAL_WRITE_COALESCE 1
+#endif
+
+/* Read the part of the flash in the memory mapped window directly, see
+ * my_spi_read() */
+#ifndef SPIFFS_HAL_FLASH_MAP
+#define SPIFFS_HAL_FLASH_MAP 1
+#endif
+#ifndef FLASH_MAP_SIZE
+#define FLASH_MAP_SIZE          0x100000
+#endif
+
+/* Serve small reads from a couple of cached flash pages, see
+ * my_spi_read(). Only reads beyond the memory mapped window get there,
+ * so the cache is left out when the partition is compiled in and lies
+ * within the window. Otherwise it is kept, even though the default
+ * partition is in the window, as my_spiffs_set_partition() can move the
+ * partition beyond it. */
+#ifndef SPIFFS_HAL_READ_CACHE
+#if SPIFFS_SINGLETON && SPIFFS_HAL_FLASH_MAP && \
+        SPIFFS_PART_ADDR + SPIFFS_PART_SIZE <= FLASH_MAP_SIZE
+#define SPIFFS_HAL_READ_CACHE 0
+#else
+#define SPIFFS_HAL_READ_CACHE 1
+#endif
+#endif
+
+/* Collect garbage in the background when the file system is idle, see
+ * bg_gc_kick() */
+#ifndef SPIFFS_BG_GC
+#define SPIFFS_BG_GC 1
+#endif
+
+/* Check the consistency of the file system in the background after a
+ * mount which did not come from a checkpoint, see bg_check_kick() */
+#ifndef SPIFFS_BG_CHECK
+#define SPIFFS_BG_CHECK 1
+#endif
+
+#if SPIFFS_HAL_WRITE_COALESCE
+static void write_buf_merge(uint32_t addr, uint32_t size, uint8_t *dst);
+#endif
+#if SPIFFS_HAL_READ_CACHE
+static void read_cache_erase(uint32_t addr, uint32_t size);
+#endif
+#if SPIFFS_BG_GC
+static void bg_gc_kick(void);
+#else
+#define bg_gc_kick()
+#endif
+#if SPIFFS_BG_CHECK
+/* The background consistency check is due or in progress, and its
+ * progress as returned by SPIFFS_check_step() */
+static bool bg_check_pending;
+static uint8_t bg_check_progress;
+static struct user_timer bg_check_timer;
+static void bg_check_kick(void);
+#else
+#define bg_check_pending false
+#define bg_check_kick()
+#endif
+
+/* Keep a checkpoint of the mount state in flash, see ckpt_cancel() */
+#if defined(SPIFFS_PART_CKPT_ADDR) && SPIFFS_MOUNT_STATE
+#define SPIFFS_CKPT 1
+static int32_t ckpt_cancel(void);
+#else
+#define SPIFFS_CKPT 0
+#define ckpt_cancel() SPIFFS_OK
+#endif
+
+/* The buffers are sized for the largest page size a partition may have */
 static u8_t spiffs_work_buf[LOG_PAGE_SIZE*2];
 static u8_t spiffs_fds[32*4];
 static u8_t spiffs_cache_buf[(LOG_PAGE_SIZE+32)*4];
@@ -29,38 +109,945 @@ static u8_t spiffs_cache_buf[(LOG_PAGE_SIZE+32)*4];
 
 static spiffs fs;
 
-void my_spiffs_mount() {
+/* The partition.
+ *
+ * The geometry of the partition comes from the build-time partition
+ * table (SPIFFS_PART_* in the Makefile, defaults in spiffs_config.h),
+ * unless a partition descriptor is found in flash at
+ * SPIFFS_PART_DESC_ADDR. my_spiffs_set_partition() writes the
+ * descriptor, so a device can be moved to a larger partition without
+ * rebuilding the firmware.
+ *
+ * SPIFFS_USE_MAGIC is off, to stay compatible with the file systems
+ * already out there, so a partition cannot be recognised by its
+ * contents. my_spiffs_mount() formats the partition only if SPIFFS
+ * refuses to mount it, and my_spiffs_set_partition() always formats the
+ * new partition. */
+
+#define SPIFFS_PART_DESC_MAGIC      0x74705053  /* "SPpt" */
+#define SPIFFS_PART_MIN_BLOCKS      4
+
+struct spiffs_part_desc {
+    uint32_t magic;
+    uint32_t addr;
+    uint32_t size;
+    uint32_t block_size;
+    uint32_t page_size;
+    /* The fields above xor'ed together, inverted */
+    uint32_t check;
+};
+
+static struct my_spiffs_partition part;
+
+static uint32_t part_desc_check(const struct spiffs_part_desc *desc) {
+    return ~(desc->magic ^ desc->addr ^ desc->size ^ desc->block_size ^ desc->page_size);
+}
+
+static bool part_valid(const struct my_spiffs_partition *p) {
+    if (p->page_size < 64 || p->page_size > LOG_PAGE_SIZE ||
+            (p->page_size & (p->page_size - 1)) != 0) {
+        return false;
+    }
+    if (p->block_size == 0 || (p->block_size & (SPI_FLASH_SEC_SIZE - 1)) != 0 ||
+            (p->addr & (SPI_FLASH_SEC_SIZE - 1)) != 0) {
+        return false;
+    }
+    if (p->size % p->block_size != 0 ||
+            p->size / p->block_size < SPIFFS_PART_MIN_BLOCKS) {
+        return false;
+    }
+#ifdef SPIFFS_PART_DESC_ADDR
+    if (SPIFFS_PART_DESC_ADDR >= p->addr && SPIFFS_PART_DESC_ADDR < p->addr + p->size) {
+        return false;
+    }
+#endif
+#ifdef SPIFFS_PART_CKPT_ADDR
+    if (SPIFFS_PART_CKPT_ADDR >= p->addr && SPIFFS_PART_CKPT_ADDR < p->addr + p->size) {
+        return false;
+    }
+#endif
+    return true;
+}
+
+/* Read the partition descriptor from flash, returns false if there is
+ * none or it is not usable, leaving '*p' as it was */
+static bool part_desc_read(struct my_spiffs_partition *p) {
+#ifdef SPIFFS_PART_DESC_ADDR
+    struct spiffs_part_desc desc;
+    if (spi_flash_read(SPIFFS_PART_DESC_ADDR, (uint32_t *) &desc, sizeof(desc)) != SPI_FLASH_RESULT_OK) {
+        SPIFFS_HAL_DEBUG("Flash operation fail line %d\n\r", __LINE__);
+        return false;
+    }
+    if (desc.magic != SPIFFS_PART_DESC_MAGIC || desc.check != part_desc_check(&desc)) {
+        return false;
+    }
+    struct my_spiffs_partition part = {
+        .addr = desc.addr,
+        .size = desc.size,
+        .block_size = desc.block_size,
+        .page_size = desc.page_size,
+    };
+    if (!part_valid(&part)) {
+        SPIFFS_HAL_DEBUG("Bad partition descriptor\n");
+        return false;
+    }
+    *p = part;
+    return true;
+#else
+    (void) p;
+    return false;
+#endif
+}
+
+static int32_t part_desc_write(const struct my_spiffs_partition *p) {
+#ifdef SPIFFS_PART_DESC_ADDR
+    struct spiffs_part_desc desc = {
+        .magic = SPIFFS_PART_DESC_MAGIC,
+        .addr = p->addr,
+        .size = p->size,
+        .block_size = p->block_size,
+        .page_size = p->page_size,
+    };
+    desc.check = part_desc_check(&desc);
+    if (spi_flash_erase_sector(SPIFFS_PART_DESC_ADDR / SPI_FLASH_SEC_SIZE) != SPI_FLASH_RESULT_OK ||
+            spi_flash_write(SPIFFS_PART_DESC_ADDR, (uint32_t *) &desc, sizeof(desc)) != SPI_FLASH_RESULT_OK) {
+        SPIFFS_HAL_DEBUG("Flash operation fail line %d\n\r", __LINE__);
+        return SPIFFS_ERR_INTERNAL;
+    }
+    return SPIFFS_OK;
+#else
+    (void) p;
+    return SPIFFS_ERR_NOT_CONFIGURED;
+#endif
+}
+
+#if SPIFFS_CKPT
+/* Mount state checkpoint.
+ *
+ * Mounting makes SPIFFS read the object lookup pages of every block, to
+ * count the free and deleted pages, find the free page cursor and the
+ * largest erase count, and build the RAM index of object index headers
+ * (SPIFFS_LU_INDEX). The time this takes grows with the partition. So
+ * at unmount, and SPIFFS_CKPT_DELAY_MS after the first write since the
+ * last checkpoint, what the scan would find is saved in a checkpoint
+ * record in the sector at SPIFFS_PART_CKPT_ADDR, and mounting takes it
+ * from there with SPIFFS_mount_from_state() instead.
+ *
+ * A checkpoint is only good as long as the partition is as it was when
+ * the checkpoint was written. So before anything is written to or
+ * erased from the partition, the checkpoint is cancelled by programming
+ * its 'live' word to zero, which needs no erase. A reset after that
+ * leaves no valid checkpoint, and the next mount scans, and finishes
+ * whatever was interrupted (see fs_recover()), as it always did.
+ *
+ * The records are appended to the sector one after another, and the
+ * sector is only erased when it is full. Mounting uses the last record
+ * if its CRC is good, it has not been cancelled and it is for the same
+ * partition. Anything which writes the partition behind the back of
+ * this code, such as flashing a new SPIFFS image, must erase the
+ * checkpoint sector too. No checkpoint is written before the background
+ * consistency check which follows a mount without one is done, so that
+ * a reset before that starts the check over (see SPIFFS_BG_CHECK).
+ *
+ * The size of a record depends on the mount state, and so on the build
+ * (SPIFFS_LU_INDEX). Each record carries its size, and a sector with a
+ * record of another size is erased at mount, as its slots cannot be
+ * found, nor its record cancelled, by this build. */
+#define SPIFFS_CKPT_MAGIC           0x6b635053  /* "SPck" */
+#ifndef SPIFFS_CKPT_DELAY_MS
+#define SPIFFS_CKPT_DELAY_MS        (10*60*1000)
+#endif
+
+struct spiffs_ckpt {
+    uint32_t magic;
+    /* sizeof(struct spiffs_ckpt) */
+    uint32_t len;
+    uint32_t addr;
+    uint32_t size;
+    uint32_t block_size;
+    uint32_t page_size;
+    spiffs_mount_state state;
+    /* user_crc16() of the fields above */
+    uint32_t crc;
+    /* 0xffffffff, programmed to zero when the checkpoint is cancelled */
+    uint32_t live;
+} __attribute__((aligned(4)));
+
+#define CKPT_SLOTS  (SPI_FLASH_SEC_SIZE / sizeof(struct spiffs_ckpt))
+
+/* The slot of the valid checkpoint, or -1 if there is none */
+static int32_t ckpt_slot = -1;
+/* The first unused slot */
+static uint32_t ckpt_next;
+/* The record read or written, kept off the small stack */
+static struct spiffs_ckpt ckpt_rec;
+#if SPIFFS_CKPT_DELAY_MS
+static struct user_timer ckpt_timer;
+#endif
+
+static uint32_t ckpt_addr(uint32_t slot) {
+    return SPIFFS_PART_CKPT_ADDR + slot * sizeof(struct spiffs_ckpt);
+}
+
+static uint32_t ckpt_crc(const struct spiffs_ckpt *c) {
+    return user_crc16((const uint8_t *) c, offsetof(struct spiffs_ckpt, crc));
+}
+
+static int32_t ckpt_erase(void) {
+    ckpt_slot = -1;
+    ckpt_next = 0;
+    if (spi_flash_erase_sector(SPIFFS_PART_CKPT_ADDR / SPI_FLASH_SEC_SIZE) != SPI_FLASH_RESULT_OK) {
+        SPIFFS_HAL_DEBUG("Flash operation fail line %d\n\r", __LINE__);
+        ckpt_next = CKPT_SLOTS;
+        return SPIFFS_ERR_INTERNAL;
+    }
+    return SPIFFS_OK;
+}
+
+/* Find the last checkpoint. Returns its mount state if it is valid and
+ * for the partition 'p', or NULL. */
+static const spiffs_mount_state *ckpt_read(const struct my_spiffs_partition *p) {
+    struct spiffs_ckpt *c = &ckpt_rec;
+    uint32_t slot, magic;
+    ckpt_slot = -1;
+    for (slot = 0; slot < CKPT_SLOTS; slot++) {
+        if (spi_flash_read(ckpt_addr(slot), &magic, sizeof(magic)) != SPI_FLASH_RESULT_OK) {
+            SPIFFS_HAL_DEBUG("Flash operation fail line %d\n\r", __LINE__);
+            ckpt_next = CKPT_SLOTS;
+            return NULL;
+        }
+        if (magic == 0xffffffff) {
+            break;
+        }
+    }
+    ckpt_next = slot;
+    if (slot == 0 || spi_flash_read(ckpt_addr(slot - 1), (uint32_t *) c, sizeof(*c)) != SPI_FLASH_RESULT_OK) {
+        return NULL;
+    }
+    if (c->magic != SPIFFS_CKPT_MAGIC || c->len != sizeof(*c)) {
+        /* Of another layout, or torn in its first words */
+        SPIFFS_HAL_DEBUG("Foreign checkpoint, erasing\n");
+        ckpt_erase();
+        return NULL;
+    }
+    if (c->crc != ckpt_crc(c) || c->live != 0xffffffff) {
+        return NULL;
+    }
+    /* Valid even if for another partition, so that it gets cancelled */
+    ckpt_slot = slot - 1;
+    if (c->addr != p->addr || c->size != p->size || c->block_size != p->block_size ||
+            c->page_size != p->page_size) {
+        return NULL;
+    }
+    return &c->state;
+}
+
+/* Save the mount state of the mounted file system, which must have
+ * nothing buffered */
+static int32_t ckpt_write(void) {
+    struct spiffs_ckpt *c = &ckpt_rec;
+    if (ckpt_next >= CKPT_SLOTS && ckpt_erase() != SPIFFS_OK) {
+        return SPIFFS_ERR_INTERNAL;
+    }
+    memset(c, 0, sizeof(*c));
+    c->magic = SPIFFS_CKPT_MAGIC;
+    c->len = sizeof(*c);
+    c->addr = part.addr;
+    c->size = part.size;
+    c->block_size = part.block_size;
+    c->page_size = part.page_size;
+    SPIFFS_get_mount_state(&fs, &c->state);
+    c->crc = ckpt_crc(c);
+    c->live = 0xffffffff;
+    uint32_t slot = ckpt_next++;
+    if (spi_flash_write(ckpt_addr(slot), (uint32_t *) c, sizeof(*c)) != SPI_FLASH_RESULT_OK) {
+        SPIFFS_HAL_DEBUG("Flash operation fail line %d\n\r", __LINE__);
+        return SPIFFS_ERR_INTERNAL;
+    }
+    ckpt_slot = slot;
+    return SPIFFS_OK;
+}
+
+#if SPIFFS_CKPT_DELAY_MS
+static void ckpt_timer_cb(void *arg) {
+    if (SPIFFS_mounted(&fs) && ckpt_slot < 0 && !bg_check_pending &&
+            my_spi_flush() == SPIFFS_OK) {
+        ckpt_write();
+    }
+}
+#endif
+
+/* Cancel the valid checkpoint, if there is one, before the partition is
+ * modified, and have a new one written SPIFFS_CKPT_DELAY_MS later */
+static int32_t ckpt_cancel(void) {
+#if SPIFFS_CKPT_DELAY_MS
+    if (!ckpt_timer.armed) {
+        user_timer_setfn(&ckpt_timer, ckpt_timer_cb, NULL);
+        user_timer_arm(&ckpt_timer, SPIFFS_CKPT_DELAY_MS, false);
+    }
+#endif
+    if (ckpt_slot < 0) {
+        return SPIFFS_OK;
+    }
+    uint32_t zero = 0;
+    uint32_t addr = ckpt_addr(ckpt_slot) + offsetof(struct spiffs_ckpt, live);
+    ckpt_slot = -1;
+    if (spi_flash_write(addr, &zero, sizeof(zero)) != SPI_FLASH_RESULT_OK) {
+        SPIFFS_HAL_DEBUG("Flash operation fail line %d\n\r", __LINE__);
+        return SPIFFS_ERR_INTERNAL;
+    }
+    return SPIFFS_OK;
+}
+#endif //SPIFFS_CKPT
+
+/* Finishing interrupted wish_fs replaces and deletes at mount.
+ *
+ * The object index header pages are visited in one pass over the lookup
+ * pages, and the headers named with WISH_FS_TMP_SUFFIX or
+ * WISH_FS_NEW_SUFFIX are noted, along with header pages which never
+ * were finalized. A rename interrupted after the new header page was
+ * finalized but before the old one was deleted leaves two headers of the
+ * same object; the later name of the two is kept.
+ *
+ * Any other object index header move cut short the same way, such as the
+ * one which stores the new size after an append, also leaves two final
+ * headers of the object, and SPIFFS_check() would delete the whole object
+ * for the data pages both refer to. Of the two, the one whose data pages
+ * are all there is kept, then the larger one, then the one with a wish_fs
+ * suffix, and the other is deleted. The objects seen are noted by
+ * a hash of their ids in fs.work, so that the lookup pages are only
+ * searched again for an object whose hash was seen before.
+ *
+ * Objects which only have a temporary name are deleted page by page,
+ * since the remove which was interrupted may have left the object index
+ * incomplete. A file with the new suffix is renamed over the file without
+ * it. A page written by a reset before its lookup entry is deleted, so
+ * that it is not programmed over. Reads one page header for each index
+ * header and each block in the partition, much less than SPIFFS_check()
+ * does. */
+#define RECOVER_MAX 8
+
+enum recover_kind {
+    RECOVER_UNFINISHED,
+    RECOVER_TMP,
+    RECOVER_NEW,
+};
+
+struct recover_entry {
+    spiffs_obj_id obj_id;
+    spiffs_page_ix pix;
+    enum recover_kind kind;
+};
+
+struct recover_state {
+    struct recover_entry entries[RECOVER_MAX];
+    int count;
+    bool overflow;
+    /* The block of the last free page checked */
+    int free_bix;
+};
+
+static bool name_has_suffix(const u8_t *name, const char *suffix) {
+    size_t len = 0;
+    while (len < SPIFFS_OBJ_NAME_LEN && name[len] != 0) {
+        len++;
+    }
+    size_t slen = strlen(suffix);
+    return len > slen && memcmp(name + len - slen, suffix, slen) == 0;
+}
+
+/* Whether the data pages the object index header 'hdr' at 'pix' refers to
+ * are all there, final and not deleted */
+static s32_t recover_header_whole(spiffs *fs, spiffs_page_ix pix,
+        const spiffs_page_object_ix_header *hdr, bool *whole) {
+    spiffs_obj_id obj_id = hdr->p_hdr.obj_id & ~SPIFFS_OBJ_ID_IX_FLAG;
+    u32_t size = hdr->size == SPIFFS_UNDEFINED_LEN ? 0 : hdr->size;
+    u32_t pages = (size + SPIFFS_DATA_PAGE_SIZE(fs) - 1) / SPIFFS_DATA_PAGE_SIZE(fs);
+    u32_t i;
+    if (pages > SPIFFS_OBJ_HDR_IX_LEN(fs)) {
+        pages = SPIFFS_OBJ_HDR_IX_LEN(fs);
+    }
+    *whole = false;
+    for (i = 0; i < pages; i++) {
+        spiffs_page_ix data_pix;
+        spiffs_page_header ph;
+        s32_t res = _spiffs_rd(fs, SPIFFS_OP_T_OBJ_LU2 | SPIFFS_OP_C_READ, 0,
+            SPIFFS_PAGE_TO_PADDR(fs, pix) + sizeof(spiffs_page_object_ix_header) + i * sizeof(data_pix),
+            sizeof(data_pix), (u8_t *) &data_pix);
+        SPIFFS_CHECK_RES(res);
+        if (data_pix >= SPIFFS_PAGES_PER_BLOCK(fs) * fs->block_count) {
+            return SPIFFS_OK;
+        }
+        res = _spiffs_rd(fs, SPIFFS_OP_T_OBJ_LU2 | SPIFFS_OP_C_READ, 0,
+            SPIFFS_PAGE_TO_PADDR(fs, data_pix), sizeof(ph), (u8_t *) &ph);
+        SPIFFS_CHECK_RES(res);
+        if (ph.obj_id != obj_id || ph.span_ix != i ||
+                (ph.flags & (SPIFFS_PH_FLAG_USED | SPIFFS_PH_FLAG_FINAL | SPIFFS_PH_FLAG_INDEX |
+                    SPIFFS_PH_FLAG_DELET)) != (SPIFFS_PH_FLAG_INDEX | SPIFFS_PH_FLAG_DELET)) {
+            return SPIFFS_OK;
+        }
+    }
+    *whole = true;
+    return SPIFFS_OK;
+}
+
+static bool name_has_wish_fs_suffix(const u8_t *name) {
+    return name_has_suffix(name, WISH_FS_TMP_SUFFIX) || name_has_suffix(name, WISH_FS_NEW_SUFFIX);
+}
+
+/* Of the final object index headers 'hdr' at 'pix' and the one at
+ * 'other_pix' of the same object, delete the one not kept. Returns 1 if
+ * that is the one at 'pix', 0 if it is the other one, or a negative
+ * SPIFFS error. */
+static s32_t recover_duplicate(spiffs *fs, struct recover_state *st, spiffs_page_ix pix,
+        const spiffs_page_object_ix_header *hdr, spiffs_page_ix other_pix) {
+    spiffs_page_object_ix_header other;
+    bool whole, other_whole;
+    s32_t res = _spiffs_rd(fs, SPIFFS_OP_T_OBJ_LU2 | SPIFFS_OP_C_READ, 0,
+        SPIFFS_PAGE_TO_PADDR(fs, other_pix), sizeof(other), (u8_t *) &other);
+    SPIFFS_CHECK_RES(res);
+    res = recover_header_whole(fs, pix, hdr, &whole);
+    SPIFFS_CHECK_RES(res);
+    res = recover_header_whole(fs, other_pix, &other, &other_whole);
+    SPIFFS_CHECK_RES(res);
+    u32_t size = hdr->size == SPIFFS_UNDEFINED_LEN ? 0 : hdr->size;
+    u32_t other_size = other.size == SPIFFS_UNDEFINED_LEN ? 0 : other.size;
+    bool keep;
+    if (whole != other_whole) {
+        keep = whole;
+    }
+    else if (size != other_size) {
+        keep = size > other_size;
+    }
+    else {
+        /* A wish_fs rename, finished below as if the header with the
+         * suffix were the only one */
+        keep = name_has_wish_fs_suffix(hdr->name) || !name_has_wish_fs_suffix(other.name);
+    }
+    spiffs_page_ix del_pix = keep ? other_pix : pix;
+    SPIFFS_HAL_DEBUG("recover: duplicate header %d of %04x\n", del_pix, hdr->p_hdr.obj_id);
+    res = spiffs_page_delete(fs, del_pix);
+    SPIFFS_CHECK_RES(res);
+    /* Forget what was noted of the deleted header */
+    int i, j;
+    for (i = 0, j = 0; i < st->count; i++) {
+        if (st->entries[i].pix != del_pix) {
+            st->entries[j++] = st->entries[i];
+        }
+    }
+    st->count = j;
+    return keep ? 0 : 1;
+}
+
+static s32_t recover_visitor(spiffs *fs, spiffs_obj_id obj_id, spiffs_block_ix bix, int ix_entry,
+        const void *user_const_p, void *user_var_p) {
+    struct recover_state *st = user_var_p;
+    spiffs_page_ix pix = SPIFFS_OBJ_LOOKUP_ENTRY_TO_PIX(fs, bix, ix_entry);
+    spiffs_page_object_ix_header hdr;
+    s32_t res;
+    if (obj_id == SPIFFS_OBJ_ID_FREE && st->free_bix != bix) {
+        /* The pages of a block are taken in order, so only the first free
+         * one can have been written by a reset before its lookup entry */
+        st->free_bix = bix;
+        res = _spiffs_rd(fs, SPIFFS_OP_T_OBJ_LU2 | SPIFFS_OP_C_READ, 0,
+            SPIFFS_PAGE_TO_PADDR(fs, pix), sizeof(hdr.p_hdr), (u8_t *) &hdr.p_hdr);
+        SPIFFS_CHECK_RES(res);
+        if (hdr.p_hdr.obj_id == SPIFFS_OBJ_ID_FREE && hdr.p_hdr.span_ix == (spiffs_span_ix) -1 &&
+                hdr.p_hdr.flags == 0xff) {
+            return SPIFFS_VIS_COUNTINUE;
+        }
+        SPIFFS_HAL_DEBUG("recover: page %d written but free\n", pix);
+        /* Counted as free by the mount */
+        fs->stats_p_allocated++;
+        if (ix_entry == 0) {
+            fs->free_blocks--;
+        }
+        res = spiffs_page_delete(fs, pix);
+        SPIFFS_CHECK_RES(res);
+        return SPIFFS_VIS_COUNTINUE_RELOAD;
+    }
+    if (obj_id == SPIFFS_OBJ_ID_FREE || obj_id == SPIFFS_OBJ_ID_DELETED ||
+            (obj_id & SPIFFS_OBJ_ID_IX_FLAG) == 0) {
+        return SPIFFS_VIS_COUNTINUE;
+    }
+    res = _spiffs_rd(fs, SPIFFS_OP_T_OBJ_LU2 | SPIFFS_OP_C_READ, 0,
+        SPIFFS_PAGE_TO_PADDR(fs, pix), sizeof(hdr), (u8_t *) &hdr);
+    SPIFFS_CHECK_RES(res);
+    if (hdr.p_hdr.span_ix != 0 || (hdr.p_hdr.flags & SPIFFS_PH_FLAG_DELET) == 0 ||
+            (hdr.p_hdr.flags & SPIFFS_PH_FLAG_IXDELE) == 0) {
+        return SPIFFS_VIS_COUNTINUE;
+    }
+    s32_t ret = SPIFFS_VIS_COUNTINUE;
+    if ((hdr.p_hdr.flags & SPIFFS_PH_FLAG_FINAL) == 0) {
+        u32_t bit = (obj_id & ~SPIFFS_OBJ_ID_IX_FLAG) % (SPIFFS_CFG_LOG_PAGE_SZ(fs) * 8);
+        if (fs->work[bit / 8] & (1 << (bit % 8))) {
+            /* Searching the lookup pages takes fs->lu_work */
+            ret = SPIFFS_VIS_COUNTINUE_RELOAD;
+            spiffs_page_ix other_pix;
+            res = spiffs_obj_lu_find_id_and_span(fs, obj_id, 0, pix, &other_pix);
+            if (res == SPIFFS_OK) {
+                res = recover_duplicate(fs, st, pix, &hdr, other_pix);
+                SPIFFS_CHECK_RES(res);
+                if (res == 1) {
+                    return ret;
+                }
+            }
+            else if (res != SPIFFS_ERR_NOT_FOUND) {
+                return res;
+            }
+        }
+        fs->work[bit / 8] |= 1 << (bit % 8);
+    }
+    enum recover_kind kind;
+    if (hdr.p_hdr.flags & SPIFFS_PH_FLAG_FINAL) {
+        kind = RECOVER_UNFINISHED;
+    }
+    else if (name_has_suffix(hdr.name, WISH_FS_TMP_SUFFIX)) {
+        kind = RECOVER_TMP;
+    }
+    else if (name_has_suffix(hdr.name, WISH_FS_NEW_SUFFIX)) {
+        kind = RECOVER_NEW;
+    }
+    else {
+        return ret;
+    }
+    if (st->count == RECOVER_MAX) {
+        st->overflow = true;
+        return ret;
+    }
+    st->entries[st->count].obj_id = obj_id & ~SPIFFS_OBJ_ID_IX_FLAG;
+    st->entries[st->count].pix = pix;
+    st->entries[st->count].kind = kind;
+    st->count++;
+    return ret;
+}
+
+static s32_t delete_object_visitor(spiffs *fs, spiffs_obj_id obj_id, spiffs_block_ix bix, int ix_entry,
+        const void *user_const_p, void *user_var_p) {
+    spiffs_obj_id target = *(const spiffs_obj_id *) user_const_p;
+    if (obj_id == SPIFFS_OBJ_ID_FREE || obj_id == SPIFFS_OBJ_ID_DELETED ||
+            (obj_id & ~SPIFFS_OBJ_ID_IX_FLAG) != target) {
+        return SPIFFS_VIS_COUNTINUE;
+    }
+    s32_t res = spiffs_page_delete(fs, SPIFFS_OBJ_LOOKUP_ENTRY_TO_PIX(fs, bix, ix_entry));
+    SPIFFS_CHECK_RES(res);
+    return SPIFFS_VIS_COUNTINUE_RELOAD;
+}
+
+/* Delete every page of the object, whatever state it was left in */
+static s32_t delete_object(spiffs_obj_id obj_id) {
+    s32_t res = spiffs_obj_lu_find_entry_visitor(&fs, 0, 0, SPIFFS_VIS_NO_WRAP, 0,
+        delete_object_visitor, &obj_id, NULL, NULL, NULL);
+    return res == SPIFFS_VIS_END ? SPIFFS_OK : res;
+}
+
+/* The object the file 'name' is, or 0 if there is no such file */
+static spiffs_obj_id find_object(const u8_t *name) {
+    spiffs_page_ix pix;
+    spiffs_page_header ph;
+    if (spiffs_object_find_object_index_header_by_name(&fs, name, &pix) != SPIFFS_OK ||
+            _spiffs_rd(&fs, SPIFFS_OP_T_OBJ_LU2 | SPIFFS_OP_C_READ, 0,
+                SPIFFS_PAGE_TO_PADDR(&fs, pix), sizeof(ph), (u8_t *) &ph) != SPIFFS_OK) {
+        return 0;
+    }
+    return ph.obj_id & ~SPIFFS_OBJ_ID_IX_FLAG;
+}
+
+static bool recover_has(const struct recover_state *st, spiffs_obj_id obj_id, enum recover_kind kind) {
+    int i;
+    for (i = 0; i < st->count; i++) {
+        if (st->entries[i].obj_id == obj_id && st->entries[i].kind == kind) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static s32_t fs_recover(void) {
+    struct recover_state st;
+    s32_t res;
+    int i;
+    do {
+        memset(&st, 0, sizeof(st));
+        st.free_bix = -1;
+        memset(fs.work, 0, SPIFFS_CFG_LOG_PAGE_SZ(&fs));
+        res = spiffs_obj_lu_find_entry_visitor(&fs, 0, 0, SPIFFS_VIS_NO_WRAP, 0,
+            recover_visitor, NULL, &st, NULL, NULL);
+        if (res != SPIFFS_VIS_END) {
+            return res;
+        }
+        if (st.count == 0) {
+            return SPIFFS_OK;
+        }
+        res = SPIFFS_OK;
+#if SPIFFS_LU_INDEX
+        /* Pages are deleted under it */
+        memset(fs.lu_index, 0, sizeof(fs.lu_index));
+        fs.lu_index_complete = 0;
+#endif
+        for (i = 0; i < st.count && res == SPIFFS_OK; i++) {
+            struct recover_entry *e = &st.entries[i];
+            if (e->kind == RECOVER_UNFINISHED) {
+                SPIFFS_HAL_DEBUG("recover: unfinished header %d\n", e->pix);
+                res = spiffs_page_delete(&fs, e->pix);
+            }
+            else if (e->kind == RECOVER_TMP) {
+                if (recover_has(&st, e->obj_id, RECOVER_NEW)) {
+                    /* Renamed to the new name, which is kept */
+                    res = spiffs_page_delete(&fs, e->pix);
+                }
+                else {
+                    SPIFFS_HAL_DEBUG("recover: deleting %04x\n", e->obj_id);
+                    res = delete_object(e->obj_id);
+                }
+            }
+        }
+        for (i = 0; i < st.count && res == SPIFFS_OK; i++) {
+            struct recover_entry *e = &st.entries[i];
+            spiffs_page_object_ix_header hdr;
+            if (e->kind != RECOVER_NEW) {
+                continue;
+            }
+            res = _spiffs_rd(&fs, SPIFFS_OP_T_OBJ_LU2 | SPIFFS_OP_C_READ, 0,
+                SPIFFS_PAGE_TO_PADDR(&fs, e->pix), sizeof(hdr), (u8_t *) &hdr);
+            if (res != SPIFFS_OK) {
+                break;
+            }
+            u8_t new_name[SPIFFS_OBJ_NAME_LEN];
+            u8_t name[SPIFFS_OBJ_NAME_LEN];
+            memcpy(new_name, hdr.name, sizeof(new_name));
+            new_name[SPIFFS_OBJ_NAME_LEN - 1] = 0;
+            memcpy(name, new_name, sizeof(name));
+            name[strlen((char *) name) - strlen(WISH_FS_NEW_SUFFIX)] = 0;
+
+            spiffs_obj_id old = find_object(name);
+            if (old == e->obj_id) {
+                /* The rename to the final name was interrupted */
+                res = spiffs_page_delete(&fs, e->pix);
+                continue;
+            }
+            SPIFFS_HAL_DEBUG("recover: %s replaces %s\n", new_name, name);
+            if (old != 0) {
+                res = delete_object(old);
+                if (res != SPIFFS_OK) {
+                    break;
+                }
+            }
+            res = SPIFFS_rename(&fs, (char *) new_name, (char *) name);
+        }
+#if SPIFFS_LU_INDEX
+        spiffs_lu_index_build(&fs);
+#endif
+        my_spi_flush();
+    } while (res == SPIFFS_OK && st.overflow);
+    return res;
+}
+
+static int32_t part_mount(const struct my_spiffs_partition *p, bool format) {
     spiffs_config cfg = { 0 };
-#if 0
-    /* NB: SPIFFS_SIGNLETON is defined, configuration is static! */
-    //cfg.phys_size = 2*1024*1024; // use all spi flash
-    cfg.phys_size = 8*SPI_FLASH_SEC_SIZE; // use just some spi flash
-    cfg.phys_addr = 0x1da000; // start spiffs at start of spi flash
-    cfg.phys_erase_block = SPI_FLASH_SEC_SIZE; // according to datasheet
-    cfg.log_block_size = SPI_FLASH_SEC_SIZE; // let us not complicate things
-    cfg.log_page_size = LOG_PAGE_SIZE; // as we said
+#if SPIFFS_SINGLETON
+    /* The geometry is compiled in */
+    if (p->addr != SPIFFS_PART_ADDR || p->size != SPIFFS_PART_SIZE ||
+            p->block_size != SPIFFS_PART_BLOCK_SIZE || p->page_size != SPIFFS_PART_PAGE_SIZE) {
+        SPIFFS_HAL_DEBUG("Partition differs from the singleton one\n");
+        return SPIFFS_ERR_NOT_CONFIGURED;
+    }
+#else
+    cfg.phys_addr = p->addr;
+    cfg.phys_size = p->size;
+    cfg.phys_erase_block = SPI_FLASH_SEC_SIZE;
+    cfg.log_block_size = p->block_size;
+    cfg.log_page_size = p->page_size;
 #endif
 
     cfg.hal_read_f = my_spi_read;
     cfg.hal_write_f = my_spi_write;
     cfg.hal_erase_f = my_spi_erase;
 
-    int res = SPIFFS_mount(&fs, &cfg, spiffs_work_buf, spiffs_fds, sizeof(spiffs_fds), spiffs_cache_buf, sizeof(spiffs_cache_buf), 0);
-    SPIFFS_HAL_DEBUG("mount res: %d\n", res);
+    if (SPIFFS_mounted(&fs)) {
+        SPIFFS_unmount(&fs);
+    }
+    int32_t res;
+    bool from_ckpt = false, formatted = false;
+#if SPIFFS_BG_CHECK
+    bg_check_pending = false;
+#endif
+#if SPIFFS_CKPT
+    const spiffs_mount_state *state = ckpt_read(p);
+    if (state != NULL && !format) {
+        res = SPIFFS_mount_from_state(&fs, &cfg, spiffs_work_buf, spiffs_fds, sizeof(spiffs_fds),
+            spiffs_cache_buf, sizeof(spiffs_cache_buf), 0, state);
+        from_ckpt = res == SPIFFS_OK;
+    }
+    else
+#endif
+    {
+        res = SPIFFS_mount(&fs, &cfg, spiffs_work_buf, spiffs_fds, sizeof(spiffs_fds),
+            spiffs_cache_buf, sizeof(spiffs_cache_buf), 0);
+    }
+    my_spi_flush();
+    SPIFFS_HAL_DEBUG("mount res: %d%s\n", res, from_ckpt ? " from checkpoint" : "");
+    if (format || res != SPIFFS_OK) {
+        /* Even a failed mount leaves the configuration behind, which is
+         * what SPIFFS_format needs */
+        SPIFFS_unmount(&fs);
+        res = SPIFFS_format(&fs);
+        my_spi_flush();
+        formatted = true;
+        SPIFFS_HAL_DEBUG("format res: %d\n", res);
+        if (res == SPIFFS_OK) {
+            res = SPIFFS_mount(&fs, &cfg, spiffs_work_buf, spiffs_fds, sizeof(spiffs_fds),
+                spiffs_cache_buf, sizeof(spiffs_cache_buf), 0);
+            my_spi_flush();
+            SPIFFS_HAL_DEBUG("mount res: %d\n", res);
+        }
+    }
+    if (res == SPIFFS_OK) {
+        part = *p;
+        /* Nothing was written after the checkpoint, so nothing can have
+         * been interrupted either */
+        int32_t rec = from_ckpt ? SPIFFS_OK : fs_recover();
+        my_spi_flush();
+        if (rec != SPIFFS_OK) {
+            SPIFFS_HAL_DEBUG("recover res: %d\n", rec);
+        }
+        bg_gc_kick();
+#if SPIFFS_BG_CHECK
+        /* Without a checkpoint the file system was not unmounted, and
+         * anything may have been cut short by the reset */
+        bg_check_pending = !from_ckpt && !formatted;
+        bg_check_progress = 1;
+        bg_check_kick();
+#endif
+    }
+    return res;
 }
 
+void my_spiffs_unmount(void) {
+    bool mounted = SPIFFS_mounted(&fs);
+    if (mounted) {
+        SPIFFS_unmount(&fs);
+    }
+    int32_t res = my_spi_flush();
+#if SPIFFS_CKPT
+#if SPIFFS_CKPT_DELAY_MS
+    user_timer_disarm(&ckpt_timer);
+#endif
+    if (mounted && res == SPIFFS_OK && ckpt_slot < 0 && !bg_check_pending) {
+        ckpt_write();
+    }
+#else
+    (void) res;
+#endif
+#if SPIFFS_BG_CHECK
+    user_timer_disarm(&bg_check_timer);
+    bg_check_pending = false;
+#endif
+#if SPIFFS_HAL_READ_CACHE
+    /* The flash may change before the next mount */
+    read_cache_erase(0, 0xffffffff);
+#endif
+}
+
+void my_spiffs_mount() {
+    struct my_spiffs_partition p = {
+        .addr = SPIFFS_PART_ADDR,
+        .size = SPIFFS_PART_SIZE,
+        .block_size = SPIFFS_PART_BLOCK_SIZE,
+        .page_size = SPIFFS_PART_PAGE_SIZE,
+    };
+    if (part_desc_read(&p)) {
+        SPIFFS_HAL_DEBUG("spiffs partition from descriptor\n");
+    }
+    SPIFFS_HAL_DEBUG("spiffs partition %x size %x block %x page %d\n",
+        p.addr, p.size, p.block_size, p.page_size);
+    part_mount(&p, false);
+}
+
+int32_t my_spiffs_set_partition(const struct my_spiffs_partition *p) {
+    if (!part_valid(p)) {
+        return SPIFFS_ERR_NOT_CONFIGURED;
+    }
+    int32_t res = part_desc_write(p);
+    if (res != SPIFFS_OK) {
+        return res;
+    }
+    return part_mount(p, true);
+}
+
+void my_spiffs_get_partition(struct my_spiffs_partition *p) {
+    *p = part;
+}
+
+
+#if SPIFFS_BG_GC
+/* Background garbage collection.
+ *
+ * SPIFFS collects garbage when a write finds three or fewer free
+ * blocks, and the write then waits for whole blocks to be cleaned and
+ * erased. Instead, after a file system operation which may have left
+ * deleted pages behind, a timer is armed, and when the file system has
+ * been idle for SPIFFS_BG_GC_IDLE_MS, the garbage is collected one step
+ * per timer tick, until there are more than SPIFFS_BG_GC_FREE_BLOCKS free
+ * blocks. The default is the limit of SPIFFS itself, so the background
+ * does the work the next write would have done; a higher limit moves
+ * more live pages and wears the flash more. A step is one block erase,
+ * preceded by moving the live pages out of the block if it has any;
+ * SPIFFS keeps the state of a block clean in its work buffers, so the
+ * step cannot be made any smaller. Any file system operation postpones
+ * the next step. */
+#ifndef SPIFFS_BG_GC_FREE_BLOCKS
+#define SPIFFS_BG_GC_FREE_BLOCKS    3
+#endif
+#ifndef SPIFFS_BG_GC_IDLE_MS
+#define SPIFFS_BG_GC_IDLE_MS        200
+#endif
+#define SPIFFS_BG_GC_STEP_MS        USER_TIMER_TICK_MS
+
+static struct user_timer bg_gc_timer;
+
+static bool bg_gc_needed(void) {
+    return SPIFFS_mounted(&fs) && fs.free_blocks <= SPIFFS_BG_GC_FREE_BLOCKS
+        && fs.stats_p_deleted > 0;
+}
 
+static void bg_gc_timer_cb(void *arg) {
+    if (my_spiffs_gc_step() > 0) {
+        user_timer_arm(&bg_gc_timer, SPIFFS_BG_GC_STEP_MS, false);
+    }
+}
+
+static void bg_gc_kick(void) {
+    if (bg_gc_needed()) {
+        user_timer_setfn(&bg_gc_timer, bg_gc_timer_cb, NULL);
+        user_timer_arm(&bg_gc_timer, SPIFFS_BG_GC_IDLE_MS, false);
+    }
+}
+#endif //SPIFFS_BG_GC
+
+#if SPIFFS_BG_CHECK
+/* Background consistency check.
+ *
+ * A reset or a power cut can leave a write or a garbage collection half
+ * done in a way that the mount and fs_recover() do not mend, which is
+ * what SPIFFS_check() is for. But it reads every page of the partition
+ * a few times over, which takes seconds on a large partition. So after
+ * a mount which did not come from a checkpoint, and so followed a reset,
+ * the check is done with SPIFFS_check_step() when the file system has
+ * been idle for SPIFFS_BG_CHECK_IDLE_MS, for SPIFFS_BG_CHECK_BUDGET_US of
+ * every timer tick until it is done. SPIFFS goes back over the part of
+ * the check it was in the middle of when the file system is used between
+ * the steps, so any file system operation postpones the next step. */
+#ifndef SPIFFS_BG_CHECK_IDLE_MS
+#define SPIFFS_BG_CHECK_IDLE_MS     1000
+#endif
+#ifndef SPIFFS_BG_CHECK_BUDGET_US
+#define SPIFFS_BG_CHECK_BUDGET_US   5000
+#endif
+#define SPIFFS_BG_CHECK_STEP_MS     USER_TIMER_TICK_MS
+
+static void bg_check_timer_cb(void *arg) {
+    if (my_spiffs_check_step() > 0) {
+        user_timer_arm(&bg_check_timer, SPIFFS_BG_CHECK_STEP_MS, false);
+    }
+}
+
+static void bg_check_kick(void) {
+    if (bg_check_pending) {
+        user_timer_setfn(&bg_check_timer, bg_check_timer_cb, NULL);
+        user_timer_arm(&bg_check_timer, SPIFFS_BG_CHECK_IDLE_MS, false);
+    }
+}
+#endif //SPIFFS_BG_CHECK
+
+/* Microseconds since boot, of the SDK */
+uint32 system_get_time(void);
+
+uint32_t my_spiffs_time_us(void) {
+    return system_get_time();
+}
+
+int32_t my_spiffs_check_step(void) {
+#if SPIFFS_BG_CHECK
+    if (!bg_check_pending || !SPIFFS_mounted(&fs)) {
+        return 0;
+    }
+    int32_t res = SPIFFS_check_step(&fs, SPIFFS_BG_CHECK_BUDGET_US);
+    my_spi_flush();
+    if (res > 0) {
+        bg_check_progress = res;
+        return res;
+    }
+    bg_check_pending = false;
+    bg_check_progress = 0;
+    if (res < 0) {
+        SPIFFS_HAL_DEBUG("check errno %d\n", SPIFFS_errno(&fs));
+        return res;
+    }
+    SPIFFS_HAL_DEBUG("check done\n");
+    /* Mending deletes pages */
+    bg_gc_kick();
+    return 0;
+#else
+    return 0;
+#endif
+}
+
+int32_t my_spiffs_gc_step(void) {
+#if SPIFFS_BG_GC
+    if (!bg_gc_needed()) {
+        return 0;
+    }
+    uint32_t free_blocks = fs.free_blocks;
+    uint32_t deleted = fs.stats_p_deleted;
+    int32_t res = SPIFFS_gc_step(&fs);
+    my_spi_flush();
+    if (res == SPIFFS_ERR_NO_DELETED_BLOCKS) {
+        return 0;
+    }
+    if (res < 0) {
+        SPIFFS_HAL_DEBUG("gc step errno %d\n", SPIFFS_errno(&fs));
+        return res;
+    }
+    /* A candidate block with nothing deleted in it only gets its pages
+     * moved around, so give up until the next modification */
+    if (fs.free_blocks <= free_blocks && fs.stats_p_deleted >= deleted) {
+        return 0;
+    }
+    return bg_gc_needed() ? 1 : 0;
+#else
+    return 0;
+#endif
+}
+
+
+/* The HAL writes which were coalesced during an operation are only
+ * programmed by my_spi_flush(), and if that fails the operation has
+ * failed too, whatever SPIFFS returned */
 wish_file_t my_fs_open(const char *pathname) {
     spiffs_file fd = 0;
     fd = SPIFFS_open(&fs, pathname, SPIFFS_CREAT |  SPIFFS_RDWR, 0);
+    int32_t res = my_spi_flush();
+    bg_check_kick();
     if (fd < 0) {
         SPIFFS_HAL_DEBUG("Could not open file: %d\n\r", SPIFFS_errno(&fs));
     }
+    else if (res != SPIFFS_OK) {
+        /* The file may not be in flash as it was created */
+        SPIFFS_close(&fs, fd);
+        my_spi_flush();
+        return res;
+    }
     return fd;
 }
 
 int32_t my_fs_read(wish_file_t fd, void* buf, size_t count) {
     int32_t ret = SPIFFS_read(&fs, fd, buf, count);
+    int32_t res = my_spi_flush();
+    bg_check_kick();
+    if (res != SPIFFS_OK) {
+        return res;
+    }
     if (ret < 0) {
         if (ret == SPIFFS_ERR_END_OF_OBJECT) {
             //SPIFFS_HAL_DEBUG("EOF encountered?\n\r");
@@ -75,37 +1062,410 @@ int32_t my_fs_read(wish_file_t fd, void* buf, size_t count) {
 
 int32_t my_fs_write(wish_file_t fd, const void *buf, size_t count) {
     int32_t ret = SPIFFS_write(&fs, fd, (void *)buf, count); 
+    int32_t res = my_spi_flush();
+    bg_gc_kick();
+    bg_check_kick();
     if (ret < 0) {
         SPIFFS_HAL_DEBUG("write errno %d\n", SPIFFS_errno(&fs));
     }
-    return ret; 
+    return res != SPIFFS_OK ? res : ret; 
 }
 
 wish_offset_t my_fs_lseek(wish_file_t fd, wish_offset_t offset, int whence) {
     int32_t ret = SPIFFS_lseek(&fs, fd, offset, whence);
+    int32_t res = my_spi_flush();
+    bg_check_kick();
     if (ret < 0) {
         SPIFFS_HAL_DEBUG("seek errno %d\n", SPIFFS_errno(&fs));
     }
-    return ret;
+    return res != SPIFFS_OK ? res : ret;
 }
 
 int32_t my_fs_close(wish_file_t fd) {
     int32_t ret = SPIFFS_close(&fs, fd);
-    return ret;
+    int32_t res = my_spi_flush();
+    bg_gc_kick();
+    bg_check_kick();
+    return res != SPIFFS_OK ? res : ret;
 }
 
 int32_t my_fs_rename(const char *oldpath, const char *newpath) {
-    return SPIFFS_rename(&fs, oldpath, newpath);
+    int32_t ret = SPIFFS_rename(&fs, oldpath, newpath);
+    int32_t res = my_spi_flush();
+    bg_gc_kick();
+    bg_check_kick();
+    return res != SPIFFS_OK ? res : ret;
 }
 
 
 int32_t my_fs_remove(const char *path) {
-    return SPIFFS_remove(&fs, path);
+    int32_t ret = SPIFFS_remove(&fs, path);
+    int32_t res = my_spi_flush();
+    bg_gc_kick();
+    bg_check_kick();
+    return res != SPIFFS_OK ? res : ret;
 }
 
+/* SPIFFS never programs over data, any change to a data page writes a
+ * new copy of the page and of the object index pages pointing to it.
+ * Bytes of a file which still are 0xff in flash can however be
+ * programmed in place, as long as the copies of the page in the SPIFFS
+ * cache are dropped. Garbage collection copies the programmed bytes
+ * along with the page. */
+int32_t my_fs_program(wish_file_t fd, wish_offset_t offset, const void *buf, size_t count) {
+    spiffs_fd *f;
+    int32_t res = SPIFFS_fflush(&fs, fd);
+    if (res < 0) {
+        return res;
+    }
+    res = spiffs_fd_get(&fs, fd, &f);
+    if (res != SPIFFS_OK) {
+        return res;
+    }
+    if (offset < 0 || f->size == SPIFFS_UNDEFINED_LEN || offset + count > f->size) {
+        return SPIFFS_ERR_END_OF_OBJECT;
+    }
 
-int32_t my_spi_read(uint32_t addr, uint32_t size, uint8_t *dst) {
-    uint32_t result = SPIFFS_OK;
+    const uint8_t *src = buf;
+    size_t done = 0;
+    while (done < count) {
+        uint32_t pos = offset + done;
+        spiffs_span_ix spix = pos / SPIFFS_DATA_PAGE_SIZE(&fs);
+        uint32_t page_offset = pos % SPIFFS_DATA_PAGE_SIZE(&fs);
+        uint32_t nb = SPIFFS_DATA_PAGE_SIZE(&fs) - page_offset;
+        if (nb > count - done) {
+            nb = count - done;
+        }
+
+        spiffs_page_ix pix;
+        if (spix < SPIFFS_OBJ_HDR_IX_LEN(&fs)) {
+            /* The page is listed in the object index header */
+            res = my_spi_read(SPIFFS_PAGE_TO_PADDR(&fs, f->objix_hdr_pix) +
+                sizeof(spiffs_page_object_ix_header) + spix * sizeof(spiffs_page_ix),
+                sizeof(pix), (uint8_t *) &pix);
+        }
+        else {
+            res = spiffs_obj_lu_find_id_and_span(&fs, f->obj_id & ~SPIFFS_OBJ_ID_IX_FLAG,
+                spix, 0, &pix);
+        }
+        if (res != SPIFFS_OK) {
+            return res;
+        }
+        spiffs_page_header ph;
+        res = my_spi_read(SPIFFS_PAGE_TO_PADDR(&fs, pix), sizeof(ph), (uint8_t *) &ph);
+        if (res != SPIFFS_OK) {
+            return res;
+        }
+        if (ph.obj_id != (f->obj_id & ~SPIFFS_OBJ_ID_IX_FLAG) || ph.span_ix != spix) {
+            return SPIFFS_ERR_DATA_SPAN_MISMATCH;
+        }
+
+        uint32_t addr = SPIFFS_PAGE_TO_PADDR(&fs, pix) + sizeof(spiffs_page_header) + page_offset;
+        uint32_t i;
+        for (i = 0; i < nb; i += 16) {
+            uint8_t erased[16];
+            uint32_t n = nb - i < sizeof(erased) ? nb - i : sizeof(erased);
+            res = my_spi_read(addr + i, n, erased);
+            if (res != SPIFFS_OK) {
+                return res;
+            }
+            uint32_t j;
+            for (j = 0; j < n; j++) {
+                if (erased[j] != 0xff) {
+                    return SPIFFS_ERR_NOT_WRITABLE;
+                }
+            }
+        }
+        res = my_spi_write(addr, nb, (uint8_t *) src + done);
+        if (res != SPIFFS_OK) {
+            return res;
+        }
+#if SPIFFS_CACHE
+        spiffs_cache_drop_page(&fs, pix);
+#endif
+        done += nb;
+    }
+    res = my_spi_flush();
+    if (res != SPIFFS_OK) {
+        return res;
+    }
+    return count;
+}
+
+struct list_state {
+    my_fs_list_func_t *func;
+    void *arg;
+};
+
+static s32_t list_cb(spiffs *fs, const struct spiffs_dirent *e, u32_t pages, void *user) {
+    struct list_state *st = user;
+    struct my_fs_file f = {
+        .name = (const char *) e->name,
+        .size = e->size,
+        .id = e->obj_id & ~SPIFFS_OBJ_ID_IX_FLAG,
+        .pages = pages,
+    };
+    return st->func(&f, st->arg);
+}
+
+/* The cursor is the lookup entry of the index header of the next file,
+ * counted from the start of the partition. The directory is not closed,
+ * as SPIFFS_closedir() would count as use of the file system to the
+ * background consistency check. */
+int32_t my_fs_list(uint32_t *cursor, my_fs_list_func_t *func, void *arg) {
+    spiffs_DIR d;
+    if (SPIFFS_opendir(&fs, "/", &d) == NULL) {
+        return SPIFFS_errno(&fs);
+    }
+    if (*cursor == MY_FS_LIST_END) {
+        return 0;
+    }
+    d.block = *cursor / SPIFFS_OBJ_LOOKUP_MAX_ENTRIES(&fs);
+    d.entry = *cursor % SPIFFS_OBJ_LOOKUP_MAX_ENTRIES(&fs);
+    struct list_state st = { .func = func, .arg = arg };
+    int32_t ret = SPIFFS_list(&d, list_cb, &st);
+    my_spi_flush();
+    bg_check_kick();
+    if (ret < 0) {
+        SPIFFS_HAL_DEBUG("list errno %d\n", ret);
+        return ret;
+    }
+    if (d.block >= fs.block_count) {
+        *cursor = MY_FS_LIST_END;
+    }
+    else {
+        *cursor = d.block * SPIFFS_OBJ_LOOKUP_MAX_ENTRIES(&fs) + d.entry;
+    }
+    return ret;
+}
+
+uint32_t my_spiffs_get_gc_runs(void) {
+    return fs.stats_gc_runs;
+}
+
+#define ERASE_AGE_NONE 0xffff
+
+/* See spiffs_gc_find_candidate(), which computes the age the same way */
+static int32_t block_erase_age(spiffs_block_ix bix, uint16_t *age) {
+    spiffs_obj_id erase_count;
+    int32_t res = my_spi_read(SPIFFS_ERASE_COUNT_PADDR(&fs, bix), sizeof(erase_count),
+        (uint8_t *) &erase_count);
+    if (res != SPIFFS_OK) {
+        return res;
+    }
+    if (erase_count == SPIFFS_OBJ_ID_FREE) {
+        *age = ERASE_AGE_NONE;
+    }
+    else if (fs.max_erase_count > erase_count) {
+        *age = fs.max_erase_count - erase_count;
+    }
+    else {
+        *age = SPIFFS_OBJ_ID_FREE - (erase_count - fs.max_erase_count);
+    }
+    return SPIFFS_OK;
+}
+
+int32_t my_spiffs_get_erase_ages(uint16_t *ages, uint32_t max) {
+    if (!SPIFFS_mounted(&fs)) {
+        return SPIFFS_ERR_NOT_MOUNTED;
+    }
+    spiffs_block_ix bix;
+    for (bix = 0; bix < fs.block_count && bix < max; bix++) {
+        int32_t res = block_erase_age(bix, &ages[bix]);
+        if (res != SPIFFS_OK) {
+            return res;
+        }
+    }
+    return bix;
+}
+
+int32_t my_spiffs_get_stats(struct my_spiffs_stats *st) {
+    if (!SPIFFS_mounted(&fs)) {
+        return SPIFFS_ERR_NOT_MOUNTED;
+    }
+    memset(st, 0, sizeof(*st));
+    st->blocks = fs.block_count;
+    st->pages_total = fs.block_count *
+        (SPIFFS_PAGES_PER_BLOCK(&fs) - SPIFFS_OBJ_LOOKUP_PAGES(&fs));
+    st->pages_allocated = fs.stats_p_allocated;
+    st->pages_deleted = fs.stats_p_deleted;
+    st->pages_free = st->pages_total - st->pages_allocated - st->pages_deleted;
+#if SPIFFS_GC_STATS
+    st->gc_runs = fs.stats_gc_runs;
+    st->gc_pages_moved = fs.stats_gc_pages_moved;
+#endif
+#if SPIFFS_CACHE_STATS
+    st->cache_hits = fs.cache_hits;
+    st->cache_misses = fs.cache_misses;
+    st->cache_lu_hits = fs.cache_lu_hits;
+    st->cache_lu_misses = fs.cache_lu_misses;
+    st->cache_ix_hits = fs.cache_ix_hits;
+    st->cache_ix_misses = fs.cache_ix_misses;
+    st->cache_data_hits = fs.cache_data_hits;
+    st->cache_data_misses = fs.cache_data_misses;
+#endif
+#if SPIFFS_BG_CHECK
+    st->check_progress = bg_check_pending ? bg_check_progress : 0;
+#endif
+    st->erase_count = fs.max_erase_count;
+    st->erase_age_min = ERASE_AGE_NONE;
+    spiffs_block_ix bix;
+    for (bix = 0; bix < fs.block_count; bix++) {
+        uint16_t age;
+        int32_t res = block_erase_age(bix, &age);
+        if (res != SPIFFS_OK) {
+            return res;
+        }
+        if (age == ERASE_AGE_NONE) {
+            continue;
+        }
+        if (age < st->erase_age_min) {
+            st->erase_age_min = age;
+        }
+        if (age > st->erase_age_max) {
+            st->erase_age_max = age;
+        }
+    }
+    if (st->erase_age_min == ERASE_AGE_NONE) {
+        st->erase_age_min = 0;
+    }
+    return SPIFFS_OK;
+}
+
+
+#if SPIFFS_HAL_READ_CACHE
+
+/* Read-ahead cache.
+ *
+ * SPIFFS reads page headers and object index headers a few bytes at a
+ * time, typically just before reading the whole page into its own cache.
+ * Reads smaller than a page are served from read_cache, which holds
+ * READ_CACHE_LINES aligned pages of flash; a miss reads the whole page
+ * with a single aligned spi_flash_read. A page sized read is served from
+ * read_cache if the page happens to be there, and otherwise goes straight
+ * to flash.
+ *
+ * The lines always mirror the flash: programming is applied to them by
+ * read_cache_program() and erasing drops them, so pending coalesced
+ * writes are merged on top of cached data just as on top of data read
+ * from flash. With SPIFFS_HAL_FLASH_MAP, only reads beyond the memory
+ * mapped window come here. */
+
+#define READ_CACHE_LINES        2
+#define READ_CACHE_LINE_SIZE    LOG_PAGE_SIZE
+#define READ_CACHE_NONE         0xffffffff
+
+static uint32_t read_cache[READ_CACHE_LINES][READ_CACHE_LINE_SIZE/4];
+/* Flash address of each line, or READ_CACHE_NONE */
+static uint32_t read_cache_addr[READ_CACHE_LINES] = { READ_CACHE_NONE, READ_CACHE_NONE };
+/* The line used last, the other one is replaced on a miss */
+static uint8_t read_cache_last;
+
+static uint8_t *read_cache_line(uint32_t line_addr) {
+    int i;
+    for (i = 0; i < READ_CACHE_LINES; i++) {
+        if (read_cache_addr[i] == line_addr) {
+            read_cache_last = i;
+            return (uint8_t *) read_cache[i];
+        }
+    }
+    i = (read_cache_last + 1) % READ_CACHE_LINES;
+    read_cache_addr[i] = READ_CACHE_NONE;
+    if (spi_flash_read(line_addr, read_cache[i], READ_CACHE_LINE_SIZE) != SPI_FLASH_RESULT_OK) {
+        SPIFFS_HAL_DEBUG("Flash operation fail line %d\n\r", __LINE__);
+        return NULL;
+    }
+    read_cache_addr[i] = line_addr;
+    read_cache_last = i;
+    return (uint8_t *) read_cache[i];
+}
+
+/* Whether all of the bytes are in a single cached line */
+static bool read_cache_has(uint32_t addr, uint32_t size) {
+    uint32_t line_addr = addr & ~(READ_CACHE_LINE_SIZE - 1);
+    int i;
+    if (addr + size > line_addr + READ_CACHE_LINE_SIZE) {
+        return false;
+    }
+    for (i = 0; i < READ_CACHE_LINES; i++) {
+        if (read_cache_addr[i] == line_addr) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Apply programming 'size' bytes at 'addr' to the cached lines */
+static void read_cache_program(uint32_t addr, uint32_t size, const uint8_t *src) {
+    int i;
+    for (i = 0; i < READ_CACHE_LINES; i++) {
+        uint32_t line_addr = read_cache_addr[i];
+        if (line_addr == READ_CACHE_NONE ||
+                addr >= line_addr + READ_CACHE_LINE_SIZE || addr + size <= line_addr) {
+            continue;
+        }
+        uint32_t lo = addr > line_addr ? addr : line_addr;
+        uint32_t hi = addr + size;
+        if (hi > line_addr + READ_CACHE_LINE_SIZE) {
+            hi = line_addr + READ_CACHE_LINE_SIZE;
+        }
+        uint8_t *line = (uint8_t *) read_cache[i];
+        for (; lo < hi; lo++) {
+            line[lo - line_addr] &= src[lo - addr];
+        }
+    }
+}
+
+static void read_cache_erase(uint32_t addr, uint32_t size) {
+    int i;
+    for (i = 0; i < READ_CACHE_LINES; i++) {
+        if (read_cache_addr[i] >= addr && read_cache_addr[i] < addr + size) {
+            read_cache_addr[i] = READ_CACHE_NONE;
+        }
+    }
+}
+
+#endif //SPIFFS_HAL_READ_CACHE
+
+#if SPIFFS_HAL_FLASH_MAP
+
+/* Memory mapped reads.
+ *
+ * The flash cache of the ESP8266 maps the first megabyte of flash at
+ * 0x40200000, where it can be read with aligned 32-bit loads (anything
+ * else is an exception, see espfs.c). A load which hits the cache is far
+ * cheaper than a spi_flash_read call, and a miss fills a whole cache line
+ * at once, so the object lookup scans of SPIFFS and the small reads of
+ * page and index headers are served from the window whenever the region
+ * lies in it. spi_flash_write and spi_flash_erase_sector disable the
+ * flash cache while they run, which drops its contents, so the window
+ * does not return stale data after the flash is changed. */
+
+#ifndef FLASH_MAP_READ
+#define FLASH_MAP_READ(addr)    (*(const volatile uint32_t *) (0x40200000 + (addr)))
+#endif
+
+static void map_read(uint32_t addr, uint32_t size, uint8_t *dst) {
+    uint32_t word_addr = addr & ~3;
+    uint32_t ofs = addr - word_addr;
+    uint32_t end = addr + size;
+    while (word_addr < end) {
+        uint32_t word = FLASH_MAP_READ(word_addr);
+        uint32_t nb = 4 - ofs;
+        if (nb > end - word_addr - ofs) {
+            nb = end - word_addr - ofs;
+        }
+        memcpy(dst, (uint8_t *) &word + ofs, nb);
+        dst += nb;
+        word_addr += 4;
+        ofs = 0;
+    }
+}
+
+#endif //SPIFFS_HAL_FLASH_MAP
+
+/* Read from flash using aligned spi_flash_read calls only */
+static int32_t spi_read_aligned(uint32_t addr, uint32_t size, uint8_t *dst) {
     /* The address that is the next alingned one after addr */
     uint32_t alignedBegin = (addr + 3) & (~3);
     /* The address that is the next alingned one after addr + size */
@@ -115,15 +1475,17 @@ int32_t my_spi_read(uint32_t addr, uint32_t size, uint8_t *dst) {
     }
 
     /* Read the odd bytes that are immediately before the next aligned
-     * address after start addr */
+     * address after start addr. The read may also end before that
+     * address. */
     if (addr < alignedBegin) {
-        uint32_t nb = alignedBegin - addr;
-        uint32_t tmp;
-        if (spi_flash_read(alignedBegin - 4, &tmp, 4) != SPI_FLASH_RESULT_OK) {
+        uint32_t ofs = alignedBegin - addr;
+        uint32_t nb = (size < ofs) ? size : ofs;
+        uint8_t tmp[4] __attribute__((aligned(4)));
+        if (spi_flash_read(alignedBegin - 4, (uint32_t*) tmp, 4) != SPI_FLASH_RESULT_OK) {
             SPIFFS_HAL_DEBUG("Flash operation fail line %d\n\r", __LINE__);
             return SPIFFS_ERR_INTERNAL;
         }
-        memcpy(dst, &tmp + 4 - nb, nb);
+        memcpy(dst, tmp + 4 - ofs, nb);
     }
 
     /* Read the bytes which are between the correctly aligned start and
@@ -148,14 +1510,182 @@ int32_t my_spi_read(uint32_t addr, uint32_t size, uint8_t *dst) {
 
         memcpy(dst + size - nb, &tmp, nb);
     }
+    return SPIFFS_OK;
+}
 
-    return result;
+int32_t my_spi_read(uint32_t addr, uint32_t size, uint8_t *dst) {
+    user_metric_add(USER_METRIC_SPIFFS_READS, 1);
+#if SPIFFS_HAL_FLASH_MAP
+    if (addr + size <= FLASH_MAP_SIZE) {
+        map_read(addr, size, dst);
+    }
+    else
+#endif
+#if SPIFFS_HAL_READ_CACHE
+    if (size < READ_CACHE_LINE_SIZE || read_cache_has(addr, size)) {
+        uint32_t done = 0;
+        /* From one or two lines, as the read is at most a line */
+        while (done < size) {
+            uint32_t line_addr = (addr + done) & ~(READ_CACHE_LINE_SIZE - 1);
+            uint32_t ofs = addr + done - line_addr;
+            uint32_t nb = READ_CACHE_LINE_SIZE - ofs;
+            if (nb > size - done) {
+                nb = size - done;
+            }
+            uint8_t *line = read_cache_line(line_addr);
+            if (line == NULL) {
+                return SPIFFS_ERR_INTERNAL;
+            }
+            memcpy(dst + done, line + ofs, nb);
+            done += nb;
+        }
+    }
+    else
+#endif
+    {
+        int32_t res = spi_read_aligned(addr, size, dst);
+        if (res != SPIFFS_OK) {
+            return res;
+        }
+    }
+
+#if SPIFFS_HAL_WRITE_COALESCE
+    write_buf_merge(addr, size, dst);
+#endif
+    return SPIFFS_OK;
+}
+
+#if SPIFFS_HAL_WRITE_COALESCE
+
+/* Write coalescing.
+ *
+ * SPIFFS updates page headers, object lookup entries and index entries
+ * with writes of a few bytes, and each of them would cost one or more
+ * spi_flash_write calls (one for every unaligned head and tail). Instead,
+ * writes to the same SPIFFS page (fs.cfg.log_page_size, at most
+ * LOG_PAGE_SIZE) are gathered to write_buf, and the page
+ * is programmed with a single aligned spi_flash_write when SPIFFS moves
+ * on to another page, or when my_spi_flush() is called at the end of the
+ * file system operation.
+ *
+ * The bytes of write_buf which were not written are 0xff, and
+ * programming them leaves the flash unchanged, as programming can only
+ * turn ones to zeros. A write which overlaps bytes already in write_buf
+ * (typically SPIFFS updating the flags of a page header it has just
+ * written) flushes the buffer first, so that the flash sees the two
+ * writes in the same order as SPIFFS made them, and the crash safety of
+ * SPIFFS is not changed. For the same reason writes to different pages
+ * are never reordered. */
+
+#define WRITE_BUF_NONE 0xffffffff
+
+static uint32_t write_buf[LOG_PAGE_SIZE/4];
+/* Flash address of the page in write_buf, or WRITE_BUF_NONE */
+static uint32_t write_buf_addr = WRITE_BUF_NONE;
+/* The bytes written to write_buf, as offsets to the page */
+static uint16_t write_buf_lo;
+static uint16_t write_buf_hi;
+
+int32_t my_spi_flush(void) {
+    if (write_buf_addr == WRITE_BUF_NONE) {
+        return SPIFFS_OK;
+    }
+    uint32_t lo = write_buf_lo & ~3;
+    uint32_t hi = (write_buf_hi + 3) & ~3;
+    uint32_t addr = write_buf_addr;
+    write_buf_addr = WRITE_BUF_NONE;
+#if SPIFFS_HAL_READ_CACHE
+    read_cache_program(addr + lo, hi - lo, (const uint8_t *) (write_buf + lo/4));
+#endif
+    if (spi_flash_write(addr + lo, write_buf + lo/4, hi - lo) != SPI_FLASH_RESULT_OK) {
+        SPIFFS_HAL_DEBUG("Flash operation fail line %d\n\r", __LINE__);
+        return SPIFFS_ERR_INTERNAL;
+    }
+    return SPIFFS_OK;
+}
+
+/* Apply the bytes of write_buf, which are not yet in flash, to data
+ * just read from flash */
+static void write_buf_merge(uint32_t addr, uint32_t size, uint8_t *dst) {
+    if (write_buf_addr == WRITE_BUF_NONE) {
+        return;
+    }
+    uint32_t lo = write_buf_addr + write_buf_lo;
+    uint32_t hi = write_buf_addr + write_buf_hi;
+    if (addr > lo) {
+        lo = addr;
+    }
+    if (addr + size < hi) {
+        hi = addr + size;
+    }
+    const uint8_t *buf = (const uint8_t *) write_buf;
+    for (; lo < hi; lo++) {
+        dst[lo - addr] &= buf[lo - write_buf_addr];
+    }
+}
+
+int32_t my_spi_write(uint32_t addr, uint32_t size, uint8_t *src) {
+    user_metric_add(USER_METRIC_SPIFFS_WRITES, 1);
+    if (ckpt_cancel() != SPIFFS_OK) {
+        return SPIFFS_ERR_INTERNAL;
+    }
+
+    /* The pages of the partition, which may be smaller than write_buf */
+    uint32_t page_size = SPIFFS_CFG_LOG_PAGE_SZ(&fs);
+    while (size > 0) {
+        uint32_t page = addr & ~(page_size - 1);
+        uint32_t lo = addr - page;
+        uint32_t nb = page_size - lo;
+        if (nb > size) {
+            nb = size;
+        }
+        uint32_t hi = lo + nb;
+
+        if (write_buf_addr != WRITE_BUF_NONE &&
+                (write_buf_addr != page || (lo < write_buf_hi && hi > write_buf_lo))) {
+            int32_t res = my_spi_flush();
+            if (res != SPIFFS_OK) {
+                return res;
+            }
+        }
+        if (write_buf_addr == WRITE_BUF_NONE) {
+            memset(write_buf, 0xff, sizeof(write_buf));
+            write_buf_addr = page;
+            write_buf_lo = lo;
+            write_buf_hi = hi;
+        }
+        memcpy((uint8_t *) write_buf + lo, src, nb);
+        if (lo < write_buf_lo) {
+            write_buf_lo = lo;
+        }
+        if (hi > write_buf_hi) {
+            write_buf_hi = hi;
+        }
+
+        addr += nb;
+        src += nb;
+        size -= nb;
+    }
+    return SPIFFS_OK;
+}
+
+#else //SPIFFS_HAL_WRITE_COALESCE
+
+int32_t my_spi_flush(void) {
+    return SPIFFS_OK;
 }
 
 /* Don't set this smaller than 256 as it will corrupt things? */
 static const int UNALIGNED_WRITE_BUFFER_SIZE = 256;
 
 int32_t my_spi_write(uint32_t addr, uint32_t size, uint8_t *src) {
+    user_metric_add(USER_METRIC_SPIFFS_WRITES, 1);
+    if (ckpt_cancel() != SPIFFS_OK) {
+        return SPIFFS_ERR_INTERNAL;
+    }
+#if SPIFFS_HAL_READ_CACHE
+    read_cache_program(addr, size, src);
+#endif
 
     uint32_t alignedBegin = (addr + 3) & (~3);
     uint32_t alignedEnd = (addr + size) & (~3);
@@ -224,6 +1754,8 @@ int32_t my_spi_write(uint32_t addr, uint32_t size, uint8_t *src) {
     return SPIFFS_OK;
 }
 
+#endif //SPIFFS_HAL_WRITE_COALESCE
+
 int32_t my_spi_erase(uint32_t addr, uint32_t size) {
     if ((size & (SPI_FLASH_SEC_SIZE - 1)) != 0 ||
         (addr & (SPI_FLASH_SEC_SIZE - 1)) != 0) {
@@ -231,6 +1763,24 @@ int32_t my_spi_erase(uint32_t addr, uint32_t size) {
     }
     const uint32_t sector = addr / SPI_FLASH_SEC_SIZE;
     const uint32_t sectorCount = size / SPI_FLASH_SEC_SIZE;
+    user_metric_add(USER_METRIC_SPIFFS_ERASES, sectorCount);
+    if (ckpt_cancel() != SPIFFS_OK) {
+        return SPIFFS_ERR_INTERNAL;
+    }
+#if SPIFFS_HAL_WRITE_COALESCE
+    /* A pending write to the erased sectors would be lost anyway, and any
+     * other must reach the flash before the erase does (think of garbage
+     * collection moving the last page out of a block before erasing it) */
+    if (write_buf_addr >= addr && write_buf_addr < addr + size) {
+        write_buf_addr = WRITE_BUF_NONE;
+    }
+    else if (my_spi_flush() != SPIFFS_OK) {
+        return SPIFFS_ERR_INTERNAL;
+    }
+#endif
+#if SPIFFS_HAL_READ_CACHE
+    read_cache_erase(addr, size);
+#endif
     uint32_t i = 0;
     for (i = 0; i < sectorCount; ++i) {
         if (spi_flash_erase_sector(sector + i) != SPI_FLASH_RESULT_OK) {
@@ -4,7 +4,34 @@
 #include <stdint.h>
 #include "wish_fs.h"
 
+/* Geometry of the SPIFFS partition, in bytes */
+struct my_spiffs_partition {
+    uint32_t addr;
+    uint32_t size;
+    uint32_t block_size;
+    uint32_t page_size;
+};
+
+/* Mount the partition given by the descriptor in flash, or by the
+ * build-time partition table if there is no descriptor. The partition is
+ * formatted if it cannot be mounted. Replaces and deletes of wish_fs
+ * interrupted by a reset are finished (see wish_fs_replace_open()).
+ * If the partition has not been written since the last mount state
+ * checkpoint, the state is taken from it instead of scanning the whole
+ * partition (see SPIFFS_PART_CKPT_ADDR). */
 void my_spiffs_mount();
+
+/* Unmount the file system, writing out whatever is buffered, and write
+ * a mount state checkpoint. */
+void my_spiffs_unmount(void);
+
+/* Write the partition descriptor to flash, and format and mount the
+ * partition. Everything on the file system is lost. Returns SPIFFS_OK,
+ * or SPIFFS_ERR_NOT_CONFIGURED if the geometry is not usable. */
+int32_t my_spiffs_set_partition(const struct my_spiffs_partition *p);
+
+/* The partition which is mounted */
+void my_spiffs_get_partition(struct my_spiffs_partition *p);
 void test_spiffs(void);
 
 /* Implementations of the actual I/O functions required by wish_fs
@@ -17,4 +44,107 @@ int32_t my_fs_close(wish_file_t fd);
 int32_t my_fs_rename(const char *oldpath, const char *newpath);
 int32_t my_fs_remove(const char *path);
 
+/* Write 'count' bytes at 'offset' of an open file by programming them
+ * into flash in place, instead of SPIFFS writing new copies of the data
+ * and index pages. Only bytes which have not been written since the file
+ * was filled with 0xff can be programmed this way, and the file cannot
+ * grow. Costs one flash write and no erase. Returns 'count', or
+ * SPIFFS_ERR_NOT_WRITABLE if any of the bytes were already written. */
+int32_t my_fs_program(wish_file_t fd, wish_offset_t offset, const void *buf, size_t count);
+
+/* A file listed by my_fs_list() */
+struct my_fs_file {
+    const char *name;
+    uint32_t size;
+    /* The SPIFFS object id */
+    uint32_t id;
+    /* Pages the file takes, its index pages included */
+    uint32_t pages;
+};
+
+/* Called by my_fs_list() for every file. Returns 0 to go on, or 1 to
+ * stop before the file, which then is the first one listed from the
+ * cursor. Must not call the my_fs_* functions. */
+typedef int32_t my_fs_list_func_t(const struct my_fs_file *f, void *arg);
+
+/* The cursor of my_fs_list() after the last file */
+#define MY_FS_LIST_END 0xffffffff
+
+/* List the files from '*cursor' on, 0 being the first file, in one pass
+ * over the object lookup pages, so that listing all files with their
+ * sizes costs one read per lookup page and one per file. The cursor is
+ * left at the file the callback stopped before, or at MY_FS_LIST_END.
+ * Returns the number of files listed, or a negative SPIFFS error. */
+int32_t my_fs_list(uint32_t *cursor, my_fs_list_func_t *func, void *arg);
+
+/* Write to flash whatever the SPI HAL layer has buffered. The my_fs_*
+ * functions do this before returning, so this is only needed when
+ * calling SPIFFS directly. */
+int32_t my_spi_flush(void);
+
+/* Do one step of the background garbage collection: erase one block,
+ * first moving its live pages elsewhere if needed. Returns 1 if more
+ * steps are needed, 0 if there is enough free space or nothing to
+ * collect, or a negative SPIFFS error. This is normally driven by a
+ * timer when the file system is idle, see SPIFFS_BG_GC. */
+int32_t my_spiffs_gc_step(void);
+
+/* Do one step of the background consistency check, which is due after
+ * a mount which did not come from a checkpoint: check for about
+ * SPIFFS_BG_CHECK_BUDGET_US. Returns the progress of the check from 1 to
+ * 255 if more steps are needed, 0 if the check is done or there is none
+ * to do, or a negative SPIFFS error. This is normally driven by a timer
+ * when the file system is idle, see SPIFFS_BG_CHECK. */
+int32_t my_spiffs_check_step(void);
+
+/* Number of garbage collection runs SPIFFS has made since mount */
+uint32_t my_spiffs_get_gc_runs(void);
+
+/* File system statistics, for predicting the wear of the flash.
+ *
+ * SPIFFS does not keep a count of erases per block. Instead, every
+ * erase stamps the block with a running erase number of the whole
+ * partition, which the garbage collection uses to prefer blocks which
+ * were erased long ago. The erase age of a block is the number of erases
+ * made in the partition since that block was last erased. When the
+ * ages stay low and even, the erases are spread evenly, and each block
+ * has been erased about erase_count / blocks times. */
+struct my_spiffs_stats {
+    uint32_t blocks;
+    /* Pages for file data and indexes, by state */
+    uint32_t pages_total;
+    uint32_t pages_allocated;
+    uint32_t pages_deleted;
+    uint32_t pages_free;
+    /* Since mount */
+    uint32_t gc_runs;
+    uint32_t gc_pages_moved;
+    uint32_t cache_hits;
+    uint32_t cache_misses;
+    /* The above by the kind of page: object lookup, object index and
+     * data pages */
+    uint32_t cache_lu_hits;
+    uint32_t cache_lu_misses;
+    uint32_t cache_ix_hits;
+    uint32_t cache_ix_misses;
+    uint32_t cache_data_hits;
+    uint32_t cache_data_misses;
+    /* Progress of the background consistency check from 1 to 255, or 0
+     * if there is none to do */
+    uint32_t check_progress;
+    /* The running erase number, wraps at 0x7fff */
+    uint32_t erase_count;
+    uint32_t erase_age_min;
+    uint32_t erase_age_max;
+};
+
+/* Fill in the statistics of the mounted file system. The erase ages are
+ * read from flash, one read per block. */
+int32_t my_spiffs_get_stats(struct my_spiffs_stats *st);
+
+/* Read the erase ages of the first 'max' blocks into 'ages'. Blocks
+ * never erased by SPIFFS have age 0xffff. Returns the number of blocks
+ * read, or a negative SPIFFS error. */
+int32_t my_spiffs_get_erase_ages(uint16_t *ages, uint32_t max);
+
 #endif
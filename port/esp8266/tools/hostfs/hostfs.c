@@ -0,0 +1,328 @@
+/*
+ * wish_fs backends for Linux, see hostfs.h
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "wish_fs.h"
+#include "spiffs.h"
+#include "spiffs_nucleus.h"
+#include "spiffs_integration.h"
+#include "user_metrics.h"
+#include "user_timer.h"
+#include "flash_emu.h"
+#include "hostfs.h"
+
+bool hostfs_verbose;
+
+static bool spiffs_backend;
+static struct hostfs_stats stats;
+
+/* POSIX backend */
+
+static char root[PATH_MAX];
+
+static int posix_path(const char *name, char *path) {
+    /* SPIFFS has no directories, a leading slash is part of the name */
+    while (*name == '/') {
+        name++;
+    }
+    if (snprintf(path, PATH_MAX, "%s/%s", root, name) >= PATH_MAX) {
+        return -1;
+    }
+    return 0;
+}
+
+static wish_file_t posix_open(const char *pathname) {
+    char path[PATH_MAX];
+    stats.opens++;
+    if (posix_path(pathname, path) < 0) {
+        return WISH_FS_FAIL;
+    }
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    return fd < 0 ? WISH_FS_FAIL : fd;
+}
+
+static int32_t posix_read(wish_file_t fd, void *buf, size_t count) {
+    stats.reads++;
+    ssize_t ret = read(fd, buf, count);
+    return ret < 0 ? WISH_FS_FAIL : ret;
+}
+
+static int32_t posix_write(wish_file_t fd, const void *buf, size_t count) {
+    stats.writes++;
+    ssize_t ret = write(fd, buf, count);
+    return ret < 0 ? WISH_FS_FAIL : ret;
+}
+
+static wish_offset_t posix_lseek(wish_file_t fd, wish_offset_t offset, int whence) {
+    static const int whences[] = {
+        [WISH_FS_SEEK_SET] = SEEK_SET,
+        [WISH_FS_SEEK_CUR] = SEEK_CUR,
+        [WISH_FS_SEEK_END] = SEEK_END,
+    };
+    stats.seeks++;
+    if (whence < WISH_FS_SEEK_SET || whence > WISH_FS_SEEK_END) {
+        return WISH_FS_FAIL;
+    }
+    off_t ret = lseek(fd, offset, whences[whence]);
+    return ret < 0 || ret > INT32_MAX ? WISH_FS_FAIL : ret;
+}
+
+static int32_t posix_close(wish_file_t fd) {
+    stats.closes++;
+    return close(fd) < 0 ? WISH_FS_FAIL : 0;
+}
+
+static int32_t posix_rename(const char *oldpath, const char *newpath) {
+    char from[PATH_MAX], to[PATH_MAX];
+    stats.renames++;
+    if (posix_path(oldpath, from) < 0 || posix_path(newpath, to) < 0) {
+        return WISH_FS_FAIL;
+    }
+    return rename(from, to) < 0 ? WISH_FS_FAIL : 0;
+}
+
+static int32_t posix_remove(const char *path) {
+    char p[PATH_MAX];
+    stats.removes++;
+    if (posix_path(path, p) < 0) {
+        return WISH_FS_FAIL;
+    }
+    return unlink(p) < 0 ? WISH_FS_FAIL : 0;
+}
+
+int hostfs_posix_init(const char *dir) {
+    if (strlen(dir) >= sizeof(root)) {
+        return -1;
+    }
+    strcpy(root, dir);
+    if (access(root, W_OK) < 0) {
+        perror(root);
+        return -1;
+    }
+    spiffs_backend = false;
+    memset(&stats, 0, sizeof(stats));
+    wish_fs_set_open(posix_open);
+    wish_fs_set_read(posix_read);
+    wish_fs_set_write(posix_write);
+    wish_fs_set_lseek(posix_lseek);
+    wish_fs_set_close(posix_close);
+    wish_fs_set_rename(posix_rename);
+    wish_fs_set_remove(posix_remove);
+    return 0;
+}
+
+/* SPIFFS backend, counting the calls on the way to spiffs_integration.c */
+
+static wish_file_t emu_open(const char *pathname) {
+    stats.opens++;
+    return my_fs_open(pathname);
+}
+
+static int32_t emu_read(wish_file_t fd, void *buf, size_t count) {
+    stats.reads++;
+    return my_fs_read(fd, buf, count);
+}
+
+static int32_t emu_write(wish_file_t fd, const void *buf, size_t count) {
+    stats.writes++;
+    return my_fs_write(fd, buf, count);
+}
+
+static wish_offset_t emu_lseek(wish_file_t fd, wish_offset_t offset, int whence) {
+    stats.seeks++;
+    return my_fs_lseek(fd, offset, whence);
+}
+
+static int32_t emu_close(wish_file_t fd) {
+    stats.closes++;
+    return my_fs_close(fd);
+}
+
+static int32_t emu_rename(const char *oldpath, const char *newpath) {
+    stats.renames++;
+    return my_fs_rename(oldpath, newpath);
+}
+
+static int32_t emu_remove(const char *path) {
+    stats.removes++;
+    return my_fs_remove(path);
+}
+
+int hostfs_spiffs_init(const char *image) {
+    if (image != NULL) {
+        if (flash_emu_open_image(image) < 0) {
+            return -1;
+        }
+    }
+    else {
+        flash_emu_reset();
+    }
+    /* SPIFFS writes the flags byte of a page header as a whole */
+    flash_emu_ignore(SPIFFS_PART_PAGE_SIZE, offsetof(spiffs_page_header, flags));
+    my_spiffs_mount();
+    spiffs_backend = true;
+    memset(&stats, 0, sizeof(stats));
+    wish_fs_set_open(emu_open);
+    wish_fs_set_read(emu_read);
+    wish_fs_set_write(emu_write);
+    wish_fs_set_lseek(emu_lseek);
+    wish_fs_set_close(emu_close);
+    wish_fs_set_rename(emu_rename);
+    wish_fs_set_remove(emu_remove);
+    return 0;
+}
+
+void hostfs_close(void) {
+    if (spiffs_backend) {
+        my_spiffs_unmount();
+        flash_emu_close_image();
+    }
+}
+
+void hostfs_get_stats(struct hostfs_stats *st) {
+    *st = stats;
+    if (spiffs_backend) {
+        struct my_spiffs_partition p;
+        my_spiffs_get_partition(&p);
+        st->flash = flash_emu_stats;
+        flash_emu_get_wear(p.addr, p.size, &st->wear);
+    }
+}
+
+void hostfs_print_stats(void) {
+    struct hostfs_stats st;
+    hostfs_get_stats(&st);
+    printf("calls: open %u read %u write %u seek %u close %u rename %u remove %u\n",
+        st.opens, st.reads, st.writes, st.seeks, st.closes, st.renames, st.removes);
+    if (!spiffs_backend) {
+        return;
+    }
+    printf("flash: reads %u (%u B) programs %u (%u B) erases %u map loads %u\n",
+        st.flash.reads, st.flash.read_bytes, st.flash.programs,
+        st.flash.program_bytes, st.flash.erases, st.flash.map_loads);
+    printf("flash time %.1f ms, erases per sector min %u max %u mean %.2f\n",
+        st.flash.time_us / 1000.0, st.wear.min, st.wear.max,
+        st.wear.sectors ? (double) st.wear.erases / st.wear.sectors : 0.0);
+    if (st.flash.bad_programs) {
+        printf("flash: %u bytes programmed from 0 to 1\n", st.flash.bad_programs);
+    }
+}
+
+/* Stand-ins for the SDK and the port */
+
+int os_printf_plus(const char *format, ...) {
+    if (!hostfs_verbose) {
+        return 0;
+    }
+    va_list ap;
+    va_start(ap, format);
+    int ret = vprintf(format, ap);
+    va_end(ap);
+    return ret;
+}
+
+void user_metric_add(enum user_metric metric, uint32_t n) {
+}
+
+/* The steps of the background consistency check are timed by the
+ * modeled flash time */
+uint32_t system_get_time(void) {
+    return (uint32_t) flash_emu_stats.time_us;
+}
+
+/* The timers of the file system code, run in hostfs_idle() on the ticks
+ * they expire on */
+#define HOSTFS_TIMERS 4
+
+static struct user_timer *timers[HOSTFS_TIMERS];
+static uint32_t now_ticks;
+
+void user_timer_setfn(struct user_timer *timer, user_timer_func_t *func, void *arg) {
+    timer->func = func;
+    timer->arg = arg;
+}
+
+void user_timer_arm(struct user_timer *timer, uint32_t ms, bool repeat) {
+    uint32_t ticks = (ms + USER_TIMER_TICK_MS - 1) / USER_TIMER_TICK_MS;
+    int i, free_slot = -1;
+    timer->expires = now_ticks + (ticks ? ticks : 1);
+    timer->period = repeat ? ticks : 0;
+    timer->armed = true;
+    for (i = 0; i < HOSTFS_TIMERS; i++) {
+        if (timers[i] == timer) {
+            return;
+        }
+        if (timers[i] == NULL && free_slot < 0) {
+            free_slot = i;
+        }
+    }
+    if (free_slot < 0) {
+        fprintf(stderr, "hostfs: out of timers\n");
+        abort();
+    }
+    timers[free_slot] = timer;
+}
+
+void user_timer_disarm(struct user_timer *timer) {
+    int i;
+    timer->armed = false;
+    for (i = 0; i < HOSTFS_TIMERS; i++) {
+        if (timers[i] == timer) {
+            timers[i] = NULL;
+        }
+    }
+}
+
+int32_t user_timer_get_next_ms(void) {
+    int32_t next = -1;
+    int i;
+    for (i = 0; i < HOSTFS_TIMERS; i++) {
+        if (timers[i] != NULL) {
+            int32_t ms = (timers[i]->expires - now_ticks) * USER_TIMER_TICK_MS;
+            if (next < 0 || ms < next) {
+                next = ms;
+            }
+        }
+    }
+    return next;
+}
+
+void hostfs_idle(uint32_t ms) {
+    uint32_t ticks = ms / USER_TIMER_TICK_MS;
+    while (spiffs_backend && ticks--) {
+        int i;
+        bool armed = false;
+        now_ticks++;
+        for (i = 0; i < HOSTFS_TIMERS; i++) {
+            struct user_timer *t = timers[i];
+            if (t == NULL) {
+                continue;
+            }
+            armed = true;
+            if (t->expires != now_ticks) {
+                continue;
+            }
+            if (t->period) {
+                t->expires = now_ticks + t->period;
+            }
+            else {
+                timers[i] = NULL;
+                t->armed = false;
+            }
+            t->func(t->arg);
+        }
+        if (!armed) {
+            break;
+        }
+    }
+}
@@ -0,0 +1,72 @@
+#ifndef HOSTFS_H
+#define HOSTFS_H
+
+/* wish_fs backends for running the port code on a PC.
+ *
+ * The file system below wish_fs is set with wish_fs_set_*(), and on the
+ * chip it is SPIFFS (spiffs_integration.c). On Linux, one of these can be
+ * used instead:
+ *
+ * - POSIX files in a directory, for running the Wish and Mist code
+ *   where the file system is of no interest.
+ *
+ * - The real SPIFFS code and spiffs_integration.c over the NOR flash
+ *   emulator of tools/spiffshal, kept in RAM or in an image file. The
+ *   emulator counts every flash operation, models the time they would
+ *   take on the chip, and counts the erases of every sector, so the
+ *   latency and wear of a workload can be measured on a PC.
+ *
+ * The SPIFFS backend also stands in for the SDK and port functions
+ * spiffs_integration.c needs: os_printf_plus(), user_metric_add(),
+ * system_get_time(), which is the modeled flash time, and the
+ * user_timer_* functions. Timers only run in hostfs_idle(). */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "flash_emu.h"
+
+/* Use the files in 'dir', which must exist, for wish_fs. File names are
+ * taken relative to it. Returns 0, or -1 on failure. */
+int hostfs_posix_init(const char *dir);
+
+/* Use SPIFFS on emulated flash for wish_fs. With 'image' NULL the flash
+ * is in RAM and starts erased, otherwise it is kept in the image file,
+ * and the file system in it is mounted if there is one. The partition
+ * is the one in the partition descriptor in flash, or the default one.
+ * Returns 0, or -1 on failure. */
+int hostfs_spiffs_init(const char *image);
+
+/* Let the system be idle for 'ms' milliseconds of flash time, running
+ * the timers armed by the file system code, such as the background
+ * garbage collection. Does nothing for the POSIX backend. */
+void hostfs_idle(uint32_t ms);
+
+/* Unmount and write the image back */
+void hostfs_close(void);
+
+struct hostfs_stats {
+    /* Calls to the wish_fs backend */
+    uint32_t opens;
+    uint32_t reads;
+    uint32_t writes;
+    uint32_t seeks;
+    uint32_t closes;
+    uint32_t renames;
+    uint32_t removes;
+    /* Flash operations and modeled time, SPIFFS backend only */
+    struct flash_emu_stats flash;
+    /* Erases of the sectors of the SPIFFS partition */
+    struct flash_emu_wear wear;
+};
+
+/* The statistics since hostfs_*_init() */
+void hostfs_get_stats(struct hostfs_stats *st);
+
+/* Print the statistics on stdout */
+void hostfs_print_stats(void);
+
+/* Print the output of os_printf_plus() */
+extern bool hostfs_verbose;
+
+#endif //HOSTFS_H
@@ -0,0 +1,220 @@
+/*
+ * Throughput and latency of a Wish like file workload over the host
+ * wish_fs backends, see hostfs.h.
+ *
+ * Every round saves the identity database through a temporary file and
+ * rename, loads it back and verifies it, and appends a record to a log,
+ * which is started over every LOG_RECORDS rounds, all through the buffered wish_fs layer. The rounds per second of wall
+ * clock time are printed, and for the SPIFFS backend also the modeled
+ * flash time of a round (median, 99th percentile, worst), the flash
+ * operations and the wear of the partition.
+ *
+ * With -c, the database left by the previous run in the same directory
+ * or image is checked before starting, to see that it survived.
+ *
+ * Usage: hostfs_bench [-v] [-c] [-n rounds] [-I idle ms]
+ *                     (-p dir | -s | -i image)
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "wish_fs.h"
+#include "hostfs.h"
+
+#define IDENTITIES 4
+#define IDENTITY_LEN 380
+#define LOG_RECORD_LEN 24
+/* The log is removed and started over after this many records */
+#define LOG_RECORDS 100
+#define DEFAULT_ROUNDS 500
+
+static const char *db_name = "wish_id_db.bson";
+static const char *db_tmp_name = "wish_id_db.bson.tmp";
+static const char *log_name = "wish_log";
+
+static void fail(const char *what) {
+    fprintf(stderr, "FAIL: %s\n", what);
+    exit(1);
+}
+
+static void fill(uint8_t *buf, size_t len, uint32_t seed) {
+    size_t i;
+    for (i = 0; i < len; i++) {
+        seed = seed * 1103515245 + 12345;
+        buf[i] = seed >> 16;
+    }
+}
+
+/* The database of round 'round' */
+static void make_db(uint8_t db[][IDENTITY_LEN], uint32_t round) {
+    int i;
+    for (i = 0; i < IDENTITIES; i++) {
+        fill(db[i], IDENTITY_LEN, round * IDENTITIES + i);
+    }
+}
+
+/* In the pieces the elements of a BSON document would be written in */
+static const uint16_t identity_pieces[] = { 4, 12, 28, 36, 8, 40, 72, 40, 104, 24, 12 };
+
+static void save_db(uint8_t db[][IDENTITY_LEN]) {
+    wish_file_t fd = wish_fs_open(db_tmp_name);
+    if (fd < 0) {
+        fail("open db tmp");
+    }
+    int i;
+    unsigned int j;
+    for (i = 0; i < IDENTITIES; i++) {
+        size_t done = 0;
+        for (j = 0; j < sizeof(identity_pieces) / sizeof(identity_pieces[0]); j++) {
+            if (wish_fs_write(fd, db[i] + done, identity_pieces[j]) != identity_pieces[j]) {
+                fail("db write");
+            }
+            done += identity_pieces[j];
+        }
+    }
+    if (wish_fs_close(fd) < 0) {
+        fail("db close");
+    }
+    wish_fs_remove(db_name);
+    if (wish_fs_rename(db_tmp_name, db_name) < 0) {
+        fail("db rename");
+    }
+}
+
+static void check_db(uint8_t db[][IDENTITY_LEN]) {
+    uint8_t doc[IDENTITY_LEN];
+    wish_file_t fd = wish_fs_open(db_name);
+    if (fd < 0) {
+        fail("open db");
+    }
+    int i;
+    for (i = 0; i < IDENTITIES; i++) {
+        if (wish_fs_read(fd, doc, 4) != 4 ||
+                wish_fs_read(fd, doc + 4, IDENTITY_LEN - 4) != IDENTITY_LEN - 4) {
+            fail("db read");
+        }
+        if (memcmp(doc, db[i], IDENTITY_LEN) != 0) {
+            fail("db verify");
+        }
+    }
+    wish_fs_close(fd);
+}
+
+static void append_log(uint32_t round) {
+    uint8_t record[LOG_RECORD_LEN];
+    if (round % LOG_RECORDS == 0) {
+        wish_fs_remove(log_name);
+    }
+    fill(record, sizeof(record), 100000 + round);
+    wish_file_t fd = wish_fs_open(log_name);
+    if (fd < 0) {
+        fail("open log");
+    }
+    wish_fs_lseek(fd, 0, WISH_FS_SEEK_END);
+    if (wish_fs_write(fd, record, sizeof(record)) != sizeof(record)) {
+        fail("log write");
+    }
+    wish_fs_close(fd);
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+    return x < y ? -1 : x > y;
+}
+
+int main(int argc, char **argv) {
+    const char *dir = NULL, *image = NULL;
+    bool ram = false, check = false;
+    uint32_t rounds = DEFAULT_ROUNDS, idle_ms = 0;
+    int i;
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-v") == 0) {
+            hostfs_verbose = true;
+        }
+        else if (strcmp(argv[i], "-c") == 0) {
+            check = true;
+        }
+        else if (strcmp(argv[i], "-s") == 0) {
+            ram = true;
+        }
+        else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            dir = argv[++i];
+        }
+        else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+            image = argv[++i];
+        }
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            rounds = strtoul(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "-I") == 0 && i + 1 < argc) {
+            idle_ms = strtoul(argv[++i], NULL, 0);
+        }
+        else {
+            break;
+        }
+    }
+    if (i < argc || rounds == 0 || (dir != NULL) + (image != NULL) + ram != 1) {
+        fprintf(stderr, "Usage: %s [-v] [-c] [-n rounds] [-I idle ms] "
+            "(-p dir | -s | -i image)\n", argv[0]);
+        return 2;
+    }
+
+    int ret = dir ? hostfs_posix_init(dir) : hostfs_spiffs_init(image);
+    if (ret < 0) {
+        fail("init");
+    }
+    bool spiffs = dir == NULL;
+    printf("%s backend, %u rounds\n", dir ? "posix" : image ? "spiffs image" : "spiffs ram",
+        rounds);
+
+    static uint8_t db[IDENTITIES][IDENTITY_LEN];
+    if (check) {
+        /* The previous run ended with the same number of rounds */
+        make_db(db, rounds - 1);
+        check_db(db);
+    }
+
+    uint64_t *latency = calloc(rounds, sizeof(uint64_t));
+    if (latency == NULL) {
+        fail("calloc");
+    }
+    struct hostfs_stats st;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    uint32_t r;
+    for (r = 0; r < rounds; r++) {
+        hostfs_get_stats(&st);
+        uint64_t t = st.flash.time_us;
+        make_db(db, r);
+        save_db(db);
+        check_db(db);
+        append_log(r);
+        hostfs_get_stats(&st);
+        latency[r] = st.flash.time_us - t;
+        hostfs_idle(idle_ms);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("%.0f rounds/s wall clock\n", rounds / secs);
+
+    if (spiffs) {
+        qsort(latency, rounds, sizeof(latency[0]), cmp_u64);
+        printf("flash time per round: p50 %.2f ms p99 %.2f ms max %.2f ms\n",
+            latency[rounds / 2] / 1000.0, latency[rounds * 99 / 100] / 1000.0,
+            latency[rounds - 1] / 1000.0);
+    }
+    hostfs_print_stats();
+    hostfs_get_stats(&st);
+    if (st.flash.bad_programs) {
+        fail("bits programmed from 0 to 1");
+    }
+    free(latency);
+    hostfs_close();
+    printf("PASS\n");
+    return 0;
+}
@@ -0,0 +1,501 @@
+/*
+ * Power cut test of the crash-safe replace and delete of wish_fs, see
+ * wish_fs_replace_open().
+ *
+ * The identity database is saved with wish_fs_replace_open() and
+ * wish_fs_replace_commit(), and a mappings file is removed with
+ * wish_fs_delete(), on the SPIFFS backend over emulated flash. Each is
+ * first made once to count its programs and erases, and then again from
+ * the same flash contents with the power cut at every one of them in
+ * turn. After each cut the file system is mounted, which finishes or
+ * rolls back what was interrupted, and the system idles until the
+ * background consistency check which follows (SPIFFS_BG_CHECK) is done.
+ * Then the database must be the old or the new version, and the
+ * mappings file whole or gone. Another file,
+ * which is never written, must be intact, and the file system must take
+ * a new save afterwards. The file system is mounted from the mount state
+ * checkpoint written at unmount, so the first operation of each is the
+ * cancelling of the checkpoint.
+ *
+ * Last, a file is appended to in one write of several pages, which
+ * SPIFFS makes in a batch (SPIFFS_APPEND_BATCH, which the Makefile
+ * turns on for this test), with the power cut at every flash operation.
+ * Right after the cut, and after the recovery, no
+ * data page of the file which is final may be torn, as the consistency
+ * check keeps final pages, and the file must be as it was or fully
+ * appended. This includes a cut while SPIFFS moves the object index
+ * header to its new size, which leaves two final headers of the file for
+ * the recovery at mount to choose from.
+ *
+ * The test is repeated from several states of the file system. Between
+ * them the system idles, so that the background garbage collection
+ * keeps enough free blocks for the saves not to collect garbage in the
+ * foreground (see SPIFFS_BG_GC_FREE_BLOCKS in the Makefile): SPIFFS
+ * relies on SPIFFS_check() to repair a collection cut short, which is
+ * not what is tested here.
+ *
+ * Usage: hostfs_fault [-v]
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "wish_fs.h"
+#include "spiffs.h"
+#include "spiffs_nucleus.h"
+#include "spiffs_integration.h"
+#include "hostfs.h"
+
+#define IDENTITIES 4
+#define IDENTITY_LEN 380
+#define DB_LEN (IDENTITIES * IDENTITY_LEN)
+#define STATIC_LEN 12000
+/* A partition of 16 blocks */
+#define PART_ADDR 0xe0000
+#define PART_SIZE 0x10000
+#define BLOCK_SIZE 4096
+#define PAGE_SIZE 256
+#define DATA_PAGE_SIZE (PAGE_SIZE - sizeof(spiffs_page_header))
+#define IDLE_MS 5000
+/* Long enough for the consistency check after a power cut */
+#define CHECK_IDLE_MS 3000
+#define MAPPINGS_LEN 2000
+/* Whole pages, so that the append only writes new pages */
+#define APPEND_BASE_LEN (2 * DATA_PAGE_SIZE)
+#define APPEND_LEN 1600
+/* States of the file system the power is cut from, and the saves made
+ * between them */
+#define STATES 6
+#define SAVES_PER_STATE 3
+
+static const char *db_name = "wish_id_db.bson";
+static const char *static_name = "static.bin";
+static const char *mappings_name = "mappings.bin";
+static const char *append_name = "export.bin";
+
+static void fail(const char *what) {
+    fprintf(stderr, "FAIL: %s\n", what);
+    exit(1);
+}
+
+static void fill(uint8_t *buf, size_t len, uint32_t seed) {
+    size_t i;
+    for (i = 0; i < len; i++) {
+        seed = seed * 1103515245 + 12345;
+        buf[i] = seed >> 16;
+    }
+}
+
+/* Write 'len' bytes of 'buf' to a file in one go */
+static int write_file(const char *name, const uint8_t *buf, size_t len) {
+    wish_fs_remove(name);
+    wish_file_t fd = wish_fs_open(name);
+    if (fd < 0) {
+        return -1;
+    }
+    int ret = wish_fs_write(fd, buf, len) == len ? 0 : -1;
+    if (wish_fs_close(fd) < 0) {
+        ret = -1;
+    }
+    return ret;
+}
+
+/* Append 'len' bytes of 'buf' to a file in one go */
+static int append_file(const char *name, const uint8_t *buf, size_t len) {
+    wish_file_t fd = wish_fs_open(name);
+    if (fd < 0) {
+        return -1;
+    }
+    int ret = 0;
+    if (wish_fs_lseek(fd, 0, WISH_FS_SEEK_END) < 0 || wish_fs_write(fd, buf, len) != len) {
+        ret = -1;
+    }
+    if (wish_fs_close(fd) < 0) {
+        ret = -1;
+    }
+    return ret;
+}
+
+/* Size of the file 'name', which is created empty if it is missing */
+static int32_t read_file(const char *name, uint8_t *buf, size_t len) {
+    wish_file_t fd = wish_fs_open(name);
+    if (fd < 0) {
+        fail("open");
+    }
+    int32_t size = wish_fs_lseek(fd, 0, WISH_FS_SEEK_END);
+    if (size < 0 || wish_fs_lseek(fd, 0, WISH_FS_SEEK_SET) != 0) {
+        fail("seek");
+    }
+    if (size > 0 && wish_fs_read(fd, buf, size < len ? size : len) != (size < len ? size : len)) {
+        fail("read");
+    }
+    wish_fs_close(fd);
+    return size;
+}
+
+/* The database, written in the pieces the elements of a BSON document
+ * would be */
+static int save_db(uint32_t version) {
+    static const uint16_t pieces[] = { 4, 12, 28, 36, 8, 40, 72, 40, 104, 24, 12 };
+    uint8_t db[DB_LEN];
+    fill(db, sizeof(db), version);
+    wish_file_t fd = wish_fs_replace_open(db_name);
+    if (fd < 0) {
+        return -1;
+    }
+    size_t done = 0;
+    while (done < sizeof(db)) {
+        unsigned int j;
+        for (j = 0; j < sizeof(pieces) / sizeof(pieces[0]); j++) {
+            if (wish_fs_write(fd, db + done, pieces[j]) != pieces[j]) {
+                wish_fs_replace_abort(fd, db_name);
+                return -1;
+            }
+            done += pieces[j];
+        }
+    }
+    return wish_fs_replace_commit(fd, db_name);
+}
+
+/* The version of the database on the file system, or -1 if it is none
+ * of 'a' and 'b' */
+static int64_t db_version(uint32_t a, uint32_t b) {
+    uint8_t db[DB_LEN + 1], expected[DB_LEN];
+    if (read_file(db_name, db, sizeof(db)) != DB_LEN) {
+        return -1;
+    }
+    fill(expected, sizeof(expected), a);
+    if (memcmp(db, expected, DB_LEN) == 0) {
+        return a;
+    }
+    fill(expected, sizeof(expected), b);
+    if (memcmp(db, expected, DB_LEN) == 0) {
+        return b;
+    }
+    return -1;
+}
+
+static void check_static(void) {
+    static uint8_t buf[STATIC_LEN + 1], expected[STATIC_LEN];
+    fill(expected, sizeof(expected), 0x5747);
+    if (read_file(static_name, buf, sizeof(buf)) != STATIC_LEN ||
+            memcmp(buf, expected, STATIC_LEN) != 0) {
+        fail("static file changed");
+    }
+}
+
+/* No temporary files are left by the recovery at mount */
+static void check_no_tmp(const char *name) {
+    char path[WISH_FS_MAX_PATH];
+    uint8_t b;
+    snprintf(path, sizeof(path), "%s%s", name, WISH_FS_TMP_SUFFIX);
+    if (read_file(path, &b, 1) != 0) {
+        fail("temporary file left");
+    }
+    wish_fs_remove(path);
+    snprintf(path, sizeof(path), "%s%s", name, WISH_FS_NEW_SUFFIX);
+    if (read_file(path, &b, 1) != 0) {
+        fail("new file left");
+    }
+    wish_fs_remove(path);
+}
+
+static uint32_t flash_ops(void) {
+    struct hostfs_stats st;
+    hostfs_get_stats(&st);
+    return st.flash.programs + st.flash.erases;
+}
+
+static uint32_t flash_erases(void) {
+    struct hostfs_stats st;
+    hostfs_get_stats(&st);
+    return st.flash.erases;
+}
+
+/* Mount the file system as the flash was at 'snapshot', optionally
+ * with the power cut after 'cut' programs and erases */
+static void boot(const uint8_t *snapshot, int64_t cut) {
+    my_spiffs_unmount();
+    flash_emu_power_on();
+    if (snapshot) {
+        flash_emu_restore(snapshot);
+    }
+    my_spiffs_mount();
+    if (cut >= 0) {
+        flash_emu_cut_power(cut);
+    }
+}
+
+/* Let the background consistency check run to the end */
+static void idle_check(void) {
+    struct my_spiffs_stats st;
+    hostfs_idle(CHECK_IDLE_MS);
+    if (my_spiffs_get_stats(&st) != 0 || st.check_progress != 0) {
+        fail("consistency check not done");
+    }
+}
+
+/* Counts of the outcomes */
+struct outcome {
+    uint32_t cuts;
+    uint32_t old;
+    uint32_t new;
+};
+
+/* Cut the power at every flash operation of saving 'version' over
+ * 'version' - 1 */
+static void test_replace(const uint8_t *snapshot, uint32_t version, struct outcome *o) {
+    boot(snapshot, -1);
+    uint32_t ops = flash_ops(), erases = flash_erases();
+    if (save_db(version) < 0) {
+        fail("save");
+    }
+    ops = flash_ops() - ops;
+    if (flash_erases() != erases) {
+        fail("garbage collected while saving");
+    }
+    my_spiffs_unmount();
+
+    uint32_t cut;
+    for (cut = 0; cut <= ops; cut++) {
+        boot(snapshot, cut);
+        if (hostfs_verbose) {
+            printf("replace, power cut at operation %u of %u\n", cut, ops);
+        }
+        save_db(version);
+        if (cut < ops && !flash_emu_power_lost()) {
+            fail("power was not cut");
+        }
+        boot(NULL, -1);
+        idle_check();
+        int64_t v = db_version(version - 1, version);
+        if (v < 0) {
+            fprintf(stderr, "power cut at operation %u of %u\n", cut, ops);
+            fail("database is neither the old nor the new version");
+        }
+        o->cuts++;
+        if (v == version) {
+            o->new++;
+        }
+        else {
+            o->old++;
+        }
+        check_no_tmp(db_name);
+        check_static();
+        if (save_db(version + 1) < 0 || db_version(version + 1, version + 1) < 0) {
+            fail("save after recovery");
+        }
+    }
+}
+
+/* Cut the power at every flash operation of deleting the mappings */
+static void test_delete(uint8_t *snapshot, uint32_t version, struct outcome *o) {
+    static uint8_t mappings[MAPPINGS_LEN], buf[MAPPINGS_LEN + 1];
+    fill(mappings, sizeof(mappings), version + 0x10000);
+    boot(snapshot, -1);
+    if (write_file(mappings_name, mappings, sizeof(mappings)) < 0) {
+        fail("mappings write");
+    }
+    my_spiffs_unmount();
+    memcpy(snapshot, flash_emu_data(), FLASH_EMU_SIZE);
+
+    boot(snapshot, -1);
+    uint32_t ops = flash_ops();
+    if (wish_fs_delete(mappings_name) < 0) {
+        fail("delete");
+    }
+    ops = flash_ops() - ops;
+    my_spiffs_unmount();
+
+    uint32_t cut;
+    for (cut = 0; cut <= ops; cut++) {
+        boot(snapshot, cut);
+        wish_fs_delete(mappings_name);
+        boot(NULL, -1);
+        idle_check();
+        int32_t size = read_file(mappings_name, buf, sizeof(buf));
+        o->cuts++;
+        if (size == 0) {
+            o->new++;
+        }
+        else if (size == MAPPINGS_LEN && memcmp(buf, mappings, MAPPINGS_LEN) == 0) {
+            o->old++;
+        }
+        else {
+            fprintf(stderr, "power cut at operation %u of %u\n", cut, ops);
+            fail("mappings are neither whole nor gone");
+        }
+        check_no_tmp(mappings_name);
+        check_static();
+    }
+    boot(snapshot, -1);
+    wish_fs_delete(mappings_name);
+    my_spiffs_unmount();
+    memcpy(snapshot, flash_emu_data(), FLASH_EMU_SIZE);
+}
+
+struct find_file {
+    const char *name;
+    uint32_t id;
+};
+
+static int32_t find_file_cb(const struct my_fs_file *f, void *arg) {
+    struct find_file *ff = arg;
+    if (strcmp(f->name, ff->name) == 0) {
+        ff->id = f->id & ~SPIFFS_OBJ_ID_IX_FLAG;
+    }
+    return 0;
+}
+
+/* The object id of the data pages of the file 'name' */
+static uint32_t file_id(const char *name) {
+    struct find_file ff = { .name = name, .id = 0 };
+    uint32_t cursor = 0;
+    if (my_fs_list(&cursor, find_file_cb, &ff) < 0 || ff.id == 0) {
+        fail("file not listed");
+    }
+    return ff.id;
+}
+
+/* Every data page of the object 'id' in flash which is final and not
+ * deleted must hold 'data' at its span */
+static void check_final_pages(uint32_t id, const uint8_t *data, size_t len) {
+    const uint8_t *flash = flash_emu_data();
+    uint32_t addr;
+    for (addr = PART_ADDR; addr < PART_ADDR + PART_SIZE; addr += PAGE_SIZE) {
+        if ((addr - PART_ADDR) % BLOCK_SIZE == 0) {
+            /* The object lookup page of the block */
+            continue;
+        }
+        spiffs_page_header ph;
+        memcpy(&ph, flash + addr, sizeof(ph));
+        if (ph.obj_id != id || (ph.flags & (SPIFFS_PH_FLAG_USED | SPIFFS_PH_FLAG_FINAL)) != 0 ||
+                (ph.flags & (SPIFFS_PH_FLAG_INDEX | SPIFFS_PH_FLAG_DELET)) !=
+                (SPIFFS_PH_FLAG_INDEX | SPIFFS_PH_FLAG_DELET)) {
+            continue;
+        }
+        size_t offset = ph.span_ix * DATA_PAGE_SIZE;
+        if (offset >= len) {
+            fail("final page past the end of the data");
+        }
+        size_t n = len - offset < DATA_PAGE_SIZE ? len - offset : DATA_PAGE_SIZE;
+        if (memcmp(flash + addr + sizeof(ph), data + offset, n) != 0) {
+            fprintf(stderr, "page %05x span %u\n", addr, ph.span_ix);
+            fail("torn data page is final");
+        }
+    }
+}
+
+/* Cut the power at every flash operation of appending to a file in one
+ * write */
+static void test_append(uint8_t *snapshot, uint32_t version, struct outcome *o) {
+    static uint8_t data[APPEND_BASE_LEN + APPEND_LEN], buf[APPEND_BASE_LEN + APPEND_LEN + 1];
+    fill(data, sizeof(data), version + 0x20000);
+    boot(snapshot, -1);
+    if (write_file(append_name, data, APPEND_BASE_LEN) < 0) {
+        fail("append base write");
+    }
+    uint32_t id = file_id(append_name);
+    my_spiffs_unmount();
+    memcpy(snapshot, flash_emu_data(), FLASH_EMU_SIZE);
+
+    boot(snapshot, -1);
+    uint32_t ops = flash_ops();
+    if (append_file(append_name, data + APPEND_BASE_LEN, APPEND_LEN) < 0) {
+        fail("append");
+    }
+    ops = flash_ops() - ops;
+    my_spiffs_unmount();
+
+    uint32_t cut;
+    for (cut = 0; cut <= ops; cut++) {
+        boot(snapshot, cut);
+        append_file(append_name, data + APPEND_BASE_LEN, APPEND_LEN);
+        check_final_pages(id, data, sizeof(data));
+        boot(NULL, -1);
+        idle_check();
+        check_final_pages(id, data, sizeof(data));
+        int32_t size = read_file(append_name, buf, sizeof(buf));
+        o->cuts++;
+        if (size == sizeof(data) && memcmp(buf, data, sizeof(data)) == 0) {
+            o->new++;
+        }
+        else if (size == APPEND_BASE_LEN && memcmp(buf, data, APPEND_BASE_LEN) == 0) {
+            o->old++;
+        }
+        else {
+            fprintf(stderr, "power cut at operation %u of %u\n", cut, ops);
+            fail("file is neither as it was nor appended");
+        }
+        check_static();
+    }
+    boot(snapshot, -1);
+    wish_fs_remove(append_name);
+    my_spiffs_unmount();
+    memcpy(snapshot, flash_emu_data(), FLASH_EMU_SIZE);
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1 && strcmp(argv[1], "-v") == 0) {
+        hostfs_verbose = true;
+    }
+    else if (argc > 1) {
+        fprintf(stderr, "Usage: %s [-v]\n", argv[0]);
+        return 2;
+    }
+    struct my_spiffs_partition part = {
+        .addr = PART_ADDR,
+        .size = PART_SIZE,
+        .block_size = BLOCK_SIZE,
+        .page_size = PAGE_SIZE,
+    };
+    if (hostfs_spiffs_init(NULL) < 0 || my_spiffs_set_partition(&part) < 0) {
+        fail("init");
+    }
+    static uint8_t data[STATIC_LEN];
+    fill(data, sizeof(data), 0x5747);
+    if (write_file(static_name, data, sizeof(data)) < 0) {
+        fail("static write");
+    }
+
+    uint8_t *snapshot = malloc(FLASH_EMU_SIZE);
+    if (snapshot == NULL) {
+        fail("malloc");
+    }
+    struct outcome replace = { 0 }, delete = { 0 }, append = { 0 };
+    uint32_t version = 0;
+    int state, i;
+    for (state = 0; state < STATES; state++) {
+        for (i = 0; i < SAVES_PER_STATE; i++) {
+            if (save_db(++version) < 0) {
+                fail("save");
+            }
+        }
+        hostfs_idle(IDLE_MS);
+        my_spiffs_unmount();
+        memcpy(snapshot, flash_emu_data(), FLASH_EMU_SIZE);
+        test_replace(snapshot, version + 1, &replace);
+        test_delete(snapshot, version, &delete);
+        test_append(snapshot, version, &append);
+        boot(snapshot, -1);
+    }
+    free(snapshot);
+
+    printf("replace: %u power cuts, old version %u, new version %u\n",
+        replace.cuts, replace.old, replace.new);
+    printf("delete: %u power cuts, file whole %u, gone %u\n",
+        delete.cuts, delete.old, delete.new);
+    printf("append: %u power cuts, as it was %u, appended %u\n",
+        append.cuts, append.old, append.new);
+    struct hostfs_stats st;
+    hostfs_get_stats(&st);
+    if (st.flash.bad_programs) {
+        fail("bits programmed from 0 to 1");
+    }
+    hostfs_close();
+    printf("PASS\n");
+    return 0;
+}
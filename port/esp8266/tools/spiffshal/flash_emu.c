@@ -0,0 +1,220 @@
+/*
+ * NOR flash emulator, see flash_emu.h
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+typedef uint32_t uint32;
+typedef uint16_t uint16;
+
+#include "spi_flash.h"
+#include "flash_emu.h"
+
+struct flash_emu_stats flash_emu_stats;
+
+static uint8_t flash_ram[FLASH_EMU_SIZE];
+static uint8_t *flash = flash_ram;
+static int image_fd = -1;
+static uint32_t sector_erases[FLASH_EMU_SIZE / SPI_FLASH_SEC_SIZE];
+/* Programs and erases until the power is cut, or -1 */
+static int64_t power_ops_left = -1;
+static bool power_lost;
+static uint32_t ignore_page_size;
+static uint32_t ignore_offset;
+
+void flash_emu_reset(void) {
+    memset(flash, 0xff, FLASH_EMU_SIZE);
+    memset(&flash_emu_stats, 0, sizeof(flash_emu_stats));
+    memset(sector_erases, 0, sizeof(sector_erases));
+}
+
+int flash_emu_open_image(const char *path) {
+    flash_emu_close_image();
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+    off_t size = lseek(fd, 0, SEEK_END);
+    if (size < 0) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+    /* Erased flash beyond the end of the file */
+    static const uint8_t erased[SPI_FLASH_SEC_SIZE] = { [0 ... SPI_FLASH_SEC_SIZE - 1] = 0xff };
+    while (size < FLASH_EMU_SIZE) {
+        size_t n = FLASH_EMU_SIZE - size < sizeof(erased) ? FLASH_EMU_SIZE - size : sizeof(erased);
+        if (pwrite(fd, erased, n, size) != (ssize_t) n) {
+            perror(path);
+            close(fd);
+            return -1;
+        }
+        size += n;
+    }
+    void *p = mmap(NULL, FLASH_EMU_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+    flash = p;
+    image_fd = fd;
+    memset(&flash_emu_stats, 0, sizeof(flash_emu_stats));
+    memset(sector_erases, 0, sizeof(sector_erases));
+    return 0;
+}
+
+void flash_emu_close_image(void) {
+    if (image_fd < 0) {
+        return;
+    }
+    msync(flash, FLASH_EMU_SIZE, MS_SYNC);
+    munmap(flash, FLASH_EMU_SIZE);
+    close(image_fd);
+    image_fd = -1;
+    flash = flash_ram;
+    flash_emu_reset();
+}
+
+void flash_emu_cut_power(uint32_t ops) {
+    power_ops_left = ops;
+    power_lost = false;
+}
+
+void flash_emu_power_on(void) {
+    power_ops_left = -1;
+    power_lost = false;
+}
+
+bool flash_emu_power_lost(void) {
+    return power_lost;
+}
+
+void flash_emu_restore(const uint8_t *data) {
+    memcpy(flash, data, FLASH_EMU_SIZE);
+}
+
+/* Whether the program or erase which is about to be made is the one
+ * the power is cut in */
+static bool power_cut_now(void) {
+    if (power_ops_left < 0) {
+        return false;
+    }
+    if (power_ops_left == 0) {
+        power_lost = true;
+        power_ops_left = -1;
+        return true;
+    }
+    power_ops_left--;
+    return false;
+}
+
+void flash_emu_get_wear(uint32_t addr, uint32_t size, struct flash_emu_wear *w) {
+    uint32_t first = addr / SPI_FLASH_SEC_SIZE;
+    uint32_t last = (addr + size) / SPI_FLASH_SEC_SIZE;
+    uint32_t i;
+    memset(w, 0, sizeof(*w));
+    for (i = first; i < last && i < FLASH_EMU_SIZE / SPI_FLASH_SEC_SIZE; i++) {
+        uint32_t n = sector_erases[i];
+        if (w->sectors == 0 || n < w->min) {
+            w->min = n;
+        }
+        if (n > w->max) {
+            w->max = n;
+        }
+        w->erases += n;
+        w->sectors++;
+    }
+}
+
+void flash_emu_ignore(uint32_t page_size, uint32_t offset) {
+    ignore_page_size = page_size;
+    ignore_offset = offset;
+}
+
+const uint8_t *flash_emu_data(void) {
+    return flash;
+}
+
+static void check_access(const char *op, uint32_t addr, const void *buf, uint32_t size) {
+    if ((addr & 3) || (size & 3) || (buf != NULL && ((uintptr_t) buf & 3))) {
+        fprintf(stderr, "%s: unaligned access addr %08x size %u buf %p\n", op, addr, size, buf);
+        abort();
+    }
+    if (addr > FLASH_EMU_SIZE || size > FLASH_EMU_SIZE - addr) {
+        fprintf(stderr, "%s: out of flash addr %08x size %u\n", op, addr, size);
+        abort();
+    }
+}
+
+SpiFlashOpResult spi_flash_read(uint32 src_addr, uint32 *des_addr, uint32 size) {
+    /* The buffer of a read is not checked yet, as my_spi_read() reads
+     * straight to the buffer given by SPIFFS */
+    check_access("read", src_addr, NULL, size);
+    flash_emu_stats.reads++;
+    flash_emu_stats.read_bytes += size;
+    flash_emu_stats.time_us += FLASH_EMU_READ_US(size);
+    memcpy(des_addr, flash + src_addr, size);
+    return SPI_FLASH_RESULT_OK;
+}
+
+uint32 flash_emu_map_read(uint32 addr) {
+    if ((addr & 3) || addr >= FLASH_EMU_MAP_SIZE) {
+        fprintf(stderr, "map: bad load at %08x\n", addr);
+        abort();
+    }
+    flash_emu_stats.map_loads++;
+    if (flash_emu_stats.map_loads % FLASH_EMU_MAP_LOADS_PER_US == 0) {
+        flash_emu_stats.time_us++;
+    }
+    uint32_t word;
+    memcpy(&word, flash + addr, 4);
+    return word;
+}
+
+SpiFlashOpResult spi_flash_write(uint32 des_addr, uint32 *src_addr, uint32 size) {
+    check_access("write", des_addr, src_addr, size);
+    if (power_lost) {
+        return SPI_FLASH_RESULT_OK;
+    }
+    if (power_cut_now()) {
+        size /= 2;
+    }
+    flash_emu_stats.programs++;
+    flash_emu_stats.program_bytes += size;
+    flash_emu_stats.time_us += FLASH_EMU_PROGRAM_US(size);
+
+    const uint8_t *src = (const uint8_t *) src_addr;
+    uint32_t i;
+    for (i = 0; i < size; i++) {
+        uint32_t addr = des_addr + i;
+        bool ignored = ignore_page_size != 0 && addr % ignore_page_size == ignore_offset;
+        if (src[i] != 0xff && !ignored && ((flash[addr] ^ src[i]) & src[i])) {
+            fprintf(stderr, "write: %02x over %02x at %08x\n", src[i], flash[addr], addr);
+            flash_emu_stats.bad_programs++;
+        }
+        flash[addr] &= src[i];
+    }
+    return SPI_FLASH_RESULT_OK;
+}
+
+SpiFlashOpResult spi_flash_erase_sector(uint16 sec) {
+    uint32_t addr = sec * SPI_FLASH_SEC_SIZE;
+    check_access("erase", addr, flash, SPI_FLASH_SEC_SIZE);
+    if (power_lost || power_cut_now()) {
+        return SPI_FLASH_RESULT_OK;
+    }
+    flash_emu_stats.erases++;
+    sector_erases[sec]++;
+    flash_emu_stats.time_us += FLASH_EMU_ERASE_US;
+    memset(flash + addr, 0xff, SPI_FLASH_SEC_SIZE);
+    return SPI_FLASH_RESULT_OK;
+}
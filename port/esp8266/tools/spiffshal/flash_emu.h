@@ -0,0 +1,98 @@
+#ifndef FLASH_EMU_H
+#define FLASH_EMU_H
+
+/* NOR flash emulator behind the spi_flash_* functions of the SDK.
+ *
+ * Like the real flash, erasing sets a sector to 0xff and programming can
+ * only clear bits. Addresses, lengths and buffers must be 4-byte
+ * aligned, as spi_flash_* require. Every operation is counted.
+ *
+ * Loads from the memory mapped window are emulated too. Like on the chip,
+ * they must be aligned 32-bit loads within the first megabyte.
+ *
+ * The time the operations would take on the chip is modeled too, from
+ * typical figures of SPI NOR flash on a 40 MHz bus: a sector erase takes
+ * tens of milliseconds, a page program under a millisecond, and reads
+ * are limited by the bus. Loads from the memory mapped window mostly hit
+ * the flash cache, and are counted as a cache miss per 32 loads.
+ *
+ * The flash is kept in RAM, or in an image file mapped with mmap(), so
+ * that the contents persist from one run to the next. The erases of
+ * every sector are counted, to see how evenly the flash wears. */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define FLASH_EMU_SIZE (4*1024*1024)
+#define FLASH_EMU_MAP_SIZE (1024*1024)
+
+/* Modeled duration of the operations, in microseconds */
+#define FLASH_EMU_ERASE_US              40000
+#define FLASH_EMU_PROGRAM_US(bytes)     (40 + (bytes) * 3)
+#define FLASH_EMU_READ_US(bytes)        (5 + (bytes) / 5)
+#define FLASH_EMU_MAP_LOADS_PER_US      32
+
+struct flash_emu_stats {
+    uint32_t reads;
+    uint32_t read_bytes;
+    uint32_t programs;
+    uint32_t program_bytes;
+    uint32_t erases;
+    /* 32-bit loads from the memory mapped window */
+    uint32_t map_loads;
+    /* Bytes which were programmed with a value other than 0xff, and which
+     * would have needed a bit to go from 0 to 1 */
+    uint32_t bad_programs;
+    /* Modeled time spent in flash operations, microseconds */
+    uint64_t time_us;
+};
+
+extern struct flash_emu_stats flash_emu_stats;
+
+/* Erases of a range of sectors */
+struct flash_emu_wear {
+    uint32_t sectors;
+    uint32_t erases;
+    uint32_t min;
+    uint32_t max;
+};
+
+/* Erase the whole flash and clear the statistics */
+void flash_emu_reset(void);
+
+/* Do not check for 0 to 1 programming at this offset of every 'page_size'
+ * bytes. SPIFFS writes the flags byte of a page header as a whole,
+ * although it only ever clears bits of it. */
+void flash_emu_ignore(uint32_t page_size, uint32_t offset);
+
+const uint8_t *flash_emu_data(void);
+
+/* Keep the flash in the image file 'path' instead of RAM. A missing or
+ * short file is extended with erased flash. Returns 0, or -1 if the file
+ * cannot be opened or mapped. The statistics are cleared, but not the
+ * contents. */
+int flash_emu_open_image(const char *path);
+
+/* Write the flash back to the image file, and return to RAM, erased */
+void flash_emu_close_image(void);
+
+/* Erases of the sectors of 'size' bytes at 'addr', since the last reset
+ * or open */
+void flash_emu_get_wear(uint32_t addr, uint32_t size, struct flash_emu_wear *w);
+
+/* Cut the power after 'ops' more programs and erases. The program in
+ * progress when the power goes only programs the first half of its
+ * bytes, an erase in progress is not made at all. Later programs and
+ * erases are ignored until flash_emu_power_on(); reads still work. */
+void flash_emu_cut_power(uint32_t ops);
+
+void flash_emu_power_on(void);
+
+/* Whether the power was cut */
+bool flash_emu_power_lost(void);
+
+/* Set the contents of the flash, as taken from flash_emu_data() */
+void flash_emu_restore(const uint8_t *data);
+
+#endif //FLASH_EMU_H
@@ -0,0 +1,1228 @@
+/*
+ * Host test and benchmark for the SPIFFS flash layer of the port.
+ *
+ * spiffs_integration.c and SPIFFS itself, the same code as in the
+ * firmware, run on top of an emulated NOR flash (flash_emu.c) which
+ * counts every spi_flash_* call. The workloads are like the ones of the
+ * Wish core: appending small records to a file, and rewriting small
+ * files through a temporary file and rename.
+ *
+ * The program checks that every file reads back as it was written, that
+ * no flash bit was ever programmed from 0 to 1, and prints the flash
+ * operations per SPIFFS write of each workload. The Makefile builds it
+ * with and without SPIFFS_HAL_WRITE_COALESCE, and with the batched
+ * appends of SPIFFS_APPEND_BATCH, and as neither must change what ends
+ * up in flash, the images written with -o are compared.
+ *
+ * A second benchmark opens a set of small files and reads them back in
+ * short records, and prints the flash reads and bytes read per
+ * SPIFFS_open and SPIFFS_read, along with the loads from the memory
+ * mapped flash window. It is also built without SPIFFS_HAL_FLASH_MAP,
+ * and without both that and SPIFFS_HAL_READ_CACHE, to compare the
+ * window and the read-ahead cache against reading
+ * flash directly.
+ *
+ * Last, the same churn of small file rewrites is run on partitions of
+ * 32 KB, 256 KB and 1 MB, set up with my_spiffs_set_partition(), and the
+ * garbage collection runs, erases (in total and per block), pages moved
+ * per garbage collection, the largest erase age and the SPIFFS cache hit
+ * rate of each are printed, as my_spiffs_get_stats() reports them, and
+ * then the hit rate by the kind of page: object lookup, object index and
+ * data. The Makefile also builds it with the plain LRU replacement of the
+ * SPIFFS cache instead of SPIFFS_CACHE_SLRU. The last partition is then
+ * mounted again from its descriptor in flash.
+ *
+ * On the 1 MB partition, a file of 64 KB is then written in pieces of a
+ * kilobyte, as an identity export or an OTA image staged in the file
+ * system would be, and the flash operations are printed as for the
+ * first workloads.
+ *
+ * The mount benchmark fills partitions of 32 KB up to 2 MB with a few
+ * files, and prints the flash reads and modeled flash time of mounting
+ * them after a reset, which scans the lookup pages, and after an
+ * unmount, which takes the mount state from the checkpoint written at
+ * unmount. Both must find the same state, and a write must cancel the
+ * checkpoint. A checkpoint of another record layout must not be taken.
+ *
+ * The check benchmark mounts partitions of 32 KB up to 1 MB as after a
+ * reset, and runs the background consistency check (SPIFFS_BG_CHECK) to
+ * the end, printing its steps, flash reads, and the modeled flash time
+ * of the whole check and of the longest step.
+ *
+ * The list benchmark adds files to the 1 MB partition and lists them
+ * with my_fs_list(), in one go and in pages of ten files as the fsList
+ * Mist endpoint does, and then gets the size of each by opening it and
+ * seeking to its end, and prints the flash reads and modeled flash time
+ * of each way. Listing reads every lookup page once and every index
+ * header once, while opening by name is cheap here only because the
+ * names are known and opened in the order the files were written, so
+ * that the search for each starts next to it. The listed sizes must be
+ * right, and the listed pages add up to the allocated pages of the file
+ * system.
+ *
+ * The garbage collection benchmark toggles a relay setting on the 32 KB
+ * partition, next to a couple of static databases and a database which
+ * is rewritten now and then, and prints the distribution of the modeled
+ * flash time of a settings write, with and without the system being idle
+ * long enough for the background garbage collection (SPIFFS_BG_GC) to
+ * run between the writes.
+ *
+ * The settings benchmark toggles the same setting the way the Sonoff app
+ * used to save it, rewriting one byte of a file, and through the
+ * append-only settings log (user_settings.c), and prints the flash
+ * programs, bytes programmed, erases and modeled flash time per toggle.
+ * The log is then loaded again, also after a record torn by a reset.
+ *
+ * The wish_fs benchmark saves and loads an identity database through
+ * the buffered wish_fs layer (WISH_FS_BUFFERS, on in this build only), writing and reading it in BSON sized
+ * pieces as the Wish core does, and through plain calls to the file
+ * system as wish_fs used to make them, and prints the file system calls,
+ * flash operations and modeled flash time per save and load.
+ *
+ * Before all that, a partition descriptor which passes its check but
+ * has an unusable geometry is put in flash, and the first mount must
+ * ignore it and use the partition of the build.
+ *
+ * Usage: spiffshal [-v] [-o image]
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include "spiffs.h"
+#include "spiffs_nucleus.h"
+#include "spiffs_integration.h"
+#include "user_metrics.h"
+#include "user_timer.h"
+#include "user_settings.h"
+#include "wish_fs.h"
+#include "flash_emu.h"
+
+/* spi_flash_* functions of Espressif SDK assume these odd definitions */
+typedef uint32_t uint32;
+typedef uint16_t uint16;
+
+#include "spi_flash.h"
+
+#ifndef SPIFFS_HAL_WRITE_COALESCE
+#define SPIFFS_HAL_WRITE_COALESCE 1
+#endif
+#ifndef SPIFFS_HAL_READ_CACHE
+#define SPIFFS_HAL_READ_CACHE 1
+#endif
+#ifndef SPIFFS_HAL_FLASH_MAP
+#define SPIFFS_HAL_FLASH_MAP 1
+#endif
+
+#define APPEND_RECORDS 400
+#define APPEND_RECORD_LEN 24
+#define REWRITE_ROUNDS 40
+#define REWRITE_FILE_LEN 600
+#define EXPORT_FILE_LEN (64*1024)
+#define EXPORT_WRITE_LEN 1024
+#define READ_FILES 8
+#define READ_FILE_LEN 700
+#define READ_ROUNDS 10
+#define READ_RECORD_LEN 20
+#define CHURN_ROUNDS 400
+#define STATIC_FILE_LEN 12000
+#define TOGGLES 2000
+#define TOGGLE_REWRITE_EVERY 20
+#define IDLE_MAX_STEPS 100
+#define IDENTITIES 4
+#define IDENTITY_LEN 380
+#define IDENTITY_ROUNDS 50
+#define MOUNT_FILES 12
+#define LIST_FILES 40
+#define LIST_PAGE_FILES 10
+
+static bool verbose;
+static uint32_t hal_reads;
+static uint32_t hal_writes;
+static uint32_t fs_writes;
+
+/* Replaces os_printf_plus of the SDK, used for debug output */
+int os_printf_plus(const char *format, ...) {
+    if (!verbose) {
+        return 0;
+    }
+    va_list ap;
+    va_start(ap, format);
+    int ret = vprintf(format, ap);
+    va_end(ap);
+    return ret;
+}
+
+/* Replaces user_metrics.c, counts the calls to the SPI HAL layer */
+void user_metric_add(enum user_metric metric, uint32_t n) {
+    if (metric == USER_METRIC_SPIFFS_READS) {
+        hal_reads += n;
+    }
+    else if (metric == USER_METRIC_SPIFFS_WRITES) {
+        hal_writes += n;
+    }
+}
+
+/* Replaces system_get_time of the SDK with the modeled flash time, which
+ * the steps of the background consistency check are timed by */
+uint32_t system_get_time(void) {
+    return (uint32_t) flash_emu_stats.time_us;
+}
+
+/* Replaces user_timer.c. The timer armed last is run when the benchmark
+ * lets the system be idle; the only timer of the code under test is the
+ * one of the background garbage collection. */
+static struct user_timer *idle_timer;
+
+void user_timer_setfn(struct user_timer *timer, user_timer_func_t *func, void *arg) {
+    timer->func = func;
+    timer->arg = arg;
+}
+
+void user_timer_arm(struct user_timer *timer, uint32_t ms, bool repeat) {
+    timer->armed = true;
+    idle_timer = timer;
+}
+
+void user_timer_disarm(struct user_timer *timer) {
+    timer->armed = false;
+}
+
+/* Run the armed timer until it is no longer re-armed, at most 'max'
+ * times. Returns the number of runs. */
+static uint32_t run_idle(uint32_t max) {
+    uint32_t n = 0;
+    while (idle_timer != NULL && idle_timer->armed && n < max) {
+        idle_timer->armed = false;
+        idle_timer->func(idle_timer->arg);
+        n++;
+    }
+    return n;
+}
+
+static void fail(const char *what) {
+    fprintf(stderr, "FAIL: %s\n", what);
+    exit(1);
+}
+
+static void fill(uint8_t *buf, size_t len, uint32_t seed) {
+    size_t i;
+    for (i = 0; i < len; i++) {
+        seed = seed * 1103515245 + 12345;
+        buf[i] = seed >> 16;
+    }
+}
+
+static void write_all(wish_file_t fd, const uint8_t *buf, size_t len) {
+    fs_writes++;
+    if (my_fs_write(fd, buf, len) != (int32_t) len) {
+        fail("write");
+    }
+}
+
+static void check_file(const char *name, const uint8_t *expected, size_t len) {
+    uint8_t buf[REWRITE_FILE_LEN];
+    size_t done = 0;
+    wish_file_t fd = my_fs_open(name);
+    if (fd < 0) {
+        fail("open for reading");
+    }
+    while (done < len) {
+        size_t n = len - done < sizeof(buf) ? len - done : sizeof(buf);
+        if (my_fs_read(fd, buf, n) != (int32_t) n) {
+            fail("read");
+        }
+        if (memcmp(buf, expected + done, n) != 0) {
+            fprintf(stderr, "%s differs at %zu\n", name, done);
+            fail("verify");
+        }
+        done += n;
+    }
+    if (my_fs_read(fd, buf, 1) != 0) {
+        fail("file too long");
+    }
+    my_fs_close(fd);
+}
+
+struct snapshot {
+    struct flash_emu_stats flash;
+    uint32_t hal_reads;
+    uint32_t hal_writes;
+    uint32_t fs_writes;
+};
+
+static void snapshot(struct snapshot *s) {
+    s->flash = flash_emu_stats;
+    s->hal_reads = hal_reads;
+    s->hal_writes = hal_writes;
+    s->fs_writes = fs_writes;
+}
+
+static void report(const char *name, const struct snapshot *s) {
+    uint32_t writes = fs_writes - s->fs_writes;
+    uint32_t programs = flash_emu_stats.programs - s->flash.programs;
+    printf("%-8s %6u %8u %8u %9u %8u %7u %8.2f\n", name, writes,
+        hal_writes - s->hal_writes, programs,
+        flash_emu_stats.program_bytes - s->flash.program_bytes,
+        flash_emu_stats.reads - s->flash.reads,
+        flash_emu_stats.erases - s->flash.erases,
+        writes ? (double) programs / writes : 0.0);
+}
+
+/* Flash reads made by a number of SPIFFS calls */
+struct read_cost {
+    uint32_t calls;
+    uint32_t hal_reads;
+    uint32_t reads;
+    uint32_t read_bytes;
+    uint32_t map_loads;
+};
+
+static void read_cost_add(struct read_cost *c, const struct snapshot *s) {
+    c->calls++;
+    c->hal_reads += hal_reads - s->hal_reads;
+    c->reads += flash_emu_stats.reads - s->flash.reads;
+    c->read_bytes += flash_emu_stats.read_bytes - s->flash.read_bytes;
+    c->map_loads += flash_emu_stats.map_loads - s->flash.map_loads;
+}
+
+static void report_reads(const char *name, const struct read_cost *c) {
+    printf("%-8s %6u %8u %8u %9u %8.2f %8.1f %9.1f\n", name, c->calls,
+        c->hal_reads, c->reads, c->read_bytes,
+        c->calls ? (double) c->reads / c->calls : 0.0,
+        c->calls ? (double) c->read_bytes / c->calls : 0.0,
+        c->calls ? (double) c->map_loads / c->calls : 0.0);
+}
+
+/* Open small files and read them in records, as wish_fs does when
+ * loading the databases */
+static void read_benchmark(void) {
+    static uint8_t files[READ_FILES][READ_FILE_LEN];
+    char name[16];
+    int i, j;
+    for (i = 0; i < READ_FILES; i++) {
+        fill(files[i], READ_FILE_LEN, 1000 + i);
+        snprintf(name, sizeof(name), "/file%d", i);
+        wish_file_t fd = my_fs_open(name);
+        if (fd < 0) {
+            fail("open for writing");
+        }
+        write_all(fd, files[i], READ_FILE_LEN);
+        my_fs_close(fd);
+    }
+
+    struct read_cost open_cost = { 0 }, read_cost = { 0 };
+    struct snapshot s;
+    for (j = 0; j < READ_ROUNDS; j++) {
+        for (i = 0; i < READ_FILES; i++) {
+            snprintf(name, sizeof(name), "/file%d", i);
+            snapshot(&s);
+            wish_file_t fd = my_fs_open(name);
+            if (fd < 0) {
+                fail("open for reading");
+            }
+            read_cost_add(&open_cost, &s);
+
+            uint8_t buf[READ_RECORD_LEN];
+            size_t done;
+            for (done = 0; done < READ_FILE_LEN; done += READ_RECORD_LEN) {
+                size_t n = READ_FILE_LEN - done < sizeof(buf) ? READ_FILE_LEN - done : sizeof(buf);
+                snapshot(&s);
+                if (my_fs_read(fd, buf, n) != (int32_t) n) {
+                    fail("read");
+                }
+                read_cost_add(&read_cost, &s);
+                if (memcmp(buf, files[i] + done, n) != 0) {
+                    fail("verify read");
+                }
+            }
+            my_fs_close(fd);
+        }
+    }
+
+    printf("%-8s %6s %8s %8s %9s %8s %8s %9s\n", "op", "calls",
+        "hal rd", "reads", "read B", "reads/op", "B/op", "loads/op");
+    report_reads("open", &open_cost);
+    report_reads("read", &read_cost);
+}
+
+/* Rewrite a small file over and over on partitions of different size */
+static double hit_rate(uint32_t hits, uint32_t misses) {
+    return hits + misses ? 100.0 * hits / (hits + misses) : 0.0;
+}
+
+static void partition_benchmark(void) {
+    static const struct my_spiffs_partition parts[] = {
+        { .addr = 0xf2000, .size = 32*1024, .block_size = 4096, .page_size = 256 },
+        { .addr = 0xb0000, .size = 256*1024, .block_size = 4096, .page_size = 256 },
+        { .addr = 0x100000, .size = 1024*1024, .block_size = 4096, .page_size = 256 },
+    };
+    /* Too few blocks for SPIFFS */
+    static const struct my_spiffs_partition bad = {
+        .addr = 0xf2000, .size = 8*1024, .block_size = 4096, .page_size = 256
+    };
+    uint8_t file[REWRITE_FILE_LEN];
+    static uint8_t stat[STATIC_FILE_LEN];
+    struct my_spiffs_partition p;
+    struct my_spiffs_stats cache[sizeof(parts) / sizeof(parts[0])];
+    unsigned int i;
+    int j;
+
+    fill(stat, sizeof(stat), 4000);
+    if (my_spiffs_set_partition(&bad) != SPIFFS_ERR_NOT_CONFIGURED) {
+        fail("bad partition accepted");
+    }
+
+    printf("%-8s %6s %8s %8s %7s %9s %7s %8s %7s %7s\n", "part KB", "writes",
+        "programs", "reads", "erases", "erases/bl", "gc runs", "moved/gc",
+        "age max", "hit %");
+    for (i = 0; i < sizeof(parts) / sizeof(parts[0]); i++) {
+        struct snapshot s;
+        if (my_spiffs_set_partition(&parts[i]) != SPIFFS_OK) {
+            fail("set partition");
+        }
+        snapshot(&s);
+        /* A file which stays, so that garbage collection has to move
+         * pages */
+        wish_file_t fd = my_fs_open("/static");
+        if (fd < 0) {
+            fail("open /static");
+        }
+        write_all(fd, stat, sizeof(stat));
+        my_fs_close(fd);
+        for (j = 0; j < CHURN_ROUNDS; j++) {
+            fill(file, sizeof(file), 5000 + j);
+            fd = my_fs_open("/db.tmp");
+            if (fd < 0) {
+                fail("open /db.tmp");
+            }
+            size_t done;
+            for (done = 0; done < sizeof(file); done += 100) {
+                write_all(fd, file + done, 100);
+            }
+            my_fs_close(fd);
+            my_fs_remove("/db");
+            if (my_fs_rename("/db.tmp", "/db") != SPIFFS_OK) {
+                fail("rename");
+            }
+        }
+        struct my_spiffs_stats st;
+        if (my_spiffs_get_stats(&st) != SPIFFS_OK ||
+                st.blocks != parts[i].size / parts[i].block_size ||
+                st.pages_free + st.pages_allocated + st.pages_deleted != st.pages_total) {
+            fail("fs stats");
+        }
+        uint32_t erases = flash_emu_stats.erases - s.flash.erases;
+        printf("%-8u %6u %8u %8u %7u %9.2f %7u %8.2f %7u %7.1f\n", parts[i].size / 1024,
+            fs_writes - s.fs_writes,
+            flash_emu_stats.programs - s.flash.programs,
+            flash_emu_stats.reads - s.flash.reads, erases,
+            (double) erases / st.blocks, st.gc_runs,
+            st.gc_runs ? (double) st.gc_pages_moved / st.gc_runs : 0.0,
+            st.erase_age_max,
+            hit_rate(st.cache_hits, st.cache_misses));
+        cache[i] = st;
+    }
+    printf("%-8s %12s %12s %12s\n", "part KB", "lookup hit %", "index hit %", "data hit %");
+    for (i = 0; i < sizeof(parts) / sizeof(parts[0]); i++) {
+        printf("%-8u %12.1f %12.1f %12.1f\n", parts[i].size / 1024,
+            hit_rate(cache[i].cache_lu_hits, cache[i].cache_lu_misses),
+            hit_rate(cache[i].cache_ix_hits, cache[i].cache_ix_misses),
+            hit_rate(cache[i].cache_data_hits, cache[i].cache_data_misses));
+    }
+
+    /* As after a reboot, the partition comes from the descriptor */
+    my_spiffs_mount();
+    my_spiffs_get_partition(&p);
+    if (p.addr != parts[i - 1].addr || p.size != parts[i - 1].size) {
+        fail("partition descriptor");
+    }
+    check_file("/db", file, sizeof(file));
+    check_file("/static", stat, sizeof(stat));
+}
+
+/* Write a large file in large pieces, on the partition left by
+ * partition_benchmark() */
+static void export_benchmark(void) {
+    static uint8_t export[EXPORT_FILE_LEN];
+    struct snapshot s;
+    size_t done;
+
+    fill(export, sizeof(export), 6000);
+    snapshot(&s);
+    wish_file_t fd = my_fs_open("/export");
+    if (fd < 0) {
+        fail("open /export");
+    }
+    for (done = 0; done < sizeof(export); done += EXPORT_WRITE_LEN) {
+        write_all(fd, export + done, EXPORT_WRITE_LEN);
+    }
+    my_fs_close(fd);
+    printf("%-8s %6s %8s %8s %9s %8s %7s %8s\n", "workload", "writes",
+        "hal wr", "programs", "prog B", "reads", "erases", "prog/wr");
+    report("export", &s);
+    check_file("/export", export, sizeof(export));
+    my_fs_remove("/export");
+}
+
+/* Mount the partition, as after a reset, between the snapshots 's' and
+ * 'e' */
+static void timed_mount(struct snapshot *s, struct snapshot *e, struct my_spiffs_stats *st) {
+    snapshot(s);
+    my_spiffs_mount();
+    snapshot(e);
+    if (my_spiffs_get_stats(st) != SPIFFS_OK) {
+        fail("fs stats");
+    }
+}
+
+static void report_mount(const struct snapshot *s, const struct snapshot *e) {
+    printf(" %8u %8u %8u %8.2f", e->flash.reads - s->flash.reads,
+        e->flash.read_bytes - s->flash.read_bytes, e->flash.map_loads - s->flash.map_loads,
+        (e->flash.time_us - s->flash.time_us) / 1000.0);
+}
+
+/* Mount partitions of different size by scanning them, and from the
+ * checkpoint written at unmount */
+static void mount_benchmark(void) {
+    static const struct my_spiffs_partition parts[] = {
+        { .addr = 0xf2000, .size = 32*1024, .block_size = 4096, .page_size = 256 },
+        { .addr = 0xb0000, .size = 256*1024, .block_size = 4096, .page_size = 256 },
+        { .addr = 0x100000, .size = 1024*1024, .block_size = 4096, .page_size = 256 },
+        { .addr = 0x200000, .size = 2048*1024, .block_size = 4096, .page_size = 256 },
+    };
+    static uint8_t files[MOUNT_FILES][REWRITE_FILE_LEN];
+    struct snapshot s, scan, ckpt, e;
+    struct my_spiffs_stats scan_st, ckpt_st;
+    char name[16];
+    uint32_t ckpt_cost = 0;
+    unsigned int i;
+    int j;
+
+    printf("%-8s %8s %8s %8s %8s %8s %8s %8s %8s\n", "mount KB", "reads", "read B",
+        "loads", "ms", "ck reads", "ck B", "ck loads", "ck ms");
+    for (i = 0; i < sizeof(parts) / sizeof(parts[0]); i++) {
+        if (my_spiffs_set_partition(&parts[i]) != SPIFFS_OK) {
+            fail("set partition");
+        }
+        for (j = 0; j < MOUNT_FILES; j++) {
+            fill(files[j], sizeof(files[j]), 7000 + j);
+            snprintf(name, sizeof(name), "/m%02d", j);
+            wish_file_t fd = my_fs_open(name);
+            if (fd < 0) {
+                fail("open");
+            }
+            write_all(fd, files[j], sizeof(files[j]));
+            my_fs_close(fd);
+        }
+
+        /* Written to since the last checkpoint, so the lookup pages are
+         * scanned, and there is no checkpoint at unmount before the
+         * background consistency check which follows is done */
+        timed_mount(&s, &scan, &scan_st);
+        while (my_spiffs_check_step() > 0) {
+        }
+        my_spiffs_unmount();
+        timed_mount(&ckpt, &e, &ckpt_st);
+        printf("%-8u", parts[i].size / 1024);
+        report_mount(&s, &scan);
+        report_mount(&ckpt, &e);
+        printf("\n");
+        ckpt_cost = e.flash.reads + e.flash.map_loads - ckpt.flash.reads - ckpt.flash.map_loads;
+        if (scan_st.pages_free != ckpt_st.pages_free ||
+                scan_st.pages_allocated != ckpt_st.pages_allocated ||
+                scan_st.pages_deleted != ckpt_st.pages_deleted ||
+                scan_st.erase_age_max != ckpt_st.erase_age_max) {
+            fail("mount state from checkpoint");
+        }
+        for (j = 0; j < MOUNT_FILES; j++) {
+            snprintf(name, sizeof(name), "/m%02d", j);
+            check_file(name, files[j], sizeof(files[j]));
+        }
+
+        /* A write cancels the checkpoint */
+        fill(files[0], sizeof(files[0]), 8000 + i);
+        my_fs_remove("/m00");
+        wish_file_t fd = my_fs_open("/m00");
+        if (fd < 0) {
+            fail("open");
+        }
+        write_all(fd, files[0], sizeof(files[0]));
+        my_fs_close(fd);
+        timed_mount(&s, &scan, &scan_st);
+        if (scan.flash.reads + scan.flash.map_loads - s.flash.reads - s.flash.map_loads <= ckpt_cost) {
+            fail("mounted from a cancelled checkpoint");
+        }
+        check_file("/m00", files[0], sizeof(files[0]));
+    }
+
+    /* A checkpoint written by a build with a smaller mount state is not
+     * taken, and its sector is erased so that the checkpoints of this
+     * build work again */
+    uint32_t rec[16];
+    memset(rec, 0, sizeof(rec));
+    rec[0] = 0x6b635053;
+    rec[1] = sizeof(rec);
+    rec[2] = parts[i - 1].addr;
+    rec[3] = parts[i - 1].size;
+    rec[4] = parts[i - 1].block_size;
+    rec[5] = parts[i - 1].page_size;
+    rec[15] = 0xffffffff;
+    spi_flash_erase_sector(SPIFFS_PART_CKPT_ADDR / SPI_FLASH_SEC_SIZE);
+    spi_flash_write(SPIFFS_PART_CKPT_ADDR, rec, sizeof(rec));
+    timed_mount(&s, &scan, &scan_st);
+    if (scan.flash.reads + scan.flash.map_loads - s.flash.reads - s.flash.map_loads <= ckpt_cost) {
+        fail("mounted from a checkpoint of another layout");
+    }
+    spi_flash_read(SPIFFS_PART_CKPT_ADDR, rec, sizeof(rec[0]));
+    if (rec[0] != 0xffffffff) {
+        fail("checkpoint of another layout kept");
+    }
+    while (my_spiffs_check_step() > 0) {
+    }
+    my_spiffs_unmount();
+    timed_mount(&ckpt, &e, &ckpt_st);
+    if (e.flash.reads + e.flash.map_loads - ckpt.flash.reads - ckpt.flash.map_loads > ckpt_cost) {
+        fail("no checkpoint after one of another layout");
+    }
+}
+
+/* Mount partitions of different size as after a reset, and run the
+ * background consistency check which follows to the end */
+static void check_benchmark(void) {
+    static const struct my_spiffs_partition parts[] = {
+        { .addr = 0xf2000, .size = 32*1024, .block_size = 4096, .page_size = 256 },
+        { .addr = 0xb0000, .size = 256*1024, .block_size = 4096, .page_size = 256 },
+        { .addr = 0x100000, .size = 1024*1024, .block_size = 4096, .page_size = 256 },
+    };
+    static uint8_t files[MOUNT_FILES][REWRITE_FILE_LEN];
+    struct my_spiffs_stats st;
+    char name[16];
+    unsigned int i;
+    int j;
+
+    printf("%-8s %8s %8s %8s %8s\n", "check KB", "steps", "reads", "ms", "max ms");
+    for (i = 0; i < sizeof(parts) / sizeof(parts[0]); i++) {
+        if (my_spiffs_set_partition(&parts[i]) != SPIFFS_OK) {
+            fail("set partition");
+        }
+        for (j = 0; j < MOUNT_FILES; j++) {
+            fill(files[j], sizeof(files[j]), 9000 + j);
+            snprintf(name, sizeof(name), "/c%02d", j);
+            wish_file_t fd = my_fs_open(name);
+            if (fd < 0) {
+                fail("open");
+            }
+            write_all(fd, files[j], sizeof(files[j]));
+            my_fs_close(fd);
+        }
+
+        my_spiffs_mount();
+        if (my_spiffs_get_stats(&st) != SPIFFS_OK || st.check_progress == 0) {
+            fail("no check after a reset");
+        }
+        struct snapshot s, e;
+        uint32_t steps = 0;
+        uint64_t max_us = 0;
+        int32_t res;
+        snapshot(&s);
+        do {
+            uint64_t t = flash_emu_stats.time_us;
+            res = my_spiffs_check_step();
+            if (flash_emu_stats.time_us - t > max_us) {
+                max_us = flash_emu_stats.time_us - t;
+            }
+            steps++;
+        } while (res > 0);
+        snapshot(&e);
+        if (res < 0) {
+            fail("check");
+        }
+        if (my_spiffs_get_stats(&st) != SPIFFS_OK || st.check_progress != 0) {
+            fail("check still in progress");
+        }
+        printf("%-8u %8u %8u %8.2f %8.2f\n", parts[i].size / 1024, steps,
+            e.flash.reads - s.flash.reads, (e.flash.time_us - s.flash.time_us) / 1000.0,
+            max_us / 1000.0);
+        for (j = 0; j < MOUNT_FILES; j++) {
+            snprintf(name, sizeof(name), "/c%02d", j);
+            check_file(name, files[j], sizeof(files[j]));
+        }
+    }
+}
+
+struct list_state {
+    uint32_t files;
+    uint32_t max;
+    uint32_t pages;
+    uint32_t sizes[MOUNT_FILES + LIST_FILES];
+};
+
+static int32_t list_file(const struct my_fs_file *f, void *arg) {
+    struct list_state *st = arg;
+    if (st->files == st->max) {
+        return 1;
+    }
+    if (st->files >= sizeof(st->sizes) / sizeof(st->sizes[0])) {
+        fail("listed too many files");
+    }
+    if (verbose) {
+        printf("  %s %u bytes, id %04x, %u pages\n", f->name, f->size, f->id, f->pages);
+    }
+    st->sizes[st->files++] = f->size;
+    st->pages += f->pages;
+    return 0;
+}
+
+static void report_list(const char *name, uint32_t calls, const struct snapshot *s,
+        const struct snapshot *e) {
+    printf("%-8s %6u %8u %8.2f\n", name, calls, e->flash.reads - s->flash.reads,
+        (e->flash.time_us - s->flash.time_us) / 1000.0);
+}
+
+/* List the files of the partition left by check_benchmark(), with more
+ * files added, against getting their sizes one by one */
+static void list_benchmark(void) {
+    static uint8_t file[REWRITE_FILE_LEN];
+    struct list_state all, paged;
+    struct snapshot s, e;
+    struct my_spiffs_stats st;
+    char name[16];
+    uint32_t cursor, calls;
+    int j;
+
+    for (j = 0; j < LIST_FILES; j++) {
+        fill(file, sizeof(file), 9500 + j);
+        snprintf(name, sizeof(name), "/l%02d", j);
+        wish_file_t fd = my_fs_open(name);
+        if (fd < 0) {
+            fail("open");
+        }
+        write_all(fd, file, (j * 97) % sizeof(file));
+        my_fs_close(fd);
+    }
+
+    printf("%-8s %6s %8s %8s\n", "list", "calls", "reads", "ms");
+    memset(&all, 0, sizeof(all));
+    all.max = MOUNT_FILES + LIST_FILES;
+    cursor = 0;
+    snapshot(&s);
+    if (my_fs_list(&cursor, list_file, &all) != MOUNT_FILES + LIST_FILES ||
+            cursor != MY_FS_LIST_END) {
+        fail("list");
+    }
+    snapshot(&e);
+    report_list("all", 1, &s, &e);
+    if (my_spiffs_get_stats(&st) != SPIFFS_OK || all.pages != st.pages_allocated) {
+        fail("listed pages");
+    }
+
+    memset(&paged, 0, sizeof(paged));
+    cursor = 0;
+    calls = 0;
+    snapshot(&s);
+    while (cursor != MY_FS_LIST_END) {
+        paged.max = paged.files + LIST_PAGE_FILES;
+        if (my_fs_list(&cursor, list_file, &paged) < 0) {
+            fail("list");
+        }
+        calls++;
+    }
+    snapshot(&e);
+    report_list("paged", calls, &s, &e);
+    if (paged.files != all.files || memcmp(paged.sizes, all.sizes, sizeof(all.sizes)) != 0) {
+        fail("paged list");
+    }
+
+    /* The names are known here, the sizes are listed in the same order */
+    uint32_t sizes = 0;
+    snapshot(&s);
+    for (j = 0; j < MOUNT_FILES + LIST_FILES; j++) {
+        if (j < MOUNT_FILES) {
+            snprintf(name, sizeof(name), "/c%02d", j);
+        }
+        else {
+            snprintf(name, sizeof(name), "/l%02d", j - MOUNT_FILES);
+        }
+        wish_file_t fd = my_fs_open(name);
+        if (fd < 0) {
+            fail("open");
+        }
+        sizes += my_fs_lseek(fd, 0, WISH_FS_SEEK_END);
+        my_fs_close(fd);
+    }
+    snapshot(&e);
+    report_list("open", MOUNT_FILES + LIST_FILES, &s, &e);
+    for (j = 0; j < MOUNT_FILES + LIST_FILES; j++) {
+        sizes -= all.sizes[j];
+    }
+    if (sizes != 0) {
+        fail("listed sizes");
+    }
+}
+
+static int cmp_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+    return x < y ? -1 : x > y;
+}
+
+/* Toggle a relay setting, with or without idle time for the background
+ * garbage collection between the toggles */
+static void gc_benchmark(bool idle) {
+    static const struct my_spiffs_partition part = {
+        .addr = 0xf2000, .size = 32*1024, .block_size = 4096, .page_size = 256
+    };
+    static uint32_t latency[TOGGLES];
+    static uint8_t stat[STATIC_FILE_LEN / 4];
+    uint8_t file[REWRITE_FILE_LEN];
+    uint32_t fg_gc = 0, steps = 0;
+    struct snapshot s;
+    int i;
+
+    if (my_spiffs_set_partition(&part) != SPIFFS_OK) {
+        fail("set partition");
+    }
+    fill(stat, sizeof(stat), 6000);
+    const char *names[] = { "/identities", "/contacts" };
+    for (i = 0; i < 2; i++) {
+        wish_file_t fd = my_fs_open(names[i]);
+        if (fd < 0) {
+            fail("open static");
+        }
+        write_all(fd, stat, sizeof(stat));
+        my_fs_close(fd);
+    }
+    run_idle(IDLE_MAX_STEPS);
+
+    snapshot(&s);
+    for (i = 0; i < TOGGLES; i++) {
+        /* As the Sonoff app saves the relay state */
+        uint8_t relay = i & 1;
+        uint64_t t = flash_emu_stats.time_us;
+        uint32_t gc_runs = my_spiffs_get_gc_runs();
+        wish_file_t fd = my_fs_open("/relay");
+        if (fd < 0) {
+            fail("open /relay");
+        }
+        my_fs_lseek(fd, 0, SPIFFS_SEEK_SET);
+        write_all(fd, &relay, 1);
+        my_fs_close(fd);
+        latency[i] = flash_emu_stats.time_us - t;
+        if (my_spiffs_get_gc_runs() != gc_runs) {
+            fg_gc++;
+        }
+
+        if (i % TOGGLE_REWRITE_EVERY == 0) {
+            fill(file, sizeof(file), 7000 + i);
+            fd = my_fs_open("/db.tmp");
+            if (fd < 0) {
+                fail("open /db.tmp");
+            }
+            write_all(fd, file, sizeof(file));
+            my_fs_close(fd);
+            my_fs_remove("/db");
+            if (my_fs_rename("/db.tmp", "/db") != SPIFFS_OK) {
+                fail("rename");
+            }
+        }
+        if (idle) {
+            steps += run_idle(IDLE_MAX_STEPS);
+        }
+    }
+
+    qsort(latency, TOGGLES, sizeof(latency[0]), cmp_u32);
+    printf("%-8s %7u %8.2f %8.2f %8.2f %7u %8u %7u\n", idle ? "bg gc" : "no idle",
+        TOGGLES, latency[TOGGLES / 2] / 1000.0, latency[TOGGLES * 99 / 100] / 1000.0,
+        latency[TOGGLES - 1] / 1000.0, fg_gc, steps,
+        flash_emu_stats.erases - s.flash.erases);
+
+    check_file("/db", file, sizeof(file));
+    check_file("/identities", stat, sizeof(stat));
+}
+
+/* Toggle the relay setting through a one byte file, or through the
+ * settings log */
+static void settings_benchmark(bool log) {
+    static const struct my_spiffs_partition part = {
+        .addr = 0xf2000, .size = 32*1024, .block_size = 4096, .page_size = 256
+    };
+    static uint8_t stat[STATIC_FILE_LEN / 4];
+    struct snapshot s;
+    uint8_t relay = 0;
+    int i;
+
+    if (my_spiffs_set_partition(&part) != SPIFFS_OK) {
+        fail("set partition");
+    }
+    fill(stat, sizeof(stat), 8000);
+    wish_file_t fd = my_fs_open("/identities");
+    if (fd < 0) {
+        fail("open static");
+    }
+    write_all(fd, stat, sizeof(stat));
+    my_fs_close(fd);
+    user_settings_init();
+
+    snapshot(&s);
+    uint64_t t = flash_emu_stats.time_us;
+    for (i = 0; i < TOGGLES; i++) {
+        relay = i & 1;
+        if (log) {
+            if (user_settings_set(USER_SETTINGS_RELAY, &relay, 1) != 0) {
+                fail("settings set");
+            }
+            continue;
+        }
+        fd = my_fs_open("/relay");
+        if (fd < 0) {
+            fail("open /relay");
+        }
+        my_fs_lseek(fd, 0, SPIFFS_SEEK_SET);
+        write_all(fd, &relay, 1);
+        my_fs_close(fd);
+    }
+    printf("%-8s %7u %8.2f %8.2f %8u %8.3f %8u\n", log ? "log" : "file", TOGGLES,
+        (double) (flash_emu_stats.programs - s.flash.programs) / TOGGLES,
+        (double) (flash_emu_stats.program_bytes - s.flash.program_bytes) / TOGGLES,
+        flash_emu_stats.erases - s.flash.erases,
+        (flash_emu_stats.time_us - t) / 1000.0 / TOGGLES,
+        my_spiffs_get_gc_runs());
+
+    if (log) {
+        /* As after a reboot */
+        uint8_t value = 0xaa;
+        user_settings_init();
+        if (user_settings_get(USER_SETTINGS_RELAY, &value, 1) != 1 || value != relay) {
+            fail("settings reload");
+        }
+        if (user_settings_get(USER_SETTINGS_TOGGLE_RELAY, &value, 1) != -1) {
+            fail("settings unset key");
+        }
+        /* A record of which only the header made it to flash before a
+         * reset, at the end of the log */
+        value = !relay;
+        if (user_settings_set(USER_SETTINGS_TOGGLE_RELAY, &value, 1) != 0) {
+            fail("settings set");
+        }
+        fd = my_fs_open("settings.log");
+        if (fd < 0) {
+            fail("open settings.log");
+        }
+        static uint8_t buf[1024];
+        my_fs_lseek(fd, 0, SPIFFS_SEEK_SET);
+        int32_t len = my_fs_read(fd, buf, sizeof(buf));
+        int32_t end = 0;
+        while (end + 1 < len && buf[end] != 0xff) {
+            end += 4 + buf[end + 1];
+        }
+        if (end + 2 > len) {
+            fail("settings log end");
+        }
+        uint8_t torn[2] = { USER_SETTINGS_RELAY, 1 };
+        if (my_fs_program(fd, end, torn, sizeof(torn)) != sizeof(torn)) {
+            fail("program torn record");
+        }
+        if (my_fs_program(fd, end, torn, sizeof(torn)) != SPIFFS_ERR_NOT_WRITABLE) {
+            fail("programmed over data");
+        }
+        my_fs_close(fd);
+        user_settings_init();
+        if (user_settings_get(USER_SETTINGS_RELAY, &value, 1) != 1 || value != relay) {
+            fail("settings reload after torn record");
+        }
+        if (user_settings_get(USER_SETTINGS_TOGGLE_RELAY, &value, 1) != 1 || value != !relay) {
+            fail("settings reload after torn record");
+        }
+        value = relay;
+        if (user_settings_set(USER_SETTINGS_TOGGLE_RELAY, &value, 1) != 0) {
+            fail("settings set after torn record");
+        }
+        user_settings_init();
+        if (user_settings_get(USER_SETTINGS_TOGGLE_RELAY, &value, 1) != 1 || value != relay) {
+            fail("settings reload after torn record");
+        }
+    }
+    check_file("/identities", stat, sizeof(stat));
+}
+
+/* The file system below wish_fs, counting the calls made to it */
+static uint32_t fs_calls;
+
+static wish_file_t counted_open(const char *pathname) {
+    fs_calls++;
+    return my_fs_open(pathname);
+}
+
+static int32_t counted_read(wish_file_t fd, void *buf, size_t count) {
+    fs_calls++;
+    return my_fs_read(fd, buf, count);
+}
+
+static int32_t counted_write(wish_file_t fd, const void *buf, size_t count) {
+    fs_calls++;
+    return my_fs_write(fd, buf, count);
+}
+
+static wish_offset_t counted_lseek(wish_file_t fd, wish_offset_t offset, int whence) {
+    fs_calls++;
+    return my_fs_lseek(fd, offset, whence);
+}
+
+static int32_t counted_close(wish_file_t fd) {
+    fs_calls++;
+    return my_fs_close(fd);
+}
+
+static int32_t counted_rename(const char *oldpath, const char *newpath) {
+    fs_calls++;
+    return my_fs_rename(oldpath, newpath);
+}
+
+static int32_t counted_remove(const char *path) {
+    fs_calls++;
+    return my_fs_remove(path);
+}
+
+struct fs_ops {
+    wish_file_t (*open)(const char *pathname);
+    int32_t (*read)(wish_file_t fd, void *buf, size_t count);
+    int32_t (*write)(wish_file_t fd, const void *buf, size_t count);
+    wish_offset_t (*lseek)(wish_file_t fd, wish_offset_t offset, int whence);
+    int32_t (*close)(wish_file_t fd);
+};
+
+static const struct fs_ops buffered_ops = {
+    wish_fs_open, wish_fs_read, wish_fs_write, wish_fs_lseek, wish_fs_close
+};
+
+static const struct fs_ops direct_ops = {
+    counted_open, counted_read, counted_write, counted_lseek, counted_close
+};
+
+/* Lengths of the pieces an identity is written in, like the elements of
+ * its BSON document: alias, uid, keys, transports, permissions */
+static const uint16_t identity_pieces[] = { 4, 12, 28, 36, 8, 40, 72, 40, 104, 24, 12 };
+
+static void identity_save(const struct fs_ops *ops, uint8_t identities[][IDENTITY_LEN]) {
+    wish_file_t fd = ops->open("wish_id_db.bson.tmp");
+    if (fd < 0) {
+        fail("open wish_id_db.bson.tmp");
+    }
+    int i;
+    unsigned int j;
+    for (i = 0; i < IDENTITIES; i++) {
+        size_t done = 0;
+        for (j = 0; j < sizeof(identity_pieces) / sizeof(identity_pieces[0]); j++) {
+            if (ops->write(fd, identities[i] + done, identity_pieces[j]) != identity_pieces[j]) {
+                fail("identity write");
+            }
+            done += identity_pieces[j];
+        }
+    }
+    ops->close(fd);
+    counted_remove("wish_id_db.bson");
+    if (counted_rename("wish_id_db.bson.tmp", "wish_id_db.bson") != SPIFFS_OK) {
+        fail("rename");
+    }
+}
+
+/* Read the length of each document, and then the document */
+static void identity_load(const struct fs_ops *ops, uint8_t identities[][IDENTITY_LEN]) {
+    uint8_t doc[IDENTITY_LEN];
+    wish_file_t fd = ops->open("wish_id_db.bson");
+    if (fd < 0) {
+        fail("open wish_id_db.bson");
+    }
+    int i;
+    for (i = 0; i < IDENTITIES; i++) {
+        if (ops->read(fd, doc, 4) != 4) {
+            fail("identity read");
+        }
+        if (ops->read(fd, doc + 4, IDENTITY_LEN - 4) != IDENTITY_LEN - 4) {
+            fail("identity read");
+        }
+        if (memcmp(doc, identities[i], IDENTITY_LEN) != 0) {
+            fail("identity verify");
+        }
+    }
+    /* The end of the database */
+    if (ops->read(fd, doc, 4) != 0) {
+        fail("identity read past end");
+    }
+    ops->close(fd);
+}
+
+static void wish_fs_benchmark(bool buffered) {
+    static uint8_t identities[IDENTITIES][IDENTITY_LEN];
+    const struct fs_ops *ops = buffered ? &buffered_ops : &direct_ops;
+    struct snapshot s;
+    uint64_t t;
+    uint32_t calls;
+    int i, j;
+
+    snapshot(&s);
+    t = flash_emu_stats.time_us;
+    calls = fs_calls;
+    for (i = 0; i < IDENTITY_ROUNDS; i++) {
+        for (j = 0; j < IDENTITIES; j++) {
+            fill(identities[j], IDENTITY_LEN, 9000 + i * IDENTITIES + j);
+        }
+        identity_save(ops, identities);
+    }
+    printf("%-8s %6u %8.1f %8.1f %8.1f %8.1f %8.3f\n", buffered ? "save buf" : "save",
+        IDENTITY_ROUNDS, (double) (fs_calls - calls) / IDENTITY_ROUNDS,
+        (double) (flash_emu_stats.programs - s.flash.programs) / IDENTITY_ROUNDS,
+        (double) (flash_emu_stats.reads - s.flash.reads) / IDENTITY_ROUNDS,
+        (double) (flash_emu_stats.map_loads - s.flash.map_loads) / IDENTITY_ROUNDS,
+        (flash_emu_stats.time_us - t) / 1000.0 / IDENTITY_ROUNDS);
+
+    snapshot(&s);
+    t = flash_emu_stats.time_us;
+    calls = fs_calls;
+    for (i = 0; i < IDENTITY_ROUNDS; i++) {
+        identity_load(ops, identities);
+    }
+    printf("%-8s %6u %8.1f %8.1f %8.1f %8.1f %8.3f\n", buffered ? "load buf" : "load",
+        IDENTITY_ROUNDS, (double) (fs_calls - calls) / IDENTITY_ROUNDS,
+        (double) (flash_emu_stats.programs - s.flash.programs) / IDENTITY_ROUNDS,
+        (double) (flash_emu_stats.reads - s.flash.reads) / IDENTITY_ROUNDS,
+        (double) (flash_emu_stats.map_loads - s.flash.map_loads) / IDENTITY_ROUNDS,
+        (flash_emu_stats.time_us - t) / 1000.0 / IDENTITY_ROUNDS);
+}
+
+/* Write a partition descriptor, in the layout of spiffs_integration.c,
+ * with a right check but a page size SPIFFS cannot use */
+static void bad_descriptor(void) {
+    uint32_t desc[6] = { 0x74705053, 0x100000, 1024*1024, 4096, 100 };
+    desc[5] = ~(desc[0] ^ desc[1] ^ desc[2] ^ desc[3] ^ desc[4]);
+    spi_flash_erase_sector(SPIFFS_PART_DESC_ADDR / SPI_FLASH_SEC_SIZE);
+    spi_flash_write(SPIFFS_PART_DESC_ADDR, desc, sizeof(desc));
+}
+
+int main(int argc, char **argv) {
+    const char *image = NULL;
+    int i;
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-v") == 0) {
+            verbose = true;
+        }
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            image = argv[++i];
+        }
+        else {
+            fprintf(stderr, "Usage: %s [-v] [-o image]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    flash_emu_reset();
+    flash_emu_ignore(SPIFFS_PART_PAGE_SIZE, offsetof(spiffs_page_header, flags));
+    bad_descriptor();
+    my_spiffs_mount();
+    struct my_spiffs_partition p;
+    my_spiffs_get_partition(&p);
+    if (p.addr != SPIFFS_PART_ADDR || p.size != SPIFFS_PART_SIZE ||
+            p.block_size != SPIFFS_PART_BLOCK_SIZE || p.page_size != SPIFFS_PART_PAGE_SIZE) {
+        fail("bad partition descriptor used");
+    }
+
+    printf("write coalescing %s, read cache %s, flash map %s\n",
+        SPIFFS_HAL_WRITE_COALESCE ? "on" : "off", SPIFFS_HAL_READ_CACHE ? "on" : "off",
+        SPIFFS_HAL_FLASH_MAP ? "on" : "off");
+    printf("%-8s %6s %8s %8s %9s %8s %7s %8s\n", "workload", "writes",
+        "hal wr", "programs", "prog B", "reads", "erases", "prog/wr");
+
+    struct snapshot s;
+
+    /* Append small records, as the Wish core does to its logs */
+    static uint8_t log[APPEND_RECORDS * APPEND_RECORD_LEN];
+    fill(log, sizeof(log), 1);
+    snapshot(&s);
+    wish_file_t fd = my_fs_open("/log");
+    if (fd < 0) {
+        fail("open /log");
+    }
+    for (i = 0; i < APPEND_RECORDS; i++) {
+        write_all(fd, log + i * APPEND_RECORD_LEN, APPEND_RECORD_LEN);
+    }
+    my_fs_close(fd);
+    report("append", &s);
+
+    /* Rewrite a small file through a temporary, as wish_fs does for
+     * the identity and contact databases */
+    uint8_t file[REWRITE_FILE_LEN];
+    snapshot(&s);
+    for (i = 0; i < REWRITE_ROUNDS; i++) {
+        fill(file, sizeof(file), 100 + i);
+        fd = my_fs_open("/db.tmp");
+        if (fd < 0) {
+            fail("open /db.tmp");
+        }
+        /* In records, the way the databases are serialised */
+        size_t done;
+        for (done = 0; done < sizeof(file); done += 100) {
+            write_all(fd, file + done, 100);
+        }
+        my_fs_close(fd);
+        my_fs_remove("/db");
+        if (my_fs_rename("/db.tmp", "/db") != SPIFFS_OK) {
+            fail("rename");
+        }
+    }
+    report("rewrite", &s);
+
+    snapshot(&s);
+    check_file("/log", log, sizeof(log));
+    check_file("/db", file, sizeof(file));
+    report("verify", &s);
+
+    printf("gc runs %u, hal reads %u\n", my_spiffs_get_gc_runs(), hal_reads);
+
+    read_benchmark();
+    partition_benchmark();
+    export_benchmark();
+    mount_benchmark();
+    check_benchmark();
+    list_benchmark();
+
+    printf("%-8s %7s %8s %8s %8s %7s %8s %7s\n", "toggle", "writes",
+        "p50 ms", "p99 ms", "max ms", "fg gc", "bg steps", "erases");
+    gc_benchmark(false);
+    gc_benchmark(true);
+
+    /* The settings log is replaced through wish_fs */
+    wish_fs_set_open(counted_open);
+    wish_fs_set_read(counted_read);
+    wish_fs_set_write(counted_write);
+    wish_fs_set_lseek(counted_lseek);
+    wish_fs_set_close(counted_close);
+    wish_fs_set_rename(counted_rename);
+    wish_fs_set_remove(counted_remove);
+    printf("%-8s %7s %8s %8s %8s %8s %8s\n", "settings", "writes",
+        "prog/wr", "B/wr", "erases", "ms/wr", "gc runs");
+    settings_benchmark(false);
+    settings_benchmark(true);
+
+    printf("%-8s %6s %8s %8s %8s %8s %8s\n", "wish_fs", "rounds",
+        "fs calls", "programs", "reads", "loads", "ms");
+    wish_fs_benchmark(false);
+    wish_fs_benchmark(true);
+
+    if (flash_emu_stats.bad_programs != 0) {
+        fail("bits programmed from 0 to 1");
+    }
+
+    if (image != NULL) {
+        FILE *f = fopen(image, "wb");
+        if (f == NULL || fwrite(flash_emu_data(), FLASH_EMU_SIZE, 1, f) != 1) {
+            fail("write image");
+        }
+        fclose(f);
+    }
+    printf("PASS\n");
+    return 0;
+}
@@ -0,0 +1,8 @@
+/* Host stand-in for bson.h, only the type is needed by user_metrics.h */
+
+#ifndef BSON_H
+#define BSON_H
+
+typedef struct bson bson;
+
+#endif //BSON_H
@@ -0,0 +1,14 @@
+/* Host stand-in for osapi.h of the SDK */
+
+#ifndef OSAPI_H
+#define OSAPI_H
+
+#include <string.h>
+
+#define os_memcpy memcpy
+#define os_memset memset
+#define os_strlen strlen
+
+int os_printf_plus(const char *format, ...);
+
+#endif //OSAPI_H
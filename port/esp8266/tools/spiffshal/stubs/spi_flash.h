@@ -0,0 +1,22 @@
+/* Host stand-in for spi_flash.h of the SDK, see flash_emu.c */
+
+#ifndef SPI_FLASH_H
+#define SPI_FLASH_H
+
+typedef enum {
+    SPI_FLASH_RESULT_OK,
+    SPI_FLASH_RESULT_ERR,
+    SPI_FLASH_RESULT_TIMEOUT
+} SpiFlashOpResult;
+
+#define SPI_FLASH_SEC_SIZE 4096
+
+SpiFlashOpResult spi_flash_erase_sector(uint16 sec);
+SpiFlashOpResult spi_flash_write(uint32 des_addr, uint32 *src_addr, uint32 size);
+SpiFlashOpResult spi_flash_read(uint32 src_addr, uint32 *des_addr, uint32 size);
+
+/* The memory mapped flash window at 0x40200000, see my_spi_read() */
+uint32 flash_emu_map_read(uint32 addr);
+#define FLASH_MAP_READ(addr) flash_emu_map_read(addr)
+
+#endif //SPI_FLASH_H
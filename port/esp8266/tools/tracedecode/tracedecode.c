@@ -0,0 +1,166 @@
+/*
+ * Decoder for the trace ring of the ESP8266 port, see user_trace.h.
+ *
+ * Reads either a console log containing the "TRC ..." lines produced by
+ * user_trace_drain(), or with -b, the binary blob returned by the "trace"
+ * Mist endpoint. Prints the events as a timeline, with the time relative
+ * to the first event and to the previous event.
+ *
+ * Usage: tracedecode [-b] [file]
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "user_trace.h"
+
+static const char *event_names[USER_TRACE_EVENT_MAX] = {
+#define EVENT_NAME(id, fmt) #id,
+    USER_TRACE_EVENTS(EVENT_NAME)
+#undef EVENT_NAME
+};
+
+static const char *event_formats[USER_TRACE_EVENT_MAX] = {
+#define EVENT_FORMAT(id, fmt) fmt,
+    USER_TRACE_EVENTS(EVENT_FORMAT)
+#undef EVENT_FORMAT
+};
+
+static bool have_first;
+static uint32_t first_timestamp;
+static uint32_t prev_timestamp;
+/* Timestamps wrap around every 71 minutes, keep track of the wraps so
+ * that the timeline keeps growing */
+static uint64_t wrap_offset;
+
+/* Print the arguments according to the format string of the event */
+static void print_args(const char *fmt, uint32_t arg0, uint32_t arg1) {
+    uint32_t args[2] = { arg0, arg1 };
+    int argi = 0;
+    const char *p = fmt;
+    while (*p) {
+        if (*p != '%' || p[1] == '\0') {
+            putchar(*p++);
+            continue;
+        }
+        p++;
+        uint32_t arg = argi < 2 ? args[argi] : 0;
+        switch (*p) {
+        case 'u':
+            printf("%u", arg);
+            argi++;
+            break;
+        case 'd':
+            printf("%d", (int32_t) arg);
+            argi++;
+            break;
+        case 'x':
+            printf("%x", arg);
+            argi++;
+            break;
+        case 'I':
+            printf("%u.%u.%u.%u", arg & 0xff, (arg >> 8) & 0xff,
+                (arg >> 16) & 0xff, arg >> 24);
+            argi++;
+            break;
+        default:
+            putchar(*p);
+            break;
+        }
+        p++;
+    }
+}
+
+static void print_event(uint32_t timestamp, uint32_t event, uint32_t arg0, uint32_t arg1) {
+    if (!have_first) {
+        first_timestamp = timestamp;
+        prev_timestamp = timestamp;
+        have_first = true;
+    }
+    if (timestamp < prev_timestamp) {
+        wrap_offset += (uint64_t) 1 << 32;
+    }
+    uint64_t since_first = wrap_offset + timestamp - first_timestamp;
+    uint32_t since_prev = timestamp - prev_timestamp;
+    prev_timestamp = timestamp;
+
+    printf("%10.3f ms (+%8.3f)  ", since_first / 1000.0, since_prev / 1000.0);
+    if (event < USER_TRACE_EVENT_MAX) {
+        printf("%-22s ", event_names[event]);
+        print_args(event_formats[event], arg0, arg1);
+        putchar('\n');
+    }
+    else {
+        printf("unknown event %u: %x %x\n", event, arg0, arg1);
+    }
+}
+
+/* Decode the binary blob from the Mist endpoint. The records are in the
+ * little-endian byte order of the ESP8266. */
+static int decode_binary(FILE *in) {
+    uint8_t rec[sizeof(struct user_trace_entry)];
+    while (fread(rec, sizeof(rec), 1, in) == 1) {
+        uint32_t w[4];
+        int i = 0;
+        for (i = 0; i < 4; i++) {
+            w[i] = rec[4*i] | rec[4*i + 1] << 8 | rec[4*i + 2] << 16 | (uint32_t) rec[4*i + 3] << 24;
+        }
+        print_event(w[0], w[1], w[2], w[3]);
+    }
+    return 0;
+}
+
+/* Decode the TRC lines from a console log, ignoring everything else */
+static int decode_log(FILE *in) {
+    char line[256];
+    while (fgets(line, sizeof(line), in) != NULL) {
+        char *p = strstr(line, "TRC ");
+        if (p == NULL) {
+            continue;
+        }
+        unsigned int timestamp, event, arg0, arg1, lost;
+        if (sscanf(p, "TRC lost %u", &lost) == 1) {
+            printf("*** %u events lost\n", lost);
+        }
+        else if (sscanf(p, "TRC %x %x %x %x", &timestamp, &event, &arg0, &arg1) == 4) {
+            print_event(timestamp, event, arg0, arg1);
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    bool binary = false;
+    const char *path = NULL;
+    int i = 0;
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-b") == 0) {
+            binary = true;
+        }
+        else if (path == NULL && argv[i][0] != '-') {
+            path = argv[i];
+        }
+        else {
+            fprintf(stderr, "Usage: %s [-b] [file]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    FILE *in = stdin;
+    if (path != NULL) {
+        in = fopen(path, binary ? "rb" : "r");
+        if (in == NULL) {
+            perror(path);
+            return 1;
+        }
+    }
+
+    int ret = binary ? decode_binary(in) : decode_log(in);
+    if (in != stdin) {
+        fclose(in);
+    }
+    return ret;
+}
@@ -0,0 +1,473 @@
+/*
+ * Host test and benchmark for the Wish UART transport.
+ *
+ * Two endpoints, each with a SLIP decoder and a link (user_slip.c and
+ * user_uart_link.c, the same code as in the firmware), talk to each
+ * other over a pty pair. Each endpoint emulates the tx ring of the uart
+ * driver and the receive buffer of the Wish core, so the credit based
+ * flow control is exercised just like on the device.
+ *
+ * Without options, runs the tests:
+ *   - open the link, and transfer 1 MiB in both directions at once,
+ *     checking every byte, and that the emulated Wish receive buffer
+ *     never overflows
+ *   - corrupt one bit on the line, check that both ends close the link,
+ *     and that it can be opened again
+ *
+ * With -B, runs the benchmark: throughput of a one-way transfer, and the
+ * round trip latency of 64 byte messages. A pty has no baud rate, so
+ * with -b <baud> the writes are paced to what a UART at that rate would
+ * carry (10 bits per byte).
+ *
+ * Usage: uartlink [-B] [-b baud]
+ */
+
+#define _XOPEN_SOURCE 600
+#define _DEFAULT_SOURCE
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "user_slip.h"
+#include "user_uart_link.h"
+
+/* The same as UART_TX_RING_SIZE and WISH_PORT_RX_RB_SZ in the firmware */
+#define TX_RING_LEN 1024
+#define APP_RX_BUF_LEN 1500
+/* The largest message the Wish core sends at once */
+#define APP_MAX_MSG 1400
+
+struct endpoint {
+    const char *name;
+    int fd;
+
+    uint8_t dec_buf[USER_UART_LINK_MAX_FRAME];
+    struct user_slip_decoder dec;
+    struct user_uart_link link;
+
+    /* Emulated uart tx ring */
+    uint8_t out[TX_RING_LEN];
+    size_t out_len;
+    uint64_t out_total;
+    /* Flip a bit of the byte at this offset of the output, or -1 */
+    int64_t corrupt_at;
+
+    /* Emulated application: a byte stream generated and checked with
+     * xorshift32 */
+    uint32_t tx_state;
+    uint32_t rx_state;
+    uint64_t to_send;
+    uint64_t sent;
+    uint64_t received;
+    size_t app_rx_used;
+    bool echo;
+    bool bad_data;
+
+    bool open;
+    int closed_count;
+};
+
+static uint32_t baud_rate;
+static struct timespec pace_start;
+static bool failed;
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint32_t xorshift32(uint32_t *state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+static void check(bool cond, const char *what) {
+    if (!cond) {
+        printf("FAIL: %s\n", what);
+        failed = true;
+    }
+}
+
+static bool ep_send_frame(void *ctx, const uint8_t *frame, size_t len) {
+    struct endpoint *ep = ctx;
+    if (TX_RING_LEN - ep->out_len < USER_SLIP_MAX_ENCODED_LEN(len)) {
+        return false;
+    }
+    ep->out[ep->out_len++] = USER_SLIP_END;
+    size_t used = 0;
+    ep->out_len += user_slip_encode(frame, len, &used, ep->out + ep->out_len, TX_RING_LEN - ep->out_len);
+    ep->out[ep->out_len++] = USER_SLIP_END;
+    return true;
+}
+
+static void ep_recv_data(void *ctx, const uint8_t *data, size_t len) {
+    struct endpoint *ep = ctx;
+    ep->app_rx_used += len;
+    if (ep->app_rx_used > APP_RX_BUF_LEN) {
+        printf("%s: receive buffer overflow, %zu bytes\n", ep->name, ep->app_rx_used);
+        failed = true;
+    }
+    if (ep->echo) {
+        if (user_uart_link_send(&ep->link, data, len) != 0) {
+            printf("%s: echo failed\n", ep->name);
+            failed = true;
+        }
+    }
+    else {
+        size_t i = 0;
+        for (i = 0; i < len; i++) {
+            if (data[i] != (uint8_t) xorshift32(&ep->rx_state)) {
+                ep->bad_data = true;
+            }
+        }
+    }
+    ep->received += len;
+}
+
+static void ep_state_changed(void *ctx, enum user_uart_link_state state, bool by_peer) {
+    struct endpoint *ep = ctx;
+    if (state == USER_UART_LINK_OPEN) {
+        ep->open = true;
+    }
+    else if (state == USER_UART_LINK_CLOSED) {
+        ep->open = false;
+        ep->closed_count++;
+    }
+}
+
+static const struct user_uart_link_ops ep_ops = {
+    .send_frame = ep_send_frame,
+    .recv_data = ep_recv_data,
+    .state_changed = ep_state_changed,
+};
+
+static void link_frame_cb(uint8_t *frame, size_t len, void *ctx) {
+    struct endpoint *ep = ctx;
+    user_uart_link_input(&ep->link, frame, len);
+}
+
+static void ep_init(struct endpoint *ep, const char *name, int fd) {
+    memset(ep, 0, sizeof(struct endpoint));
+    ep->name = name;
+    ep->fd = fd;
+    ep->corrupt_at = -1;
+    user_slip_decoder_init(&ep->dec, ep->dec_buf, sizeof(ep->dec_buf));
+    user_uart_link_init(&ep->link, &ep_ops, ep, APP_RX_BUF_LEN);
+}
+
+/* Start a new stream in each direction */
+static void ep_reset_stream(struct endpoint *ep, uint64_t to_send) {
+    ep->tx_state = 0x12345678;
+    ep->rx_state = 0x12345678;
+    ep->to_send = to_send;
+    ep->sent = 0;
+    ep->received = 0;
+    ep->app_rx_used = 0;
+    ep->bad_data = false;
+}
+
+/* Write the emulated tx ring to the pty, paced to the baud rate */
+static void ep_flush(struct endpoint *ep) {
+    if (ep->out_len == 0) {
+        return;
+    }
+    size_t n = ep->out_len;
+    if (baud_rate > 0) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        double elapsed = (ts.tv_sec - pace_start.tv_sec) + (ts.tv_nsec - pace_start.tv_nsec) / 1e9;
+        double allowed = elapsed * baud_rate / 10 - ep->out_total;
+        if (allowed < n) {
+            n = allowed > 0 ? (size_t) allowed : 0;
+        }
+    }
+    if (ep->corrupt_at >= 0 && (uint64_t) ep->corrupt_at < ep->out_total + n) {
+        ep->out[ep->corrupt_at - ep->out_total] ^= 0x01;
+        ep->corrupt_at = -1;
+    }
+    ssize_t w = n > 0 ? write(ep->fd, ep->out, n) : 0;
+    if (w > 0) {
+        memmove(ep->out, ep->out + w, ep->out_len - w);
+        ep->out_len -= w;
+        ep->out_total += w;
+    }
+}
+
+static void ep_read(struct endpoint *ep) {
+    uint8_t buf[4096];
+    ssize_t n = read(ep->fd, buf, sizeof(buf));
+    if (n > 0) {
+        user_slip_decode(&ep->dec, buf, n, link_frame_cb, ep);
+    }
+}
+
+/* Emulate the application: consume some received data, and queue more
+ * data to send */
+static void ep_app(struct endpoint *ep) {
+    if (ep->app_rx_used > 0) {
+        size_t n = 1 + rand() % 700;
+        ep->app_rx_used -= n < ep->app_rx_used ? n : ep->app_rx_used;
+    }
+    user_uart_link_set_rx_free(&ep->link, APP_RX_BUF_LEN - ep->app_rx_used);
+
+    while (ep->open && !ep->echo && ep->sent < ep->to_send) {
+        uint8_t msg[APP_MAX_MSG];
+        size_t len = 1 + rand() % APP_MAX_MSG;
+        if (len > ep->to_send - ep->sent) {
+            len = ep->to_send - ep->sent;
+        }
+        uint32_t state = ep->tx_state;
+        size_t i = 0;
+        for (i = 0; i < len; i++) {
+            msg[i] = xorshift32(&state);
+        }
+        if (user_uart_link_send(&ep->link, msg, len) != 0) {
+            break;
+        }
+        ep->tx_state = state;
+        ep->sent += len;
+    }
+}
+
+static void run_once(struct endpoint *a, struct endpoint *b) {
+    struct pollfd fds[2] = {
+        { .fd = a->fd, .events = POLLIN },
+        { .fd = b->fd, .events = POLLIN },
+    };
+    poll(fds, 2, 1);
+    ep_read(a);
+    ep_read(b);
+    ep_app(a);
+    ep_app(b);
+    user_uart_link_poll(&a->link);
+    user_uart_link_poll(&b->link);
+    ep_flush(a);
+    ep_flush(b);
+}
+
+typedef bool done_fn(struct endpoint *a, struct endpoint *b);
+
+static bool run_until(struct endpoint *a, struct endpoint *b, done_fn *done, int timeout_ms) {
+    uint64_t deadline = now_us() + (uint64_t) timeout_ms * 1000;
+    while (!done(a, b)) {
+        if (now_us() > deadline) {
+            return false;
+        }
+        run_once(a, b);
+    }
+    return true;
+}
+
+static bool both_open(struct endpoint *a, struct endpoint *b) {
+    return a->open && b->open;
+}
+
+static bool both_closed(struct endpoint *a, struct endpoint *b) {
+    return !a->open && !b->open;
+}
+
+static bool all_received(struct endpoint *a, struct endpoint *b) {
+    return a->received == b->to_send && b->received == a->to_send;
+}
+
+static bool open_link(struct endpoint *a, struct endpoint *b) {
+    user_uart_link_open(&a->link);
+    return run_until(a, b, both_open, 2000);
+}
+
+static int open_pty_pair(int *master, int *slave) {
+    *master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (*master < 0 || grantpt(*master) != 0 || unlockpt(*master) != 0) {
+        perror("pty");
+        return -1;
+    }
+    *slave = open(ptsname(*master), O_RDWR | O_NOCTTY);
+    if (*slave < 0) {
+        perror("pty slave");
+        return -1;
+    }
+
+    int fds[2] = { *master, *slave };
+    int i = 0;
+    for (i = 0; i < 2; i++) {
+        struct termios t;
+        tcgetattr(fds[i], &t);
+        cfmakeraw(&t);
+        tcsetattr(fds[i], TCSANOW, &t);
+        fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+    }
+    return 0;
+}
+
+static void test_transfer(struct endpoint *a, struct endpoint *b) {
+    const uint64_t len = 1024 * 1024;
+    ep_reset_stream(a, len);
+    ep_reset_stream(b, len);
+    check(open_link(a, b), "link opens");
+
+    uint64_t t0 = now_us();
+    check(run_until(a, b, all_received, 60000), "all data received");
+    uint64_t t = now_us() - t0;
+    check(!a->bad_data && !b->bad_data, "data intact");
+    check(a->link.crc_errors == 0 && b->link.crc_errors == 0, "no crc errors");
+    printf("transfer: %llu bytes each way in %.3f s\n", (unsigned long long) len, t / 1e6);
+}
+
+static void test_corruption(struct endpoint *a, struct endpoint *b) {
+    ep_reset_stream(a, 256 * 1024);
+    ep_reset_stream(b, 0);
+    int a_closed = a->closed_count;
+    int b_closed = b->closed_count;
+    a->corrupt_at = a->out_total + 5000;
+
+    check(run_until(a, b, both_closed, 10000), "both ends close after corruption");
+    check(b->link.crc_errors + b->link.seq_errors > 0, "corruption detected");
+    check(a->closed_count == a_closed + 1 && b->closed_count == b_closed + 1, "close reported once");
+    check(!b->bad_data, "no corrupted data delivered");
+
+    /* The link can be opened again, and works */
+    ep_reset_stream(a, 64 * 1024);
+    ep_reset_stream(b, 64 * 1024);
+    check(open_link(a, b), "link opens again");
+    check(run_until(a, b, all_received, 10000), "data received after reopen");
+    check(!a->bad_data && !b->bad_data, "data intact after reopen");
+    printf("corruption: detected (crc errors %u, seq errors %u), link reopened\n",
+        b->link.crc_errors, b->link.seq_errors);
+}
+
+static bool one_way_done(struct endpoint *a, struct endpoint *b) {
+    return b->received == a->to_send;
+}
+
+static void bench_throughput(struct endpoint *a, struct endpoint *b) {
+    const uint64_t len = baud_rate > 0 ? 512 * 1024 : 8 * 1024 * 1024;
+    ep_reset_stream(a, len);
+    ep_reset_stream(b, 0);
+    uint64_t line0 = a->out_total;
+    uint64_t t0 = now_us();
+    check(run_until(a, b, one_way_done, 120000), "benchmark transfer completes");
+    uint64_t t = now_us() - t0;
+    double secs = t / 1e6;
+    double line = a->out_total - line0;
+    printf("throughput: %.1f kB/s payload, %.1f kB/s on the line, %.1f%% overhead\n",
+        len / secs / 1000, line / secs / 1000, (line - len) * 100.0 / len);
+    if (baud_rate > 0) {
+        printf("            %.1f%% of the %u baud line rate\n",
+            len / secs * 10 * 100 / baud_rate, baud_rate);
+    }
+}
+
+static int compare_u64(const void *x, const void *y) {
+    uint64_t a = *(const uint64_t *) x;
+    uint64_t b = *(const uint64_t *) y;
+    return a < b ? -1 : a > b;
+}
+
+static bool ping_returned(struct endpoint *a, struct endpoint *b) {
+    return a->received == a->sent;
+}
+
+static void bench_latency(struct endpoint *a, struct endpoint *b) {
+    const int rounds = 1000;
+    const size_t msg_len = 64;
+    static uint64_t rtt[1000];
+    uint8_t msg[64];
+    memset(msg, 0x55, sizeof(msg));
+
+    ep_reset_stream(a, 0);
+    ep_reset_stream(b, 0);
+    /* The echo data is not the checked stream */
+    a->echo = false;
+    b->echo = true;
+
+    int i = 0;
+    for (i = 0; i < rounds; i++) {
+        uint64_t t0 = now_us();
+        a->sent += msg_len;
+        check(user_uart_link_send(&a->link, msg, msg_len) == 0, "ping queued");
+        if (!run_until(a, b, ping_returned, 2000)) {
+            check(false, "ping returned");
+            break;
+        }
+        rtt[i] = now_us() - t0;
+    }
+    b->echo = false;
+    qsort(rtt, i, sizeof(uint64_t), compare_u64);
+    if (i > 0) {
+        uint64_t sum = 0;
+        int j = 0;
+        for (j = 0; j < i; j++) {
+            sum += rtt[j];
+        }
+        printf("latency: %zu byte round trip, avg %llu us, p50 %llu us, p99 %llu us\n",
+            msg_len, (unsigned long long) (sum / i), (unsigned long long) rtt[i / 2],
+            (unsigned long long) rtt[i * 99 / 100]);
+    }
+}
+
+int main(int argc, char **argv) {
+    bool bench = false;
+    int i = 0;
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-B") == 0) {
+            bench = true;
+        }
+        else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            baud_rate = strtoul(argv[++i], NULL, 10);
+        }
+        else {
+            fprintf(stderr, "Usage: %s [-B] [-b baud]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    int master = -1;
+    int slave = -1;
+    if (open_pty_pair(&master, &slave) != 0) {
+        return 1;
+    }
+    srand(1);
+    clock_gettime(CLOCK_MONOTONIC, &pace_start);
+
+    static struct endpoint a;
+    static struct endpoint b;
+    ep_init(&a, "A", master);
+    ep_init(&b, "B", slave);
+
+    if (bench) {
+        if (!open_link(&a, &b)) {
+            printf("FAIL: link opens\n");
+            return 1;
+        }
+        bench_throughput(&a, &b);
+        bench_latency(&a, &b);
+    }
+    else {
+        test_transfer(&a, &b);
+        test_corruption(&a, &b);
+    }
+
+    close(slave);
+    close(master);
+    if (failed) {
+        return 1;
+    }
+    if (!bench) {
+        printf("PASS\n");
+    }
+    return 0;
+}
@@ -15,6 +15,7 @@ typedef struct espconn* ConnTypePtr;
 
 #include "httpd.h"
 #include "captdns.h"
+#include "spiffs_integration.h"
 
 static int ICACHE_FLASH_ATTR cgiGenerateCaptivePortalLoginPage(HttpdConnData *connData);
 
@@ -25,6 +26,12 @@ HttpdBuiltInUrl builtInUrls[] = {
     {NULL, NULL, NULL}
 };
 
+/* The cgi routines of libesphttpd which restart the system call this
+ * first */
+void httpdBeforeRestart(void) {
+    my_spiffs_unmount();
+}
+
 void init_captive_portal(void) {
     captdnsInit();
     httpdInit(builtInUrls, 80);
@@ -0,0 +1,24 @@
+/*
+ * CRC-16/CCITT-FALSE, see user_crc.h
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "user_crc.h"
+
+/* Four bits at a time to keep the table small */
+static const uint16_t crc16_nibble_table[16] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+    0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef,
+};
+
+uint16_t user_crc16(const uint8_t *data, size_t len) {
+    uint16_t crc = 0xffff;
+    size_t i = 0;
+    for (i = 0; i < len; i++) {
+        crc = (crc << 4) ^ crc16_nibble_table[(crc >> 12) ^ (data[i] >> 4)];
+        crc = (crc << 4) ^ crc16_nibble_table[(crc >> 12) ^ (data[i] & 0x0f)];
+    }
+    return crc;
+}
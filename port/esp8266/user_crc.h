@@ -0,0 +1,14 @@
+#ifndef USER_CRC_H
+#define USER_CRC_H
+
+/* CRC-16/CCITT-FALSE, for checking frames and records: the UART link
+ * (user_uart_link.h), the settings log (user_settings.c) and the mount
+ * state checkpoint (spiffs_integration.c). It does not depend on the
+ * SDK, so it can be used in host tools and tests too. */
+
+#include <stdint.h>
+#include <stddef.h>
+
+uint16_t user_crc16(const uint8_t *data, size_t len);
+
+#endif
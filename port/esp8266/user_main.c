@@ -32,6 +32,12 @@
 #include "spiffs_integration.h"
 #include "user_hw_config.h"
 #include "user_support.h"
+#include "user_stack.h"
+#include "user_timer.h"
+#include "user_metrics.h"
+#include "user_trace.h"
+#include "user_uart_wish.h"
+#include "user_settings.h"
 #include "user_main.h"
 #include "port_printf.h"
 
@@ -81,19 +87,28 @@ static void  my_free(void* ptr) {
     os_free(ptr);
 }
 
-static os_timer_t systick_timer;
+static struct user_timer systick_timer;
 
 /* Call-back functoin to the meminfo timer to periodically print memory
  * statistics */
 static void ICACHE_FLASH_ATTR user_print_meminfo(void) {
     os_printf("\t*** Free heap size %d\n\r", system_get_free_heap_size());
     os_printf("\t*** Current amount of untouched stack: %d \n\r", user_find_stack_canary());
+    user_stack_print_stats();
+    user_metrics_sample();
+    user_metrics_print();
 }
 
 void ICACHE_FLASH_ATTR systick_timer_cb(void) {
     /* Report to Wish that one second has passed */
     wish_time_report_periodic(&core);
 
+#if WITH_TRACE_UART_DRAIN
+    /* Drain only part of the trace per second, as the output blocks
+     * on the UART */
+    user_trace_drain(16);
+#endif
+
     static wish_time_t timestamp;
     wish_time_t now = wish_time_get_relative(&core);
     if (now >= (timestamp + 60)) {
@@ -122,9 +137,9 @@ void user_init(void)
     user_print_meminfo();
     
     /* Setup system tick timer which supplies timebase to Wish */
-    os_timer_disarm(&systick_timer);
-    os_timer_setfn(&systick_timer, (os_timer_func_t *) systick_timer_cb, NULL);
-    os_timer_arm(&systick_timer, 1000, 1);
+    user_timer_disarm(&systick_timer);
+    user_timer_setfn(&systick_timer, (user_timer_func_t *) systick_timer_cb, NULL);
+    user_timer_arm(&systick_timer, 1000, true);
 
     mbedtls_platform_set_calloc_free(my_calloc, my_free);
 
@@ -142,6 +157,7 @@ void user_init(void)
     wish_fs_set_remove(my_fs_remove);
 
     my_spiffs_mount();
+    user_settings_init();
     //test_spiffs();
     wish_uid_list_elem_t uid_list[4];
     memset(uid_list, 0, sizeof (uid_list));
@@ -203,6 +219,9 @@ void user_init(void)
 #endif
 
     wish_message_processor_init(&core);
+#if WITH_UART_TRANSPORT
+    user_uart_wish_init();
+#endif
 
     //init_captive_portal();
 
@@ -227,13 +246,3 @@ uint32 user_rf_cal_sector_set(void) {
     return RF_CAL_SEC_ADDR >> 24;
 }
 
-#if 0
-/* Do-nothing ISR function for uart0 receive. 
- * This implementation is essential to have, becuase for some reason the 
- * Espressif-supplied uart driver does enable the interrupt, 
- * and defines this ISR routine to be called. */
-void uart0_rx_intr_handler(void *para) {
-
-}
-#endif
-
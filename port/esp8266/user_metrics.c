@@ -0,0 +1,128 @@
+/*
+ * Runtime metrics registry, see user_metrics.h
+ */
+
+#include <stdint.h>
+
+#include "osapi.h"
+#include "user_interface.h"
+#include "espmissingincludes.h"
+#include "driver/uart.h"
+
+#include "bson.h"
+
+#include "spiffs_integration.h"
+#include "user_stack.h"
+#include "user_metrics.h"
+
+static const char *metric_names[USER_METRIC_MAX] = {
+    [USER_METRIC_TCP_RX_BYTES] = "tcpRxBytes",
+    [USER_METRIC_TCP_TX_BYTES] = "tcpTxBytes",
+    [USER_METRIC_TCP_RX_FRAMES] = "tcpRxFrames",
+    [USER_METRIC_TCP_TX_FRAMES] = "tcpTxFrames",
+    [USER_METRIC_SPIFFS_READS] = "spiffsReads",
+    [USER_METRIC_SPIFFS_WRITES] = "spiffsWrites",
+    [USER_METRIC_SPIFFS_ERASES] = "spiffsErases",
+    [USER_METRIC_SPIFFS_GC_RUNS] = "spiffsGcRuns",
+    [USER_METRIC_WIFI_RECONNECTS] = "wifiReconnects",
+    [USER_METRIC_UART_TX_DROPPED] = "uartTxDropped",
+    [USER_METRIC_UART_RX_FRAMES] = "uartRxFrames",
+    [USER_METRIC_UART_RX_ERRORS] = "uartRxErrors",
+    [USER_METRIC_UART_RX_OVERFLOWS] = "uartRxOverflows",
+    [USER_METRIC_IPC_QUEUE_DEPTH] = "ipcQueueDepth",
+    [USER_METRIC_HEAP_FREE] = "heapFree",
+    [USER_METRIC_STACK_FREE] = "stackFree",
+    [USER_METRIC_WIFI_RSSI] = "wifiRssi",
+};
+
+static int32_t metric_values[USER_METRIC_MAX];
+
+struct histogram_desc {
+    const char *name;
+    /* Upper bounds (inclusive) of all buckets but the last one */
+    uint32_t bounds[USER_HISTOGRAM_BUCKETS - 1];
+};
+
+static const struct histogram_desc histogram_descs[USER_HISTOGRAM_MAX] = {
+    [USER_HISTOGRAM_TCP_RX_SIZE] = { "tcpRxSize", { 64, 128, 256, 512, 1024 } },
+    [USER_HISTOGRAM_IPC_QUEUE_DEPTH] = { "ipcQueueDepthHist", { 1, 2, 4, 8, 16 } },
+};
+
+static uint32_t histogram_counts[USER_HISTOGRAM_MAX][USER_HISTOGRAM_BUCKETS];
+
+void user_metric_add(enum user_metric metric, uint32_t n) {
+    metric_values[metric] += n;
+}
+
+void user_metric_set(enum user_metric metric, int32_t value) {
+    metric_values[metric] = value;
+}
+
+int32_t user_metric_get(enum user_metric metric) {
+    return metric_values[metric];
+}
+
+const char *user_metric_get_name(enum user_metric metric) {
+    return metric_names[metric];
+}
+
+void user_histogram_observe(enum user_histogram histogram, uint32_t value) {
+    const uint32_t *bounds = histogram_descs[histogram].bounds;
+    int i = 0;
+    while (i < USER_HISTOGRAM_BUCKETS - 1 && value > bounds[i]) {
+        i++;
+    }
+    histogram_counts[histogram][i]++;
+}
+
+void user_metrics_sample(void) {
+    metric_values[USER_METRIC_HEAP_FREE] = system_get_free_heap_size();
+    metric_values[USER_METRIC_STACK_FREE] = user_stack_get_free_min();
+    metric_values[USER_METRIC_SPIFFS_GC_RUNS] = my_spiffs_get_gc_runs();
+#if UART_TX_RING_EN
+    metric_values[USER_METRIC_UART_TX_DROPPED] = uart0_tx_ring_dropped();
+#endif
+#if UART_RX_RING_EN
+    metric_values[USER_METRIC_UART_RX_OVERFLOWS] = uart0_rx_ring_overflows();
+#endif
+
+    /* wifi_station_get_rssi() returns 31 when not connected */
+    int8_t rssi = wifi_station_get_rssi();
+    metric_values[USER_METRIC_WIFI_RSSI] = rssi == 31 ? 0 : rssi;
+}
+
+int user_metrics_append_bson(bson *bs) {
+    int i = 0;
+    for (i = 0; i < USER_METRIC_MAX; i++) {
+        bson_append_int(bs, metric_names[i], metric_values[i]);
+    }
+
+    for (i = 0; i < USER_HISTOGRAM_MAX; i++) {
+        bson_append_start_array(bs, histogram_descs[i].name);
+        int j = 0;
+        for (j = 0; j < USER_HISTOGRAM_BUCKETS; j++) {
+            /* BSON arrays are indexed by their field names */
+            char index[2] = { '0' + j, 0 };
+            bson_append_int(bs, index, histogram_counts[i][j]);
+        }
+        bson_append_finish_array(bs);
+    }
+
+    return bs->err ? -1 : 0;
+}
+
+void user_metrics_print(void) {
+    os_printf("\t*** Metrics:\n\r");
+    int i = 0;
+    for (i = 0; i < USER_METRIC_MAX; i++) {
+        os_printf("\t***   %s: %d\n\r", metric_names[i], metric_values[i]);
+    }
+    for (i = 0; i < USER_HISTOGRAM_MAX; i++) {
+        os_printf("\t***   %s:", histogram_descs[i].name);
+        int j = 0;
+        for (j = 0; j < USER_HISTOGRAM_BUCKETS; j++) {
+            os_printf(" %d", histogram_counts[i][j]);
+        }
+        os_printf("\n\r");
+    }
+}
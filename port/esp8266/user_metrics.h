@@ -0,0 +1,76 @@
+#ifndef USER_METRICS_H
+#define USER_METRICS_H
+
+/* Runtime metrics registry.
+ *
+ * The port layer keeps a fixed set of counters, gauges and histograms,
+ * which can be read over Mist (see the "metrics" endpoint of MistConfig)
+ * or printed on the console. Counters only ever grow, gauges hold the
+ * latest sampled value. Histograms count observations into fixed
+ * buckets, whose upper bounds are given in user_metrics.c. The last
+ * bucket of every histogram is unbounded.
+ *
+ * Gauges which are cheap to sample (heap, stack, RSSI) are not kept up to
+ * date continuously, instead they are refreshed by user_metrics_sample()
+ * before the metrics are read out. */
+
+#include <stdint.h>
+
+#include "bson.h"
+
+enum user_metric {
+    /* Counters */
+    USER_METRIC_TCP_RX_BYTES,
+    USER_METRIC_TCP_TX_BYTES,
+    USER_METRIC_TCP_RX_FRAMES,
+    USER_METRIC_TCP_TX_FRAMES,
+    USER_METRIC_SPIFFS_READS,
+    USER_METRIC_SPIFFS_WRITES,
+    USER_METRIC_SPIFFS_ERASES,
+    USER_METRIC_SPIFFS_GC_RUNS,
+    USER_METRIC_WIFI_RECONNECTS,
+    USER_METRIC_UART_TX_DROPPED,
+    USER_METRIC_UART_RX_FRAMES,
+    USER_METRIC_UART_RX_ERRORS,
+    USER_METRIC_UART_RX_OVERFLOWS,
+    /* Gauges */
+    USER_METRIC_IPC_QUEUE_DEPTH,
+    USER_METRIC_HEAP_FREE,
+    USER_METRIC_STACK_FREE,
+    USER_METRIC_WIFI_RSSI,
+    USER_METRIC_MAX,
+};
+
+enum user_histogram {
+    /* Size of the TCP segments received, in bytes */
+    USER_HISTOGRAM_TCP_RX_SIZE,
+    /* Length of the IPC queue when an event is added to it */
+    USER_HISTOGRAM_IPC_QUEUE_DEPTH,
+    USER_HISTOGRAM_MAX,
+};
+
+#define USER_HISTOGRAM_BUCKETS 6
+
+void user_metric_add(enum user_metric metric, uint32_t n);
+
+void user_metric_set(enum user_metric metric, int32_t value);
+
+int32_t user_metric_get(enum user_metric metric);
+
+/* The name of the metric, as used on the Mist endpoint */
+const char *user_metric_get_name(enum user_metric metric);
+
+void user_histogram_observe(enum user_histogram histogram, uint32_t value);
+
+/* Refresh the gauges which are sampled rather than updated */
+void user_metrics_sample(void);
+
+/* Append all the metrics into a bson document being built, one field per
+ * metric. Histograms are appended as arrays of bucket counts. Returns 0
+ * on success, or -1 if the bson buffer ran out. */
+int user_metrics_append_bson(bson *bs);
+
+/* Print the metrics using os_printf */
+void user_metrics_print(void);
+
+#endif //USER_METRICS_H
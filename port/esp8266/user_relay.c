@@ -18,6 +18,7 @@
 #include "wish_identity.h"
 #include "user_main.h"
 #include "port_printf.h"
+#include "user_stack.h"
 
 
 static struct espconn* espconn;
@@ -27,11 +28,13 @@ static struct espconn* espconn;
  * The relay control connection's TCP receive CB
  */
 static void user_relay_tcp_recv_cb(void *arg, char *pusrdata, unsigned short length) {
+    USER_STACK_ENTER(USER_STACK_PROBE_RELAY);
 //    PORT_PRINTF("in relay tcp recv cb\n\r");
     struct espconn *espconn = arg;
     wish_relay_client_t *relay = espconn->reverse;
     wish_relay_client_feed(user_get_core_instance(), relay, (unsigned char*) pusrdata, length);
     wish_relay_client_periodic(user_get_core_instance(), relay);
+    USER_STACK_EXIT(USER_STACK_PROBE_RELAY);
 }
 
 /* The relay control connection's TCP sent callback
@@ -45,13 +48,15 @@ static void user_relay_tcp_sent_cb(void *arg)
  */
 static void user_relay_tcp_discon_cb(void *arg)
 {
-    PORT_PRINTF("Relay TCP disconnect cb\n\r");
+    USER_STACK_ENTER(USER_STACK_PROBE_RELAY);
+    PORT_LOG(PORT_LOG_DEBUG, "Relay TCP disconnect cb");
     struct espconn *espconn = arg;
     wish_relay_client_t *relay = espconn->reverse;
     relay_ctrl_disconnect_cb(user_get_core_instance(), relay);
     
     os_free(espconn->proto.tcp);
     os_free(espconn);
+    USER_STACK_EXIT(USER_STACK_PROBE_RELAY);
 }
 
 /*
@@ -66,7 +71,8 @@ static int user_relay_tcp_send(int relay_sockfd, unsigned char* data, int len) {
  * The relay control connections TCP connect error callback 
  */
 static void user_relay_tcp_recon_cb(void *arg, sint8 err) {
-    PORT_PRINTF("Error when establishing relay control connection: %d\r\n", err);
+    USER_STACK_ENTER(USER_STACK_PROBE_RELAY);
+    PORT_LOG(PORT_LOG_CRITICAL, "Error when establishing relay control connection: %d", err);
     
     
     struct espconn *espconn = arg;
@@ -75,6 +81,7 @@ static void user_relay_tcp_recon_cb(void *arg, sint8 err) {
     
     os_free(espconn->proto.tcp);
     os_free(espconn);
+    USER_STACK_EXIT(USER_STACK_PROBE_RELAY);
 }
 
 
@@ -82,10 +89,11 @@ static void user_relay_tcp_recon_cb(void *arg, sint8 err) {
  * The Relay control connection's TCP connect callback
  */
 static void user_relay_tcp_connect_cb(void *arg) {
+    USER_STACK_ENTER(USER_STACK_PROBE_RELAY);
     struct espconn *pespconn = arg;
     wish_relay_client_t *relay = pespconn->reverse;
 
-    PORT_PRINTF("Relay server control connection established \r\n");
+    PORT_LOG(PORT_LOG_DEBUG, "Relay server control connection established");
 
     espconn_regist_recvcb(pespconn, user_relay_tcp_recv_cb);
     espconn_regist_sentcb(pespconn, user_relay_tcp_sent_cb);
@@ -96,6 +104,7 @@ static void user_relay_tcp_connect_cb(void *arg) {
     //relay->send_arg = arg;
     relay_ctrl_connected_cb(user_get_core_instance(), relay);
     wish_relay_client_periodic(user_get_core_instance(), relay);
+    USER_STACK_EXIT(USER_STACK_PROBE_RELAY);
 }
 
 //int8_t user_start_relay_control() {
@@ -110,7 +119,7 @@ void wish_relay_client_open(wish_core_t* core, wish_relay_client_t *relay, uint8
 
     /* ESP-specific stuff starts here */
 
-    PORT_PRINTF("Open relay control connection\n\r");
+    PORT_LOG(PORT_LOG_DEBUG, "Open relay control connection");
 
     /* Allocate the espconn structure for client use. This will be
      * de-allocated in the client disconnect callback, or the
@@ -159,7 +168,7 @@ void wish_relay_client_open(wish_core_t* core, wish_relay_client_t *relay, uint8
 
 void wish_relay_client_close(wish_core_t *core, wish_relay_client_t *rctx) {
     if (espconn_disconnect(espconn) != 0) {
-        PORT_PRINTF("Relay control diconnect fail\n\r");
+        PORT_LOG(PORT_LOG_CRITICAL, "Relay control diconnect fail");
         /* The relay control connection disconnect failed, this is probably because it had never connected. Free the espconn */
  
         relay_ctrl_disconnect_cb(user_get_core_instance(), rctx);
@@ -0,0 +1,276 @@
+/*
+ * Persistent settings log, see user_settings.h
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "osapi.h"
+
+#include "wish_fs.h"
+#include "spiffs_integration.h"
+#include "user_crc.h"
+#include "user_settings.h"
+
+#define USER_SETTINGS_DEBUG os_printf_plus
+
+#define SETTINGS_FILENAME   "settings.log"
+
+/* Size of the log file. Each record of a one byte value takes five bytes,
+ * so about a hundred changes fit between compactions. */
+#ifndef USER_SETTINGS_FILE_SIZE
+#define USER_SETTINGS_FILE_SIZE 512
+#endif
+
+#define RECORD_HDR_LEN  2
+#define RECORD_CRC_LEN  2
+#define RECORD_LEN(len) (RECORD_HDR_LEN + (len) + RECORD_CRC_LEN)
+#define KEY_ERASED      0xff
+#define NO_OFFSET       0xffff
+
+/* Offset of the latest record of each key in the log */
+static uint16_t key_offset[USER_SETTINGS_KEYS];
+/* Offset of the unused end of the log */
+static uint32_t log_end;
+
+static int32_t log_open(void) {
+    wish_file_t fd = my_fs_open(SETTINGS_FILENAME);
+    if (fd < 0) {
+        USER_SETTINGS_DEBUG("Could not open %s\n", SETTINGS_FILENAME);
+    }
+    return fd;
+}
+
+static int32_t read_at(wish_file_t fd, uint32_t offset, void *buf, size_t len) {
+    if (my_fs_lseek(fd, offset, WISH_FS_SEEK_SET) != offset) {
+        return -1;
+    }
+    return my_fs_read(fd, buf, len) == len ? 0 : -1;
+}
+
+/* Read the record at 'offset' to 'record', which must hold
+ * RECORD_LEN(USER_SETTINGS_MAX_VALUE) bytes. Returns the length of the
+ * record, 0 at the end of the log, or -1 if the record is corrupt. */
+static int32_t read_record(wish_file_t fd, uint32_t offset, uint8_t *record) {
+    if (offset + RECORD_HDR_LEN > USER_SETTINGS_FILE_SIZE) {
+        return 0;
+    }
+    if (read_at(fd, offset, record, RECORD_HDR_LEN) < 0) {
+        return -1;
+    }
+    if (record[0] == KEY_ERASED) {
+        return 0;
+    }
+    uint8_t len = record[1];
+    if (len > USER_SETTINGS_MAX_VALUE ||
+            offset + RECORD_LEN(len) > USER_SETTINGS_FILE_SIZE) {
+        return -1;
+    }
+    if (read_at(fd, offset + RECORD_HDR_LEN, record + RECORD_HDR_LEN,
+            len + RECORD_CRC_LEN) < 0) {
+        return -1;
+    }
+    uint16_t crc = user_crc16(record, RECORD_HDR_LEN + len);
+    if (record[RECORD_HDR_LEN + len] != crc >> 8 ||
+            record[RECORD_HDR_LEN + len + 1] != (crc & 0xff)) {
+        return -1;
+    }
+    return RECORD_LEN(len);
+}
+
+static void make_record(uint8_t *record, enum user_settings_key key,
+        const void *buf, size_t len) {
+    record[0] = key;
+    record[1] = len;
+    memcpy(record + RECORD_HDR_LEN, buf, len);
+    uint16_t crc = user_crc16(record, RECORD_HDR_LEN + len);
+    record[RECORD_HDR_LEN + len] = crc >> 8;
+    record[RECORD_HDR_LEN + len + 1] = crc & 0xff;
+}
+
+/* Scan the log for the latest record of each key. Returns false if the
+ * log ends in a corrupt record, so it cannot be appended to.
+ *
+ * Records carry no sequence number, as the offset orders them: they are
+ * only ever appended, so of two records of a key the later one is the
+ * newer. A record torn by a reset is the last one written, and nothing
+ * valid follows it. A compaction writes a new file, which replaces the
+ * old one whole through wish_fs_replace_commit(), so there is never a
+ * second log whose records would have to be ordered against these. */
+static bool log_scan(wish_file_t fd) {
+    uint8_t record[RECORD_LEN(USER_SETTINGS_MAX_VALUE)];
+    int i;
+    for (i = 0; i < USER_SETTINGS_KEYS; i++) {
+        key_offset[i] = NO_OFFSET;
+    }
+    log_end = 0;
+    while (true) {
+        int32_t len = read_record(fd, log_end, record);
+        if (len == 0) {
+            return true;
+        }
+        if (len < 0) {
+            USER_SETTINGS_DEBUG("Corrupt settings record at %d\n", log_end);
+            return false;
+        }
+        /* Records of keys this firmware does not know are dropped at the
+         * next compaction */
+        if (record[0] < USER_SETTINGS_KEYS) {
+            key_offset[record[0]] = log_end;
+        }
+        log_end += len;
+    }
+}
+
+/* Write the latest record of each key, and optionally a new record, to a
+ * new log and replace the old log with it (see wish_fs_replace_open()).
+ * 'old_fd' may be negative when there is no old log. */
+static int32_t log_compact(wish_file_t old_fd, const uint8_t *new_record) {
+    uint8_t record[RECORD_LEN(USER_SETTINGS_MAX_VALUE)];
+    uint16_t new_offset[USER_SETTINGS_KEYS];
+    uint32_t new_end = 0;
+    int i;
+
+    wish_file_t fd = wish_fs_replace_open(SETTINGS_FILENAME);
+    if (fd < 0) {
+        if (old_fd >= 0) {
+            my_fs_close(old_fd);
+        }
+        return -1;
+    }
+    for (i = 0; i < USER_SETTINGS_KEYS; i++) {
+        new_offset[i] = NO_OFFSET;
+        if (new_record && new_record[0] == i) {
+            continue;
+        }
+        if (old_fd < 0 || key_offset[i] == NO_OFFSET) {
+            continue;
+        }
+        int32_t len = read_record(old_fd, key_offset[i], record);
+        if (len <= 0) {
+            continue;
+        }
+        if (wish_fs_write(fd, record, len) != len) {
+            goto fail;
+        }
+        new_offset[i] = new_end;
+        new_end += len;
+    }
+    if (new_record) {
+        int32_t len = RECORD_LEN(new_record[1]);
+        if (wish_fs_write(fd, new_record, len) != len) {
+            goto fail;
+        }
+        new_offset[new_record[0]] = new_end;
+        new_end += len;
+    }
+    /* Pad with erased bytes for appending to */
+    memset(record, 0xff, sizeof(record));
+    uint32_t pos = new_end;
+    while (pos < USER_SETTINGS_FILE_SIZE) {
+        int32_t len = USER_SETTINGS_FILE_SIZE - pos;
+        if (len > sizeof(record)) {
+            len = sizeof(record);
+        }
+        if (wish_fs_write(fd, record, len) != len) {
+            goto fail;
+        }
+        pos += len;
+    }
+    if (old_fd >= 0) {
+        my_fs_close(old_fd);
+    }
+    if (wish_fs_replace_commit(fd, SETTINGS_FILENAME) < 0) {
+        USER_SETTINGS_DEBUG("Could not replace settings log\n");
+        return -1;
+    }
+    memcpy(key_offset, new_offset, sizeof(key_offset));
+    log_end = new_end;
+    return 0;
+
+fail:
+    USER_SETTINGS_DEBUG("Could not write settings log\n");
+    if (old_fd >= 0) {
+        my_fs_close(old_fd);
+    }
+    wish_fs_replace_abort(fd, SETTINGS_FILENAME);
+    return -1;
+}
+
+static int32_t log_size(wish_file_t fd) {
+    return my_fs_lseek(fd, 0, WISH_FS_SEEK_END);
+}
+
+void user_settings_init(void) {
+    int i;
+    for (i = 0; i < USER_SETTINGS_KEYS; i++) {
+        key_offset[i] = NO_OFFSET;
+    }
+    log_end = 0;
+
+    wish_file_t fd = log_open();
+    if (fd < 0) {
+        return;
+    }
+    if (log_size(fd) != USER_SETTINGS_FILE_SIZE) {
+        /* No settings saved yet. A compaction cut short by a reset was
+         * finished or rolled back when the file system was mounted. */
+        log_compact(fd, NULL);
+        return;
+    }
+    if (!log_scan(fd)) {
+        log_compact(fd, NULL);
+        return;
+    }
+    my_fs_close(fd);
+}
+
+int32_t user_settings_get(enum user_settings_key key, void *buf, size_t len) {
+    uint8_t record[RECORD_LEN(USER_SETTINGS_MAX_VALUE)];
+    if (key >= USER_SETTINGS_KEYS || key_offset[key] == NO_OFFSET) {
+        return -1;
+    }
+    wish_file_t fd = log_open();
+    if (fd < 0) {
+        return -1;
+    }
+    int32_t ret = read_record(fd, key_offset[key], record);
+    my_fs_close(fd);
+    if (ret <= 0) {
+        return -1;
+    }
+    uint8_t value_len = record[1];
+    memcpy(buf, record + RECORD_HDR_LEN, value_len < len ? value_len : len);
+    return value_len;
+}
+
+int32_t user_settings_set(enum user_settings_key key, const void *buf, size_t len) {
+    uint8_t record[RECORD_LEN(USER_SETTINGS_MAX_VALUE)];
+    if (key >= USER_SETTINGS_KEYS || key == 0 || len > USER_SETTINGS_MAX_VALUE) {
+        return -1;
+    }
+    wish_file_t fd = log_open();
+    if (fd < 0) {
+        return -1;
+    }
+    if (key_offset[key] != NO_OFFSET &&
+            read_record(fd, key_offset[key], record) > 0 &&
+            record[1] == len && memcmp(record + RECORD_HDR_LEN, buf, len) == 0) {
+        my_fs_close(fd);
+        return 0;
+    }
+
+    make_record(record, key, buf, len);
+    int32_t record_len = RECORD_LEN(len);
+    if (log_end + record_len <= USER_SETTINGS_FILE_SIZE &&
+            my_fs_program(fd, log_end, record, record_len) == record_len) {
+        key_offset[key] = log_end;
+        log_end += record_len;
+        my_fs_close(fd);
+        return 0;
+    }
+    /* The log is full, or its end was not erased after all */
+    return log_compact(fd, record);
+}
@@ -0,0 +1,42 @@
+#ifndef USER_SETTINGS_H
+#define USER_SETTINGS_H
+
+/* Small persistent settings, kept as an append-only log in SPIFFS.
+ *
+ * Every change of a setting appends one record to a preallocated file,
+ * which is programmed into flash in place (see my_fs_program()). The
+ * latest record of a key holds its value. When the file is full, the
+ * latest records are copied to a new file which replaces the old one.
+ *
+ * A record is
+ *
+ *   key (1) | len (1) | value (len) | crc16 (2)
+ *
+ * where crc16 is CRC-16/CCITT-FALSE over key, len and value, most
+ * significant byte first. A key of 0xff marks the unused end of the log.
+ * A record torn by a reset fails the CRC check, and is dropped along with
+ * anything after it the next time the log is loaded. */
+
+#include <stdint.h>
+#include <stddef.h>
+
+enum user_settings_key {
+    USER_SETTINGS_RELAY = 1,
+    USER_SETTINGS_TOGGLE_RELAY,
+    USER_SETTINGS_KEYS,
+};
+
+#define USER_SETTINGS_MAX_VALUE 64
+
+/* Load the settings log, call after my_spiffs_mount() */
+void user_settings_init(void);
+
+/* Copy the value of 'key' to 'buf'. Returns the length of the value, or
+ * -1 if the key has not been set. At most 'len' bytes are copied. */
+int32_t user_settings_get(enum user_settings_key key, void *buf, size_t len);
+
+/* Set 'key' to the 'len' bytes of 'buf'. Setting a key to the value it
+ * already has does not write anything. Returns 0, or -1 on failure. */
+int32_t user_settings_set(enum user_settings_key key, const void *buf, size_t len);
+
+#endif //USER_SETTINGS_H
@@ -0,0 +1,92 @@
+/*
+ * SLIP framing, see user_slip.h
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "user_slip.h"
+
+void user_slip_decoder_init(struct user_slip_decoder *dec, uint8_t *buf, size_t buf_size) {
+    dec->buf = buf;
+    dec->buf_size = buf_size;
+    dec->len = 0;
+    dec->escaped = false;
+    dec->discard = false;
+    dec->errors = 0;
+}
+
+void user_slip_decode(struct user_slip_decoder *dec, const uint8_t *data, size_t len,
+        user_slip_frame_cb_t *frame_cb, void *ctx) {
+    size_t i = 0;
+    for (i = 0; i < len; i++) {
+        uint8_t c = data[i];
+
+        if (c == USER_SLIP_END) {
+            if (!dec->discard && !dec->escaped && dec->len > 0) {
+                frame_cb(dec->buf, dec->len, ctx);
+            }
+            else if (dec->escaped) {
+                dec->errors++;
+            }
+            dec->len = 0;
+            dec->escaped = false;
+            dec->discard = false;
+            continue;
+        }
+        if (dec->discard) {
+            continue;
+        }
+
+        if (dec->escaped) {
+            dec->escaped = false;
+            if (c == USER_SLIP_ESC_END) {
+                c = USER_SLIP_END;
+            }
+            else if (c == USER_SLIP_ESC_ESC) {
+                c = USER_SLIP_ESC;
+            }
+            else {
+                dec->errors++;
+                dec->discard = true;
+                continue;
+            }
+        }
+        else if (c == USER_SLIP_ESC) {
+            dec->escaped = true;
+            continue;
+        }
+
+        if (dec->len == dec->buf_size) {
+            dec->errors++;
+            dec->discard = true;
+            continue;
+        }
+        dec->buf[dec->len++] = c;
+    }
+}
+
+size_t user_slip_encode(const uint8_t *in, size_t in_len, size_t *in_used,
+        uint8_t *out, size_t out_size) {
+    size_t i = 0;
+    size_t o = 0;
+    for (i = 0; i < in_len; i++) {
+        uint8_t c = in[i];
+        if (c == USER_SLIP_END || c == USER_SLIP_ESC) {
+            if (out_size - o < 2) {
+                break;
+            }
+            out[o++] = USER_SLIP_ESC;
+            out[o++] = c == USER_SLIP_END ? USER_SLIP_ESC_END : USER_SLIP_ESC_ESC;
+        }
+        else {
+            if (out_size - o < 1) {
+                break;
+            }
+            out[o++] = c;
+        }
+    }
+    *in_used = i;
+    return o;
+}
@@ -0,0 +1,61 @@
+#ifndef USER_SLIP_H
+#define USER_SLIP_H
+
+/* SLIP framing (RFC 1055) for the UART.
+ *
+ * A frame is sent as its bytes followed by USER_SLIP_END, with END and
+ * ESC bytes inside the frame replaced by two-byte escape sequences. An
+ * END is also sent before the frame, so that any noise on the line
+ * before it ends up in a separate frame, which the receiver drops.
+ *
+ * The decoder is fed with whatever bytes have arrived, and calls back
+ * with each complete frame. It does not depend on the SDK, so it can be
+ * used in host tools and tests too. */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define USER_SLIP_END       0xC0
+#define USER_SLIP_ESC       0xDB
+#define USER_SLIP_ESC_END   0xDC
+#define USER_SLIP_ESC_ESC   0xDD
+
+/* Called with each complete frame. The frame is only valid during the
+ * call. */
+typedef void user_slip_frame_cb_t(uint8_t *frame, size_t len, void *ctx);
+
+struct user_slip_decoder {
+    uint8_t *buf;
+    size_t buf_size;
+    /* Length of the frame being received */
+    size_t len;
+    /* The previous byte was USER_SLIP_ESC */
+    bool escaped;
+    /* The frame being received is bad, drop bytes until the next END */
+    bool discard;
+    /* Number of frames dropped because they were too long or had an
+     * invalid escape sequence */
+    uint32_t errors;
+};
+
+/* Initialise a decoder which receives frames of at most 'buf_size' bytes
+ * to 'buf' */
+void user_slip_decoder_init(struct user_slip_decoder *dec, uint8_t *buf, size_t buf_size);
+
+/* Feed 'len' received bytes to the decoder. 'frame_cb' is called for every
+ * frame which is completed by these bytes. Empty frames are ignored. */
+void user_slip_decode(struct user_slip_decoder *dec, const uint8_t *data, size_t len,
+    user_slip_frame_cb_t *frame_cb, void *ctx);
+
+/* Encode bytes of a frame into 'out', without the END bytes before and
+ * after the frame. Encodes as much of 'in' as fits, sets '*in_used' to the
+ * number of bytes of 'in' consumed, and returns the number of bytes
+ * written to 'out'. An escaped byte is never split. */
+size_t user_slip_encode(const uint8_t *in, size_t in_len, size_t *in_used,
+    uint8_t *out, size_t out_size);
+
+/* The size of a frame of 'len' bytes on the line, in the worst case */
+#define USER_SLIP_MAX_ENCODED_LEN(len) (2 * (len) + 2)
+
+#endif //USER_SLIP_H
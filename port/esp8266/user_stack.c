@@ -0,0 +1,156 @@
+/*
+ * Per-entry-point stack accounting, see user_stack.h
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "osapi.h"
+#include "user_interface.h"
+#include "espmissingincludes.h"
+
+#include "user_support.h"
+#include "user_stack.h"
+
+/* STACK_CANARY repeated over a whole 32-bit word */
+#define STACK_CANARY_WORD ((uint32_t) STACK_CANARY * 0x01010101)
+
+/* Amount of stack under the frame of user_stack_enter() which is not
+ * repainted when entering a probe. With the call0 ABI of the lx106 there
+ * are no register windows to spill, but stack_repaint() itself gets its
+ * frame, with the saved return address, just below. */
+#define STACK_PAINT_MARGIN 32
+
+/* Maximum nesting depth of probes we keep track of */
+#define STACK_PROBE_NEST_MAX 4
+
+struct stack_frame {
+    enum user_stack_probe probe;
+    /* Lowest stack address known to have been used while this probe was
+     * active */
+    uint8_t *low;
+};
+
+static struct user_stack_stat stack_stats[USER_STACK_PROBE_MAX] = {
+    [USER_STACK_PROBE_MSG_TASK] = { .name = "msg_task" },
+    [USER_STACK_PROBE_IPC_TASK] = { .name = "ipc_task" },
+    [USER_STACK_PROBE_TCP_RECV] = { .name = "tcp_recv" },
+    [USER_STACK_PROBE_TCP_SENT] = { .name = "tcp_sent" },
+    [USER_STACK_PROBE_TCP_CONNECT] = { .name = "tcp_connect" },
+    [USER_STACK_PROBE_TCP_DISCON] = { .name = "tcp_discon" },
+    [USER_STACK_PROBE_TCP_RECON] = { .name = "tcp_recon" },
+    [USER_STACK_PROBE_UDP_RECV] = { .name = "udp_recv" },
+    [USER_STACK_PROBE_RELAY] = { .name = "relay" },
+    [USER_STACK_PROBE_UART_RX] = { .name = "uart_rx" },
+    [USER_STACK_PROBE_MIST_READ] = { .name = "mist_read" },
+    [USER_STACK_PROBE_MIST_WRITE] = { .name = "mist_write" },
+    [USER_STACK_PROBE_MIST_INVOKE] = { .name = "mist_invoke" },
+};
+
+static struct stack_frame frames[STACK_PROBE_NEST_MAX];
+/* Current nesting depth. May exceed STACK_PROBE_NEST_MAX, in which case
+ * the innermost probes are not recorded */
+static int num_frames;
+
+/* Lowest stack address ever seen in use by any of the scans */
+static uint8_t *stack_low_global = (uint8_t *) USER_STACK_START;
+
+/* Find the lowest stack address which no longer has the canary value */
+static uint8_t *stack_scan(void) {
+    volatile uint32_t *p = (uint32_t *) USER_STACK_END;
+    while (p < (uint32_t *) USER_STACK_START && *p == STACK_CANARY_WORD) {
+        p++;
+    }
+    uint8_t *low = (uint8_t *) p;
+    if (low < stack_low_global) {
+        stack_low_global = low;
+    }
+    return low;
+}
+
+/* Re-paint the stack between the lowest used address and the stack
+ * pointer of the caller. Written as an explicit loop, because calling
+ * memset() here would use the very stack we are painting. */
+static void stack_repaint(uint8_t *low, uint8_t *sp) {
+    volatile uint32_t *p = (uint32_t *) ((uint32_t) low & ~3);
+    uint32_t *end = (uint32_t *) ((uint32_t) (sp - STACK_PAINT_MARGIN) & ~3);
+    while (p < end) {
+        *p++ = STACK_CANARY_WORD;
+    }
+}
+
+void user_stack_enter(enum user_stack_probe probe) {
+    uint8_t *sp = (uint8_t *) __builtin_frame_address(0);
+    uint8_t *low = stack_scan();
+
+    if (num_frames > 0 && low < frames[num_frames - 1].low) {
+        /* Charge the outer probe for what has been used so far, as we
+         * are about to erase the evidence */
+        frames[num_frames - 1].low = low;
+    }
+    if (num_frames >= STACK_PROBE_NEST_MAX) {
+        /* Too deep nesting; the outer probes are still accounted
+         * correctly, as we don't repaint */
+        num_frames++;
+        return;
+    }
+    stack_repaint(low, sp);
+
+    int32_t entry_free = sp - (uint8_t *) USER_STACK_END;
+    struct user_stack_stat *stat = &stack_stats[probe];
+    if (stat->calls == 0 || entry_free < stat->entry_free_min) {
+        stat->entry_free_min = entry_free;
+    }
+
+    frames[num_frames].probe = probe;
+    frames[num_frames].low = sp;
+    num_frames++;
+}
+
+void user_stack_exit(enum user_stack_probe probe) {
+    uint8_t *low = stack_scan();
+
+    if (num_frames == 0) {
+        /* Unbalanced enter/exit */
+        return;
+    }
+    num_frames--;
+    if (num_frames >= STACK_PROBE_NEST_MAX || frames[num_frames].probe != probe) {
+        return;
+    }
+    if (frames[num_frames].low < low) {
+        low = frames[num_frames].low;
+    }
+
+    int32_t untouched = low - (uint8_t *) USER_STACK_END;
+    struct user_stack_stat *stat = &stack_stats[probe];
+    if (stat->calls == 0 || untouched < stat->free_min) {
+        stat->free_min = untouched;
+    }
+    stat->calls++;
+
+    if (num_frames > 0 && low < frames[num_frames - 1].low) {
+        frames[num_frames - 1].low = low;
+    }
+}
+
+int32_t user_stack_get_free_min(void) {
+    return stack_low_global - (uint8_t *) USER_STACK_END;
+}
+
+const struct user_stack_stat *user_stack_get_stats(void) {
+    return stack_stats;
+}
+
+void user_stack_print_stats(void) {
+    os_printf("\t*** Stack usage per entry point: calls, free at entry, free at deepest\n\r");
+    int i = 0;
+    for (i = 0; i < USER_STACK_PROBE_MAX; i++) {
+        struct user_stack_stat *stat = &stack_stats[i];
+        if (stat->calls == 0) {
+            continue;
+        }
+        os_printf("\t***   %s: %d, %d, %d\n\r", stat->name, stat->calls,
+            stat->entry_free_min, stat->free_min);
+    }
+}
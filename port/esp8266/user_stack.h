@@ -0,0 +1,74 @@
+#ifndef USER_STACK_H
+#define USER_STACK_H
+
+/* Per-entry-point stack accounting.
+ *
+ * Every place where the SDK hands control to our code (the system
+ * tasks, espconn callbacks, Mist endpoint handlers) is wrapped with
+ * USER_STACK_ENTER()/USER_STACK_EXIT(). On entry the part of the stack
+ * below the current stack pointer is re-painted with STACK_CANARY, and
+ * on exit the canary is searched for again, which tells us how deep
+ * that particular entry point went. Entry points may nest, the outer
+ * one is then charged for the stack used by the inner one too.
+ *
+ * Note that interrupts run on the same stack, so an ISR which fires
+ * while a probe is active is accounted to that probe. */
+
+#include <stdint.h>
+
+/* Set to 0 to compile out all the probes */
+#define WITH_STACK_PROBES 1
+
+enum user_stack_probe {
+    USER_STACK_PROBE_MSG_TASK,
+    USER_STACK_PROBE_IPC_TASK,
+    USER_STACK_PROBE_TCP_RECV,
+    USER_STACK_PROBE_TCP_SENT,
+    USER_STACK_PROBE_TCP_CONNECT,
+    USER_STACK_PROBE_TCP_DISCON,
+    USER_STACK_PROBE_TCP_RECON,
+    USER_STACK_PROBE_UDP_RECV,
+    USER_STACK_PROBE_RELAY,
+    USER_STACK_PROBE_UART_RX,
+    USER_STACK_PROBE_MIST_READ,
+    USER_STACK_PROBE_MIST_WRITE,
+    USER_STACK_PROBE_MIST_INVOKE,
+    USER_STACK_PROBE_MAX,
+};
+
+struct user_stack_stat {
+    const char *name;
+    /* Number of completed enter/exit pairs */
+    uint32_t calls;
+    /* Smallest amount of free stack seen at entry, in bytes */
+    int32_t entry_free_min;
+    /* Smallest amount of stack left untouched while the probe was
+     * active, in bytes. This is the "deepest point" of the entry point */
+    int32_t free_min;
+};
+
+#if WITH_STACK_PROBES
+#define USER_STACK_ENTER(probe) user_stack_enter(probe)
+#define USER_STACK_EXIT(probe) user_stack_exit(probe)
+#else
+#define USER_STACK_ENTER(probe)
+#define USER_STACK_EXIT(probe)
+#endif
+
+void user_stack_enter(enum user_stack_probe probe);
+
+void user_stack_exit(enum user_stack_probe probe);
+
+/* Smallest amount of untouched stack ever recorded by the probes. Because
+ * the probes re-paint the stack, user_find_stack_canary() must take this into
+ * account. Returns USER_STACK_SIZE if nothing has been recorded. */
+int32_t user_stack_get_free_min(void);
+
+/* Get the stack statistics table, indexed by enum user_stack_probe. The
+ * table has USER_STACK_PROBE_MAX entries. */
+const struct user_stack_stat *user_stack_get_stats(void);
+
+/* Print the stack statistics table using os_printf */
+void user_stack_print_stats(void);
+
+#endif //USER_STACK_H
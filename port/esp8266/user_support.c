@@ -3,6 +3,7 @@
 
 #include "osapi.h"
 #include "user_support.h"
+#include "user_stack.h"
 #include "espmissingincludes.h"
 #include "user_interface.h"
 
@@ -13,6 +14,7 @@
 #include "wish_time.h"
 #include "spiffs.h"
 #include "spiffs_integration.h"
+#include "wish_fs.h"
 #include "port_printf.h"
 
 void user_paint_stack(void) {
@@ -29,11 +31,16 @@ int32_t user_find_stack_canary(void) {
         p++;
         c++;
     }
-    return c;
+    /* The stack probes re-paint the stack, so the canary alone only
+     * tells the usage since the latest probe */
+    int32_t probe_min = user_stack_get_free_min();
+    return (probe_min < c) ? probe_min : c;
 }
 
 /**
- * This function will restart the device. 
+ * This function will restart the device, after unmounting the file
+ * system so that whatever is buffered is written out and the next mount
+ * can take the mount state from a checkpoint. 
  *
  * XXX Please that restart will not happen if you have just flashed the
  * device. In that case a hard reboot is necessary before reboot will
@@ -41,6 +48,7 @@ int32_t user_find_stack_canary(void) {
  */
 void user_reboot(void) {
     os_printf("\n\r\t*** REBOOT ***\n");
+    my_spiffs_unmount();
     system_restart();
     while(1);
 }
@@ -63,8 +71,9 @@ int32_t user_get_uptime_minutes(void) {
 }
 
 void user_mappings_file_delete(void) {
-    int32_t ret = my_fs_remove("mappings.bin");
-    if (ret != SPIFFS_OK) {
+    /* A reset in the middle leaves either the whole file or no file */
+    int32_t ret = wish_fs_delete("mappings.bin");
+    if (ret < 0) {
         PORT_PRINTF("Failed removing mappings.bin");
     }
 }
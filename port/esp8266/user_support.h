@@ -28,7 +28,8 @@ void user_paint_stack(void);
 int32_t user_find_stack_canary(void);
 
 /**
- * This function will restart the device. 
+ * This function will restart the device, after unmounting the file
+ * system. Deliberate restarts should go through this. 
  *
  * XXX Please that restart will not happen if you have just flashed the
  * device. In that case a hard reboot is necessary before reboot will
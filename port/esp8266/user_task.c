@@ -21,6 +21,8 @@
 #include "user_main.h"
 #include "wish_port_config.h"
 #include "port_printf.h"
+#include "user_stack.h"
+#include "user_uart_wish.h"
 
 
 os_event_t *task_event_queue;
@@ -31,6 +33,7 @@ static void my_message_processor_task(ETSEvent *e) {
     struct wish_event ev = { .event_type = e->sig, 
         .context = (wish_connection_t *)e->par };
     wish_core_t* core = user_get_core_instance();
+    USER_STACK_ENTER(USER_STACK_PROBE_MSG_TASK);
     
     if (ev.event_type == WISH_EVENT_REQUEST_CONNECTION_CLOSING && ev.context == NULL && ev.metadata != NULL) {
         espconn_disconnect(ev.metadata);
@@ -56,8 +59,17 @@ static void my_message_processor_task(ETSEvent *e) {
             system_soft_wdt_feed(); 
         }
         
-        espconn_recv_unhold(ev.context->send_arg);
+#if WITH_UART_TRANSPORT
+        if (user_uart_wish_is_connection(ev.context)) {
+            user_uart_wish_rx_consumed(ev.context);
+        }
+        else
+#endif
+        {
+            espconn_recv_unhold(ev.context->send_arg);
+        }
     }
+    USER_STACK_EXIT(USER_STACK_PROBE_MSG_TASK);
 }
 
 /* Initialise a event queue for handling messages. */
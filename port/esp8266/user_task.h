@@ -1,8 +1,13 @@
+/* The NONOS SDK has three user task priorities, 0 to 2, and all of them
+ * are taken here. Deferred work which does not fit in one of these tasks
+ * runs from a timer instead, like the log flush in port_log.c. */
 #define MESSAGE_PROCESSOR_TASK_ID 0
 #define SERVICE_IPC_TASK_ID 1
+#define UART_RX_TASK_ID 2
 
 #define TASK_EVENT_QUEUE_LEN 16
 #define SERVICE_IPC_QUEUE_LEN 32
+#define UART_RX_QUEUE_LEN 2
 
 //#define MIST_FOLLOW_TASK_ID 2
 //#define FOLLOW_EVENT_QUEUE_LEN 1
@@ -33,10 +33,14 @@
 #include "utlist.h"
 #include "wish_connection.h"
 #include "user_main.h"
-#include "port_printf.h"
+#include "user_stack.h"
+#include "user_timer.h"
+#include "user_metrics.h"
+#include "user_trace.h"
+#include "user_uart_wish.h"
 
 
-LOCAL os_timer_t test_timer;
+LOCAL struct user_timer test_timer;
 ip_addr_t tcp_server_ip;
 
 LOCAL void ICACHE_FLASH_ATTR user_tcp_recon_cb(void *arg, sint8 err);
@@ -53,11 +57,11 @@ LOCAL void ICACHE_FLASH_ATTR
 user_tcp_recv_cb(void *arg, char *pusrdata, unsigned short length)
 {
     struct espconn *espconn = arg;
-    PORT_PRINTF("tcp_recv_cb IP: %d.%d.%d.%d\n\r", 
-        espconn->proto.tcp->remote_ip[0],
-        espconn->proto.tcp->remote_ip[1],
-        espconn->proto.tcp->remote_ip[2],
-        espconn->proto.tcp->remote_ip[3]);
+    USER_STACK_ENTER(USER_STACK_PROBE_TCP_RECV);
+    user_metric_add(USER_METRIC_TCP_RX_BYTES, length);
+    user_metric_add(USER_METRIC_TCP_RX_FRAMES, 1);
+    user_histogram_observe(USER_HISTOGRAM_TCP_RX_SIZE, length);
+    USER_TRACE(TCP_RECV, USER_TRACE_IP(espconn->proto.tcp->remote_ip), length);
 
     //received some data from tcp connection
 
@@ -71,6 +75,7 @@ user_tcp_recv_cb(void *arg, char *pusrdata, unsigned short length)
             espconn->proto.tcp->local_port);
 
     if (connection == NULL) {
+        USER_STACK_EXIT(USER_STACK_PROBE_TCP_RECV);
         return;
     }
     
@@ -81,7 +86,7 @@ user_tcp_recv_cb(void *arg, char *pusrdata, unsigned short length)
          * wish_core_feed() would disconnect the connection, but that is against the espconn rules - you can't call espconn_disconnect while in an espconn callback.
          * We need to just flag the connection for closure later, else a memory leak will ensue.
          */
-        PORT_PRINTF("Received packet that is too large to handle. %d > %d Disconnecting.\n", length, rb_free);
+        USER_TRACE(TCP_RECV_TOO_LARGE, length, rb_free);
         struct wish_event ev = { .event_type = WISH_EVENT_REQUEST_CONNECTION_CLOSING, 
             .context = connection };
         wish_message_processor_notify(&ev);
@@ -93,6 +98,7 @@ user_tcp_recv_cb(void *arg, char *pusrdata, unsigned short length)
             .context = connection };
         wish_message_processor_notify(&ev);
     }
+    USER_STACK_EXIT(USER_STACK_PROBE_TCP_RECV);
 }
 
 
@@ -137,6 +143,7 @@ user_tcp_sent_cb(void *arg)
     //data sent successfully
 
     struct espconn *espconn = arg;
+    USER_STACK_ENTER(USER_STACK_PROBE_TCP_SENT);
 
     wish_connection_t *cb_ctx = (wish_connection_t *) espconn->reverse;
 
@@ -145,7 +152,8 @@ user_tcp_sent_cb(void *arg)
     LL_FOREACH(active_conn_head, conn) {
         if (conn->espconn->reverse == cb_ctx) {
             if (conn->busy == false) {
-                PORT_PRINTF("Not busy, this is not possible\n");
+                USER_TRACE(TCP_SENT_NOT_BUSY, 0, 0);
+                USER_STACK_EXIT(USER_STACK_PROBE_TCP_SENT);
                 return;
             }
 
@@ -156,7 +164,7 @@ user_tcp_sent_cb(void *arg)
                 os_free(e);
             }
             else {
-                PORT_PRINTF("fifo_head is null, this is not possible!\n");
+                USER_TRACE(TCP_SENT_FIFO_NULL, 0, 0);
             }
             
             /* Send next */
@@ -166,7 +174,7 @@ user_tcp_sent_cb(void *arg)
             if (fifo_len == 0) {
                 /* No longer busy */
                 conn->busy = false;
-                PORT_PRINTF("Send FIFO is now empty!\n");
+                USER_TRACE(TCP_SENT_FIFO_DONE, 0, 0);
             }
             else {
                 /* Continue with sending next buffer */
@@ -176,14 +184,14 @@ user_tcp_sent_cb(void *arg)
                 }
                 else if (ret == ESPCONN_MAXNUM) {
                     /* Buffers are currently full, can send later */
-                    PORT_PRINTF("user_tcp_send_cb: send buffers full, will retry\n");
+                    USER_TRACE(TCP_SENT_RETRY, 0, 0);
                 }
                 else {
                     /* failed send, and we don't think we can recover it. 
                      * ESPCONN_MEM out of memory
                      * ESPCONN_ARG illegal espconn structure
                      * ?? */
-                    PORT_PRINTF("Failed sending data, dropping the data, ret = %d\n", ret);
+                    USER_TRACE(TCP_SENT_FAIL, ret, 0);
                     struct fifo_entry *elt = NULL;
                     LL_DELETE(conn->fifo_head, elt);
                     os_free(elt->data);
@@ -199,10 +207,11 @@ user_tcp_sent_cb(void *arg)
             break;
         }
     }
+    USER_STACK_EXIT(USER_STACK_PROBE_TCP_SENT);
 }
 
 static void cleanup_active_conn(wish_connection_t* ctx) {
-    PORT_PRINTF("cleanup_active_conn\n");
+    USER_TRACE(TCP_CLEANUP, ctx, 0);
     /* Find the active connection related to this espconn */
     struct active_conn_entry *conn = NULL;
     struct active_conn_entry *tmp = NULL;
@@ -233,24 +242,24 @@ LOCAL void ICACHE_FLASH_ATTR
 user_tcp_discon_cb(void *arg)
 {
     struct espconn *espconn = arg;
+    USER_STACK_ENTER(USER_STACK_PROBE_TCP_DISCON);
 
+    USER_TRACE(TCP_DISCON, USER_TRACE_IP(espconn->proto.tcp->remote_ip),
+        espconn->proto.tcp->remote_port);
+
+    wish_connection_t *ctx = espconn->reverse;
     os_free(espconn->proto.tcp);
     os_free(espconn);
 
-    PORT_PRINTF("tcp_discon_cb IP: %d.%d.%d.%d\n\r", 
-        espconn->proto.tcp->remote_ip[0],
-        espconn->proto.tcp->remote_ip[1],
-        espconn->proto.tcp->remote_ip[2],
-        espconn->proto.tcp->remote_ip[3]);
-
-    wish_connection_t *ctx = espconn->reverse;
     if (ctx == NULL) {
-        PORT_PRINTF("Connection close: wish context not found!\n");
+        USER_TRACE(TCP_DISCON_NO_CTX, 0, 0);
+        USER_STACK_EXIT(USER_STACK_PROBE_TCP_DISCON);
         return;
     }
 
     cleanup_active_conn(ctx);
     wish_core_signal_tcp_event(user_get_core_instance(), ctx, TCP_DISCONNECTED);
+    USER_STACK_EXIT(USER_STACK_PROBE_TCP_DISCON);
 }
 
 /******************************************************************************
@@ -264,20 +273,20 @@ user_tcp_server_discon_cb(void *arg)
 {
     //tcp disconnect successfully
     struct espconn *espconn = arg;
-    PORT_PRINTF("tcp_server_discon_cb IP: %d.%d.%d.%d\n\r", 
-        espconn->proto.tcp->remote_ip[0],
-        espconn->proto.tcp->remote_ip[1],
-        espconn->proto.tcp->remote_ip[2],
-        espconn->proto.tcp->remote_ip[3]);
+    USER_STACK_ENTER(USER_STACK_PROBE_TCP_DISCON);
+    USER_TRACE(TCP_SERVER_DISCON, USER_TRACE_IP(espconn->proto.tcp->remote_ip),
+        espconn->proto.tcp->remote_port);
 
     wish_connection_t *ctx = espconn->reverse;
     if (ctx == NULL) {
-        PORT_PRINTF("Connection close: wish context not found!\n");
+        USER_TRACE(TCP_DISCON_NO_CTX, 0, 0);
+        USER_STACK_EXIT(USER_STACK_PROBE_TCP_DISCON);
         return;
     }
     
     cleanup_active_conn(ctx);
-    wish_core_signal_tcp_event(user_get_core_instance(), ctx, TCP_CLIENT_DISCONNECTED);  
+    wish_core_signal_tcp_event(user_get_core_instance(), ctx, TCP_CLIENT_DISCONNECTED);
+    USER_STACK_EXIT(USER_STACK_PROBE_TCP_DISCON);
 }
 
 /******************************************************************************
@@ -290,15 +299,17 @@ LOCAL void ICACHE_FLASH_ATTR
 user_tcp_server_connect_cb(void *arg)
 {
     struct espconn *pespconn = arg;
+    USER_STACK_ENTER(USER_STACK_PROBE_TCP_CONNECT);
     uint8_t null_wuid[WISH_ID_LEN] = { 0 };
     wish_connection_t* connection = wish_connection_init(user_get_core_instance(), null_wuid, null_wuid);
     if (connection == NULL) {
-        PORT_PRINTF("We cannot accept incoming connections right now\n");
+        USER_TRACE(TCP_ACCEPT_FAIL, 0, 0);
         /* We cannot call espconn_disconnect() here. But we have no connection either! Then we put the pespconn pointer to event metadata, and handle it explicitly in message processor task implementation. */
         struct wish_event ev = { .event_type = WISH_EVENT_REQUEST_CONNECTION_CLOSING, 
             .context = NULL,
             .metadata = pespconn };
         wish_message_processor_notify(&ev);
+        USER_STACK_EXIT(USER_STACK_PROBE_TCP_CONNECT);
         return;
     }
     /* Register the reverse so that we can later for example clean up
@@ -313,8 +324,7 @@ user_tcp_server_connect_cb(void *arg)
     connection->remote_port = pespconn->proto.tcp->remote_port;
  
 
-    PORT_PRINTF("Incoming connection from %d.%d.%d.%d\r\n", 
-        connection->remote_ip_addr[0], connection->remote_ip_addr[1], connection->remote_ip_addr[2], connection->remote_ip_addr[3]);
+    USER_TRACE(TCP_ACCEPT, USER_TRACE_IP(connection->remote_ip_addr), connection->remote_port);
 
     espconn_regist_recvcb(pespconn, user_tcp_recv_cb);
     espconn_regist_sentcb(pespconn, user_tcp_sent_cb);
@@ -324,7 +334,7 @@ user_tcp_server_connect_cb(void *arg)
     espconn_regist_time(pespconn, 60, 1);
     /* Disable Nagle algorithm */
     if (espconn_set_opt(pespconn, ESPCONN_NODELAY) != 0) {
-        PORT_PRINTF("Error disabling Nagle algorithm (incoming connection)");
+        USER_TRACE(TCP_NODELAY_FAIL, 0, 0);
     }
     
     struct active_conn_entry *conn_entry = (struct active_conn_entry*) os_malloc(sizeof (struct active_conn_entry));
@@ -337,6 +347,7 @@ user_tcp_server_connect_cb(void *arg)
     }
     
     wish_core_signal_tcp_event(user_get_core_instance(), connection, TCP_CLIENT_CONNECTED);
+    USER_STACK_EXIT(USER_STACK_PROBE_TCP_CONNECT);
 }
 
 /* Use this function the post data to be sent using TCP.
@@ -350,17 +361,19 @@ my_send_data(void *pespconn, unsigned char* data, int len)
 
     struct fifo_entry *e = (struct fifo_entry *) os_malloc(sizeof (struct fifo_entry));
     if (e == NULL) {
-        PORT_PRINTF("Out of memory when sending data!\n");
+        USER_TRACE(TCP_SEND_OOM, len, 0);
         return -1;
     }
     memset(e, 0, sizeof (struct fifo_entry));
     e->data = (char *) os_malloc(len);
     if (e->data == NULL) {
-        PORT_PRINTF("Out of memory when sending data!\n");
+        USER_TRACE(TCP_SEND_OOM, len, 0);
         return -1;
     }
     memcpy(e->data, data, len);
     e->data_len = len;
+    user_metric_add(USER_METRIC_TCP_TX_BYTES, len);
+    user_metric_add(USER_METRIC_TCP_TX_FRAMES, 1);
 
     struct active_conn_entry *conn;
     LL_FOREACH(active_conn_head, conn) {
@@ -369,11 +382,11 @@ my_send_data(void *pespconn, unsigned char* data, int len)
             LL_APPEND(conn->fifo_head, e);
 
             if (conn->busy) {
-                PORT_PRINTF("Send deferred!\n");
+                USER_TRACE(TCP_SEND_DEFERRED, len, 0);
             }
             else {
                 /* busy is false */
-                PORT_PRINTF("Sending now!\n");
+                USER_TRACE(TCP_SEND_NOW, len, 0);
                 sint8 ret = espconn_send(conn->espconn, conn->fifo_head->data, conn->fifo_head->data_len);
                 
                 if ( ret == ESPCONN_OK) {
@@ -381,14 +394,14 @@ my_send_data(void *pespconn, unsigned char* data, int len)
                     conn->busy = true;
                 }
                 else if ( ret == ESPCONN_MAXNUM) {
-                    PORT_PRINTF("my_send_data: Send buffers full - will try later\n");
+                    USER_TRACE(TCP_SEND_RETRY, len, 0);
                 }
                 else {
                     /* failed send, and we don't think we can recover it. 
                      * ESPCONN_MEM out of memory
                      * ESPCONN_ARG illegal espconn structure
                      * ?? */
-                    PORT_PRINTF("Failed sending data, dropping the data, ret = %d\n", ret);
+                    USER_TRACE(TCP_SEND_FAIL, ret, len);
                     LL_DELETE(conn->fifo_head, e);
                     os_free(e->data);
                     os_free(e);
@@ -418,6 +431,7 @@ LOCAL void ICACHE_FLASH_ATTR
 user_tcp_connect_cb(void *arg)
 {
     struct espconn *pespconn = arg;
+    USER_STACK_ENTER(USER_STACK_PROBE_TCP_CONNECT);
 
     espconn_regist_recvcb(pespconn, user_tcp_recv_cb);
     espconn_regist_sentcb(pespconn, user_tcp_sent_cb);
@@ -432,12 +446,11 @@ user_tcp_connect_cb(void *arg)
     connection->local_port = pespconn->proto.tcp->local_port;
     connection->remote_port = pespconn->proto.tcp->remote_port;
  
-    PORT_PRINTF("Connected to %d.%d.%d.%d:%d\r\n", 
-        connection->remote_ip_addr[0], connection->remote_ip_addr[1], connection->remote_ip_addr[2], connection->remote_ip_addr[3], connection->remote_port);
+    USER_TRACE(TCP_CONNECTED, USER_TRACE_IP(connection->remote_ip_addr), connection->remote_port);
 
     /* Disable Nagle algorithm */
     if (espconn_set_opt(pespconn, ESPCONN_NODELAY) != 0) {
-        PORT_PRINTF("Error disabling Nagle algorithm (outgoing connection)");
+        USER_TRACE(TCP_NODELAY_FAIL, 1, 0);
     }
     
     struct active_conn_entry *conn_entry = (struct active_conn_entry*) os_malloc(sizeof (struct active_conn_entry));
@@ -457,6 +470,7 @@ user_tcp_connect_cb(void *arg)
         /* For connections opened normally */
         wish_core_signal_tcp_event(user_get_core_instance(), connection, TCP_CONNECTED);
     }
+    USER_STACK_EXIT(USER_STACK_PROBE_TCP_CONNECT);
 }
 
 /******************************************************************************
@@ -468,19 +482,16 @@ user_tcp_connect_cb(void *arg)
 LOCAL void ICACHE_FLASH_ATTR
 user_tcp_recon_cb(void *arg, sint8 err)
 {
+    USER_STACK_ENTER(USER_STACK_PROBE_TCP_RECON);
     //PORT_PRINTF("reconnect callback, error code %d !!! \r\n", err);
     //error occured , tcp connection broke. user can try to reconnect here.
     if (arg == NULL) {
-        PORT_PRINTF("user_tcp_recon_cb arg is NULL");
+        USER_TRACE(TCP_RECON_NULL, 0, 0);
+        USER_STACK_EXIT(USER_STACK_PROBE_TCP_RECON);
         return;
     }
     struct espconn *espconn = arg;
-    PORT_PRINTF("error occurred (outgoing connection), IP: %d.%d.%d.%d err=%d\n\r", 
-        espconn->proto.tcp->remote_ip[0],
-        espconn->proto.tcp->remote_ip[1],
-        espconn->proto.tcp->remote_ip[2],
-        espconn->proto.tcp->remote_ip[3],
-        err);
+    USER_TRACE(TCP_RECON, USER_TRACE_IP(espconn->proto.tcp->remote_ip), err);
     wish_connection_t* connection 
         = wish_identify_context(user_get_core_instance(), espconn->proto.tcp->remote_ip,
             espconn->proto.tcp->remote_port, 
@@ -497,6 +508,7 @@ user_tcp_recon_cb(void *arg, sint8 err)
     if (connection == NULL) {
         //os_free(espconn->proto.tcp);
         //os_free(espconn);
+        USER_STACK_EXIT(USER_STACK_PROBE_TCP_RECON);
         return;
     }
 
@@ -506,6 +518,7 @@ user_tcp_recon_cb(void *arg, sint8 err)
     
     //os_free(espconn->proto.tcp);
     //os_free(espconn);
+    USER_STACK_EXIT(USER_STACK_PROBE_TCP_RECON);
 }
 
 /******************************************************************************
@@ -517,14 +530,10 @@ user_tcp_recon_cb(void *arg, sint8 err)
 LOCAL void ICACHE_FLASH_ATTR
 user_tcp_server_recon_cb(void *arg, sint8 err)
 {
+    USER_STACK_ENTER(USER_STACK_PROBE_TCP_RECON);
     //error occured , tcp connection broke. user can try to reconnect here. 
     struct espconn *espconn = arg;
-    PORT_PRINTF("error occurred (incoming connection) IP: %d.%d.%d.%d err=%d\n\r", 
-        espconn->proto.tcp->remote_ip[0],
-        espconn->proto.tcp->remote_ip[1],
-        espconn->proto.tcp->remote_ip[2],
-        espconn->proto.tcp->remote_ip[3],
-        err);
+    USER_TRACE(TCP_SERVER_RECON, USER_TRACE_IP(espconn->proto.tcp->remote_ip), err);
     
     wish_connection_t* connection 
         = wish_identify_context(user_get_core_instance(), espconn->proto.tcp->remote_ip,
@@ -542,11 +551,13 @@ user_tcp_server_recon_cb(void *arg, sint8 err)
     
     
     if (connection == NULL) {
+        USER_STACK_EXIT(USER_STACK_PROBE_TCP_RECON);
         return;
     }
     
     cleanup_active_conn(connection);
-    wish_core_signal_tcp_event(user_get_core_instance(), connection, TCP_DISCONNECTED);  
+    wish_core_signal_tcp_event(user_get_core_instance(), connection, TCP_DISCONNECTED);
+    USER_STACK_EXIT(USER_STACK_PROBE_TCP_RECON);
 }
 
 
@@ -609,19 +620,16 @@ user_dns_found(const char *name, ip_addr_t * ipaddr, void *arg)
     struct espconn *pespconn = (struct espconn *) arg;
 
     if (ipaddr == NULL) {
-        PORT_PRINTF("user_dns_found NULL \r\n");
+        USER_TRACE(TCP_DNS_NULL, 0, 0);
         return;
     }
 
     //dns got ip
-    PORT_PRINTF("user_dns_found %d.%d.%d.%d \r\n",
-              *((uint8 *) & ipaddr->addr), *((uint8 *) & ipaddr->addr + 1),
-              *((uint8 *) & ipaddr->addr + 2),
-              *((uint8 *) & ipaddr->addr + 3));
+    USER_TRACE(TCP_DNS_FOUND, USER_TRACE_IP((uint8 *) &ipaddr->addr), 0);
 
     if (tcp_server_ip.addr == 0 && ipaddr->addr != 0) {
         // dns succeed, create tcp connection
-        os_timer_disarm(&test_timer);
+        user_timer_disarm(&test_timer);
         user_connect_tcp(pespconn, ipaddr);
 
     }
@@ -640,7 +648,7 @@ user_dns_check_cb(void *arg)
 
     espconn_gethostbyname(pespconn, TEST_HOSTNAME, &tcp_server_ip, user_dns_found);     // recall DNS function
 
-    os_timer_arm(&test_timer, 1000, 0);
+    user_timer_arm(&test_timer, 1000, false);
 }
 
 
@@ -659,13 +667,13 @@ user_check_ip(void)
     struct ip_info ipconfig;
 
     //disarm timer first
-    os_timer_disarm(&test_timer);
+    user_timer_disarm(&test_timer);
 
     //get ip info of ESP8266 station
     wifi_get_ip_info(STATION_IF, &ipconfig);
     //PORT_PRINTF("wifi connect status = %d\n\r", wifi_station_get_connect_status());
     if (wifi_station_get_connect_status() == STATION_GOT_IP && ipconfig.ip.addr != 0) {
-        PORT_PRINTF("user_check_ip: Got IP address.\r\n");
+        USER_TRACE(TCP_GOT_IP, ipconfig.ip.addr, 0);
 
         static bool server_started = false;
         if (!server_started) {
@@ -687,13 +695,13 @@ user_check_ip(void)
         if ((wifi_station_get_connect_status() == STATION_WRONG_PASSWORD ||
              wifi_station_get_connect_status() == STATION_NO_AP_FOUND ||
              wifi_station_get_connect_status() == STATION_CONNECT_FAIL)) {
-            PORT_PRINTF("user_check_ip: Connect fail status=%d\r\n", wifi_station_get_connect_status());
+            USER_TRACE(TCP_CONNECT_FAIL, wifi_station_get_connect_status(), 0);
         }
         else {
             //re-arm timer to check ip
-            os_timer_setfn(&test_timer,
-                           (os_timer_func_t *) user_check_ip, NULL);
-            os_timer_arm(&test_timer, 100, 0);
+            user_timer_setfn(&test_timer,
+                           (user_timer_func_t *) user_check_ip, NULL);
+            user_timer_arm(&test_timer, 100, false);
         }
     }
 }
@@ -701,9 +709,9 @@ user_check_ip(void)
 
 void ICACHE_FLASH_ATTR user_tcp_setup_dhcp_check(void) {
     //set a timer to check whether got ip from router succeed or not.
-    os_timer_disarm(&test_timer);
-    os_timer_setfn(&test_timer, (os_timer_func_t *) user_check_ip, NULL);
-    os_timer_arm(&test_timer, 100, 0);
+    user_timer_disarm(&test_timer);
+    user_timer_setfn(&test_timer, (user_timer_func_t *) user_check_ip, NULL);
+    user_timer_arm(&test_timer, 100, false);
 }
 
 /* TCP connection structures for the server */
@@ -729,7 +737,7 @@ void user_start_server(void) {
 
 void user_stop_server(void) {
     if (espconn_delete(&server_espconn)) {
-        PORT_PRINTF("Could not stop server correctly\n");
+        USER_TRACE(TCP_SERVER_STOP_FAIL, 0, 0);
     }
 }
 
@@ -766,6 +774,13 @@ int wish_open_connection(wish_core_t *core, wish_connection_t *ctx, wish_ip_addr
 
 
 void wish_close_connection(wish_core_t *core, wish_connection_t *ctx) {
+#if WITH_UART_TRANSPORT
+    if (user_uart_wish_is_connection(ctx)) {
+        user_uart_wish_close(ctx);
+        return;
+    }
+#endif
+
     if (ctx->context_state != WISH_CONTEXT_CLOSING) {
         ctx->context_state = WISH_CONTEXT_CLOSING;
         ctx->close_timestamp = wish_time_get_relative(core);
@@ -779,16 +794,16 @@ void wish_close_connection(wish_core_t *core, wish_connection_t *ctx) {
     }
     else {
         if (ctx->send_arg != NULL) {
-            PORT_PRINTF("Explicit connection disconnect\n\r");
+            USER_TRACE(TCP_CLOSE, ctx, 0);
             int8_t ret = espconn_disconnect(ctx->send_arg);
             if (ret != 0) {
-                PORT_PRINTF("Disconnect fail\n\r");
+                USER_TRACE(TCP_CLOSE_FAIL, ctx, ret);
             }
         }
         else {
             /* espconn is null. Perhaps this occurs because the connection was never properly
              * started? */
-            PORT_PRINTF("Skipping espconn disconnect, espconn struct is null.");
+            USER_TRACE(TCP_CLOSE_NO_ESPCONN, ctx, 0);
             /* The connection is not really opened anyway, so it should be safe to just discard the connection. */
             cleanup_active_conn(ctx);
             wish_core_signal_tcp_event(core, ctx, TCP_DISCONNECTED);
@@ -798,7 +813,7 @@ void wish_close_connection(wish_core_t *core, wish_connection_t *ctx) {
 
 int wish_get_host_ip_str(wish_core_t *core, char* addr_str, size_t addr_str_len) {
     if (addr_str_len < 4*3+3+1) {
-        PORT_PRINTF("IP addr buffer too small\n\r");
+        USER_TRACE(TCP_IP_STR_SHORT, addr_str_len, 0);
     }
     struct ip_info info;
 
@@ -0,0 +1,264 @@
+/*
+ * Hierarchical timer wheel, see user_timer.h
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "c_types.h"
+#include "os_type.h"
+#include "osapi.h"
+#include "user_interface.h"
+#include "espmissingincludes.h"
+
+#include "utlist.h"
+
+#include "user_timer.h"
+
+#define TICK_US (USER_TIMER_TICK_MS * 1000)
+
+/* Each level of the wheel has WHEEL_SLOTS slots, and a slot on level n
+ * spans WHEEL_SLOTS^n ticks. With three levels of 32 slots the wheel
+ * covers 32768 ticks, which is about 5 minutes. Timers further in the
+ * future are parked on the last slot, and re-inserted when the slot
+ * cascades. */
+#define WHEEL_BITS 5
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS 3
+#define WHEEL_RANGE (1 << (WHEEL_BITS * WHEEL_LEVELS))
+
+static struct user_timer *wheel[WHEEL_LEVELS][WHEEL_SLOTS];
+
+/* The last tick which has been processed */
+static uint32_t wheel_now;
+/* The system_get_time() value corresponding to wheel_now */
+static uint32_t wheel_time_us;
+static int num_armed;
+
+/* The one and only os_timer, driving the wheel */
+static os_timer_t wheel_timer;
+static bool wheel_timer_init;
+/* The tick the os_timer has been armed for, valid when wheel_scheduled */
+static uint32_t wheel_next;
+static bool wheel_scheduled;
+/* True while the wheel is calling timer callbacks */
+static bool wheel_running;
+
+static void wheel_timer_cb(void *arg);
+
+/* The tick which is current in real time. This can be ahead of wheel_now
+ * if the os_timer has not fired yet. */
+static uint32_t wheel_real_now(void) {
+    return wheel_now + (system_get_time() - wheel_time_us) / TICK_US;
+}
+
+/* Round up a deadline which is 'ticks' ticks away, so that deadlines
+ * with similar intervals land on the same tick. The deadline may be
+ * pushed later by at most 1/16 of the interval. */
+static uint32_t wheel_round(uint32_t expires, uint32_t ticks) {
+    uint32_t slack = ticks >> 4;
+    uint32_t granularity = 1;
+    while (granularity * 2 <= slack) {
+        granularity *= 2;
+    }
+    return (expires + granularity - 1) & ~(granularity - 1);
+}
+
+static void wheel_insert(struct user_timer *timer) {
+    uint32_t expires = timer->expires;
+    uint32_t delta = expires - wheel_now;
+    if (delta >= WHEEL_RANGE) {
+        /* Park it on the last slot, it will be re-inserted from there */
+        delta = WHEEL_RANGE - 1;
+        expires = wheel_now + delta;
+    }
+
+    int level = 0;
+    while (delta >= (1 << ((level + 1) * WHEEL_BITS))) {
+        level++;
+    }
+    uint32_t slot = (expires >> (level * WHEEL_BITS)) & WHEEL_MASK;
+    timer->slot = &wheel[level][slot];
+    DL_APPEND(*timer->slot, timer);
+}
+
+/* Move all the timers of a slot to the lower levels */
+static void wheel_cascade(int level, uint32_t slot) {
+    struct user_timer *timer = NULL;
+    while ((timer = wheel[level][slot]) != NULL) {
+        DL_DELETE(wheel[level][slot], timer);
+        wheel_insert(timer);
+    }
+}
+
+/* Advance the wheel by one tick, and run the timers which expire */
+static void wheel_tick(void) {
+    wheel_now++;
+    wheel_time_us += TICK_US;
+
+    uint32_t slot = wheel_now & WHEEL_MASK;
+    if (slot == 0) {
+        int level = 0;
+        for (level = 1; level < WHEEL_LEVELS; level++) {
+            uint32_t level_slot = (wheel_now >> (level * WHEEL_BITS)) & WHEEL_MASK;
+            wheel_cascade(level, level_slot);
+            if (level_slot != 0) {
+                break;
+            }
+        }
+    }
+
+    struct user_timer *timer = NULL;
+    while ((timer = wheel[0][slot]) != NULL) {
+        DL_DELETE(wheel[0][slot], timer);
+        if (timer->period > 0) {
+            timer->expires = wheel_round(wheel_now + timer->period, timer->period);
+            wheel_insert(timer);
+        }
+        else {
+            timer->armed = false;
+            num_armed--;
+        }
+        timer->func(timer->arg);
+    }
+}
+
+/* Is there something to do on tick t, either timers expiring or a
+ * non-empty slot to cascade */
+static bool wheel_tick_pending(uint32_t t) {
+    if (wheel[0][t & WHEEL_MASK] != NULL) {
+        return true;
+    }
+    int level = 0;
+    for (level = 1; level < WHEEL_LEVELS; level++) {
+        if (t & ((1 << (level * WHEEL_BITS)) - 1)) {
+            break;
+        }
+        if (wheel[level][(t >> (level * WHEEL_BITS)) & WHEEL_MASK] != NULL) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Find the next tick on which the wheel must run. This looks at each
+ * slot at most once: the ticks of the first rotation of level 0, then
+ * the ticks on which level 1 cascades, and so on. */
+static uint32_t wheel_next_event(void) {
+    uint32_t t = wheel_now + 1;
+    uint32_t step = 1;
+    int level = 0;
+    for (level = 0; level < WHEEL_LEVELS; level++) {
+        int i = 0;
+        for (i = 0; i < WHEEL_SLOTS; i++) {
+            if (wheel_tick_pending(t)) {
+                return t;
+            }
+            t += step;
+        }
+        step <<= WHEEL_BITS;
+        t = (t + step - 1) & ~(step - 1);
+    }
+    /* Only timers parked beyond the range of the wheel */
+    return t;
+}
+
+/* Arm the os_timer for the next tick on which there is something to do.
+ * When there are no timers, the os_timer is left disarmed. */
+static void wheel_schedule(void) {
+    os_timer_disarm(&wheel_timer);
+    wheel_scheduled = false;
+    if (num_armed == 0) {
+        return;
+    }
+
+    wheel_next = wheel_next_event();
+    int32_t delay_us = wheel_time_us + (wheel_next - wheel_now) * TICK_US
+        - system_get_time();
+    uint32_t delay_ms = 1;
+    if (delay_us > 0) {
+        delay_ms = (delay_us + 999) / 1000;
+    }
+    os_timer_arm(&wheel_timer, delay_ms, 0);
+    wheel_scheduled = true;
+}
+
+static void wheel_timer_cb(void *arg) {
+    uint32_t elapsed = (system_get_time() - wheel_time_us) / TICK_US;
+
+    wheel_running = true;
+    while (elapsed > 0) {
+        wheel_tick();
+        elapsed--;
+    }
+    wheel_running = false;
+
+    wheel_schedule();
+}
+
+void user_timer_setfn(struct user_timer *timer, user_timer_func_t *func, void *arg) {
+    timer->func = func;
+    timer->arg = arg;
+}
+
+void user_timer_arm(struct user_timer *timer, uint32_t ms, bool repeat) {
+    if (!wheel_timer_init) {
+        os_timer_setfn(&wheel_timer, (os_timer_func_t *) wheel_timer_cb, NULL);
+        wheel_timer_init = true;
+    }
+
+    user_timer_disarm(timer);
+
+    if (num_armed == 0 && !wheel_running) {
+        /* The wheel has been idle, just bring it up to date */
+        wheel_time_us = system_get_time();
+    }
+
+    uint32_t ticks = (ms + USER_TIMER_TICK_MS - 1) / USER_TIMER_TICK_MS;
+    if (ticks == 0) {
+        ticks = 1;
+    }
+    timer->expires = wheel_round(wheel_real_now() + ticks, ticks);
+    timer->period = repeat ? ticks : 0;
+    timer->armed = true;
+    num_armed++;
+    wheel_insert(timer);
+
+    /* When called from a timer callback, the wheel is re-scheduled
+     * anyway once all callbacks have run */
+    if (!wheel_running &&
+            (!wheel_scheduled || (int32_t) (timer->expires - wheel_next) < 0)) {
+        wheel_schedule();
+    }
+}
+
+void user_timer_disarm(struct user_timer *timer) {
+    if (!timer->armed) {
+        return;
+    }
+
+    DL_DELETE(*timer->slot, timer);
+    timer->armed = false;
+    num_armed--;
+
+    if (num_armed == 0 && !wheel_running) {
+        /* Nothing to wait for, let the system sleep */
+        os_timer_disarm(&wheel_timer);
+        wheel_scheduled = false;
+    }
+}
+
+int32_t user_timer_get_next_ms(void) {
+    if (num_armed == 0) {
+        return -1;
+    }
+    uint32_t next = wheel_next_event();
+    int32_t delay_us = wheel_time_us + (next - wheel_now) * TICK_US
+        - system_get_time();
+    if (delay_us < 0) {
+        return 0;
+    }
+    return delay_us / 1000;
+}
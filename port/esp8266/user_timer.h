@@ -0,0 +1,63 @@
+#ifndef USER_TIMER_H
+#define USER_TIMER_H
+
+/* Hierarchical timer wheel.
+ *
+ * All periodic activity of the port (the Wish time base, local
+ * discovery broadcasts, the DHCP check, button polling and so on) is
+ * registered here instead of each having an os_timer of its own. The
+ * wheel is driven by a single one-shot os_timer, which is always armed
+ * for the next tick on which something actually happens, so idle ticks
+ * cost nothing, and when no timers are armed there are no wakeups at
+ * all.
+ *
+ * Arming and disarming a timer are O(1). Deadlines are rounded up by a
+ * small amount (1/16 of the interval, at most), so that timers with
+ * nearly the same deadline expire on the same wakeup.
+ *
+ * The API mirrors the os_timer API, and the same rules apply: the
+ * struct user_timer must stay valid while it is armed, and the
+ * callbacks run in task context. A struct user_timer must be zeroed
+ * before first use, which static variables are. A callback may arm or disarm any
+ * timer, including its own. */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* The resolution of the wheel */
+#define USER_TIMER_TICK_MS 10
+
+typedef void user_timer_func_t(void *arg);
+
+struct user_timer {
+    struct user_timer *prev;
+    struct user_timer *next;
+    /* The wheel slot the timer is linked into, so that it can be
+     * removed without searching for it */
+    struct user_timer **slot;
+    /* The tick on which the timer expires */
+    uint32_t expires;
+    /* Interval in ticks for periodic timers, 0 for one-shot timers */
+    uint32_t period;
+    user_timer_func_t *func;
+    void *arg;
+    bool armed;
+};
+
+/* Set the callback function of a timer. The timer must not be armed. */
+void user_timer_setfn(struct user_timer *timer, user_timer_func_t *func, void *arg);
+
+/* Arm the timer to expire after 'ms' milliseconds, and then every 'ms'
+ * milliseconds if 'repeat' is true. Arming an already armed timer
+ * re-schedules it. */
+void user_timer_arm(struct user_timer *timer, uint32_t ms, bool repeat);
+
+/* Disarm the timer. It is safe to disarm a timer which is not armed. */
+void user_timer_disarm(struct user_timer *timer);
+
+/* Milliseconds until the wheel needs to run next, or -1 if there are no
+ * timers armed. This is the amount of time the system could spend in
+ * light-sleep. */
+int32_t user_timer_get_next_ms(void);
+
+#endif //USER_TIMER_H
@@ -0,0 +1,65 @@
+/*
+ * Binary trace ring buffer, see user_trace.h
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "osapi.h"
+#include "user_interface.h"
+#include "espmissingincludes.h"
+
+#include "user_trace.h"
+
+#define TRACE_MASK (USER_TRACE_RING_LEN - 1)
+
+static struct user_trace_entry trace_ring[USER_TRACE_RING_LEN];
+/* Number of events ever recorded. The next event goes to
+ * trace_ring[trace_head & TRACE_MASK] */
+static uint32_t trace_head;
+/* Number of events drained to the UART, or skipped because they were
+ * overwritten */
+static uint32_t trace_tail;
+
+void user_trace(enum user_trace_event event, uint32_t arg0, uint32_t arg1) {
+    struct user_trace_entry *e = &trace_ring[trace_head & TRACE_MASK];
+    e->timestamp = system_get_time();
+    e->event = event;
+    e->arg0 = arg0;
+    e->arg1 = arg1;
+    trace_head++;
+}
+
+void user_trace_drain(int max_events) {
+    if (trace_head - trace_tail > USER_TRACE_RING_LEN) {
+        uint32_t lost = trace_head - trace_tail - USER_TRACE_RING_LEN;
+        os_printf("TRC lost %d\n\r", lost);
+        trace_tail += lost;
+    }
+
+    while (trace_tail != trace_head && max_events > 0) {
+        struct user_trace_entry *e = &trace_ring[trace_tail & TRACE_MASK];
+        os_printf("TRC %x %x %x %x\n\r", e->timestamp, e->event, e->arg0, e->arg1);
+        trace_tail++;
+        max_events--;
+    }
+}
+
+size_t user_trace_snapshot(uint8_t *buf, size_t buf_len, uint32_t *lost) {
+    uint32_t count = trace_head < USER_TRACE_RING_LEN ? trace_head : USER_TRACE_RING_LEN;
+    uint32_t first = trace_head - count;
+    if (count * sizeof(struct user_trace_entry) > buf_len) {
+        /* Return the newest events which fit */
+        count = buf_len / sizeof(struct user_trace_entry);
+        first = trace_head - count;
+    }
+
+    uint32_t i = 0;
+    for (i = 0; i < count; i++) {
+        memcpy(buf + i * sizeof(struct user_trace_entry),
+            &trace_ring[(first + i) & TRACE_MASK], sizeof(struct user_trace_entry));
+    }
+
+    *lost = trace_head > USER_TRACE_RING_LEN ? trace_head - USER_TRACE_RING_LEN : 0;
+    return count * sizeof(struct user_trace_entry);
+}
@@ -0,0 +1,122 @@
+#ifndef USER_TRACE_H
+#define USER_TRACE_H
+
+/* Binary trace ring buffer for hot-path events.
+ *
+ * Recording an event stores a timestamp from system_get_time(), the
+ * event id and two 32-bit arguments into a fixed-size ring in RAM.
+ * Nothing is formatted on the device: the ring is either drained to the
+ * UART as hex lines (see WITH_TRACE_UART_DRAIN), or read out as a binary
+ * blob through the "trace" endpoint of MistConfig. The host tool in
+ * tools/tracedecode turns either form into a readable timeline, using
+ * the format strings of USER_TRACE_EVENTS below.
+ *
+ * When the ring is full, the oldest events are overwritten.
+ *
+ * This header is also included by the host decoder, so it must not
+ * depend on the SDK headers. */
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Set to 0 to compile out all the trace points */
+#define WITH_USER_TRACE 1
+
+/* Set to 1 to have the ring drained to the UART once a second */
+#define WITH_TRACE_UART_DRAIN 0
+
+/* Number of events the ring can hold, must be a power of two */
+#define USER_TRACE_RING_LEN 64
+
+/* The events, and how the decoder shows their arguments. The format
+ * strings take two arguments, %u, %d and %x work as in printf, and %I
+ * prints an IPv4 address recorded with USER_TRACE_IP(). The strings are
+ * never compiled into the firmware. */
+#define USER_TRACE_EVENTS(X) \
+    X(TCP_RECV, "tcp recv from %I, %u bytes") \
+    X(TCP_RECV_TOO_LARGE, "tcp recv too large, %u > %u free, disconnecting") \
+    X(TCP_SENT_NOT_BUSY, "tcp sent cb, but connection not busy") \
+    X(TCP_SENT_FIFO_NULL, "tcp sent cb, but send fifo is empty") \
+    X(TCP_SENT_FIFO_DONE, "tcp send fifo now empty") \
+    X(TCP_SENT_RETRY, "tcp sent cb, send buffers full, will retry") \
+    X(TCP_SENT_FAIL, "tcp sent cb, send failed ret=%d, dropping data") \
+    X(TCP_CLEANUP, "tcp cleanup active connection ctx=%x") \
+    X(TCP_DISCON, "tcp disconnected (outgoing) %I:%u") \
+    X(TCP_SERVER_DISCON, "tcp disconnected (incoming) %I:%u") \
+    X(TCP_DISCON_NO_CTX, "tcp disconnect, wish context not found") \
+    X(TCP_ACCEPT_FAIL, "tcp cannot accept incoming connection now") \
+    X(TCP_ACCEPT, "tcp incoming connection from %I:%u") \
+    X(TCP_CONNECTED, "tcp connected to %I:%u") \
+    X(TCP_NODELAY_FAIL, "tcp could not disable Nagle, outgoing=%u") \
+    X(TCP_SEND_OOM, "tcp out of memory queueing %u bytes") \
+    X(TCP_SEND_DEFERRED, "tcp send deferred, %u bytes") \
+    X(TCP_SEND_NOW, "tcp send now, %u bytes") \
+    X(TCP_SEND_RETRY, "tcp send buffers full, will retry, %u bytes") \
+    X(TCP_SEND_FAIL, "tcp send failed ret=%d, dropping %u bytes") \
+    X(TCP_RECON_NULL, "tcp error cb without espconn") \
+    X(TCP_RECON, "tcp error (outgoing) %I err=%d") \
+    X(TCP_SERVER_RECON, "tcp error (incoming) %I err=%d") \
+    X(TCP_DNS_NULL, "dns lookup failed") \
+    X(TCP_DNS_FOUND, "dns found %I") \
+    X(TCP_GOT_IP, "got ip address %I") \
+    X(TCP_CONNECT_FAIL, "station connect failed, status=%u") \
+    X(TCP_SERVER_STOP_FAIL, "could not stop server") \
+    X(TCP_CLOSE, "explicit disconnect ctx=%x") \
+    X(TCP_CLOSE_FAIL, "disconnect failed ctx=%x ret=%d") \
+    X(TCP_CLOSE_NO_ESPCONN, "disconnect skipped, no espconn ctx=%x") \
+    X(TCP_IP_STR_SHORT, "ip address buffer too small, %u bytes") \
+    X(IPC_QUEUE_EMPTY, "ipc task run with empty queue") \
+    X(IPC_DEFER, "ipc deferred, tcp send queue length %u") \
+    X(IPC_PROCESS, "ipc process event type=%u, %u bytes") \
+    X(IPC_BAD_EVENT, "ipc bad event type=%u") \
+    X(IPC_QUEUE_DRAINED, "ipc queue drained") \
+    X(IPC_ENQUEUE, "ipc enqueue event type=%u, %u bytes") \
+    X(IPC_EVENT_OOM, "ipc out of memory for event type=%u") \
+    X(IPC_DATA_OOM, "ipc out of memory for event type=%u, %u bytes") \
+    X(UART_LINK_OPEN, "uart link opened by peer") \
+    X(UART_LINK_CLOSED, "uart link closed, crc errors %u, seq errors %u") \
+    X(UART_LINK_NO_CONN, "uart link cannot get a wish connection") \
+    X(UART_LINK_RX_OVERFLOW, "uart link rx %u bytes > %u free")
+
+enum user_trace_event {
+#define USER_TRACE_ENUM(id, fmt) USER_TRACE_##id,
+    USER_TRACE_EVENTS(USER_TRACE_ENUM)
+#undef USER_TRACE_ENUM
+    USER_TRACE_EVENT_MAX,
+};
+
+/* One event in the ring. This is also the record format of the binary
+ * blob returned by user_trace_snapshot(), in little-endian byte order. */
+struct user_trace_entry {
+    uint32_t timestamp;
+    uint32_t event;
+    uint32_t arg0;
+    uint32_t arg1;
+};
+
+/* Pack an IPv4 address given as four bytes into one trace argument */
+#define USER_TRACE_IP(ip) ((uint32_t) (ip)[0] | (uint32_t) (ip)[1] << 8 | \
+    (uint32_t) (ip)[2] << 16 | (uint32_t) (ip)[3] << 24)
+
+#if WITH_USER_TRACE
+#define USER_TRACE(event, arg0, arg1) \
+    user_trace(USER_TRACE_##event, (uint32_t) (arg0), (uint32_t) (arg1))
+#else
+#define USER_TRACE(event, arg0, arg1)
+#endif
+
+void user_trace(enum user_trace_event event, uint32_t arg0, uint32_t arg1);
+
+/* Print at most 'max_events' not yet drained events to the UART, one hex
+ * line "TRC <timestamp> <event> <arg0> <arg1>" per event. Events which
+ * were overwritten before they could be drained are reported with a
+ * "TRC lost <n>" line. */
+void user_trace_drain(int max_events);
+
+/* Copy the events currently in the ring, oldest first, into 'buf'.
+ * Returns the number of bytes copied, which is a multiple of
+ * sizeof(struct user_trace_entry). The total number of events which
+ * have ever been overwritten is stored to 'lost'. */
+size_t user_trace_snapshot(uint8_t *buf, size_t buf_len, uint32_t *lost);
+
+#endif //USER_TRACE_H
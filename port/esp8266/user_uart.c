@@ -0,0 +1,83 @@
+/*
+ * Framed communication over UART0, see user_uart.h
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "osapi.h"
+#include "os_type.h"
+#include "user_interface.h"
+#include "espmissingincludes.h"
+
+#include "driver/uart.h"
+
+#include "user_task.h"
+#include "user_slip.h"
+#include "user_metrics.h"
+#include "user_stack.h"
+#include "user_uart.h"
+
+/* How many bytes to read from the rx ring at a time */
+#define RX_CHUNK_LEN 64
+/* How many bytes to encode at a time when sending */
+#define TX_CHUNK_LEN 64
+
+static os_event_t uart_rx_queue[UART_RX_QUEUE_LEN];
+
+static uint8_t rx_frame_buf[USER_UART_MAX_FRAME_LEN];
+static struct user_slip_decoder rx_decoder;
+static user_uart_frame_cb_t *rx_frame_cb;
+
+static void slip_frame_cb(uint8_t *frame, size_t len, void *ctx) {
+    user_metric_add(USER_METRIC_UART_RX_FRAMES, 1);
+    rx_frame_cb(frame, len);
+}
+
+static void uart_rx_task(os_event_t *e) {
+    USER_STACK_ENTER(USER_STACK_PROBE_UART_RX);
+    /* Anything arriving from now on posts the task again */
+    uart0_rx_ring_ack();
+
+    uint32_t errors = rx_decoder.errors;
+    uint8_t chunk[RX_CHUNK_LEN];
+    uint16 n = 0;
+    while ((n = uart0_rx_ring_read(chunk, sizeof(chunk))) > 0) {
+        user_slip_decode(&rx_decoder, chunk, n, slip_frame_cb, NULL);
+    }
+    user_metric_add(USER_METRIC_UART_RX_ERRORS, rx_decoder.errors - errors);
+    USER_STACK_EXIT(USER_STACK_PROBE_UART_RX);
+}
+
+void user_uart_frames_init(uint32_t baud_rate, user_uart_frame_cb_t *frame_cb) {
+    rx_frame_cb = frame_cb;
+    user_slip_decoder_init(&rx_decoder, rx_frame_buf, sizeof(rx_frame_buf));
+
+    UART_SetPrintPort(UART1);
+    UART_WaitTxFifoEmpty(UART0, 100000);
+    UART_SetBaudrate(UART0, baud_rate);
+
+    system_os_task(uart_rx_task, UART_RX_TASK_ID, uart_rx_queue, UART_RX_QUEUE_LEN);
+    uart0_rx_ring_enable(UART_RX_TASK_ID, USER_UART_RX_FULL_THRESH, USER_UART_RX_TOUT_THRESH);
+}
+
+bool user_uart_send_frame(const uint8_t *frame, size_t len) {
+    if (UART_TX_RING_SIZE - uart0_tx_ring_pending() < USER_SLIP_MAX_ENCODED_LEN(len)) {
+        return false;
+    }
+
+    uint8_t chunk[TX_CHUNK_LEN];
+    chunk[0] = USER_SLIP_END;
+    uart0_tx_buffer(chunk, 1);
+    while (len > 0) {
+        size_t used = 0;
+        size_t n = user_slip_encode(frame, len, &used, chunk, sizeof(chunk));
+        uart0_tx_buffer(chunk, n);
+        frame += used;
+        len -= used;
+    }
+    chunk[0] = USER_SLIP_END;
+    uart0_tx_buffer(chunk, 1);
+    return true;
+}
@@ -0,0 +1,41 @@
+#ifndef USER_UART_H
+#define USER_UART_H
+
+/* Framed communication over UART0.
+ *
+ * The rx interrupt moves the received bytes to the rx ring of the uart
+ * driver, and the UART_RX_TASK_ID task runs them through a SLIP decoder
+ * (see user_slip.h), calling back with each complete frame. Frames are
+ * sent through the tx ring of the driver, so sending never waits for
+ * the line.
+ *
+ * While framing is active, os_printf output is moved to UART1 (GPIO2),
+ * as text on UART0 would be seen as garbage frames by the other end. */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* The largest frame which can be received. Even with every byte
+ * escaped, a frame must fit in the tx ring of the uart driver. */
+#define USER_UART_MAX_FRAME_LEN 256
+
+/* The rx interrupt fires when the hardware fifo (128 bytes) has this
+ * many bytes, or when the line has been idle for USER_UART_RX_TOUT_THRESH
+ * byte times with something in the fifo. At 921600 baud the remaining
+ * 64 bytes of fifo give the interrupt 0.7 ms to respond. */
+#define USER_UART_RX_FULL_THRESH 64
+#define USER_UART_RX_TOUT_THRESH 4
+
+/* Called in task context with each received frame. The frame is only
+ * valid during the call. */
+typedef void user_uart_frame_cb_t(uint8_t *frame, size_t len);
+
+/* Switch UART0 to 'baud_rate' and start receiving frames */
+void user_uart_frames_init(uint32_t baud_rate, user_uart_frame_cb_t *frame_cb);
+
+/* Queue a frame for sending. Returns false, and queues nothing, if the tx
+ * ring does not have room for the frame. */
+bool user_uart_send_frame(const uint8_t *frame, size_t len);
+
+#endif //USER_UART_H
@@ -0,0 +1,262 @@
+/*
+ * Reliable byte stream over UART frames, see user_uart_link.h
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "user_crc.h"
+#include "user_uart_link.h"
+
+static void put_u32(uint8_t *p, uint32_t v) {
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static uint32_t get_u32(const uint8_t *p) {
+    return (uint32_t) p[0] << 24 | (uint32_t) p[1] << 16 | (uint32_t) p[2] << 8 | p[3];
+}
+
+/* Send a frame whose payload has been placed in link->frame_buf + 2 */
+static bool send_frame(struct user_uart_link *link, uint8_t type, uint8_t seq, size_t payload_len) {
+    uint8_t *f = link->frame_buf;
+    f[0] = type;
+    f[1] = seq;
+    uint16_t crc = user_crc16(f, 2 + payload_len);
+    f[2 + payload_len] = crc >> 8;
+    f[3 + payload_len] = crc & 0xff;
+    return link->ops->send_frame(link->ctx, f, payload_len + USER_UART_LINK_OVERHEAD);
+}
+
+static bool send_u32_frame(struct user_uart_link *link, uint8_t type, uint32_t value) {
+    put_u32(link->frame_buf + 2, value);
+    return send_frame(link, type, 0, 4);
+}
+
+static void reset(struct user_uart_link *link) {
+    link->tx_seq = 0;
+    link->rx_seq = 0;
+    link->tx_credit = 0;
+    link->rx_credit = 0;
+    link->tx_head = 0;
+    link->tx_tail = 0;
+    link->syn_pending = false;
+    link->syn_ack_pending = false;
+}
+
+/* The stream is broken, close the link and tell the application */
+static void abort_link(struct user_uart_link *link) {
+    if (link->state == USER_UART_LINK_CLOSED) {
+        return;
+    }
+    reset(link);
+    link->state = USER_UART_LINK_CLOSED;
+    link->fin_pending = true;
+    user_uart_link_poll(link);
+    link->ops->state_changed(link->ctx, USER_UART_LINK_CLOSED, true);
+}
+
+void user_uart_link_init(struct user_uart_link *link, const struct user_uart_link_ops *ops,
+        void *ctx, uint32_t rx_free) {
+    memset(link, 0, sizeof(struct user_uart_link));
+    link->ops = ops;
+    link->ctx = ctx;
+    link->state = USER_UART_LINK_CLOSED;
+    link->rx_free = rx_free;
+}
+
+void user_uart_link_open(struct user_uart_link *link) {
+    reset(link);
+    link->fin_pending = false;
+    link->state = USER_UART_LINK_SYN_SENT;
+    link->syn_pending = true;
+    user_uart_link_poll(link);
+}
+
+void user_uart_link_close(struct user_uart_link *link) {
+    if (link->state == USER_UART_LINK_CLOSED) {
+        return;
+    }
+    reset(link);
+    link->state = USER_UART_LINK_CLOSED;
+    link->fin_pending = true;
+    user_uart_link_poll(link);
+}
+
+static void input_data(struct user_uart_link *link, uint8_t seq, const uint8_t *data, size_t len) {
+    if (link->state != USER_UART_LINK_OPEN) {
+        return;
+    }
+    if (seq != link->rx_seq) {
+        link->seq_errors++;
+        abort_link(link);
+        return;
+    }
+    if (len > link->rx_credit) {
+        /* The other side sent more than it was allowed to */
+        link->seq_errors++;
+        abort_link(link);
+        return;
+    }
+    link->rx_seq++;
+    link->rx_credit -= len;
+    link->rx_free = link->rx_free > len ? link->rx_free - len : 0;
+    link->rx_bytes += len;
+    link->ops->recv_data(link->ctx, data, len);
+}
+
+void user_uart_link_input(struct user_uart_link *link, const uint8_t *frame, size_t len) {
+    if (len < USER_UART_LINK_OVERHEAD) {
+        link->crc_errors++;
+        abort_link(link);
+        return;
+    }
+    uint16_t crc = frame[len - 2] << 8 | frame[len - 1];
+    if (user_crc16(frame, len - 2) != crc) {
+        link->crc_errors++;
+        abort_link(link);
+        return;
+    }
+
+    uint8_t type = frame[0];
+    uint8_t seq = frame[1];
+    const uint8_t *payload = frame + 2;
+    size_t payload_len = len - USER_UART_LINK_OVERHEAD;
+
+    switch (type) {
+    case USER_UART_LINK_SYN:
+        if (payload_len != 4) {
+            break;
+        }
+        if (link->state == USER_UART_LINK_OPEN) {
+            /* The other side has restarted, the old stream is gone */
+            reset(link);
+            link->state = USER_UART_LINK_CLOSED;
+            link->ops->state_changed(link->ctx, USER_UART_LINK_CLOSED, true);
+        }
+        reset(link);
+        link->fin_pending = false;
+        link->state = USER_UART_LINK_OPEN;
+        link->tx_credit = get_u32(payload);
+        link->syn_ack_pending = true;
+        link->ops->state_changed(link->ctx, USER_UART_LINK_OPEN, true);
+        break;
+    case USER_UART_LINK_SYN_ACK:
+        if (payload_len != 4 || link->state != USER_UART_LINK_SYN_SENT) {
+            break;
+        }
+        link->state = USER_UART_LINK_OPEN;
+        link->tx_credit = get_u32(payload);
+        link->ops->state_changed(link->ctx, USER_UART_LINK_OPEN, false);
+        break;
+    case USER_UART_LINK_DATA:
+        input_data(link, seq, payload, payload_len);
+        break;
+    case USER_UART_LINK_CREDIT:
+        if (payload_len == 4 && link->state == USER_UART_LINK_OPEN) {
+            link->tx_credit += get_u32(payload);
+        }
+        break;
+    case USER_UART_LINK_FIN:
+        if (link->state != USER_UART_LINK_CLOSED) {
+            reset(link);
+            link->state = USER_UART_LINK_CLOSED;
+            link->ops->state_changed(link->ctx, USER_UART_LINK_CLOSED, true);
+        }
+        break;
+    default:
+        break;
+    }
+
+    user_uart_link_poll(link);
+}
+
+int user_uart_link_send(struct user_uart_link *link, const uint8_t *data, size_t len) {
+    if (link->state != USER_UART_LINK_OPEN) {
+        return -1;
+    }
+    if (USER_UART_LINK_TX_BUF_LEN - (link->tx_head - link->tx_tail) < len) {
+        return -1;
+    }
+
+    size_t i = 0;
+    for (i = 0; i < len; i++) {
+        link->tx_buf[link->tx_head++ % USER_UART_LINK_TX_BUF_LEN] = data[i];
+    }
+    user_uart_link_poll(link);
+    return 0;
+}
+
+void user_uart_link_set_rx_free(struct user_uart_link *link, uint32_t rx_free) {
+    link->rx_free = rx_free;
+    user_uart_link_poll(link);
+}
+
+size_t user_uart_link_tx_pending(struct user_uart_link *link) {
+    return link->tx_head - link->tx_tail;
+}
+
+void user_uart_link_poll(struct user_uart_link *link) {
+    if (link->fin_pending) {
+        if (!send_u32_frame(link, USER_UART_LINK_FIN, 0)) {
+            return;
+        }
+        link->fin_pending = false;
+    }
+    if (link->state == USER_UART_LINK_CLOSED) {
+        return;
+    }
+
+    /* The credit given in SYN and SYN_ACK is the whole receive buffer */
+    if (link->syn_pending) {
+        if (!send_u32_frame(link, USER_UART_LINK_SYN, link->rx_free)) {
+            return;
+        }
+        link->syn_pending = false;
+        link->rx_credit = link->rx_free;
+    }
+    if (link->syn_ack_pending) {
+        if (!send_u32_frame(link, USER_UART_LINK_SYN_ACK, link->rx_free)) {
+            return;
+        }
+        link->syn_ack_pending = false;
+        link->rx_credit = link->rx_free;
+    }
+    if (link->state != USER_UART_LINK_OPEN) {
+        return;
+    }
+
+    if (link->rx_free > link->rx_credit) {
+        uint32_t grant = link->rx_free - link->rx_credit;
+        if (grant >= USER_UART_LINK_MIN_GRANT || link->rx_credit == 0) {
+            if (send_u32_frame(link, USER_UART_LINK_CREDIT, grant)) {
+                link->rx_credit += grant;
+            }
+        }
+    }
+
+    while (link->tx_head != link->tx_tail && link->tx_credit > 0) {
+        size_t n = link->tx_head - link->tx_tail;
+        if (n > link->tx_credit) {
+            n = link->tx_credit;
+        }
+        if (n > USER_UART_LINK_MAX_PAYLOAD) {
+            n = USER_UART_LINK_MAX_PAYLOAD;
+        }
+        size_t i = 0;
+        for (i = 0; i < n; i++) {
+            link->frame_buf[2 + i] = link->tx_buf[(link->tx_tail + i) % USER_UART_LINK_TX_BUF_LEN];
+        }
+        if (!send_frame(link, USER_UART_LINK_DATA, link->tx_seq, n)) {
+            break;
+        }
+        link->tx_seq++;
+        link->tx_tail += n;
+        link->tx_credit -= n;
+        link->tx_bytes += n;
+    }
+}
@@ -0,0 +1,137 @@
+#ifndef USER_UART_LINK_H
+#define USER_UART_LINK_H
+
+/* A reliable byte stream over UART frames, for carrying a Wish
+ * connection over a serial line (see user_uart_wish.c).
+ *
+ * Every link frame is
+ *
+ *   type (1) | seq (1) | payload (0..USER_UART_LINK_MAX_PAYLOAD) | crc16 (2)
+ *
+ * where crc16 is CRC-16/CCITT-FALSE (user_crc.h) over type, seq and
+ * payload, most significant byte first. The frames are carried by SLIP (user_slip.h).
+ *
+ * Flow control is credit based: a side may only send as many payload
+ * bytes as the other side has granted, and the receiver grants more as
+ * its application consumes the data. So the receive buffer of the Wish
+ * core never overflows, and nothing needs to be retransmitted because
+ * of overrun. A frame with a bad CRC or an unexpected sequence number
+ * means that bytes of the stream were lost, and as the stream cannot be
+ * repaired the link is closed, just like a TCP connection which is
+ * reset. The Wish core then connects again.
+ *
+ * The link does not depend on the SDK; the frame output and the data
+ * input are callbacks, so that it can be tested on a host. */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Must not be larger than the frame size of the transport,
+ * USER_UART_MAX_FRAME_LEN */
+#define USER_UART_LINK_MAX_FRAME 256
+#define USER_UART_LINK_OVERHEAD 4
+#define USER_UART_LINK_MAX_PAYLOAD (USER_UART_LINK_MAX_FRAME - USER_UART_LINK_OVERHEAD)
+
+/* Bytes queued by user_uart_link_send() but not yet sent. A Wish frame
+ * must fit here in full. */
+#define USER_UART_LINK_TX_BUF_LEN 2048
+
+/* More credit is granted only when at least this much is available, so
+ * that the other side is not sent a credit frame for every few bytes */
+#define USER_UART_LINK_MIN_GRANT 128
+
+enum user_uart_link_frame_type {
+    USER_UART_LINK_SYN = 1,
+    USER_UART_LINK_SYN_ACK = 2,
+    USER_UART_LINK_DATA = 3,
+    USER_UART_LINK_CREDIT = 4,
+    USER_UART_LINK_FIN = 5,
+};
+
+enum user_uart_link_state {
+    USER_UART_LINK_CLOSED,
+    USER_UART_LINK_SYN_SENT,
+    USER_UART_LINK_OPEN,
+};
+
+struct user_uart_link_ops {
+    /* Send one link frame. Returns false if it cannot be sent now, the
+     * link then tries again on the next user_uart_link_poll(). */
+    bool (*send_frame)(void *ctx, const uint8_t *frame, size_t len);
+    /* Stream data has arrived */
+    void (*recv_data)(void *ctx, const uint8_t *data, size_t len);
+    /* The link was opened or closed. 'by_peer' is false when the link
+     * was opened with user_uart_link_open() and the other side answered,
+     * and true when the other side opened or closed it, or when it was
+     * closed because of a CRC or sequence error. A link closed with
+     * user_uart_link_close() is not reported. */
+    void (*state_changed)(void *ctx, enum user_uart_link_state state, bool by_peer);
+};
+
+struct user_uart_link {
+    const struct user_uart_link_ops *ops;
+    void *ctx;
+    enum user_uart_link_state state;
+
+    /* Sequence number of the next data frame to send / receive */
+    uint8_t tx_seq;
+    uint8_t rx_seq;
+    /* Payload bytes we may still send */
+    uint32_t tx_credit;
+    /* Payload bytes the other side may still send to us */
+    uint32_t rx_credit;
+    /* Free space in the receiving application, see user_uart_link_set_rx_free() */
+    uint32_t rx_free;
+    /* A control frame could not be sent and must be sent on the next poll */
+    bool syn_pending;
+    bool syn_ack_pending;
+    bool fin_pending;
+
+    /* The frame being sent */
+    uint8_t frame_buf[USER_UART_LINK_MAX_FRAME];
+    uint8_t tx_buf[USER_UART_LINK_TX_BUF_LEN];
+    /* Free running indexes to tx_buf */
+    uint32_t tx_head;
+    uint32_t tx_tail;
+
+    /* Statistics */
+    uint32_t tx_bytes;
+    uint32_t rx_bytes;
+    uint32_t crc_errors;
+    uint32_t seq_errors;
+};
+
+/* Initialise a closed link. 'rx_free' is the number of bytes the
+ * receiving application can take initially. */
+void user_uart_link_init(struct user_uart_link *link, const struct user_uart_link_ops *ops,
+    void *ctx, uint32_t rx_free);
+
+/* Open the link actively. state_changed is called when the other side
+ * answers. */
+void user_uart_link_open(struct user_uart_link *link);
+
+/* Close the link, and tell the other side. Anything still queued is
+ * discarded. */
+void user_uart_link_close(struct user_uart_link *link);
+
+/* Process a received frame, as delivered by the SLIP decoder */
+void user_uart_link_input(struct user_uart_link *link, const uint8_t *frame, size_t len);
+
+/* Queue stream data for sending. Returns 0 if all of it was queued, or
+ * -1 if there is not room for all of it, in which case nothing is
+ * queued. */
+int user_uart_link_send(struct user_uart_link *link, const uint8_t *data, size_t len);
+
+/* Tell the link how many more bytes the receiving application can take
+ * now. Credit is granted to the other side based on this. */
+void user_uart_link_set_rx_free(struct user_uart_link *link, uint32_t rx_free);
+
+/* Send whatever the credit and the transport allow. Call this
+ * periodically, and after the transport has room again. */
+void user_uart_link_poll(struct user_uart_link *link);
+
+/* Bytes queued for sending */
+size_t user_uart_link_tx_pending(struct user_uart_link *link);
+
+#endif //USER_UART_LINK_H
@@ -0,0 +1,131 @@
+/*
+ * Wish connection over UART0, see user_uart_wish.h
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "osapi.h"
+#include "user_interface.h"
+#include "espmissingincludes.h"
+
+#include "wish_connection.h"
+#include "wish_event.h"
+
+#include "user_main.h"
+#include "user_timer.h"
+#include "user_trace.h"
+#include "user_uart.h"
+#include "user_uart_link.h"
+#include "user_uart_wish.h"
+
+#if WITH_UART_TRANSPORT
+
+/* How often queued data and credit are retried while the link is open */
+#define LINK_POLL_MS 10
+
+static struct user_uart_link link;
+static wish_connection_t *uart_connection;
+static struct user_timer poll_timer;
+
+static void poll_timer_cb(void *arg) {
+    if (uart_connection != NULL) {
+        user_uart_link_set_rx_free(&link,
+            wish_core_get_rx_buffer_free(user_get_core_instance(), uart_connection));
+    }
+    user_uart_link_poll(&link);
+}
+
+static int uart_send_data(void *arg, unsigned char *data, int len) {
+    return user_uart_link_send(&link, data, len);
+}
+
+static bool link_send_frame(void *ctx, const uint8_t *frame, size_t len) {
+    return user_uart_send_frame(frame, len);
+}
+
+static void link_recv_data(void *ctx, const uint8_t *data, size_t len) {
+    wish_core_t *core = user_get_core_instance();
+    if (uart_connection == NULL) {
+        return;
+    }
+
+    /* The credit given to the other side should make this impossible */
+    int rb_free = wish_core_get_rx_buffer_free(core, uart_connection);
+    if ((int) len > rb_free) {
+        USER_TRACE(UART_LINK_RX_OVERFLOW, len, rb_free);
+        user_uart_wish_close(uart_connection);
+        return;
+    }
+
+    wish_core_feed(core, uart_connection, (unsigned char *) data, len);
+    struct wish_event ev = { .event_type = WISH_EVENT_NEW_DATA,
+        .context = uart_connection };
+    wish_message_processor_notify(&ev);
+}
+
+static void link_state_changed(void *ctx, enum user_uart_link_state state, bool by_peer) {
+    wish_core_t *core = user_get_core_instance();
+
+    if (state == USER_UART_LINK_OPEN) {
+        USER_TRACE(UART_LINK_OPEN, 0, 0);
+        uint8_t null_wuid[WISH_ID_LEN] = { 0 };
+        uart_connection = wish_connection_init(core, null_wuid, null_wuid);
+        if (uart_connection == NULL) {
+            USER_TRACE(UART_LINK_NO_CONN, 0, 0);
+            user_uart_link_close(&link);
+            return;
+        }
+        wish_core_register_send(core, uart_connection, uart_send_data, &link);
+        user_uart_link_set_rx_free(&link, wish_core_get_rx_buffer_free(core, uart_connection));
+        user_timer_arm(&poll_timer, LINK_POLL_MS, true);
+        wish_core_signal_tcp_event(core, uart_connection, TCP_CLIENT_CONNECTED);
+    }
+    else if (state == USER_UART_LINK_CLOSED) {
+        USER_TRACE(UART_LINK_CLOSED, link.crc_errors, link.seq_errors);
+        user_timer_disarm(&poll_timer);
+        if (uart_connection != NULL) {
+            wish_connection_t *connection = uart_connection;
+            uart_connection = NULL;
+            wish_core_signal_tcp_event(core, connection, TCP_CLIENT_DISCONNECTED);
+        }
+    }
+}
+
+static const struct user_uart_link_ops link_ops = {
+    .send_frame = link_send_frame,
+    .recv_data = link_recv_data,
+    .state_changed = link_state_changed,
+};
+
+static void uart_frame_cb(uint8_t *frame, size_t len) {
+    user_uart_link_input(&link, frame, len);
+}
+
+void user_uart_wish_init(void) {
+    user_uart_link_init(&link, &link_ops, NULL, 0);
+    user_timer_setfn(&poll_timer, poll_timer_cb, NULL);
+    user_uart_frames_init(USER_UART_WISH_BAUD_RATE, uart_frame_cb);
+}
+
+bool user_uart_wish_is_connection(wish_connection_t *connection) {
+    return connection != NULL && connection == uart_connection;
+}
+
+void user_uart_wish_rx_consumed(wish_connection_t *connection) {
+    user_uart_link_set_rx_free(&link,
+        wish_core_get_rx_buffer_free(user_get_core_instance(), connection));
+}
+
+void user_uart_wish_close(wish_connection_t *connection) {
+    if (connection != uart_connection) {
+        return;
+    }
+    user_uart_link_close(&link);
+    user_timer_disarm(&poll_timer);
+    uart_connection = NULL;
+    wish_core_signal_tcp_event(user_get_core_instance(), connection, TCP_CLIENT_DISCONNECTED);
+}
+
+#endif //WITH_UART_TRANSPORT
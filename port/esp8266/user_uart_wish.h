@@ -0,0 +1,34 @@
+#ifndef USER_UART_WISH_H
+#define USER_UART_WISH_H
+
+/* Wish connection over UART0, as an alternative to TCP.
+ *
+ * A host MCU or a gateway wired to the serial port opens the link (see
+ * user_uart_link.h), and the Wish core sees it as an incoming
+ * connection, just like one accepted by the TCP server. Only one UART
+ * connection exists at a time.
+ *
+ * When enabled, os_printf output moves to UART1 (see user_uart.h). */
+
+#include <stdbool.h>
+
+#include "wish_connection.h"
+
+/* Set to 1 to accept Wish connections on UART0 */
+#define WITH_UART_TRANSPORT 0
+
+#define USER_UART_WISH_BAUD_RATE 921600
+
+void user_uart_wish_init(void);
+
+/* Is 'connection' the UART connection? */
+bool user_uart_wish_is_connection(wish_connection_t *connection);
+
+/* Called by the message processor after it has consumed data of the UART
+ * connection, so that the other side can be given more credit */
+void user_uart_wish_rx_consumed(wish_connection_t *connection);
+
+/* wish_close_connection() for the UART connection */
+void user_uart_wish_close(wish_connection_t *connection);
+
+#endif //USER_UART_WISH_H
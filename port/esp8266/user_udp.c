@@ -23,6 +23,8 @@
 #include "user_wifi.h"
 #include "user_main.h"
 #include "port_printf.h"
+#include "user_stack.h"
+#include "user_timer.h"
 
 #define LOCAL_DISCOVERY_BCAST_PORT 9090
 #define LOCAL_DISCOVERY_BCAST_INTERVAL (5*1000)    /* Milliseconds */
@@ -33,7 +35,7 @@ struct espconn *udp_client_espconn = NULL;
 esp_udp *udp_client_info = NULL;
 
 /* Timer for sending out local discovery 'adverts' */
-os_timer_t bcast_timer;
+struct user_timer bcast_timer;
 
 
 /* Local discovery 'advert' timer expired call-back function. This sends
@@ -51,12 +53,12 @@ static void bcast_timeout_cb(void *arg) {
         wish_ldiscover_advertize(user_get_core_instance(), uid_list[0].uid);
     }
     else {
-        PORT_PRINTF("Error! Loaded %d wuids from db\n\r", num_ids);
+        PORT_LOG(PORT_LOG_CRITICAL, "Error! Loaded %d wuids from db", num_ids);
     }
 }
 
 static void udp_client_sent_cb(void *arg) {
-    WISHDEBUG(LOG_DEBUG, "UDP sent cb\n\r");
+    PORT_LOG(PORT_LOG_DEBUG, "UDP sent cb");
 }
 
 
@@ -65,7 +67,7 @@ void wish_ldiscover_enable_bcast(wish_core_t *core) {
     udp_client_espconn = (struct espconn *)os_malloc(sizeof(struct espconn));
     udp_client_info = (esp_udp *) os_malloc(sizeof(esp_udp));
     if (udp_client_espconn == NULL || udp_client_info == NULL) {
-        WISHDEBUG(LOG_CRITICAL, "Out of memory?");
+        PORT_LOG(PORT_LOG_CRITICAL, "Out of memory?");
         return;
     }
     memset(udp_client_espconn, 0, sizeof(struct espconn));
@@ -86,7 +88,7 @@ void wish_ldiscover_enable_bcast(wish_core_t *core) {
     int ret = espconn_create(udp_client_espconn);
     if (ret != 0) {
         /* non zero return, error */
-        WISHDEBUG(LOG_CRITICAL, "UDP create error (bcast) %d", ret);
+        PORT_LOG(PORT_LOG_CRITICAL, "UDP create error (bcast) %d", ret);
         return;
     }
     espconn_regist_sentcb(udp_client_espconn, udp_client_sent_cb);
@@ -103,22 +105,22 @@ void wish_ldiscover_enable_bcast(wish_core_t *core) {
     }
 
     if (!wifi_set_broadcast_if(bcast_if)) {
-        WISHDEBUG(LOG_CRITICAL, "Could not set UDP bcast if to %d", bcast_if);
+        PORT_LOG(PORT_LOG_CRITICAL, "Could not set UDP bcast if to %d", bcast_if);
         //return -1;
     }
 
 
 
-    os_timer_setfn(&bcast_timer, (os_timer_func_t*) bcast_timeout_cb, NULL);
-    os_timer_arm(&bcast_timer, LOCAL_DISCOVERY_BCAST_INTERVAL, true);
+    user_timer_setfn(&bcast_timer, (user_timer_func_t*) bcast_timeout_cb, NULL);
+    user_timer_arm(&bcast_timer, LOCAL_DISCOVERY_BCAST_INTERVAL, true);
 }
 
 /* Stop advertizing using local discovery messages */
 void wish_ldiscover_disable_bcast(wish_core_t *core) {
-    os_timer_disarm(&bcast_timer);
+    user_timer_disarm(&bcast_timer);
     int ret = espconn_delete(udp_client_espconn);
     if (ret != 0) {
-        WISHDEBUG(LOG_CRITICAL, "UDP clean up fail %d", ret );
+        PORT_LOG(PORT_LOG_CRITICAL, "UDP clean up fail %d", ret);
     }
 
 
@@ -134,7 +136,7 @@ void wish_ldiscover_disable_bcast(wish_core_t *core) {
 int wish_send_advertizement(wish_core_t *core, uint8_t *ad_msg, size_t ad_len) {
     int ret = espconn_sendto(udp_client_espconn, ad_msg, ad_len);
     if (ret != 0) {
-        WISHDEBUG(LOG_CRITICAL, "UDP sendto fail %d", ret );
+        PORT_LOG(PORT_LOG_CRITICAL, "UDP sendto fail %d", ret);
         return -1;
     }
 
@@ -143,19 +145,19 @@ int wish_send_advertizement(wish_core_t *core, uint8_t *ad_msg, size_t ad_len) {
 
 
 static void udp_server_recv_cb(void *arg, char *pdata, unsigned short len) {
-    WISHDEBUG(LOG_CRITICAL, "UDP receive %d bytes\n\r", len);
+    USER_STACK_ENTER(USER_STACK_PROBE_UDP_RECV);
+    PORT_LOG(PORT_LOG_DEBUG, "UDP receive %d bytes", len);
     struct espconn *espconn = (struct espconn*) arg;
 
     remot_info *r_info = NULL;
     if (espconn_get_connection_info(espconn, &r_info, 0)) {
-        PORT_PRINTF("Error espconn_get_connection_info\n\r");
+        PORT_LOG(PORT_LOG_CRITICAL, "Error espconn_get_connection_info");
 
     }
     wish_ip_addr_t ip;
     memcpy(&ip, r_info->remote_ip, 4);
     wish_ldiscover_feed(user_get_core_instance(), &ip, r_info->remote_port, pdata, len);
-
-
+    USER_STACK_EXIT(USER_STACK_PROBE_UDP_RECV);
 }
 
 struct espconn *udp_server_espconn = NULL;
@@ -168,7 +170,7 @@ void wish_ldiscover_enable_recv(wish_core_t *core) {
     udp_server_espconn = (struct espconn *)os_malloc(sizeof(struct espconn));
     udp_server_conn_info = (esp_udp *) os_malloc(sizeof(esp_udp));
     if (udp_server_conn_info == NULL || udp_server_espconn == NULL) {
-        WISHDEBUG(LOG_CRITICAL, "Out of memory!");
+        PORT_LOG(PORT_LOG_CRITICAL, "Out of memory!");
         return;
     }
 
@@ -187,7 +189,7 @@ void wish_ldiscover_enable_recv(wish_core_t *core) {
     int ret = espconn_create(udp_server_espconn);
     if (ret != 0) {
         /* non zero return, error */
-        WISHDEBUG(LOG_CRITICAL, "UDP create error %d (when listening)", ret);
+        PORT_LOG(PORT_LOG_CRITICAL, "UDP create error %d (when listening)", ret);
         return;
     }
     espconn_regist_recvcb(udp_server_espconn, udp_server_recv_cb);
@@ -199,7 +201,7 @@ void wish_ldiscover_disable_recv(wish_core_t *core) {
     int ret = espconn_delete(udp_server_espconn);
     if (ret != 0) {
         /* non zero return, error */
-        WISHDEBUG(LOG_CRITICAL, "UDP delete error %d (when listening)", ret);
+        PORT_LOG(PORT_LOG_CRITICAL, "UDP delete error %d (when listening)", ret);
     }
     os_free(udp_server_conn_info);
     os_free(udp_server_espconn);
@@ -27,6 +27,8 @@
 
 #include "user_support.h"
 #include "port_printf.h"
+#include "user_timer.h"
+#include "user_metrics.h"
 
 #include "user_main.h"
 
@@ -82,7 +84,7 @@ int8_t *user_wifi_get_rssis(void) {
 }
 
 
-static os_timer_t reboot_timer;
+static struct user_timer reboot_timer;
 
 
 static void reboot_timer_cb(void) {
@@ -90,9 +92,9 @@ static void reboot_timer_cb(void) {
 }
 
 void user_wifi_schedule_reboot(void) {
-        os_timer_disarm(&reboot_timer);
-        os_timer_setfn(&reboot_timer, (os_timer_func_t *) reboot_timer_cb, NULL);
-        os_timer_arm(&reboot_timer, 1000, 0);
+        user_timer_disarm(&reboot_timer);
+        user_timer_setfn(&reboot_timer, (user_timer_func_t *) reboot_timer_cb, NULL);
+        user_timer_arm(&reboot_timer, 1000, false);
 }
 
 
@@ -106,6 +108,13 @@ void system_init_ready_cb(void) {
 void wifi_event_cb(System_Event_t *evt) {
     PORT_PRINTF("Wifi event %d\n", evt->event);
 
+    static bool sta_connected_once;
+    if (evt->event == EVENT_STAMODE_CONNECTED) {
+        if (sta_connected_once) {
+            user_metric_add(USER_METRIC_WIFI_RECONNECTS, 1);
+        }
+        sta_connected_once = true;
+    }
 }
 
 
@@ -216,7 +225,7 @@ static void start_ap_timer_cb(void) {
     user_wifi_start_ap();
 }
 
-static os_timer_t start_ap_timer;
+static struct user_timer start_ap_timer;
 
 /** This function will setupt a MistConfig Mist device for Wifi
  *
@@ -225,9 +234,9 @@ void user_wifi_setup_commissioning(void) {
     wish_core_t *core = user_get_core_instance();
     core->config_skip_connection_acl = true;
     
-    os_timer_disarm(&start_ap_timer);
-    os_timer_setfn(&start_ap_timer, (os_timer_func_t *) start_ap_timer_cb, NULL);
-    os_timer_arm(&start_ap_timer, 1000, 0);
+    user_timer_disarm(&start_ap_timer);
+    user_timer_setfn(&start_ap_timer, (user_timer_func_t *) start_ap_timer_cb, NULL);
+    user_timer_arm(&start_ap_timer, 1000, false);
 
 }
 
@@ -257,7 +266,7 @@ void ap_scan_done_cb(void *arg, STATUS status) {
             ssid_str_ptrs[i] = os_malloc(ssid_len + 1);
             memset(ssid_str_ptrs[i], 0, ssid_len + 1);
             memcpy(ssid_str_ptrs[i], ssid_name, ssid_len);
-            PORT_PRINTF(ssid_str_ptrs[i]);
+            PORT_PRINTF("%s", ssid_str_ptrs[i]);
             PORT_PRINTF("\n");
             ssid_rssis[i] = bss_link->rssi;
 
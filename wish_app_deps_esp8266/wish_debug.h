@@ -37,6 +37,9 @@ extern "C" {
 
 #ifdef COMPILING_FOR_ESP8266
 int os_printf_plus(const char *format, ...)  __attribute__ ((format (printf, 1, 2)));
+
+/* Flash can only be read in 32-bit words, hence the alignment */
+#define WISHDEBUG_FMT_ATTR __attribute__((section(".irom.text"))) __attribute__((aligned(4)))
 #endif
 
 /* Log levels
@@ -62,8 +65,12 @@ int os_printf_plus(const char *format, ...)  __attribute__ ((format (printf, 1,
 
 
 /* The logging threshold. Any log message with a lower threshold will
- * not be printed out */
+ * not be printed out. As the threshold is a compile-time constant, the
+ * message is compiled out altogether. A module can define its own
+ * threshold before including this file. */
+#ifndef LOG_THRESHOLD
 #define LOG_THRESHOLD   9
+#endif
 
 void wish_debug_set_stream(unsigned int stream, bool enable);
 
@@ -82,9 +89,13 @@ void wish_debug_printf(int stream, const char* format, ...);
     if (lvl >= LOG_THRESHOLD) wish_platform_printf(format "\n\r", ## __VA_ARGS__)
     //wish_debug_printf(lvl, format "\n", ## __VA_ARGS__);
   #else
-  /* Special version needed for ESP8266 for now - this is just silly */
+  /* Special version needed for ESP8266: the format string is put in
+   * flash instead of RAM */
   #define WISHDEBUG(lvl, format, ...) \
-      if (lvl >= LOG_THRESHOLD) os_printf_plus(format "\n\r", ## __VA_ARGS__);
+      do { if (lvl >= LOG_THRESHOLD) { \
+          static const char wishdebug_fmt[] WISHDEBUG_FMT_ATTR = format "\n\r"; \
+          os_printf_plus(wishdebug_fmt, ## __VA_ARGS__); \
+      } } while (0);
 
   #endif
 #endif
@@ -99,9 +110,12 @@ void wish_debug_printf(int stream, const char* format, ...);
     if (lvl >= LOG_THRESHOLD) wish_platform_printf(format, ## __VA_ARGS__)
     //wish_debug_printf(lvl, format, ## __VA_ARGS__);
   #else
-  /* Special version needed for ESP8266 for now - this is just silly */
+  /* Special version needed for ESP8266, see WISHDEBUG */
   #define WISHDEBUG2(lvl, format, ...) \
-      if (lvl >= LOG_THRESHOLD) os_printf_plus(format, ## __VA_ARGS__);
+      do { if (lvl >= LOG_THRESHOLD) { \
+          static const char wishdebug_fmt[] WISHDEBUG_FMT_ATTR = format; \
+          os_printf_plus(wishdebug_fmt, ## __VA_ARGS__); \
+      } } while (0);
   #endif
 #endif
 
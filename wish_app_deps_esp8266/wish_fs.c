@@ -15,6 +15,9 @@
  * use the index to the table instead as "pseudo-filedescriptor".
  *
  */
+#include <stdbool.h>
+#include <string.h>
+
 #include "wish_fs.h"
 #include "wish_debug.h"
 
@@ -30,16 +33,293 @@ static wish_offset_t (*fs_close_fn)(wish_file_t fd);
 static int32_t (*fs_rename_fn)(const char *oldpath, const char *newpath);
 static int32_t (*fs_remove_fn)(const char *path);
 
+/* Buffering.
+ *
+ * The Wish core reads and writes its databases in small pieces, the
+ * size of a BSON element or document, and each of them would be a call
+ * to the file system, which on SPIFFS walks the object index and touches
+ * flash every time. Instead, a descriptor can get a buffer when it is
+ * opened, which holds a window of the file within one aligned block of
+ * WISH_FS_BUFFER_SIZE bytes. Reads are served from the window, refilling
+ * it with the whole block from the file when they go outside of it, and
+ * writes go to the window and are written back to the file when the
+ * descriptor is closed, when a read or write goes outside of the block,
+ * when the descriptor is seeked outside of the window, or on
+ * wish_fs_flush(). Reads and writes larger than the buffer go directly
+ * to the file.
+ *
+ * The block should be a multiple of the data in a flash page of the file
+ * system, 251 bytes for SPIFFS with pages of 256 bytes, so that a write
+ * back fills whole pages. A single page gains nothing on SPIFFS, as its
+ * write cache already collects the writes to a page, and costs RAM: a
+ * save of the identity database in spiffshal takes as many programs as
+ * without buffering. Two pages let SPIFFS append both with one update of
+ * the object index, and save about a fifth of the flash time, for about
+ * 1 KB of RAM with two buffers. So buffering is off unless the port
+ * enables it with WISH_FS_BUFFERS.
+ *
+ * When all buffers are in use, a descriptor is not buffered. */
+#ifndef WISH_FS_BUFFERS
+#define WISH_FS_BUFFERS         0
+#endif
+#ifndef WISH_FS_BUFFER_SIZE
+#define WISH_FS_BUFFER_SIZE     (2*251)
+#endif
+
+#if WISH_FS_BUFFERS
+struct fs_buffer {
+    bool in_use;
+    wish_file_t fd;
+    /* Position of the descriptor, as seen by the caller */
+    wish_offset_t pos;
+    /* Position of the descriptor in the underlying file system */
+    wish_offset_t fs_pos;
+    /* The window of the file held in data */
+    wish_offset_t start;
+    size_t len;
+    /* The part of the window which has not been written to the file */
+    size_t dirty_start;
+    size_t dirty_end;
+    uint8_t data[WISH_FS_BUFFER_SIZE];
+};
+
+static struct fs_buffer fs_buffers[WISH_FS_BUFFERS];
+
+static struct fs_buffer *buffer_get(wish_file_t fd) {
+    int i;
+    for (i = 0; i < WISH_FS_BUFFERS; i++) {
+        if (fs_buffers[i].in_use && fs_buffers[i].fd == fd) {
+            return &fs_buffers[i];
+        }
+    }
+    return NULL;
+}
+
+static struct fs_buffer *buffer_alloc(wish_file_t fd) {
+    int i;
+    for (i = 0; i < WISH_FS_BUFFERS; i++) {
+        if (!fs_buffers[i].in_use) {
+            struct fs_buffer *b = &fs_buffers[i];
+            b->in_use = true;
+            b->fd = fd;
+            b->pos = 0;
+            b->fs_pos = 0;
+            b->start = 0;
+            b->len = 0;
+            b->dirty_start = 0;
+            b->dirty_end = 0;
+            return b;
+        }
+    }
+    return NULL;
+}
+
+/* Move the descriptor of the underlying file system to 'pos' */
+static int32_t buffer_fs_seek(struct fs_buffer *b, wish_offset_t pos) {
+    if (b->fs_pos == pos) {
+        return 0;
+    }
+    wish_offset_t ret = fs_lseek_fn(b->fd, pos, WISH_FS_SEEK_SET);
+    if (ret != pos) {
+        /* Not known anymore */
+        b->fs_pos = -1;
+        return ret < 0 ? ret : WISH_FS_FAIL;
+    }
+    b->fs_pos = pos;
+    return 0;
+}
+
+/* Write the dirty part of the window to the file */
+static int32_t buffer_write_back(struct fs_buffer *b) {
+    if (b->dirty_end == b->dirty_start) {
+        return 0;
+    }
+    size_t len = b->dirty_end - b->dirty_start;
+    int32_t ret = buffer_fs_seek(b, b->start + b->dirty_start);
+    if (ret == 0) {
+        ret = fs_write_fn(b->fd, b->data + b->dirty_start, len);
+    }
+    b->dirty_start = b->dirty_end = 0;
+    if (ret != (int32_t) len) {
+        WISHDEBUG(LOG_CRITICAL, "wish_fs write back failed %d", ret);
+        b->fs_pos = -1;
+        b->len = 0;
+        return ret < 0 ? ret : WISH_FS_FAIL;
+    }
+    b->fs_pos += len;
+    return 0;
+}
+
+/* Write back and empty the window */
+static int32_t buffer_drop(struct fs_buffer *b) {
+    int32_t ret = buffer_write_back(b);
+    b->len = 0;
+    return ret;
+}
+
+/* The end of the page of the file which 'pos' is in */
+static wish_offset_t page_end(wish_offset_t pos) {
+    return pos - pos % WISH_FS_BUFFER_SIZE + WISH_FS_BUFFER_SIZE;
+}
+
+static int32_t buffer_read(struct fs_buffer *b, uint8_t *buf, size_t count) {
+    size_t done = 0;
+    while (done < count) {
+        if (b->pos >= b->start && b->pos < b->start + (wish_offset_t) b->len) {
+            size_t offset = b->pos - b->start;
+            size_t n = b->len - offset;
+            if (n > count - done) {
+                n = count - done;
+            }
+            memcpy(buf + done, b->data + offset, n);
+            done += n;
+            b->pos += n;
+            continue;
+        }
+
+        int32_t ret = buffer_drop(b);
+        if (ret < 0) {
+            return ret;
+        }
+        if (count - done >= WISH_FS_BUFFER_SIZE) {
+            ret = buffer_fs_seek(b, b->pos);
+            if (ret < 0) {
+                return ret;
+            }
+            ret = fs_read_fn(b->fd, buf + done, count - done);
+            if (ret > 0) {
+                b->fs_pos += ret;
+                b->pos += ret;
+                done += ret;
+            }
+            return ret < 0 ? ret : (int32_t) done;
+        }
+        /* The whole page the position is in */
+        wish_offset_t start = page_end(b->pos) - WISH_FS_BUFFER_SIZE;
+        ret = buffer_fs_seek(b, start);
+        if (ret < 0) {
+            return ret;
+        }
+        ret = fs_read_fn(b->fd, b->data, WISH_FS_BUFFER_SIZE);
+        if (ret > 0) {
+            b->fs_pos += ret;
+            b->start = start;
+            b->len = ret;
+        }
+        if (ret <= b->pos - start) {
+            /* End of file */
+            return ret < 0 ? ret : (int32_t) done;
+        }
+    }
+    return done;
+}
+
+static int32_t buffer_write(struct fs_buffer *b, const uint8_t *buf, size_t count) {
+    size_t done = 0;
+    while (done < count) {
+        /* The write goes to the window if it is in it, or extends it
+         * without leaving a gap, up to the end of the page */
+        wish_offset_t end = page_end(b->start);
+        if (!(b->pos >= b->start && b->pos <= b->start + (wish_offset_t) b->len &&
+                b->pos < end)) {
+            int32_t ret = buffer_drop(b);
+            if (ret < 0) {
+                return ret;
+            }
+            if (count - done >= WISH_FS_BUFFER_SIZE) {
+                ret = buffer_fs_seek(b, b->pos);
+                if (ret < 0) {
+                    return ret;
+                }
+                ret = fs_write_fn(b->fd, buf + done, count - done);
+                if (ret > 0) {
+                    b->fs_pos += ret;
+                    b->pos += ret;
+                    done += ret;
+                }
+                return ret < 0 ? ret : (int32_t) done;
+            }
+            b->start = b->pos;
+            end = page_end(b->start);
+        }
+
+        size_t offset = b->pos - b->start;
+        size_t n = end - b->pos;
+        if (n > count - done) {
+            n = count - done;
+        }
+        memcpy(b->data + offset, buf + done, n);
+        if (b->dirty_end == b->dirty_start) {
+            b->dirty_start = offset;
+            b->dirty_end = offset + n;
+        }
+        else {
+            if (offset < b->dirty_start) {
+                b->dirty_start = offset;
+            }
+            if (offset + n > b->dirty_end) {
+                b->dirty_end = offset + n;
+            }
+        }
+        if (offset + n > b->len) {
+            b->len = offset + n;
+        }
+        b->pos += n;
+        done += n;
+    }
+    return done;
+}
+
+static wish_offset_t buffer_lseek(struct fs_buffer *b, wish_offset_t offset, int whence) {
+    wish_offset_t pos = -1;
+    if (whence == WISH_FS_SEEK_SET) {
+        pos = offset;
+    }
+    else if (whence == WISH_FS_SEEK_CUR) {
+        pos = b->pos + offset;
+    }
+    /* Within the window the position only moves in the buffer. Other
+     * seeks go to the file system, which knows the size of the file. */
+    if (whence != WISH_FS_SEEK_END && pos >= b->start &&
+            pos <= b->start + (wish_offset_t) b->len) {
+        b->pos = pos;
+        return pos;
+    }
+    int32_t ret = buffer_drop(b);
+    if (ret < 0) {
+        return ret;
+    }
+    if (whence == WISH_FS_SEEK_CUR) {
+        /* The file system has its own idea of the current position */
+        whence = WISH_FS_SEEK_SET;
+        offset = pos;
+    }
+    pos = fs_lseek_fn(b->fd, offset, whence);
+    b->fs_pos = pos;
+    if (pos >= 0) {
+        b->pos = pos;
+    }
+    return pos;
+}
+#endif //WISH_FS_BUFFERS
+
 /* Implementations of the file system abstraction functions - they are
  * really just simple "call-throughs" for the function pointers which
- * points to actual system-dependent implementations of the functions */
+ * points to actual system-dependent implementations of the functions,
+ * by way of the buffers above */
 
 wish_file_t wish_fs_open(const char *pathname) {
     if (fs_open_fn == NULL) {
         WISHDEBUG(LOG_CRITICAL, "wish_fs not initialised properly");
         return WISH_FS_FAIL;    
     }
-    return fs_open_fn(pathname);
+    wish_file_t fd = fs_open_fn(pathname);
+#if WISH_FS_BUFFERS
+    if (fd >= 0) {
+        buffer_alloc(fd);
+    }
+#endif
+    return fd;
 }
 
 int32_t wish_fs_read(wish_file_t fd, void* buf, size_t count) {
@@ -47,6 +327,12 @@ int32_t wish_fs_read(wish_file_t fd, void* buf, size_t count) {
         WISHDEBUG(LOG_CRITICAL, "wish_fs not initialised properly");
         return WISH_FS_FAIL;        
     }
+#if WISH_FS_BUFFERS
+    struct fs_buffer *b = buffer_get(fd);
+    if (b != NULL) {
+        return buffer_read(b, buf, count);
+    }
+#endif
     return fs_read_fn(fd, buf, count);
 }
 
@@ -55,6 +341,12 @@ int32_t wish_fs_write(wish_file_t fd, const void *buf, size_t count) {
         WISHDEBUG(LOG_CRITICAL, "wish_fs not initialised properly");
         return WISH_FS_FAIL;
     }
+#if WISH_FS_BUFFERS
+    struct fs_buffer *b = buffer_get(fd);
+    if (b != NULL) {
+        return buffer_write(b, buf, count);
+    }
+#endif
     return fs_write_fn(fd, buf, count);
 }
 
@@ -63,15 +355,40 @@ wish_offset_t wish_fs_lseek(wish_file_t fd, wish_offset_t offset, int whence) {
         WISHDEBUG(LOG_CRITICAL, "wish_fs not initialised properly");
         return WISH_FS_FAIL;
     }
+#if WISH_FS_BUFFERS
+    struct fs_buffer *b = buffer_get(fd);
+    if (b != NULL) {
+        return buffer_lseek(b, offset, whence);
+    }
+#endif
     return fs_lseek_fn(fd, offset, whence);
 }
 
+int32_t wish_fs_flush(wish_file_t fd) {
+#if WISH_FS_BUFFERS
+    struct fs_buffer *b = buffer_get(fd);
+    if (b != NULL) {
+        return buffer_write_back(b);
+    }
+#endif
+    return 0;
+}
+
 int32_t wish_fs_close(wish_file_t fd) {
     if (fs_close_fn == NULL) {
         WISHDEBUG(LOG_CRITICAL, "wish_fs not initialised properly");
         return WISH_FS_FAIL;
     }
-    return fs_close_fn(fd);
+    int32_t ret = 0;
+#if WISH_FS_BUFFERS
+    struct fs_buffer *b = buffer_get(fd);
+    if (b != NULL) {
+        ret = buffer_write_back(b);
+        b->in_use = false;
+    }
+#endif
+    int32_t close_ret = fs_close_fn(fd);
+    return ret < 0 ? ret : close_ret;
 }
 
 
@@ -93,6 +410,78 @@ int32_t wish_fs_remove(const char *path) {
 
 
 
+/* Crash-safe replace and remove, see wish_fs.h */
+
+static bool suffixed_path(char *buf, const char *path, const char *suffix) {
+    size_t len = strlen(path);
+    if (len + strlen(suffix) >= WISH_FS_MAX_PATH) {
+        WISHDEBUG(LOG_CRITICAL, "wish_fs path too long: %s", path);
+        return false;
+    }
+    memcpy(buf, path, len);
+    strcpy(buf + len, suffix);
+    return true;
+}
+
+wish_file_t wish_fs_replace_open(const char *path) {
+    char tmp_path[WISH_FS_MAX_PATH];
+    if (!suffixed_path(tmp_path, path, WISH_FS_TMP_SUFFIX)) {
+        return WISH_FS_FAIL;
+    }
+    /* Left over from an earlier replace which was not committed */
+    wish_fs_remove(tmp_path);
+    return wish_fs_open(tmp_path);
+}
+
+int32_t wish_fs_replace_commit(wish_file_t fd, const char *path) {
+    char tmp_path[WISH_FS_MAX_PATH];
+    char new_path[WISH_FS_MAX_PATH];
+    if (!suffixed_path(tmp_path, path, WISH_FS_TMP_SUFFIX) ||
+            !suffixed_path(new_path, path, WISH_FS_NEW_SUFFIX)) {
+        wish_fs_close(fd);
+        return WISH_FS_FAIL;
+    }
+    if (wish_fs_close(fd) < 0) {
+        wish_fs_remove(tmp_path);
+        return WISH_FS_FAIL;
+    }
+    wish_fs_remove(new_path);
+    if (wish_fs_rename(tmp_path, new_path) < 0) {
+        wish_fs_remove(tmp_path);
+        return WISH_FS_FAIL;
+    }
+    /* Committed. Removing the old file and renaming are finished by the
+     * next mount if they are interrupted. */
+    wish_fs_remove(path);
+    if (wish_fs_rename(new_path, path) < 0) {
+        WISHDEBUG(LOG_CRITICAL, "wish_fs could not rename %s", new_path);
+        return WISH_FS_FAIL;
+    }
+    return 0;
+}
+
+int32_t wish_fs_replace_abort(wish_file_t fd, const char *path) {
+    char tmp_path[WISH_FS_MAX_PATH];
+    wish_fs_close(fd);
+    if (!suffixed_path(tmp_path, path, WISH_FS_TMP_SUFFIX)) {
+        return WISH_FS_FAIL;
+    }
+    return wish_fs_remove(tmp_path);
+}
+
+int32_t wish_fs_delete(const char *path) {
+    char tmp_path[WISH_FS_MAX_PATH];
+    if (!suffixed_path(tmp_path, path, WISH_FS_TMP_SUFFIX)) {
+        return WISH_FS_FAIL;
+    }
+    wish_fs_remove(tmp_path);
+    if (wish_fs_rename(path, tmp_path) < 0) {
+        return WISH_FS_FAIL;
+    }
+    return wish_fs_remove(tmp_path);
+}
+
+
 /* Dependency injection setter functions for the platform-dependent file
  * system functions */
 void wish_fs_set_open(wish_file_t (*fn)(const char *path)) {
@@ -14,6 +14,9 @@ extern "C" {
 
 #define WISH_FS_FAIL -1
 
+/* Longest file name, including the terminating zero, as SPIFFS_OBJ_NAME_LEN */
+#define WISH_FS_MAX_PATH    32
+
 /* File handle: Note that this must be a signed type */
 typedef int wish_file_t;
 typedef uint16_t wish_mode_t;
@@ -24,9 +27,46 @@ int32_t wish_fs_read(wish_file_t fd, void* buf, size_t count);
 int32_t wish_fs_write(wish_file_t fd, const void *buf, size_t count);
 int32_t wish_fs_lseek(wish_file_t fd, wish_offset_t offset, int whence);
 int32_t wish_fs_close(wish_file_t fd);
+/* Write whatever is buffered for 'fd' to the file system. Closing the
+ * file does this too. Returns 0, or a negative value on failure. */
+int32_t wish_fs_flush(wish_file_t fd);
 int32_t wish_fs_rename(const char *old_path, const char *new_path);
 int32_t wish_fs_remove(const char* path);
 
+/* Crash-safe replacing and removing of files.
+ *
+ * A file is replaced by writing the new contents to a temporary file,
+ * opened with wish_fs_replace_open(), and committing it with
+ * wish_fs_replace_commit(). The temporary file is first renamed to
+ * path WISH_FS_NEW_SUFFIX, which is the commit point, and then over the
+ * file. wish_fs_delete() renames the file to path WISH_FS_TMP_SUFFIX
+ * before removing it.
+ *
+ * After a reset, the file system must finish what was interrupted when
+ * it is mounted: files ending in WISH_FS_TMP_SUFFIX are removed, and a
+ * file ending in WISH_FS_NEW_SUFFIX replaces the file of the same name
+ * without the suffix (see my_spiffs_mount()). The file then is either
+ * the old or the new version. */
+#define WISH_FS_TMP_SUFFIX  ".tmp"
+#define WISH_FS_NEW_SUFFIX  ".new"
+
+/* Open an empty temporary file for the new contents of 'path'. The name
+ * of 'path' can be at most WISH_FS_MAX_PATH - 5 characters long. */
+wish_file_t wish_fs_replace_open(const char *path);
+
+/* Close 'fd', opened with wish_fs_replace_open(), and replace 'path'
+ * with it. Returns 0, or a negative value on failure, in which case
+ * 'path' is unchanged, unless the failure came after the commit point,
+ * in which case the replace is finished at the next mount. */
+int32_t wish_fs_replace_commit(wish_file_t fd, const char *path);
+
+/* Close and remove the temporary file, leaving 'path' as it was */
+int32_t wish_fs_replace_abort(wish_file_t fd, const char *path);
+
+/* Remove 'path' so that a reset leaves either the whole file or no
+ * file. Returns 0, or a negative value on failure. */
+int32_t wish_fs_delete(const char *path);
+
 /* Dependency injection */
 void wish_fs_set_open(wish_file_t (*fn)(const char *path));
 void wish_fs_set_read(int32_t (*fn)(wish_file_t fd, void* buf, size_t count));